@@ -1,19 +1,17 @@
 // marching cubes using atomic indexing
 // direct port of a C implementation
 
+// EDGE_INDICES, EDGE_FLAGS, TRIANGLE_TABLE and PACKED_TABLES are shared with
+// the cpu reference implementation, the host adds this directory to the
+// include path
+#include "mctables.h"
+
 constant float4 CUBE_CORNERS[8] =
 {
 	{ 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f },
 	{ 0.0f, 0.0f, 1.0f, 1.0f }, { 1.0f, 0.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 1.0f, 1.0f, 1.0f }
 };
 
-constant int EDGE_INDICES[12][2] = 
-{
-	{0,1}, {1,2}, {2,3}, {3,0},
-	{4,5}, {5,6}, {6,7}, {7,4},
-	{0,4}, {1,5}, {2,6}, {3,7}
-};
-
 constant float4 EDGE_DIRECTIONS[12] =
 {
 	{ 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f, 0.0f },
@@ -21,324 +19,675 @@ constant float4 EDGE_DIRECTIONS[12] =
 	{ 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }
 };
 
-constant int EDGE_FLAGS[256] =
-{
-	0x000, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00, 
-	0x190, 0x099, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90, 
-	0x230, 0x339, 0x033, 0x13a, 0x636, 0x73f, 0x435, 0x53c, 0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30, 
-	0x3a0, 0x2a9, 0x1a3, 0x0aa, 0x7a6, 0x6af, 0x5a5, 0x4ac, 0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0, 
-	0x460, 0x569, 0x663, 0x76a, 0x066, 0x16f, 0x265, 0x36c, 0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60, 
-	0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0x0ff, 0x3f5, 0x2fc, 0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0, 
-	0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x055, 0x15c, 0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950, 
-	0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0x0cc, 0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0, 
-	0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc, 0x0cc, 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0, 
-	0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c, 0x15c, 0x055, 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650, 
-	0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc, 0x2fc, 0x3f5, 0x0ff, 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0, 
-	0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c, 0x36c, 0x265, 0x16f, 0x066, 0x76a, 0x663, 0x569, 0x460, 
-	0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac, 0x4ac, 0x5a5, 0x6af, 0x7a6, 0x0aa, 0x1a3, 0x2a9, 0x3a0, 
-	0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c, 0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x033, 0x339, 0x230, 
-	0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c, 0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x099, 0x190, 
-	0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c, 0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x000
-};
+//////////////////////////////////////////////////////////////////////////
+// scalar fields
+//
+// every kernel that samples the field takes FIELD_ARGS as its trailing
+// arguments and forwards them as FIELD_PARAMS, so the field can be swapped
+// with a build option without touching the extraction kernels.
+//
+// default:			metaballs, 1/r^2 summed over every particle
+// FIELD_WYVILL:	Wyvill compact-support kernel (1 - r^2/R^2)^3 with the
+//					particles binned into a uniform grid of cells of size R,
+//					so each sample only visits the cells within R of it
+// FIELD_VOLUME:	trilinearly sampled grid loaded from a raw volume file
+// FIELD_SPHERE:	distance inside a single sphere, surface at 0
+// FIELD_NOISE:		NOISE_OCTAVES of fractal value noise, surface at 0
+// FIELD_EXPRESSION:	negated distance of a shape generated on the host from
+//					a field expression and compiled after this file, surface at 0
 
-constant int TRIANGLE_TABLE[256][16] =  
-{
-	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
-	{3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
-	{3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
-	{3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
-	{9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
-	{9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
-	{2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
-	{8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
-	{9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
-	{4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
-	{3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
-	{1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
-	{4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
-	{4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
-	{9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
-	{5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
-	{2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
-	{9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
-	{0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
-	{2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
-	{10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
-	{4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
-	{5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
-	{5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
-	{9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
-	{0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
-	{1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
-	{10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
-	{8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
-	{2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
-	{7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
-	{9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
-	{2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
-	{11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
-	{9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
-	{5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
-	{11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
-	{11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
-	{1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
-	{9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
-	{5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
-	{2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
-	{0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
-	{5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
-	{6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
-	{3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
-	{6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
-	{5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
-	{1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
-	{10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
-	{6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
-	{8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
-	{7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
-	{3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
-	{5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
-	{0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
-	{9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
-	{8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
-	{5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
-	{0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
-	{6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
-	{10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
-	{10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
-	{8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
-	{1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
-	{3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
-	{0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
-	{10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
-	{3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
-	{6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
-	{9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
-	{8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
-	{3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
-	{6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
-	{0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
-	{10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
-	{10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
-	{2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
-	{7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
-	{7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
-	{2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
-	{1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
-	{11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
-	{8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
-	{0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
-	{7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
-	{10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
-	{2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
-	{6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
-	{7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
-	{2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
-	{1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
-	{10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
-	{10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
-	{0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
-	{7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
-	{6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
-	{8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
-	{6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
-	{4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
-	{10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
-	{8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
-	{0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
-	{1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
-	{8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
-	{10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
-	{4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
-	{10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
-	{5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
-	{11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
-	{9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
-	{6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
-	{7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
-	{3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
-	{7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
-	{9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
-	{3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
-	{6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
-	{9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
-	{1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
-	{4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
-	{7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
-	{6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
-	{3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
-	{0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
-	{6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
-	{0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
-	{11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
-	{6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
-	{5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
-	{9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
-	{1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
-	{1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
-	{10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
-	{0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
-	{5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
-	{10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
-	{11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
-	{9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
-	{7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
-	{2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
-	{8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
-	{9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
-	{9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
-	{1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
-	{9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
-	{9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
-	{5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
-	{0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
-	{10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
-	{2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
-	{0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
-	{0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
-	{9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
-	{5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
-	{3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
-	{5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
-	{8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
-	{9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
-	{0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
-	{1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
-	{3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
-	{4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
-	{9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
-	{11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
-	{11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
-	{2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
-	{9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
-	{3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
-	{1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
-	{4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
-	{4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
-	{0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
-	{3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
-	{3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
-	{0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
-	{9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
-	{1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}
-};
+#if defined(FIELD_NOISE) || defined(FIELD_EXPRESSION)
+
+// hashes a lattice point to a value in [-1,1]
+float latticeValue(int4 p)
+{
+	uint h = ((uint)p.x * 73856093u) ^ ((uint)p.y * 19349663u) ^ ((uint)p.z * 83492791u);
+	h = (h ^ (h >> 13)) * 0x5bd1e995u;
+	h ^= h >> 15;
+	return (h & 0xffffff) * (2.0f / 0xffffff) - 1.0f;
+}
+
+// smoothstepped interpolation between the surrounding lattice values
+float valueNoise(float4 v)
+{
+	float4 base = floor(v);
+	float4 t = v - base;
+	int4 p = convert_int4(base);
+	t = t * t * (3.0f - 2.0f * t);
+
+	float c00 = mix(latticeValue(p), latticeValue(p + (int4)(1, 0, 0, 0)), t.x);
+	float c10 = mix(latticeValue(p + (int4)(0, 1, 0, 0)), latticeValue(p + (int4)(1, 1, 0, 0)), t.x);
+	float c01 = mix(latticeValue(p + (int4)(0, 0, 1, 0)), latticeValue(p + (int4)(1, 0, 1, 0)), t.x);
+	float c11 = mix(latticeValue(p + (int4)(0, 1, 1, 0)), latticeValue(p + (int4)(1, 1, 1, 0)), t.x);
+
+	return mix(mix(c00, c10, t.y), mix(c01, c11, t.y), t.z);
+}
+
+#endif
+
+#if defined(FIELD_WYVILL)
+
+#define FIELD_ARGS int a_particleCount, \
+	read_only global float4* a_particles, \
+	read_only global uint* a_cellStart, \
+	read_only global uint* a_cellCount, \
+	float a_radius, \
+	int4 a_cellDims
+#define FIELD_PARAMS a_particleCount, a_particles, a_cellStart, a_cellCount, a_radius, a_cellDims
+
+// cell containing the xyz of a position, clamped to the cells along each
+// axis so that positions outside the grid, a particle or the corner of a
+// search around one, land in the nearest edge cell. cellDims.w is 0, so w is
+// left out of the clamp and set to 0
+int4 cellCoord(float4 v, float radius, int4 cellDims)
+{
+	return (int4)(clamp(convert_int3(floor(v.xyz / radius)), (int3)(0), cellDims.xyz - 1), 0);
+}
+
+int cellIndex(int4 cell, int4 cellDims)
+{
+	return cell.x + (cell.y + cell.z * cellDims.y) * cellDims.x;
+}
+
+float wyvill(float distanceSqr, float radiusSqr)
+{
+	float t = 1.0f - min(distanceSqr / radiusSqr, 1.0f);
+	return t * t * t;
+}
+
+float sampleVolume(float4 v, FIELD_ARGS)
+{
+	float radiusSqr = a_radius * a_radius;
+	v.w = 0;
+
+	// cells are the size of the kernel radius so at most 2 are visited per axis
+	int4 cellMin = cellCoord(v - a_radius, a_radius, a_cellDims);
+	int4 cellMax = cellCoord(v + a_radius, a_radius, a_cellDims);
+
+	float d = 0;
+	for (int z = cellMin.z; z <= cellMax.z; ++z)
+	for (int y = cellMin.y; y <= cellMax.y; ++y)
+	for (int x = cellMin.x; x <= cellMax.x; ++x)
+	{
+		int cell = cellIndex((int4)(x, y, z, 0), a_cellDims);
+		uint end = a_cellStart[cell] + a_cellCount[cell];
+		for (uint i = a_cellStart[cell]; i < end; ++i)
+		{
+			float4 vp = v - a_particles[i];
+			d += wyvill(dot(vp.xyz, vp.xyz), radiusSqr);
+		}
+	}
+
+	return d;
+}
+
+// conservative bounds of the field within an axis-aligned box
+void boundVolume(float4 boxMin, float4 boxMax, float* fieldMin, float* fieldMax, FIELD_ARGS)
+{
+	float radiusSqr = a_radius * a_radius;
+
+	int4 cellMin = cellCoord(boxMin - a_radius, a_radius, a_cellDims);
+	int4 cellMax = cellCoord(boxMax + a_radius, a_radius, a_cellDims);
+
+	*fieldMin = 0;
+	*fieldMax = 0;
+	for (int z = cellMin.z; z <= cellMax.z; ++z)
+	for (int y = cellMin.y; y <= cellMax.y; ++y)
+	for (int x = cellMin.x; x <= cellMax.x; ++x)
+	{
+		int cell = cellIndex((int4)(x, y, z, 0), a_cellDims);
+		uint end = a_cellStart[cell] + a_cellCount[cell];
+		for (uint i = a_cellStart[cell]; i < end; ++i)
+		{
+			// the kernel falls off with distance, so it peaks at the closest
+			// point of the box and bottoms out at the furthest corner
+			float4 p = a_particles[i];
+			float4 nearest = clamp(p, boxMin, boxMax) - p;
+			float4 furthest = max(fabs(p - boxMin), fabs(boxMax - p));
+
+			*fieldMax += wyvill(dot(nearest.xyz, nearest.xyz), radiusSqr);
+			*fieldMin += wyvill(dot(furthest.xyz, furthest.xyz), radiusSqr);
+		}
+	}
+}
+
+#elif defined(FIELD_VOLUME)
+
+// sampled volume of VOLUME_TYPE samples (uchar, ushort or float), scaled by
+// VOLUME_SCALE so that integer formats are normalised to [0,1]. filtering
+// writes samples back with VOLUME_STORE, rounding and saturating integers
+#ifndef VOLUME_TYPE
+#define VOLUME_TYPE float
+#endif
+#ifndef VOLUME_SCALE
+#define VOLUME_SCALE 1.0f
+#endif
+#ifndef VOLUME_STORE
+#define VOLUME_STORE convert_float
+#endif
+
+#define FIELD_ARGS read_only global VOLUME_TYPE* a_volume, \
+	int4 a_volumeDims
+#define FIELD_PARAMS a_volume, a_volumeDims
+
+// sample at an integer coordinate, clamped to the edges of the volume
+float volumeAt(int4 p, FIELD_ARGS)
+{
+	p = clamp(p, (int4)(0), a_volumeDims - 1);
+	size_t index = p.x + (p.y + (size_t)p.z * a_volumeDims.y) * a_volumeDims.x;
+	return convert_float(a_volume[index]) * VOLUME_SCALE;
+}
+
+// trilinear interpolation between the surrounding samples
+float sampleVolume(float4 v, FIELD_ARGS)
+{
+	float4 base = floor(v);
+	float4 t = v - base;
+	int4 p = convert_int4(base);
+
+	float c00 = mix(volumeAt(p, FIELD_PARAMS), volumeAt(p + (int4)(1, 0, 0, 0), FIELD_PARAMS), t.x);
+	float c10 = mix(volumeAt(p + (int4)(0, 1, 0, 0), FIELD_PARAMS), volumeAt(p + (int4)(1, 1, 0, 0), FIELD_PARAMS), t.x);
+	float c01 = mix(volumeAt(p + (int4)(0, 0, 1, 0), FIELD_PARAMS), volumeAt(p + (int4)(1, 0, 1, 0), FIELD_PARAMS), t.x);
+	float c11 = mix(volumeAt(p + (int4)(0, 1, 1, 0), FIELD_PARAMS), volumeAt(p + (int4)(1, 1, 1, 0), FIELD_PARAMS), t.x);
+
+	return mix(mix(c00, c10, t.y), mix(c01, c11, t.y), t.z);
+}
+
+// exact bounds of the samples within an axis-aligned box of whole samples
+void boundVolume(float4 boxMin, float4 boxMax, float* fieldMin, float* fieldMax, FIELD_ARGS)
+{
+	int4 lo = convert_int4(boxMin);
+	int4 hi = convert_int4(boxMax);
+
+	*fieldMin = INFINITY;
+	*fieldMax = -INFINITY;
+	for (int z = lo.z; z <= hi.z; ++z)
+	for (int y = lo.y; y <= hi.y; ++y)
+	for (int x = lo.x; x <= hi.x; ++x)
+	{
+		float d = volumeAt((int4)(x, y, z, 0), FIELD_PARAMS);
+		*fieldMin = min(*fieldMin, d);
+		*fieldMax = max(*fieldMax, d);
+	}
+}
+
+#elif defined(FIELD_SPHERE)
+
+// a_sphere.xyz is the centre and a_sphere.w the radius
+#define FIELD_ARGS float4 a_sphere
+#define FIELD_PARAMS a_sphere
+
+// positive inside the sphere, falling off with distance like the metaballs
+float sampleVolume(float4 v, FIELD_ARGS)
+{
+	return a_sphere.w - distance(v.xyz, a_sphere.xyz);
+}
+
+// exact bounds of the field within an axis-aligned box
+void boundVolume(float4 boxMin, float4 boxMax, float* fieldMin, float* fieldMax, FIELD_ARGS)
+{
+	float4 nearest = clamp(a_sphere, boxMin, boxMax) - a_sphere;
+	float4 furthest = max(fabs(a_sphere - boxMin), fabs(boxMax - a_sphere));
+
+	*fieldMax = a_sphere.w - length(nearest.xyz);
+	*fieldMin = a_sphere.w - length(furthest.xyz);
+}
+
+#elif defined(FIELD_NOISE)
+
+#ifndef NOISE_OCTAVES
+#define NOISE_OCTAVES 4
+#endif
+
+// a_noiseScale is the frequency of the first octave in lattice cells per cube
+#define FIELD_ARGS float a_noiseScale
+#define FIELD_PARAMS a_noiseScale
+
+// each octave doubles the frequency and halves the amplitude
+float sampleVolume(float4 v, FIELD_ARGS)
+{
+	float d = 0;
+	float amplitude = 0.5f;
+
+	v *= a_noiseScale;
+	for (int i = 0; i < NOISE_OCTAVES; ++i)
+	{
+		d += valueNoise(v) * amplitude;
+		v *= 2.0f;
+		amplitude *= 0.5f;
+	}
+
+	return d;
+}
+
+// the noise isn't cheaply bounded within a box, so every brick gets the full
+// range of the octave sum and none are skipped
+void boundVolume(float4 boxMin, float4 boxMax, float* fieldMin, float* fieldMax, FIELD_ARGS)
+{
+	float range = 1.0f - 1.0f / (1 << NOISE_OCTAVES);
+	*fieldMin = -range;
+	*fieldMax = range;
+}
+
+#elif defined(FIELD_EXPRESSION)
+
+// the particles are there for expressions with metaballs in them
+#define FIELD_ARGS int a_particleCount, \
+	read_only global float4* a_particles
+#define FIELD_PARAMS a_particleCount, a_particles
+
+// generated along with the expression, negative inside the shape
+float fieldExpression(float3 p, FIELD_ARGS);
+void boundFieldExpression(float3 boxMin, float3 boxMax, float* distanceMin, float* distanceMax, FIELD_ARGS);
+
+// distance to a box at the origin
+float boxDistance(float3 p, float3 halfSize)
+{
+	float3 q = fabs(p) - halfSize;
+	return length(max(q, 0.0f)) + min(max(q.x, max(q.y, q.z)), 0.0f);
+}
+
+// distance to a torus at the origin around the y axis
+float torusDistance(float3 p, float majorRadius, float minorRadius)
+{
+	float2 q = (float2)(length(p.xz) - majorRadius, p.y);
+	return length(q) - minorRadius;
+}
+
+// polynomial smooth minimum, blending the two over a distance of k
+float smoothMin(float a, float b, float k)
+{
+	float h = clamp(0.5f + 0.5f * (b - a) / k, 0.0f, 1.0f);
+	return mix(b, a, h) - k * h * (1.0f - h);
+}
+
+// each octave doubles the frequency and halves the amplitude, from 1
+float fractalNoise(float3 p, int octaves)
+{
+	float4 v = (float4)(p, 0);
+	float d = 0;
+	float amplitude = 1.0f;
+
+	for (int i = 0; i < octaves; ++i)
+	{
+		d += valueNoise(v) * amplitude;
+		v *= 2.0f;
+		amplitude *= 0.5f;
+	}
+
+	return d;
+}
+
+// the metaballs as a distance, 1/sqrt of their 1/r^2 sum, which is never
+// further than the nearest particle and exact for one on its own
+float particleDistance(float3 p, float radius, FIELD_ARGS)
+{
+	float d = 0;
+	for (int i = 0; i < a_particleCount; ++i)
+	{
+		float3 vp = p - a_particles[i].xyz;
+		d += 1.0f / dot(vp, vp);
+	}
+
+	return rsqrt(d) - radius;
+}
+
+// positive inside the shape like the other fields
+float sampleVolume(float4 v, FIELD_ARGS)
+{
+	return -fieldExpression(v.xyz, FIELD_PARAMS);
+}
+
+// the generated bounds are of the distance, so they swap over
+void boundVolume(float4 boxMin, float4 boxMax, float* fieldMin, float* fieldMax, FIELD_ARGS)
+{
+	float distanceMin, distanceMax;
+	boundFieldExpression(boxMin.xyz, boxMax.xyz, &distanceMin, &distanceMax, FIELD_PARAMS);
+	*fieldMin = -distanceMax;
+	*fieldMax = -distanceMin;
+}
+
+#else
+
+#define FIELD_ARGS int a_particleCount, \
+	read_only global float4* a_particles
+#define FIELD_PARAMS a_particleCount, a_particles
 
 // example volume (metaballs for now)
-float sampleVolume(float4 v, 
-	int particleCount, read_only global float4* particles)
+float sampleVolume(float4 v, FIELD_ARGS)
 {
 	float4 vp;
 	float d = 0;
 	
-	for (int i = 0; i < particleCount; ++i)
+	for (int i = 0; i < a_particleCount; ++i)
 	{
-		vp = v - particles[i];
+		vp = v - a_particles[i];
 		d += 1.0 / dot(vp.xyz, vp.xyz);
 	} 
 
 	return d;
 }
 
-kernel void marchingCubes(int a_maxFaces,
-					 write_only global uint* a_faceCount, // atomic index into vertices
-					 write_only global float4* a_vertices,
-					 float a_threshold,
-					 int a_particleCount,
-					 read_only global float4* a_particles)
+// conservative bounds of the field within an axis-aligned box
+void boundVolume(float4 boxMin, float4 boxMax, float* fieldMin, float* fieldMax, FIELD_ARGS)
 {
-	// lower corner
-	float4 cubeCorner = (float4)(get_global_id(0), get_global_id(1), get_global_id(2), 0.0f);
+	*fieldMin = 0;
+	*fieldMax = 0;
+	for (int i = 0; i < a_particleCount; ++i)
+	{
+		// each metaball's contribution is largest at the closest point of the
+		// box and smallest at the furthest corner
+		float4 p = a_particles[i];
+		float4 nearest = clamp(p, boxMin, boxMax) - p;
+		float4 furthest = max(fabs(p - boxMin), fabs(boxMax - p));
 
-	// store a local copy of the cube's corner volumes
-	float cornerVolumes[8];	
-	cornerVolumes[0] = sampleVolume(cubeCorner + CUBE_CORNERS[0], a_particleCount, a_particles);
-	cornerVolumes[1] = sampleVolume(cubeCorner + CUBE_CORNERS[1], a_particleCount, a_particles);
-	cornerVolumes[2] = sampleVolume(cubeCorner + CUBE_CORNERS[2], a_particleCount, a_particles);
-	cornerVolumes[3] = sampleVolume(cubeCorner + CUBE_CORNERS[3], a_particleCount, a_particles);
-	cornerVolumes[4] = sampleVolume(cubeCorner + CUBE_CORNERS[4], a_particleCount, a_particles);
-	cornerVolumes[5] = sampleVolume(cubeCorner + CUBE_CORNERS[5], a_particleCount, a_particles);
-	cornerVolumes[6] = sampleVolume(cubeCorner + CUBE_CORNERS[6], a_particleCount, a_particles);
-	cornerVolumes[7] = sampleVolume(cubeCorner + CUBE_CORNERS[7], a_particleCount, a_particles);
-	
-	// find which corners are inside/outside the volume
+		float nearestSqr = dot(nearest.xyz, nearest.xyz);
+		if (nearestSqr == 0)
+		{
+			// particle is inside the box so the field is unbounded
+			*fieldMax = INFINITY;
+			return;
+		}
+
+		*fieldMax += 1.0f / nearestSqr;
+		*fieldMin += 1.0f / dot(furthest.xyz, furthest.xyz);
+	}
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// particle animation
+//
+// moves the particles to where they are at a_time straight into the buffer
+// the field reads, so nothing is uploaded each frame. the default 8 follow
+// hand-written paths around a_centre, placed for a 128^3 grid and scaled
+// by a_scale, while larger sets wobble by a_amplitude around their seeds,
+// whose w is a phase offset. matches animateParticles on the host.
+
+kernel void animateParticles(float a_time,
+							 float4 a_centre,
+							 float a_scale,
+							 float a_amplitude,
+							 int a_particleCount,
+							 read_only global float4* a_seeds,
+							 global float4* a_particles)
+{
+	int i = get_global_id(0);
+	if (i >= a_particleCount)
+		return;
+
+	float t = a_time;
+	if (a_particleCount == 8)
+	{
+		float4 offset = 0;
+		switch (i)
+		{
+		case 1: offset = (float4)(sin(t) * 32, cos(t * 0.5f) * 32, sin(t * 2) * 16, 0); break;
+		case 2: offset = (float4)(cos(-t * 0.25f) * 8, cos(t * 0.5f), cos(t) * 32, 0); break;
+		case 3: offset = (float4)(sin(t) * 32, cos(t * 0.5f) * 32, cos(-t * 2) * 16, 0); break;
+		case 4: offset = (float4)(sin(t) * 16, sin(t * 1.5f) * 16, sin(t * 2) * 32, 0); break;
+		case 5: offset = (float4)(cos(t * 0.3f) * 32, cos(t * 1.5f) * 32, sin(t * 2) * 32, 0); break;
+		case 6: offset = (float4)(sin(t) * 16, sin(t * 1.5f) * 16, sin(t * 2) * 32, 0); break;
+		case 7: offset = (float4)(sin(-t) * 32, sin(t * 1.5f) * 32, cos(t * 4) * 32, 0); break;
+		}
+		a_particles[i] = offset * a_scale + a_centre;
+		return;
+	}
+
+	float4 seed = a_seeds[i];
+	float phase = seed.w;
+	float4 offset = (float4)(sin(t + phase), cos(t * 0.7f + phase * 2), sin(t * 1.3f + phase * 3), 0);
+	a_particles[i] = (float4)(seed.xyz, 0) + offset * a_amplitude;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// particle binning
+//
+// counting sort of the particles into the uniform cell grid used by
+// FIELD_WYVILL. binParticles counts the particles in each cell, the counts
+// are exclusive-scanned into cell start offsets and scatterParticles then
+// writes each particle into its cell's range of the sorted buffer.
+
+kernel void binParticles(int a_particleCount,
+						 read_only global float4* a_particles,
+						 float a_radius,
+						 int4 a_cellDims,
+						 global uint* a_cellCount,
+						 global uint* a_particleCell,
+						 global uint* a_particleRank)
+{
+	int i = get_global_id(0);
+	if (i >= a_particleCount)
+		return;
+
+	int4 cell = cellCoord(a_particles[i], a_radius, a_cellDims);
+	uint index = cellIndex(cell, a_cellDims);
+
+	a_particleCell[i] = index;
+	a_particleRank[i] = atomic_inc(&a_cellCount[index]);
+}
+
+kernel void scatterParticles(int a_particleCount,
+							 read_only global float4* a_particles,
+							 read_only global uint* a_particleCell,
+							 read_only global uint* a_particleRank,
+							 read_only global uint* a_cellStart,
+							 global float4* a_sortedParticles)
+{
+	int i = get_global_id(0);
+	if (i >= a_particleCount)
+		return;
+
+	a_sortedParticles[a_cellStart[a_particleCell[i]] + a_particleRank[i]] = a_particles[i];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// exclusive prefix sum
+//
+// scanGroups scans SCAN_GROUP_SIZE elements per work-group in local memory
+// (Blelloch up-sweep / down-sweep) and writes each group's total out, the
+// totals are scanned recursively and addGroupSums folds them back in.
+
+#ifndef SCAN_GROUP_SIZE
+#define SCAN_GROUP_SIZE 256
+#endif
+
+kernel void scanGroups(global uint* a_data,
+					   global uint* a_groupSums,
+					   uint a_count)
+{
+	local uint temp[SCAN_GROUP_SIZE];
+
+	uint gid = get_global_id(0);
+	uint lid = get_local_id(0);
+
+	temp[lid] = gid < a_count ? a_data[gid] : 0;
+
+	// up-sweep, building partial sums in place
+	for (uint stride = 1; stride < SCAN_GROUP_SIZE; stride <<= 1)
+	{
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint i = (lid + 1) * stride * 2 - 1;
+		if (i < SCAN_GROUP_SIZE)
+			temp[i] += temp[i - stride];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (lid == 0)
+	{
+		a_groupSums[get_group_id(0)] = temp[SCAN_GROUP_SIZE - 1];
+		temp[SCAN_GROUP_SIZE - 1] = 0;
+	}
+
+	// down-sweep, distributing the partial sums
+	for (uint stride = SCAN_GROUP_SIZE / 2; stride > 0; stride >>= 1)
+	{
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint i = (lid + 1) * stride * 2 - 1;
+		if (i < SCAN_GROUP_SIZE)
+		{
+			uint t = temp[i - stride];
+			temp[i - stride] = temp[i];
+			temp[i] += t;
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (gid < a_count)
+		a_data[gid] = temp[lid];
+}
+
+kernel void addGroupSums(global uint* a_data,
+						 read_only global uint* a_groupSums,
+						 uint a_count)
+{
+	uint gid = get_global_id(0);
+	if (gid < a_count)
+		a_data[gid] += a_groupSums[get_group_id(0)];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// vertex output
+//
+// vertices are written as a float4 position and float4 normal (32 bytes), or
+// with COMPACT_VERTICES as 3 uints (12 bytes): the position quantised to
+// 16 bits per axis by POSITION_SCALE (65535 / the largest grid dimension) and
+// the normal octahedral-encoded into two 16-bit snorms. the vertex shader
+// decodes them. the normal's w carries the isovalue level of the surface,
+// which compact vertices keep in the spare upper half of z.
+
+#ifdef COMPACT_VERTICES
+
+#define VERTEX_TYPE uint
+#define VERTEX_STRIDE 3
+
+// maps the unit sphere onto the [-1,1] square by folding the lower hemisphere out
+float2 octahedralEncode(float4 n)
+{
+	float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if (sum == 0)
+		return (float2)(0);
+
+	n /= sum;
+	return n.z >= 0 ? n.xy : (1.0f - fabs(n.yx)) * copysign((float2)(1.0f), n.xy);
+}
+
+void writeVertex(global VERTEX_TYPE* a_vertices, uint vertex, float4 position, float4 normal)
+{
+	uint4 q = convert_uint4_sat_rte(position * POSITION_SCALE);
+	int2 e = convert_int2_rte(clamp(octahedralEncode(normal), -1.0f, 1.0f) * 32767.0f);
+
+	a_vertices[vertex * VERTEX_STRIDE] = q.x | (q.y << 16);
+	a_vertices[vertex * VERTEX_STRIDE + 1] = q.z | ((uint)normal.w << 16);
+	a_vertices[vertex * VERTEX_STRIDE + 2] = ((uint)e.x & 0xffff) | ((uint)e.y << 16);
+}
+
+#else
+
+#define VERTEX_TYPE float4
+#define VERTEX_STRIDE 2
+
+void writeVertex(global VERTEX_TYPE* a_vertices, uint vertex, float4 position, float4 normal)
+{
+	a_vertices[vertex * VERTEX_STRIDE] = position;
+	a_vertices[vertex * VERTEX_STRIDE + 1] = normal;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// lookup tables
+//
+// every cube looks up its case in the tables, and neighbouring work-items
+// rarely share a case, so the lookups diverge. by default they index the
+// int tables in constant memory, which fill most of the constant cache, and
+// a build option swaps them for PACKED_TABLES held in
+//
+// TABLES_PACKED:	constant memory
+// TABLES_LOCAL:	local memory, copied from constant memory by each work-group
+// TABLES_IMAGE:	a 256 x 1 uint4 image of packTableTexels, read through the
+//					texture cache and passed after the field arguments
+//
+// functions that read the tables take TABLE_ARGS after FIELD_ARGS, and the
+// kernels that polygonise take TABLE_KERNEL_ARGS and start with LOAD_TABLES.
+
+#if defined(TABLES_LOCAL) || defined(TABLES_IMAGE)
+#define TABLES_PACKED
+#endif
+
+#if defined(TABLES_LOCAL)
+#define TABLE_ARGS , local const PackedTables* a_tables
+#define TABLE_PARAMS , a_tables
+#define TABLE_KERNEL_ARGS
+#define LOAD_TABLES local PackedTables l_tables; \
+					loadTables(&l_tables); \
+					local const PackedTables* a_tables = &l_tables;
+
+// the work-group copies the tables cooperatively, a uint at a time
+void loadTables(local PackedTables* a_tables)
+{
+	constant uint* source = (constant uint*)&PACKED_TABLES;
+	local uint* destination = (local uint*)a_tables;
+
+	int groupVolume = get_local_size(0) * get_local_size(1) * get_local_size(2);
+	int localIndex = get_local_id(0) + (get_local_id(1) + get_local_id(2) * get_local_size(1)) * get_local_size(0);
+	for (int i = localIndex; i < (int)(sizeof(PackedTables) / sizeof(uint)); i += groupVolume)
+		destination[i] = source[i];
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+#elif defined(TABLES_IMAGE)
+#define TABLE_ARGS , read_only image1d_t a_tables
+#define TABLE_PARAMS , a_tables
+#define TABLE_KERNEL_ARGS TABLE_ARGS
+#define LOAD_TABLES
+
+#else
+#define TABLE_ARGS
+#define TABLE_PARAMS
+#define TABLE_KERNEL_ARGS
+#define LOAD_TABLES
+#endif
+
+// everything a cube needs from the tables in a single lookup, with the
+// packed triangles in x and y, the edge flags in z and the triangle count in
+// w. the int tables leave the case in x for triangleEdge to index with
+uint4 caseEntry(int flagIndex TABLE_ARGS)
+{
+#if defined(TABLES_LOCAL)
+	return (uint4)(vload2(0, a_tables->triangles[flagIndex]), (uint)a_tables->edgeFlags[flagIndex], (uint)a_tables->triangleCounts[flagIndex]);
+#elif defined(TABLES_IMAGE)
+	return read_imageui(a_tables, flagIndex);
+#elif defined(TABLES_PACKED)
+	return (uint4)(vload2(0, PACKED_TABLES.triangles[flagIndex]), (uint)PACKED_TABLES.edgeFlags[flagIndex], (uint)PACKED_TABLES.triangleCounts[flagIndex]);
+#else
+	// there can be up to five triangles per cube
+	uint triangleCount = 0;
+	while (triangleCount < 5 && TRIANGLE_TABLE[ flagIndex ][ 3 * triangleCount ] >= 0)
+		++triangleCount;
+	return (uint4)((uint)flagIndex, 0, (uint)EDGE_FLAGS[ flagIndex ], triangleCount);
+#endif
+}
+
+// edge index of the vertex'th vertex of a case's triangles
+int triangleEdge(uint4 entry, int vertex)
+{
+#if defined(TABLES_PACKED)
+	uint packed = vertex < 8 ? entry.x : entry.y;
+	return (packed >> (4 * (vertex & 7))) & 0xf;
+#else
+	return TRIANGLE_TABLE[ entry.x ][ vertex ];
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+// marching cubes
+
+// which corners are inside/outside the volume, indexing the lookup tables
+int cubeCase(const float* cornerVolumes, float a_threshold)
+{
 	int flagIndex = 0;	
 	if (cornerVolumes[ 0 ] <= a_threshold)	flagIndex = (1 << 0);
 	if (cornerVolumes[ 1 ] <= a_threshold)	flagIndex |= (1 << 1);
@@ -348,16 +697,69 @@ kernel void marchingCubes(int a_maxFaces,
 	if (cornerVolumes[ 5 ] <= a_threshold)	flagIndex |= (1 << 5);
 	if (cornerVolumes[ 6 ] <= a_threshold)	flagIndex |= (1 << 6);
 	if (cornerVolumes[ 7 ] <= a_threshold)	flagIndex |= (1 << 7);
+	return flagIndex;
+}
+
+// samples the field at the 8 corners of the cube with its lower corner at
+// cubeCorner, cubeSize samples on a side
+void sampleCorners(float4 cubeCorner, float cubeSize, float* cornerVolumes, FIELD_ARGS)
+{
+	float4 scale = (float4)(cubeSize, cubeSize, cubeSize, 1.0f);
+	cornerVolumes[0] = sampleVolume(cubeCorner + CUBE_CORNERS[0] * scale, FIELD_PARAMS);
+	cornerVolumes[1] = sampleVolume(cubeCorner + CUBE_CORNERS[1] * scale, FIELD_PARAMS);
+	cornerVolumes[2] = sampleVolume(cubeCorner + CUBE_CORNERS[2] * scale, FIELD_PARAMS);
+	cornerVolumes[3] = sampleVolume(cubeCorner + CUBE_CORNERS[3] * scale, FIELD_PARAMS);
+	cornerVolumes[4] = sampleVolume(cubeCorner + CUBE_CORNERS[4] * scale, FIELD_PARAMS);
+	cornerVolumes[5] = sampleVolume(cubeCorner + CUBE_CORNERS[5] * scale, FIELD_PARAMS);
+	cornerVolumes[6] = sampleVolume(cubeCorner + CUBE_CORNERS[6] * scale, FIELD_PARAMS);
+	cornerVolumes[7] = sampleVolume(cubeCorner + CUBE_CORNERS[7] * scale, FIELD_PARAMS);
+}
+
+// surface normal at a point, from central differences of the field
+float4 fieldNormal(float4 position, FIELD_ARGS)
+{
+	float4 normal;
+	normal.x = sampleVolume(position - (float4)(0.01f, 0, 0, 0), FIELD_PARAMS) -
+		sampleVolume(position + (float4)(0.01f, 0, 0, 0), FIELD_PARAMS);
+	normal.y = sampleVolume(position - (float4)(0, 0.01f, 0, 0), FIELD_PARAMS) -
+		sampleVolume(position + (float4)(0, 0.01f, 0, 0), FIELD_PARAMS);
+	normal.z = sampleVolume(position - (float4)(0, 0, 0.01f, 0), FIELD_PARAMS) -
+		sampleVolume(position + (float4)(0, 0, 0.01f, 0), FIELD_PARAMS);
+	normal.w = 0;
+
+	if ( dot(normal,normal) > 0 )
+		normal = normalize(normal);
+	return normal;
+}
+
+// polygonise a single cube with its lower corner at cubeCorner, cubeSize
+// samples on a side, from its already sampled corner values, appending any
+// triangles found to a_vertices with level in their normals' w
+void polygoniseCorners(float4 cubeCorner,
+					   float cubeSize,
+					   const float* cornerVolumes,
+					   int a_maxFaces,
+					   global uint* a_faceCount,
+					   global VERTEX_TYPE* a_vertices,
+					   float a_threshold,
+					   int level,
+					   FIELD_ARGS
+					   TABLE_ARGS)
+{
+	// find which corners are inside/outside the volume
+	int flagIndex = cubeCase(cornerVolumes, a_threshold);
+	uint4 entry = caseEntry(flagIndex TABLE_PARAMS);
 
 	float offset, delta;
 	float4 edgePosition[12];
 	float4 edgeNormal[12];
+	float4 scale = (float4)(cubeSize, cubeSize, cubeSize, 1.0f);
 
 	// find the intersection point between an edge
 	for ( int edgeIndex = 0 ; edgeIndex < 12 ; ++edgeIndex )
 	{
 		// test for intersection along an edge
-		if (EDGE_FLAGS[ flagIndex ] & (1<<edgeIndex))
+		if (entry.z & (1<<edgeIndex))
 		{			
 			delta = cornerVolumes[ EDGE_INDICES[ edgeIndex ][1] ] - cornerVolumes[ EDGE_INDICES[ edgeIndex ][0] ];
 			if (delta == 0.0)
@@ -365,41 +767,1633 @@ kernel void marchingCubes(int a_maxFaces,
 			else
 				offset = (a_threshold - cornerVolumes[ EDGE_INDICES[ edgeIndex ][0] ]) / delta;
 
-			edgePosition[ edgeIndex ] = cubeCorner + (CUBE_CORNERS[ EDGE_INDICES[ edgeIndex ][0] ] + EDGE_DIRECTIONS[ edgeIndex ] * offset);
+			edgePosition[ edgeIndex ] = cubeCorner + (CUBE_CORNERS[ EDGE_INDICES[ edgeIndex ][0] ] + EDGE_DIRECTIONS[ edgeIndex ] * offset) * scale;
 
 			// calculate normal
-			edgeNormal[edgeIndex].x = sampleVolume(edgePosition[edgeIndex] - (float4)(0.01f, 0, 0, 0), a_particleCount, a_particles) -
-				sampleVolume(edgePosition[edgeIndex] + (float4)(0.01f, 0, 0, 0), a_particleCount, a_particles);
-			edgeNormal[edgeIndex].y = sampleVolume(edgePosition[edgeIndex] - (float4)(0, 0.01f, 0, 0), a_particleCount, a_particles) -
-				sampleVolume(edgePosition[edgeIndex] + (float4)(0, 0.01f, 0, 0), a_particleCount, a_particles);
-			edgeNormal[edgeIndex].z = sampleVolume(edgePosition[edgeIndex] - (float4)(0, 0, 0.01f, 0), a_particleCount, a_particles) -
-				sampleVolume(edgePosition[edgeIndex] + (float4)(0, 0, 0.01f, 0), a_particleCount, a_particles);
-			edgeNormal[edgeIndex].w = 0;
-
-			if ( dot(edgeNormal[ edgeIndex ],edgeNormal[ edgeIndex ]) > 0 )
-				edgeNormal[ edgeIndex ] = normalize(edgeNormal[ edgeIndex ]);
+			edgeNormal[ edgeIndex ] = fieldNormal(edgePosition[ edgeIndex ], FIELD_PARAMS);
+			edgeNormal[ edgeIndex ].w = level;
 		}
 	}
 
 	// store the position for the triangles that were found.
-	// there can be up to five per cube
-	for ( int triangleIndex = 0 ; triangleIndex < 5 ; ++triangleIndex )
-	{
-		if (TRIANGLE_TABLE[ flagIndex ][ 3 * triangleIndex ] < 0)
-			break;
+	int triangleCount = (int)entry.w;
 
-		// using an atomic to index into the write_only array of vertices
-		uint startVertex = atomic_inc(a_faceCount);
+	if (triangleCount == 0)
+		return;
 
-		if (startVertex >= a_maxFaces)
+	// using an atomic to index into the write_only array of vertices
+	// the whole cube is counted even if it doesn't fit, so the final count
+	// tells the host how much room the surface actually needed
+	uint startVertex = atomic_add(a_faceCount, triangleCount);
+
+	for ( int triangleIndex = 0 ; triangleIndex < triangleCount ; ++triangleIndex )
+	{
+		if (startVertex + triangleIndex >= a_maxFaces)
 			break;
 
 		for ( int triangleVertex = 0 ; triangleVertex < 3 ; ++triangleVertex )
 		{
-			// write out 2 float4's for each vertex (position + normal)
-			int vertexIndex = TRIANGLE_TABLE[ flagIndex ][3 * triangleIndex + triangleVertex];
-			a_vertices[startVertex * 6 + triangleVertex * 2] = edgePosition[ vertexIndex ];
-			a_vertices[startVertex * 6 + triangleVertex * 2 + 1] = edgeNormal[ vertexIndex ];
+			// write out the position and normal of each vertex
+			int vertexIndex = triangleEdge(entry, 3 * triangleIndex + triangleVertex);
+			writeVertex(a_vertices, (startVertex + triangleIndex) * 3 + triangleVertex, edgePosition[ vertexIndex ], edgeNormal[ vertexIndex ]);
 		}
 	}	
-}
\ No newline at end of file
+}
+
+// polygonise a single cube with its lower corner at cubeCorner, appending
+// any triangles found to a_vertices
+void polygonise(float4 cubeCorner,
+				int a_maxFaces,
+				global uint* a_faceCount,
+				global VERTEX_TYPE* a_vertices,
+				float a_threshold,
+				FIELD_ARGS
+				TABLE_ARGS)
+{
+	// store a local copy of the cube's corner volumes
+	float cornerVolumes[8];	
+	sampleCorners(cubeCorner, 1.0f, cornerVolumes, FIELD_PARAMS);
+
+	polygoniseCorners(cubeCorner, 1.0f, cornerVolumes, a_maxFaces, a_faceCount, a_vertices, a_threshold, 0, FIELD_PARAMS TABLE_PARAMS);
+}
+
+kernel void marchingCubes(int a_maxFaces,
+					 write_only global uint* a_faceCount, // atomic index into vertices
+					 write_only global VERTEX_TYPE* a_vertices,
+					 float a_threshold,
+					 FIELD_ARGS
+					 TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	// lower corner
+	float4 cubeCorner = (float4)(get_global_id(0), get_global_id(1), get_global_id(2), 0.0f);
+
+	polygonise(cubeCorner, a_maxFaces, a_faceCount, a_vertices, a_threshold, FIELD_PARAMS TABLE_PARAMS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// tiled marching cubes
+//
+// neighbouring cubes share their corners, so rather than every work-item
+// sampling all 8 of its own, each work-group samples the (n+1)^3 corners of
+// its n^3 block of cubes into local memory once and the cubes read them from
+// there. the block is sized by the local work size, which the host picks per
+// device and rounds the global size up to, with a_tile sized to match.
+
+kernel void marchingCubesTiled(int a_maxFaces,
+							   global uint* a_faceCount, // atomic index into vertices
+							   global VERTEX_TYPE* a_vertices,
+							   float a_threshold,
+							   int4 a_gridSize,
+							   local float* a_tile,
+							   FIELD_ARGS
+							   TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	int4 groupSize = (int4)(get_local_size(0), get_local_size(1), get_local_size(2), 0);
+	int4 tileSize = groupSize + 1;
+	int4 groupCorner = (int4)(get_group_id(0), get_group_id(1), get_group_id(2), 0) * groupSize;
+	int4 localId = (int4)(get_local_id(0), get_local_id(1), get_local_id(2), 0);
+
+	// the work-group samples the tile cooperatively, strided by its size
+	int groupVolume = groupSize.x * groupSize.y * groupSize.z;
+	int tileVolume = tileSize.x * tileSize.y * tileSize.z;
+	for (int i = localId.x + (localId.y + localId.z * groupSize.y) * groupSize.x; i < tileVolume; i += groupVolume)
+	{
+		int4 sample = groupCorner + (int4)(i % tileSize.x, (i / tileSize.x) % tileSize.y, i / (tileSize.x * tileSize.y), 0);
+
+		// corners past the far side of the grid only belong to padding cubes
+		if (sample.x <= a_gridSize.x && sample.y <= a_gridSize.y && sample.z <= a_gridSize.z)
+			a_tile[i] = sampleVolume(convert_float4(sample), FIELD_PARAMS);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// the global size is rounded up to whole work-groups
+	int4 cube = groupCorner + localId;
+	if (cube.x >= a_gridSize.x || cube.y >= a_gridSize.y || cube.z >= a_gridSize.z)
+		return;
+
+	float cornerVolumes[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		int4 corner = localId + convert_int4(CUBE_CORNERS[i]);
+		cornerVolumes[i] = a_tile[corner.x + (corner.y + corner.z * tileSize.y) * tileSize.x];
+	}
+
+	polygoniseCorners(convert_float4(cube), 1.0f, cornerVolumes, a_maxFaces, a_faceCount, a_vertices, a_threshold, 0, FIELD_PARAMS TABLE_PARAMS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// brick-level empty-space skipping
+//
+// the grid is split into BRICK_SIZE^3 bricks of cubes. classifyBricks bounds
+// the field over each brick from the particle set and appends the bricks that
+// could contain the isosurface to a compacted work list, which
+// marchingCubesBricks then polygonises with one work-item per cube. it is
+// launched over every brick of the grid so the host never reads the count
+// back, and the work-items past the active bricks return straight away.
+
+#ifndef BRICK_SIZE
+#define BRICK_SIZE 8
+#endif
+#define BRICK_VOLUME (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+
+// relative slack so float rounding in the bound can't cull a real crossing
+#define BRICK_EPSILON 1e-4f
+
+// bricks are packed into a single uint, 10 bits per axis
+uint packBrick(uint x, uint y, uint z)
+{
+	return x | (y << 10) | (z << 20);
+}
+
+int4 unpackBrick(uint brick)
+{
+	return (int4)((int)(brick & 0x3ff), (int)((brick >> 10) & 0x3ff), (int)(brick >> 20), 0);
+}
+
+// every third bit of code, from the lowest, packed together
+uint compactBits(uint code)
+{
+	code &= 0x09249249;
+	code = (code ^ (code >> 2)) & 0x030c30c3;
+	code = (code ^ (code >> 4)) & 0x0300f00f;
+	code = (code ^ (code >> 8)) & 0xff0000ff;
+	code = (code ^ (code >> 16)) & 0x000003ff;
+	return code;
+}
+
+// position along a morton (z-order) curve, x in the lowest bit
+int4 mortonDecode(uint code)
+{
+	return (int4)((int)compactBits(code), (int)compactBits(code >> 1), (int)compactBits(code >> 2), 0);
+}
+
+// a brick's cubes only fill a morton range when it is a power of two on a side
+#if (BRICK_SIZE & (BRICK_SIZE - 1)) != 0
+#error BRICK_SIZE must be a power of two
+#endif
+
+// the cube at cubeIndex within a packed brick, x fastest or in morton order
+// with MORTON_ORDER, so that a work-group covers a block of the brick rather
+// than a few of its rows
+int4 brickCube(uint brick, int cubeIndex)
+{
+#ifdef MORTON_ORDER
+	return unpackBrick(brick) * BRICK_SIZE + mortonDecode(cubeIndex);
+#else
+	return unpackBrick(brick) * BRICK_SIZE + (int4)(cubeIndex % BRICK_SIZE, (cubeIndex / BRICK_SIZE) % BRICK_SIZE, cubeIndex / (BRICK_SIZE * BRICK_SIZE), 0);
+#endif
+}
+
+kernel void classifyBricks(float a_threshold,
+						   int4 a_gridSize,
+						   global uint* a_activeBrickCount, // atomic index into active bricks
+						   global uint* a_activeBricks,
+						   FIELD_ARGS)
+{
+	int4 brick = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+
+	// sample-space bounds of the brick, including the far corners of its last cubes
+	float4 brickMin = convert_float4(brick * BRICK_SIZE);
+	float4 brickMax = convert_float4(min(brick * BRICK_SIZE + BRICK_SIZE, a_gridSize));
+
+	float fieldMin, fieldMax;
+	boundVolume(brickMin, brickMax, &fieldMin, &fieldMax, FIELD_PARAMS);
+
+	// a cube only produces triangles if its corners straddle the threshold
+	if (fieldMax + fabs(fieldMax) * BRICK_EPSILON <= a_threshold ||
+		fieldMin - fabs(fieldMin) * BRICK_EPSILON > a_threshold)
+		return;
+
+	uint index = atomic_inc(a_activeBrickCount);
+	a_activeBricks[index] = packBrick(brick.x, brick.y, brick.z);
+}
+
+kernel void marchingCubesBricks(int a_maxFaces,
+								global uint* a_faceCount, // atomic index into vertices
+								global VERTEX_TYPE* a_vertices,
+								float a_threshold,
+								int4 a_gridSize,
+								read_only global uint* a_activeBricks,
+								read_only global uint* a_activeBrickCount,
+								FIELD_ARGS
+								TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	// one work-item per cube of each active brick
+	uint id = get_global_id(0);
+	if (id / BRICK_VOLUME >= *a_activeBrickCount)
+		return;
+
+	int4 cube = brickCube(a_activeBricks[id / BRICK_VOLUME], id % BRICK_VOLUME);
+
+	// bricks on the far edges of the grid may be partially filled
+	if (cube.x >= a_gridSize.x || cube.y >= a_gridSize.y || cube.z >= a_gridSize.z)
+		return;
+
+	polygonise(convert_float4(cube), a_maxFaces, a_faceCount, a_vertices, a_threshold, FIELD_PARAMS TABLE_PARAMS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// morton-ordered marching cubes
+//
+// marchingCubes as a 1d range over every brick of the grid, bricks in row
+// order and the cubes of each in morton order, so a work-group polygonises a
+// compact block of cubes that share corners and field reads rather than a
+// strip along x, and the triangles come out in roughly the same order. the
+// global size is the brick count times BRICK_VOLUME, padding the grid to
+// whole bricks. MORTON_ORDER orders the cubes of the brick kernels the same
+// way.
+
+kernel void marchingCubesMorton(int a_maxFaces,
+								global uint* a_faceCount, // atomic index into vertices
+								global VERTEX_TYPE* a_vertices,
+								float a_threshold,
+								int4 a_gridSize,
+								FIELD_ARGS
+								TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	uint id = get_global_id(0);
+	uint brickIndex = id / BRICK_VOLUME;
+	int4 brickCount = (a_gridSize + BRICK_SIZE - 1) / BRICK_SIZE;
+	int4 brick = (int4)(brickIndex % brickCount.x, (brickIndex / brickCount.x) % brickCount.y, brickIndex / (brickCount.x * brickCount.y), 0);
+	int4 cube = brick * BRICK_SIZE + mortonDecode(id % BRICK_VOLUME);
+
+	// bricks on the far edges of the grid may be partially filled
+	if (cube.x >= a_gridSize.x || cube.y >= a_gridSize.y || cube.z >= a_gridSize.z)
+		return;
+
+	polygonise(convert_float4(cube), a_maxFaces, a_faceCount, a_vertices, a_threshold, FIELD_PARAMS TABLE_PARAMS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// level of detail
+//
+// the grid is covered by the leaves of an octree of blocks, each
+// LOD_BLOCK_SIZE^3 cubes of 2^level samples on a side, with the host picking
+// the levels from the distance to the camera. marchingCubesLod polygonises
+// every cube of every block, a_blocks holding each block's lower corner in
+// xyz and its level in w.
+//
+// where a block borders blocks a level finer, the fine side's contour on the
+// shared face passes through the midpoints the coarse side skips and leaves
+// cracks. transitionCells stitches them transvoxel style, with one work-item
+// per coarse cube face on the border: the open edges the 4 fine cubes and
+// the coarse cube leave in the face are found from their own cases, so an
+// ambiguous face is split the way each side's triangles split it, and each
+// loop they form between the two levels is capped by clipping ears. the
+// transition cells have no depth, so unlike transvoxel the coarse cubes
+// aren't shrunk to make room for them and the caps lie in the shared face.
+
+#ifndef LOD_BLOCK_SIZE
+#define LOD_BLOCK_SIZE 16
+#endif
+#define LOD_BLOCK_VOLUME (LOD_BLOCK_SIZE * LOD_BLOCK_SIZE * LOD_BLOCK_SIZE)
+
+#if (LOD_BLOCK_SIZE & (LOD_BLOCK_SIZE - 1)) != 0
+#error LOD_BLOCK_SIZE must be a power of two
+#endif
+
+// the cube at cubeIndex within a block, in the same order as brickCube
+int4 lodBlockCube(int cubeIndex)
+{
+#ifdef MORTON_ORDER
+	return mortonDecode(cubeIndex);
+#else
+	return (int4)(cubeIndex % LOD_BLOCK_SIZE, (cubeIndex / LOD_BLOCK_SIZE) % LOD_BLOCK_SIZE, cubeIndex / (LOD_BLOCK_SIZE * LOD_BLOCK_SIZE), 0);
+#endif
+}
+
+kernel void marchingCubesLod(int a_maxFaces,
+							 global uint* a_faceCount, // atomic index into vertices
+							 global VERTEX_TYPE* a_vertices,
+							 float a_threshold,
+							 int4 a_gridSize,
+							 read_only global int4* a_blocks,
+							 FIELD_ARGS
+							 TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	// one work-item per cube of each block
+	uint id = get_global_id(0);
+	int4 block = a_blocks[id / LOD_BLOCK_VOLUME];
+	int cubeSize = 1 << block.w;
+	int4 cube = (int4)(block.xyz, 0) + lodBlockCube(id % LOD_BLOCK_VOLUME) * cubeSize;
+
+	// blocks on the far edges of the grid may be partially filled
+	if (cube.x >= a_gridSize.x || cube.y >= a_gridSize.y || cube.z >= a_gridSize.z)
+		return;
+
+	float cornerVolumes[8];
+	sampleCorners(convert_float4(cube), (float)cubeSize, cornerVolumes, FIELD_PARAMS);
+
+	polygoniseCorners(convert_float4(cube), (float)cubeSize, cornerVolumes, a_maxFaces, a_faceCount, a_vertices, a_threshold, 0, FIELD_PARAMS TABLE_PARAMS);
+}
+
+// a transition face has 3x3 samples, numbered x fastest, and 16 edges
+// between them: the 12 fine edges, first along x then along y, then the 4
+// coarse edges around the border. these are the samples at either end of
+// each edge
+constant int2 TRANSITION_EDGES[16] =
+{
+	{ 0, 1 }, { 1, 2 }, { 3, 4 }, { 4, 5 }, { 6, 7 }, { 7, 8 },
+	{ 0, 3 }, { 1, 4 }, { 2, 5 }, { 3, 6 }, { 4, 7 }, { 5, 8 },
+	{ 0, 2 }, { 2, 8 }, { 6, 8 }, { 0, 6 }
+};
+
+// each side of the face as its two fine edges and the coarse edge they split
+constant int TRANSITION_BORDERS[4][3] =
+{
+	{ 0, 1, 12 }, { 8, 11, 13 }, { 4, 5, 14 }, { 6, 9, 15 }
+};
+
+// the transition edge between two of the face's samples, or -1
+int transitionEdge(int a, int b)
+{
+	for (int i = 0; i < 16; ++i)
+		if (TRANSITION_EDGES[i].x == min(a, b) && TRANSITION_EDGES[i].y == max(a, b))
+			return i;
+	return -1;
+}
+
+// adds the sides of the gaps along the face that the cube with its lower
+// corner at cubeCorner leaves to the loop graph, where next holds the
+// crossing each one leads on to. the cube's triangles come from
+// TRIANGLE_TABLE, the same as polygoniseCorners, so an ambiguous face is
+// resolved the way the cube's case resolves it. a triangle side lying in the
+// face that no other triangle of the cube shares is on the surface's open
+// border, and the cap runs it the other way to face the same way
+void contourCubeFace(int* next,
+					 float4 cubeCorner,
+					 float cubeSize,
+					 float4 faceCorner,
+					 float4 across,
+					 float4 up,
+					 float4 normal,
+					 float sampleSpacing,
+					 float a_threshold,
+					 FIELD_ARGS)
+{
+	float cornerVolumes[8];
+	sampleCorners(cubeCorner, cubeSize, cornerVolumes, FIELD_PARAMS);
+	int flagIndex = cubeCase(cornerVolumes, a_threshold);
+
+	// the face sample at each corner of the cube, or -1 off the face
+	int faceSample[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		float4 p = cubeCorner + CUBE_CORNERS[i] * cubeSize - faceCorner;
+		faceSample[i] = dot(p.xyz, normal.xyz) != 0.0f ? -1 :
+			(int)(dot(p.xyz, across.xyz) / sampleSpacing) + 3 * (int)(dot(p.xyz, up.xyz) / sampleSpacing);
+	}
+
+	// the transition edge under each edge of the cube in the face
+	int faceEdge[12];
+	for (int i = 0; i < 12; ++i)
+	{
+		int a = faceSample[EDGE_INDICES[i][0]];
+		int b = faceSample[EDGE_INDICES[i][1]];
+		faceEdge[i] = a >= 0 && b >= 0 ? transitionEdge(a, b) : -1;
+	}
+
+	// triangle sides in the face, where a side two of the triangles share
+	// runs both ways and cancels out
+	int2 sides[15];
+	int sideCount = 0;
+	for (int t = 0; t < 15 && TRIANGLE_TABLE[flagIndex][t] >= 0; t += 3)
+	{
+		for (int v = 0; v < 3; ++v)
+		{
+			int a = faceEdge[TRIANGLE_TABLE[flagIndex][t + v]];
+			int b = faceEdge[TRIANGLE_TABLE[flagIndex][t + (v + 1) % 3]];
+			if (a < 0 || b < 0)
+				continue;
+
+			int shared = -1;
+			for (int i = 0; i < sideCount; ++i)
+				if (sides[i].x == b && sides[i].y == a)
+					shared = i;
+
+			if (shared >= 0)
+				sides[shared] = sides[--sideCount];
+			else
+				sides[sideCount++] = (int2)(a, b);
+		}
+	}
+
+	for (int i = 0; i < sideCount; ++i)
+		next[sides[i].y] = sides[i].x;
+}
+
+// twice the signed area of the triangle abc
+float triangleArea(float2 a, float2 b, float2 c)
+{
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// whether the corner at i of a polygon of count points can be clipped off as
+// an ear: it turns the same way as the polygon, whose signed area is area,
+// and none of the other points lie inside the triangle it cuts off
+bool isEar(const float2* points, int count, int i, float area)
+{
+	float2 a = points[(i + count - 1) % count];
+	float2 b = points[i];
+	float2 c = points[(i + 1) % count];
+	if (triangleArea(a, b, c) * area <= 0.0f)
+		return false;
+
+	for (int j = 0; j < count; ++j)
+	{
+		if (j == i || j == (i + 1) % count || j == (i + count - 1) % count)
+			continue;
+
+		if (triangleArea(a, b, points[j]) * area >= 0.0f &&
+			triangleArea(b, c, points[j]) * area >= 0.0f &&
+			triangleArea(c, a, points[j]) * area >= 0.0f)
+			return false;
+	}
+	return true;
+}
+
+kernel void transitionCells(int a_maxFaces,
+							global uint* a_faceCount, // atomic index into vertices
+							global VERTEX_TYPE* a_vertices,
+							float a_threshold,
+							int4 a_gridSize,
+							read_only global int4* a_blocks,
+							uint a_firstTransition, // a block's corner, its level and, from bit 8, the face
+							FIELD_ARGS)
+{
+	// one work-item per coarse cube face on each transition face, which
+	// follow the blocks
+	uint id = get_global_id(0);
+	int4 transition = a_blocks[a_firstTransition + id / (LOD_BLOCK_SIZE * LOD_BLOCK_SIZE)];
+	int level = transition.w & 0xff;
+	int face = transition.w >> 8;
+	int cell = id % (LOD_BLOCK_SIZE * LOD_BLOCK_SIZE);
+
+	// the face's normal axis and the two axes across it, with the face on the
+	// low or high side of the block along its normal
+	int axis = face >> 1;
+	int4 normal = (int4)(axis == 0, axis == 1, axis == 2, 0);
+	int4 across = (int4)(axis == 2, axis == 0, axis == 1, 0);
+	int4 up = (int4)(axis == 1, axis == 2, axis == 0, 0);
+
+	int cubeSize = 1 << level;
+	int4 corner = (int4)(transition.xyz, 0) + (across * (cell % LOD_BLOCK_SIZE) + up * (cell / LOD_BLOCK_SIZE) +
+		normal * (face & 1) * LOD_BLOCK_SIZE) * cubeSize;
+
+	// the coarse cube face has to be in the grid for there to be a crack
+	if (corner.x >= a_gridSize.x || corner.y >= a_gridSize.y || corner.z >= a_gridSize.z)
+		return;
+
+	// the fine blocks' samples are half as far apart
+	float4 samplePosition[9];
+	float sampleValue[9];
+	int inside = 0;
+	for (int i = 0; i < 9; ++i)
+	{
+		int4 p = corner + (across * (i % 3) + up * (i / 3)) * (cubeSize / 2);
+		samplePosition[i] = (float4)(convert_float4(p).xyz, 1.0f);
+		sampleValue[i] = sampleVolume(samplePosition[i], FIELD_PARAMS);
+		inside |= (sampleValue[i] <= a_threshold) << i;
+	}
+
+	// the loops the fine and coarse contours form around the gaps between
+	// them, as the crossing each one leads on to. the coarse cube is on the
+	// block's side of the face and the 4 fine cubes on the other
+	int next[16];
+	for (int i = 0; i < 16; ++i)
+		next[i] = -1;
+
+	float4 faceCorner = convert_float4(corner);
+	float4 acrossStep = convert_float4(across);
+	float4 upStep = convert_float4(up);
+	float4 normalStep = convert_float4(normal);
+	float fineSize = cubeSize / 2.0f;
+	contourCubeFace(next, faceCorner - normalStep * (float)((face & 1) * cubeSize), cubeSize, faceCorner,
+					acrossStep, upStep, normalStep, fineSize, a_threshold, FIELD_PARAMS);
+	for (int i = 0; i < 4; ++i)
+	{
+		float4 fineCorner = faceCorner + (acrossStep * (float)(i & 1) + upStep * (float)(i >> 1) - normalStep * (float)!(face & 1)) * fineSize;
+		contourCubeFace(next, fineCorner, fineSize, faceCorner, acrossStep, upStep, normalStep, fineSize, a_threshold, FIELD_PARAMS);
+	}
+
+	// along each side, the coarse crossing joins the fine one on the same
+	// half, or the two fine crossings join when the midpoint is on its own,
+	// leading into whichever already leads on
+	for (int i = 0; i < 4; ++i)
+	{
+		bool crossed[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			int2 edge = TRANSITION_EDGES[TRANSITION_BORDERS[i][j]];
+			crossed[j] = ((inside >> edge.x) ^ (inside >> edge.y)) & 1;
+		}
+
+		int a = -1, b = -1;
+		if (crossed[2])
+		{
+			a = TRANSITION_BORDERS[i][2];
+			b = TRANSITION_BORDERS[i][crossed[0] ? 0 : 1];
+		}
+		else if (crossed[0] && crossed[1])
+		{
+			a = TRANSITION_BORDERS[i][0];
+			b = TRANSITION_BORDERS[i][1];
+		}
+
+		if (a >= 0 && next[a] >= 0)
+			next[b] = a;
+		else if (a >= 0)
+			next[a] = b;
+	}
+
+	// where each crossed edge meets the surface, the same as polygoniseCorners
+	float4 edgePosition[16];
+	float4 edgeNormal[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		if (next[i] < 0)
+			continue;
+
+		int2 edge = TRANSITION_EDGES[i];
+		float delta = sampleValue[edge.y] - sampleValue[edge.x];
+		float offset = delta == 0.0f ? 0.5f : (a_threshold - sampleValue[edge.x]) / delta;
+		edgePosition[i] = mix(samplePosition[edge.x], samplePosition[edge.y], offset);
+		edgeNormal[i] = fieldNormal(edgePosition[i], FIELD_PARAMS);
+	}
+
+	// walk each loop once and cap it by clipping ears in the face, as a fan
+	// from one crossing would overlap itself where the loop isn't convex
+	int visited = 0;
+	for (int start = 0; start < 16; ++start)
+	{
+		if (next[start] < 0 || ((visited >> start) & 1))
+			continue;
+
+		int loop[16];
+		float2 points[16];
+		int loopLength = 0;
+		int node = start;
+		do
+		{
+			loop[loopLength] = node;
+			points[loopLength++] = (float2)(dot(edgePosition[node], acrossStep), dot(edgePosition[node], upStep));
+			visited |= 1 << node;
+			node = next[node];
+		} while (node >= 0 && node != start && loopLength < 16);
+
+		if (node != start || loopLength < 3)
+			continue;
+
+		float area = 0.0f;
+		for (int i = 2; i < loopLength; ++i)
+			area += triangleArea(points[0], points[i - 1], points[i]);
+
+		// counted whole even if it doesn't fit, the same as a cube's triangles
+		int triangleCount = loopLength - 2;
+		uint startFace = atomic_add(a_faceCount, triangleCount);
+		for (int t = 0; t < triangleCount; ++t)
+		{
+			// the first ear, or failing that a corner that at least turns the
+			// right way when the loop crosses itself
+			int count = loopLength - t;
+			int ear = -1;
+			for (int i = 0; ear < 0 && i < count; ++i)
+				if (isEar(points, count, i, area))
+					ear = i;
+			for (int i = 0; ear < 0 && i < count; ++i)
+				if (triangleArea(points[(i + count - 1) % count], points[i], points[(i + 1) % count]) * area > 0.0f)
+					ear = i;
+			ear = max(ear, 0);
+
+			if (startFace + t < a_maxFaces)
+			{
+				uint vertex = (startFace + t) * 3;
+				int a = loop[(ear + count - 1) % count];
+				int b = loop[ear];
+				int c = loop[(ear + 1) % count];
+				writeVertex(a_vertices, vertex, edgePosition[a], edgeNormal[a]);
+				writeVertex(a_vertices, vertex + 1, edgePosition[b], edgeNormal[b]);
+				writeVertex(a_vertices, vertex + 2, edgePosition[c], edgeNormal[c]);
+			}
+
+			for (int i = ear; i < count - 1; ++i)
+			{
+				loop[i] = loop[i + 1];
+				points[i] = points[i + 1];
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// surface nets
+//
+// a dual alternative to marching cubes: a vertex inside each cube the
+// surface crosses, and a quad joining the four cubes around each crossed
+// edge. that is about one vertex per crossed cube rather than up to 15, and
+// the quads avoid the slivers of the marching cubes cases. sampleField caches
+// the field at every sample of the grid, so the later passes read the
+// samples rather than evaluate the field again. flagNetCubes writes a 1 for
+// every crossed cube, which the host scans into each cube's vertex index.
+// placeNetVertices then places the vertices, and netQuads writes two
+// triangles for every crossed edge. the vertex buffer is sized by the host
+// from the count of an earlier frame, so vertices beyond its capacity are
+// dropped along with the quads that use them until it has grown.
+//
+// a vertex sits at the mean of its cube's edge crossings. with
+// DUAL_CONTOURING it minimises the quadric error of the crossings' tangent
+// planes instead, which keeps sharp features. QEF_REGULARISATION pulls that
+// point towards the mean, and it is clamped to the cube.
+
+#ifndef QEF_REGULARISATION
+#define QEF_REGULARISATION 0.05f
+#endif
+
+// cached samples, one more than the grid has cubes along each side
+int sampleIndex(int4 p, int4 a_gridSize)
+{
+	return p.x + (a_gridSize.x + 1) * (p.y + (a_gridSize.y + 1) * p.z);
+}
+
+int cubeIndex(int4 cube, int4 a_gridSize)
+{
+	return cube.x + a_gridSize.x * (cube.y + a_gridSize.y * cube.z);
+}
+
+// the cached samples at the 8 corners of a cube
+void loadCorners(int4 cube, int4 a_gridSize, global const float* a_samples, float* cornerVolumes)
+{
+	for (int i = 0; i < 8; ++i)
+		cornerVolumes[i] = a_samples[sampleIndex(cube + convert_int4(CUBE_CORNERS[i]), a_gridSize)];
+}
+
+// the point closest to the planes through each crossing along its normal,
+// in the least squares sense, pulled towards the mass point so that flat and
+// gently curved patches, where the planes don't pin down a single point,
+// still have a solution
+float4 solveQef(const float4* positions, const float4* normals, int count, float4 massPoint)
+{
+	// normal equations (A^T A + r I) x = A^T b, relative to the mass point
+	float a00 = QEF_REGULARISATION, a01 = 0, a02 = 0;
+	float a11 = QEF_REGULARISATION, a12 = 0, a22 = QEF_REGULARISATION;
+	float4 b = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		float4 n = normals[i];
+		float d = dot(n.xyz, (positions[i] - massPoint).xyz);
+		a00 += n.x * n.x;	a01 += n.x * n.y;	a02 += n.x * n.z;
+		a11 += n.y * n.y;	a12 += n.y * n.z;	a22 += n.z * n.z;
+		b += n * d;
+	}
+
+	// the system is symmetric positive definite, so inverting it through its
+	// cofactors is safe
+	float c00 = a11 * a22 - a12 * a12;
+	float c01 = a02 * a12 - a01 * a22;
+	float c02 = a01 * a12 - a02 * a11;
+	float c11 = a00 * a22 - a02 * a02;
+	float c12 = a01 * a02 - a00 * a12;
+	float c22 = a00 * a11 - a01 * a01;
+	float det = a00 * c00 + a01 * c01 + a02 * c02;
+
+	float4 x;
+	x.x = (c00 * b.x + c01 * b.y + c02 * b.z) / det;
+	x.y = (c01 * b.x + c11 * b.y + c12 * b.z) / det;
+	x.z = (c02 * b.x + c12 * b.y + c22 * b.z) / det;
+	x.w = 0;
+	return massPoint + x;
+}
+
+kernel void sampleField(int4 a_gridSize,
+						global float* a_samples,
+						FIELD_ARGS)
+{
+	int4 p = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+	a_samples[sampleIndex(p, a_gridSize)] = sampleVolume(convert_float4(p), FIELD_PARAMS);
+}
+
+kernel void flagNetCubes(float a_threshold,
+						 int4 a_gridSize,
+						 global const float* a_samples,
+						 global uint* a_cubeVertex) // 1 for crossed cubes, scanned into vertex indices
+{
+	int4 cube = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+
+	float cornerVolumes[8];
+	loadCorners(cube, a_gridSize, a_samples, cornerVolumes);
+	int flagIndex = cubeCase(cornerVolumes, a_threshold);
+
+	a_cubeVertex[cubeIndex(cube, a_gridSize)] = flagIndex != 0 && flagIndex != 255;
+}
+
+kernel void placeNetVertices(float a_threshold,
+							 int4 a_gridSize,
+							 global const float* a_samples,
+							 global const uint* a_cubeVertex,
+							 global float4* a_netVertices, // position and normal of each vertex
+							 uint a_vertexCapacity,
+							 FIELD_ARGS)
+{
+	int4 cube = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+
+	float cornerVolumes[8];
+	loadCorners(cube, a_gridSize, a_samples, cornerVolumes);
+	int flagIndex = cubeCase(cornerVolumes, a_threshold);
+	if (flagIndex == 0 || flagIndex == 255)
+		return;
+
+	uint vertex = a_cubeVertex[cubeIndex(cube, a_gridSize)];
+	if (vertex >= a_vertexCapacity)
+		return;
+
+	float4 cubeCorner = convert_float4(cube);
+	float4 massPoint = 0;
+	int crossingCount = 0;
+#ifdef DUAL_CONTOURING
+	float4 crossingPosition[12];
+	float4 crossingNormal[12];
+#endif
+
+	for (int edgeIndex = 0; edgeIndex < 12; ++edgeIndex)
+	{
+		float start = cornerVolumes[ EDGE_INDICES[ edgeIndex ][0] ];
+		float end = cornerVolumes[ EDGE_INDICES[ edgeIndex ][1] ];
+		if ((start <= a_threshold) == (end <= a_threshold))
+			continue;
+
+		// the ends are on either side of the threshold, so never equal
+		float offset = (a_threshold - start) / (end - start);
+		float4 position = cubeCorner + CUBE_CORNERS[ EDGE_INDICES[ edgeIndex ][0] ] + EDGE_DIRECTIONS[ edgeIndex ] * offset;
+
+#ifdef DUAL_CONTOURING
+		crossingPosition[crossingCount] = position;
+		crossingNormal[crossingCount] = fieldNormal(position, FIELD_PARAMS);
+#endif
+		massPoint += position;
+		++crossingCount;
+	}
+	massPoint /= (float)crossingCount;
+
+	float4 position = massPoint;
+#ifdef DUAL_CONTOURING
+	position = solveQef(crossingPosition, crossingNormal, crossingCount, massPoint);
+	position = clamp(position, cubeCorner + CUBE_CORNERS[0], cubeCorner + CUBE_CORNERS[6]);
+#endif
+
+	a_netVertices[vertex * 2] = position;
+	a_netVertices[vertex * 2 + 1] = fieldNormal(position, FIELD_PARAMS);
+}
+
+// one work-item per sample, taking the edges from it towards +x, +y and +z.
+// edges on the faces of the grid don't have four cubes around them, so they
+// are left open, as marching cubes leaves them
+kernel void netQuads(int a_maxFaces,
+					 write_only global uint* a_faceCount, // atomic index into vertices
+					 write_only global VERTEX_TYPE* a_vertices,
+					 float a_threshold,
+					 int4 a_gridSize,
+					 global const float* a_samples,
+					 global const uint* a_cubeVertex,
+					 global const float4* a_netVertices,
+					 uint a_vertexCapacity)
+{
+	int4 p = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+	bool below = a_samples[sampleIndex(p, a_gridSize)] <= a_threshold;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		// the edge and the two axes across it, with u x v along the edge
+		int4 along = (int4)(axis == 0, axis == 1, axis == 2, 0);
+		int4 u = (int4)(axis == 2, axis == 0, axis == 1, 0);
+		int4 v = (int4)(axis == 1, axis == 2, axis == 0, 0);
+
+		if (any((p - u - v).xyz < 0))
+			continue;
+
+		bool endBelow = a_samples[sampleIndex(p + along, a_gridSize)] <= a_threshold;
+		if (below == endBelow)
+			continue;
+
+		// the cubes around the edge, anticlockwise looking back along it
+		uint quad[4];
+		quad[0] = a_cubeVertex[cubeIndex(p - u - v, a_gridSize)];
+		quad[1] = a_cubeVertex[cubeIndex(p - v, a_gridSize)];
+		quad[2] = a_cubeVertex[cubeIndex(p, a_gridSize)];
+		quad[3] = a_cubeVertex[cubeIndex(p - u, a_gridSize)];
+		if (max(max(quad[0], quad[1]), max(quad[2], quad[3])) >= a_vertexCapacity)
+			continue;
+
+		// wound to face the side below the threshold, as the marching cubes
+		// triangles and the field normals do
+		int loop[4] = { 0, 1, 2, 3 };
+		if (!endBelow)
+		{
+			loop[1] = 3;
+			loop[3] = 1;
+		}
+
+		float4 position[4];
+		float4 normal[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			position[i] = a_netVertices[quad[loop[i]] * 2];
+			normal[i] = a_netVertices[quad[loop[i]] * 2 + 1];
+		}
+
+		// split across the shorter diagonal
+		int corners[6] = { 0, 1, 2, 0, 2, 3 };
+		float4 diagonal02 = position[2] - position[0];
+		float4 diagonal13 = position[3] - position[1];
+		if (dot(diagonal02, diagonal02) > dot(diagonal13, diagonal13))
+		{
+			corners[2] = 3;
+			corners[3] = 1;
+		}
+
+		// counted whole even if it doesn't fit, the same as a cube's triangles
+		uint startFace = atomic_add(a_faceCount, 2);
+		for (int t = 0; t < 2; ++t)
+		{
+			if (startFace + t >= a_maxFaces)
+				break;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				int corner = corners[t * 3 + i];
+				writeVertex(a_vertices, (startFace + t) * 3 + i, position[corner], normal[corner]);
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ray casting
+//
+// draws the isosurface straight into an image rather than extracting it, so
+// the cost follows the pixels rather than the triangles. the field is cached
+// with sampleField, and boundSampleBricks finds the range of the samples
+// within each BRICK_SIZE^3 brick of cubes, which bounds the interpolated
+// field too. castRays walks each pixel's ray through the bricks, skipping
+// those whose range can't contain the threshold and marching through the
+// rest RAY_STEP cubes at a time. the first step to cross the threshold is
+// narrowed down by RAY_BISECTIONS bisections, and the hit is shaded the way
+// the meshes are.
+
+#ifndef RAY_STEP
+#define RAY_STEP 0.5f
+#endif
+#ifndef RAY_BISECTIONS
+#define RAY_BISECTIONS 8
+#endif
+
+// trilinear interpolation of the cached samples, clamped to the grid
+float sampleCache(float3 v, int4 a_gridSize, global const float* a_samples)
+{
+	float3 gridMax = convert_float3(a_gridSize.xyz);
+	v = clamp(v, (float3)(0), gridMax);
+	float3 base = min(floor(v), gridMax - 1);
+	float3 t = v - base;
+	int4 p = (int4)(convert_int3(base), 0);
+
+	float c00 = mix(a_samples[sampleIndex(p, a_gridSize)], a_samples[sampleIndex(p + (int4)(1, 0, 0, 0), a_gridSize)], t.x);
+	float c10 = mix(a_samples[sampleIndex(p + (int4)(0, 1, 0, 0), a_gridSize)], a_samples[sampleIndex(p + (int4)(1, 1, 0, 0), a_gridSize)], t.x);
+	float c01 = mix(a_samples[sampleIndex(p + (int4)(0, 0, 1, 0), a_gridSize)], a_samples[sampleIndex(p + (int4)(1, 0, 1, 0), a_gridSize)], t.x);
+	float c11 = mix(a_samples[sampleIndex(p + (int4)(0, 1, 1, 0), a_gridSize)], a_samples[sampleIndex(p + (int4)(1, 1, 1, 0), a_gridSize)], t.x);
+
+	return mix(mix(c00, c10, t.y), mix(c01, c11, t.y), t.z);
+}
+
+// surface normal from central differences of the cached samples, pointing
+// down the field like fieldNormal
+float3 cacheNormal(float3 v, int4 a_gridSize, global const float* a_samples)
+{
+	float3 normal;
+	normal.x = sampleCache(v - (float3)(0.5f, 0, 0), a_gridSize, a_samples) - sampleCache(v + (float3)(0.5f, 0, 0), a_gridSize, a_samples);
+	normal.y = sampleCache(v - (float3)(0, 0.5f, 0), a_gridSize, a_samples) - sampleCache(v + (float3)(0, 0.5f, 0), a_gridSize, a_samples);
+	normal.z = sampleCache(v - (float3)(0, 0, 0.5f), a_gridSize, a_samples) - sampleCache(v + (float3)(0, 0, 0.5f), a_gridSize, a_samples);
+
+	if (dot(normal, normal) > 0)
+		normal = normalize(normal);
+	return normal;
+}
+
+// m * v for a column-major matrix as glm stores it, divided through by w
+float4 transformPoint(float16 m, float4 v)
+{
+	float4 r = m.s0123 * v.x + m.s4567 * v.y + m.s89ab * v.z + m.scdef * v.w;
+	return r / r.w;
+}
+
+kernel void boundSampleBricks(int4 a_gridSize,
+							  global const float* a_samples,
+							  global float2* a_brickRanges) // smallest and largest sample
+{
+	int4 brick = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+
+	// a brick's last samples are the next one's first, so that neighbouring
+	// bricks that are both skipped agree on which side of the threshold
+	// the ray is
+	int4 first = brick * BRICK_SIZE;
+	int4 last = min(first + BRICK_SIZE, a_gridSize);
+
+	float2 range = (float2)(INFINITY, -INFINITY);
+	for (int z = first.z; z <= last.z; ++z)
+	for (int y = first.y; y <= last.y; ++y)
+	for (int x = first.x; x <= last.x; ++x)
+	{
+		float sample = a_samples[sampleIndex((int4)(x, y, z, 0), a_gridSize)];
+		range = (float2)(min(range.x, sample), max(range.y, sample));
+	}
+
+	a_brickRanges[brick.x + get_global_size(0) * (brick.y + get_global_size(1) * brick.z)] = range;
+}
+
+// distance along the ray to its first crossing of the threshold between
+// tEnter and tExit, or -1 if it doesn't cross
+float traceRay(float3 origin,
+			   float3 direction,
+			   float tEnter,
+			   float tExit,
+			   float a_threshold,
+			   int4 a_gridSize,
+			   int4 a_brickCount,
+			   global const float* a_samples,
+			   global const float2* a_brickRanges)
+{
+	// walk the bricks in the order the ray passes through them (amanatides
+	// and woo), tMax being where it leaves the current brick along each axis
+	// and tDelta how far it travels across a whole brick
+	int3 brick = clamp(convert_int3(floor((origin + direction * tEnter) / BRICK_SIZE)), (int3)(0), a_brickCount.xyz - 1);
+	int3 stepDir = select((int3)(-1), (int3)(1), direction >= 0);
+	float3 boundary = convert_float3(brick + max(stepDir, 0)) * BRICK_SIZE;
+	float3 tMax = select((float3)(INFINITY), (boundary - origin) / direction, direction != 0);
+	float3 tDelta = select((float3)(INFINITY), BRICK_SIZE / fabs(direction), direction != 0);
+
+	float t = tEnter;
+	bool previousBelow = sampleCache(origin + direction * t, a_gridSize, a_samples) <= a_threshold;
+	while (true)
+	{
+		float tBrickExit = fmin(fmin(fmin(tMax.x, tMax.y), tMax.z), tExit);
+		float2 range = a_brickRanges[brick.x + a_brickCount.x * (brick.y + a_brickCount.y * brick.z)];
+		if (range.x <= a_threshold && range.y > a_threshold)
+		{
+			// march through the brick, landing exactly on its far side
+			while (t < tBrickExit)
+			{
+				float tNext = fmin(t + RAY_STEP, tBrickExit);
+				bool below = sampleCache(origin + direction * tNext, a_gridSize, a_samples) <= a_threshold;
+				if (below != previousBelow)
+				{
+					// the crossing is between t and tNext, halve the gap around it
+					for (int i = 0; i < RAY_BISECTIONS; ++i)
+					{
+						float tMiddle = 0.5f * (t + tNext);
+						if ((sampleCache(origin + direction * tMiddle, a_gridSize, a_samples) <= a_threshold) == previousBelow)
+							t = tMiddle;
+						else
+							tNext = tMiddle;
+					}
+					return 0.5f * (t + tNext);
+				}
+				t = tNext;
+			}
+		}
+		else
+		{
+			// every sample in the brick is on the same side of the threshold
+			previousBelow = range.y <= a_threshold;
+			t = tBrickExit;
+		}
+
+		if (tBrickExit >= tExit)
+			return -1.0f;
+
+		// on into whichever neighbouring brick the ray reaches first
+		if (tMax.x <= tMax.y && tMax.x <= tMax.z)
+		{
+			brick.x += stepDir.x;
+			tMax.x += tDelta.x;
+		}
+		else if (tMax.y <= tMax.z)
+		{
+			brick.y += stepDir.y;
+			tMax.y += tDelta.y;
+		}
+		else
+		{
+			brick.z += stepDir.z;
+			tMax.z += tDelta.z;
+		}
+		if (any(brick < 0) || any(brick >= a_brickCount.xyz))
+			return -1.0f;
+	}
+}
+
+kernel void castRays(write_only image2d_t a_image,
+					 float16 a_inversePvm, // clip space back to the grid
+					 float a_threshold,
+					 int4 a_gridSize,
+					 int4 a_brickCount,
+					 global const float* a_samples,
+					 global const float2* a_brickRanges)
+{
+	int2 pixel = (int2)(get_global_id(0), get_global_id(1));
+	float2 ndc = (convert_float2(pixel) + 0.5f) / convert_float2(get_image_dim(a_image)) * 2 - 1;
+
+	// the ray runs from the pixel on the near plane towards it on the far plane
+	float3 origin = transformPoint(a_inversePvm, (float4)(ndc, -1, 1)).xyz;
+	float3 direction = normalize(transformPoint(a_inversePvm, (float4)(ndc, 1, 1)).xyz - origin);
+
+	// clip it to the grid, the slab test copes with the infinite reciprocals
+	// of axis-aligned rays
+	float3 inverseDirection = 1.0f / direction;
+	float3 t0 = -origin * inverseDirection;
+	float3 t1 = (convert_float3(a_gridSize.xyz) - origin) * inverseDirection;
+	float3 tNear = fmin(t0, t1);
+	float3 tFar = fmax(t0, t1);
+	float tEnter = fmax(fmax(tNear.x, tNear.y), fmax(tNear.z, 0.0f));
+	float tExit = fmin(fmin(tFar.x, tFar.y), tFar.z);
+
+	float4 colour = (float4)(0, 0, 0, 1);
+	float tHit = tEnter < tExit ? traceRay(origin, direction, tEnter, tExit, a_threshold, a_gridSize, a_brickCount, a_samples, a_brickRanges) : -1.0f;
+	if (tHit >= 0)
+	{
+		// the same shading as the extracted meshes get
+		float3 normal = cacheNormal(origin + direction * tHit, a_gridSize, a_samples);
+		float d = dot(normal, normalize((float3)(1)));
+		float3 dark = (float3)(0, 0, 0.75f);
+		float3 light = (float3)(0, 0.75f, 1);
+		colour.xyz = dark + (light - dark) * d;
+	}
+
+	write_imagef(a_image, pixel, colour);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// volume filtering
+//
+// smooths a FIELD_VOLUME's raw samples before extraction with separable
+// filters, one pass along each axis. a work-group is a tile of lines along
+// a_axis that it copies into a_tile, with a_radius samples either side
+// clamped to the edge, so each sample is read from global memory about
+// once however wide the filter. the median takes the median of 3 along each
+// axis in turn, an approximation of the 3x3x3 median that keeps it separable.
+
+#ifdef FIELD_VOLUME
+
+// must match VolumeFilterType on the host
+#define FILTER_BOX 0
+#define FILTER_GAUSSIAN 1
+#define FILTER_MEDIAN 2
+
+kernel void filterVolume(read_only global VOLUME_TYPE* a_source,
+						 global VOLUME_TYPE* a_destination,
+						 int4 a_dims,
+						 int a_axis,
+						 int a_filter,
+						 int a_radius,
+						 float a_sigma,
+						 local float* a_tile)
+{
+	int4 p = (int4)(get_global_id(0), get_global_id(1), get_global_id(2), 0);
+	int4 l = (int4)(get_local_id(0), get_local_id(1), get_local_id(2), 0);
+	int4 size = (int4)(get_local_size(0), get_local_size(1), get_local_size(2), 1);
+
+	// the work-item's place along the axis, and the line of the tile it's on
+	int4 axis = (int4)(a_axis == 0, a_axis == 1, a_axis == 2, 0);
+	int along = l.x * axis.x + l.y * axis.y + l.z * axis.z;
+	int length = size.x * axis.x + size.y * axis.y + size.z * axis.z;
+	int line = a_axis == 0 ? l.y + l.z * size.y : (a_axis == 1 ? l.x + l.z * size.x : l.x + l.y * size.x);
+
+	// work-items past the far edges still load for their neighbours
+	int4 q = min(p, a_dims - 1);
+	int coordinate = q.x * axis.x + q.y * axis.y + q.z * axis.z;
+	int dim = a_dims.x * axis.x + a_dims.y * axis.y + a_dims.z * axis.z;
+	int start = p.x * axis.x + p.y * axis.y + p.z * axis.z - along - a_radius;
+
+	int span = length + 2 * a_radius;
+	local float* samples = a_tile + line * span;
+	for (int i = along; i < span; i += length)
+	{
+		int4 s = q + axis * (clamp(start + i, 0, dim - 1) - coordinate);
+		samples[i] = convert_float(a_source[s.x + (s.y + (size_t)s.z * a_dims.y) * a_dims.x]);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (any(p.xyz >= a_dims.xyz))
+		return;
+
+	int centre = along + a_radius;
+	float value;
+	if (a_filter == FILTER_MEDIAN)
+	{
+		float a = samples[centre - 1];
+		float b = samples[centre];
+		float c = samples[centre + 1];
+		value = max(min(a, b), min(max(a, b), c));
+	}
+	else
+	{
+		// the weights are cheaper to recompute than to fetch
+		float sum = 0;
+		float weightSum = 0;
+		for (int i = -a_radius; i <= a_radius; ++i)
+		{
+			float weight = a_filter == FILTER_GAUSSIAN ? exp(-0.5f * i * i / (a_sigma * a_sigma)) : 1.0f;
+			sum += samples[centre + i] * weight;
+			weightSum += weight;
+		}
+		value = sum / weightSum;
+	}
+
+	a_destination[p.x + (p.y + (size_t)p.z * a_dims.y) * a_dims.x] = VOLUME_STORE(value);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// multiple isovalues
+//
+// nested surfaces at up to 8 isovalues from a single pass over the field.
+// each cube samples its corners once and polygonises them against every
+// level, so the field is only paid for once however many there are. level
+// n's triangles are appended to its own a_maxFaces range of the vertex
+// buffer, counted in a_faceCounts[n], with n in their normals' w.
+
+kernel void marchingCubesLevels(int a_maxFaces,
+								global uint* a_faceCounts,
+								global VERTEX_TYPE* a_vertices,
+								float8 a_thresholds,
+								int a_levelCount,
+								FIELD_ARGS
+								TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	float4 cubeCorner = (float4)(get_global_id(0), get_global_id(1), get_global_id(2), 0.0f);
+
+	float cornerVolumes[8];
+	sampleCorners(cubeCorner, 1.0f, cornerVolumes, FIELD_PARAMS);
+
+	// a level outside the corners' range leaves the cube all inside or all outside
+	float lowest = cornerVolumes[0];
+	float highest = cornerVolumes[0];
+	for (int i = 1; i < 8; ++i)
+	{
+		lowest = min(lowest, cornerVolumes[i]);
+		highest = max(highest, cornerVolumes[i]);
+	}
+
+	float thresholds[8];
+	vstore8(a_thresholds, 0, thresholds);
+	for (int level = 0; level < a_levelCount; ++level)
+	{
+		if (thresholds[level] < lowest || thresholds[level] >= highest)
+			continue;
+
+		global VERTEX_TYPE* vertices = a_vertices + (size_t)level * a_maxFaces * 3 * VERTEX_STRIDE;
+		polygoniseCorners(cubeCorner, 1.0f, cornerVolumes, a_maxFaces, &a_faceCounts[level], vertices,
+						  thresholds[level], level, FIELD_PARAMS TABLE_PARAMS);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// sparse voxel hashing
+//
+// rather than a fixed grid, the field is sampled only in the bricks the
+// surface passes through, which are tracked in a pool of blocks of
+// (BRICK_SIZE + 1)^3 samples, enough for a brick's BRICK_SIZE^3 cubes.
+// an open-addressing hash table maps each brick's packed coordinates to its
+// block, and is claimed with atomic_cmpxchg so that any number of work-items
+// can allocate at once without locks. blocks are taken from and given back
+// to a stack of free ones.
+//
+// each frame the table is rebuilt from the live blocks, the bricks the
+// particles' surfaces cross are seeded, and then listSparseBricks,
+// sampleSparseBricks and growSparseBricks repeat, allocating the bricks
+// across any face the surface crosses, for a fixed number of passes.
+// collectSparseBricks frees the blocks the surface has left and lists the
+// rest for marchingCubesSparse, so the memory and the work follow the area
+// of the surface rather than the volume it sits in. the host never waits for
+// the counts, so the kernels that work through a list are launched over the
+// whole pool and the work-items past the list's count return straight away.
+
+#define SPARSE_SIDE (BRICK_SIZE + 1)
+#define SPARSE_SAMPLES (SPARSE_SIDE * SPARSE_SIDE * SPARSE_SIDE)
+
+// bricks are packed like packBrick, biased so they can go negative
+#define SPARSE_BIAS 512
+#define SPARSE_EMPTY 0xffffffff
+
+// samples walked from each seed looking for its surface
+#define SPARSE_SEED_STEPS 256
+
+// what a block of the pool holds
+#define SPARSE_FREE 0
+#define SPARSE_NEW 1		// allocated but not yet sampled this frame
+#define SPARSE_SAMPLED 2
+
+// a_counters: free blocks, listed blocks, active blocks and failed allocations
+#define SPARSE_FREE_COUNT 0
+#define SPARSE_LIST_COUNT 1
+#define SPARSE_ACTIVE_COUNT 2
+#define SPARSE_FAILED_COUNT 3
+
+// the brick containing a cube, rounding down for negative cubes
+int4 sparseBrickOf(int4 cube)
+{
+	return convert_int4(floor(convert_float4(cube) / (float)BRICK_SIZE));
+}
+
+// SPARSE_EMPTY for bricks outside the range the key can hold
+uint sparseKey(int4 brick)
+{
+	int4 biased = brick + SPARSE_BIAS;
+	if (any(biased.xyz < 0) || any(biased.xyz >= 2 * SPARSE_BIAS))
+		return SPARSE_EMPTY;
+	return packBrick((uint)biased.x, (uint)biased.y, (uint)biased.z);
+}
+
+int4 sparseBrick(uint key)
+{
+	return unpackBrick(key) - (int4)(SPARSE_BIAS, SPARSE_BIAS, SPARSE_BIAS, 0);
+}
+
+// neighbouring bricks have neighbouring keys, so they're mixed before
+// they're masked to keep them from probing along the same run of slots
+uint sparseHash(uint key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+// the sample at x, y, z of a block
+uint sparseSample(int block, int x, int y, int z)
+{
+	return (uint)block * SPARSE_SAMPLES + x + SPARSE_SIDE * (y + SPARSE_SIDE * z);
+}
+
+// what claimSparseSlot returns when it doesn't claim a slot
+#define SPARSE_PRESENT -1
+#define SPARSE_TABLE_FULL -2
+
+// claims a slot for key, returning it, SPARSE_PRESENT if key already has one
+// or SPARSE_TABLE_FULL if every slot is taken
+int claimSparseSlot(uint key, global uint* a_tableKeys, uint a_tableMask)
+{
+	uint slot = sparseHash(key) & a_tableMask;
+	for (uint probe = 0; probe <= a_tableMask; ++probe)
+	{
+		uint found = atomic_cmpxchg(&a_tableKeys[slot], SPARSE_EMPTY, key);
+		if (found == SPARSE_EMPTY)
+			return (int)slot;
+		if (found == key)
+			return SPARSE_PRESENT;
+		slot = (slot + 1) & a_tableMask;
+	}
+	return SPARSE_TABLE_FULL;
+}
+
+// allocates a block for brick unless it already has one, counting a failure
+// if the table or the pool has run out
+void insertSparseBrick(int4 brick,
+					   global uint* a_tableKeys,
+					   uint a_tableMask,
+					   global uint* a_blockKeys,
+					   global uint* a_blockStates,
+					   global int* a_freeList,
+					   global int* a_counters)
+{
+	uint key = sparseKey(brick);
+	if (key == SPARSE_EMPTY)
+		return;
+
+	// only the work-item that claims the slot allocates. a full table fails
+	// like a full pool, so the pool and the table with it grow
+	int slot = claimSparseSlot(key, a_tableKeys, a_tableMask);
+	if (slot == SPARSE_TABLE_FULL)
+		atomic_inc(&a_counters[SPARSE_FAILED_COUNT]);
+	if (slot < 0)
+		return;
+
+	// pop a free block, putting the count back if there were none
+	int block = -1;
+	int freeCount = atomic_dec(&a_counters[SPARSE_FREE_COUNT]);
+	if (freeCount > 0)
+		block = a_freeList[freeCount - 1];
+	else
+	{
+		atomic_inc(&a_counters[SPARSE_FREE_COUNT]);
+		atomic_inc(&a_counters[SPARSE_FAILED_COUNT]);
+	}
+
+	if (block >= 0)
+	{
+		a_blockKeys[block] = key;
+		a_blockStates[block] = SPARSE_NEW;
+	}
+}
+
+// one work-item per block added to the pool when it grows, stacking them on
+// the free list
+kernel void freeSparseBlocks(int a_firstBlock,
+							 global int* a_freeList,
+							 global int* a_counters)
+{
+	a_freeList[atomic_inc(&a_counters[SPARSE_FREE_COUNT])] = a_firstBlock + get_global_id(0);
+}
+
+// one work-item per block of the pool, putting the live ones back in the
+// emptied table and marking them to be sampled again
+kernel void rebuildSparseHash(global uint* a_tableKeys,
+							  uint a_tableMask,
+							  read_only global uint* a_blockKeys,
+							  global uint* a_blockStates)
+{
+	int block = get_global_id(0);
+	uint key = a_blockKeys[block];
+	if (key == SPARSE_EMPTY)
+		return;
+
+	// the keys are unique and the table has twice the slots of the pool, so
+	// there's always an empty slot for it
+	claimSparseSlot(key, a_tableKeys, a_tableMask);
+	a_blockStates[block] = SPARSE_NEW;
+}
+
+// one work-item per seed, walking along x from the sample nearest to it
+// until the field falls to the threshold and allocating the brick of the
+// first crossed edge. the metaballs peak at their particles, so every blob
+// gets a brick even before the surface has been found by growing
+kernel void seedSparseBricks(float a_threshold,
+							 int a_seedCount,
+							 read_only global float4* a_seeds,
+							 global uint* a_tableKeys,
+							 uint a_tableMask,
+							 global uint* a_blockKeys,
+							 global uint* a_blockStates,
+							 global int* a_freeList,
+							 global int* a_counters,
+							 FIELD_ARGS)
+{
+	int seed = get_global_id(0);
+	if (seed >= a_seedCount)
+		return;
+
+	int4 cube = convert_int4_rte(a_seeds[seed]);
+	cube.w = 0;
+	if (sampleVolume(convert_float4(cube), FIELD_PARAMS) <= a_threshold)
+		return;
+
+	for (int step = 0; step < SPARSE_SEED_STEPS; ++step)
+	{
+		int4 next = cube + (int4)(1, 0, 0, 0);
+		if (sampleVolume(convert_float4(next), FIELD_PARAMS) <= a_threshold)
+		{
+			// the edge belongs to the cube at its lower end
+			insertSparseBrick(sparseBrickOf(cube), a_tableKeys, a_tableMask,
+							  a_blockKeys, a_blockStates, a_freeList, a_counters);
+			return;
+		}
+		cube = next;
+	}
+}
+
+// one work-item per block of the pool, listing those still to be sampled
+kernel void listSparseBricks(global uint* a_blockStates,
+							 global int* a_list,
+							 global int* a_counters)
+{
+	int block = get_global_id(0);
+	if (a_blockStates[block] != SPARSE_NEW)
+		return;
+
+	a_blockStates[block] = SPARSE_SAMPLED;
+	a_list[atomic_inc(&a_counters[SPARSE_LIST_COUNT])] = block;
+}
+
+// one work-item per sample of each block of the pool, sampling the listed ones
+kernel void sampleSparseBricks(read_only global int* a_list,
+							   read_only global uint* a_blockKeys,
+							   global float* a_samples,
+							   read_only global int* a_counters,
+							   FIELD_ARGS)
+{
+	uint id = get_global_id(0);
+	if (id / SPARSE_SAMPLES >= (uint)a_counters[SPARSE_LIST_COUNT])
+		return;
+
+	int block = a_list[id / SPARSE_SAMPLES];
+	int index = id % SPARSE_SAMPLES;
+
+	int4 sample = sparseBrick(a_blockKeys[block]) * BRICK_SIZE +
+		(int4)(index % SPARSE_SIDE, (index / SPARSE_SIDE) % SPARSE_SIDE, index / (SPARSE_SIDE * SPARSE_SIDE), 0);
+	a_samples[(uint)block * SPARSE_SAMPLES + index] = sampleVolume(convert_float4(sample), FIELD_PARAMS);
+}
+
+// one work-item per face of each block of the pool, allocating the brick
+// across a listed block's face if the surface crosses it. the face's samples
+// are shared with that brick, so its cubes next to the face are crossed too
+kernel void growSparseBricks(float a_threshold,
+							 read_only global int* a_list,
+							 read_only global float* a_samples,
+							 global uint* a_tableKeys,
+							 uint a_tableMask,
+							 global uint* a_blockKeys,
+							 global uint* a_blockStates,
+							 global int* a_freeList,
+							 global int* a_counters)
+{
+	// the allocations below add to the free and failed counts but never the
+	// listed one, so it's the same for every work-item
+	uint id = get_global_id(0);
+	if (id / 6 >= (uint)a_counters[SPARSE_LIST_COUNT])
+		return;
+
+	int block = a_list[id / 6];
+	int face = id % 6;
+	int axis = face >> 1;
+	int layer = (face & 1) ? BRICK_SIZE : 0;
+
+	bool inside = false;
+	bool outside = false;
+	for (int v = 0; v < SPARSE_SIDE; ++v)
+	for (int u = 0; u < SPARSE_SIDE; ++u)
+	{
+		int4 p = axis == 0 ? (int4)(layer, u, v, 0) : axis == 1 ? (int4)(u, layer, v, 0) : (int4)(u, v, layer, 0);
+		float value = a_samples[sparseSample(block, p.x, p.y, p.z)];
+		outside |= value <= a_threshold;
+		inside |= value > a_threshold;
+	}
+	if (!inside || !outside)
+		return;
+
+	int4 brick = sparseBrick(a_blockKeys[block]);
+	int4 direction = (int4)(axis == 0, axis == 1, axis == 2, 0);
+	brick += (face & 1) ? direction : -direction;
+	insertSparseBrick(brick, a_tableKeys, a_tableMask,
+					  a_blockKeys, a_blockStates, a_freeList, a_counters);
+}
+
+// one work-item per block of the pool, freeing the sampled blocks the
+// surface doesn't cross and listing the rest to be polygonised. blocks
+// allocated too late to be sampled are kept for the next frame
+kernel void collectSparseBricks(float a_threshold,
+								read_only global float* a_samples,
+								global uint* a_blockKeys,
+								global uint* a_blockStates,
+								global int* a_freeList,
+								global int* a_counters,
+								global int* a_activeList)
+{
+	int block = get_global_id(0);
+	if (a_blockStates[block] != SPARSE_SAMPLED)
+		return;
+
+	bool inside = false;
+	bool outside = false;
+	for (int i = 0; i < SPARSE_SAMPLES; ++i)
+	{
+		float value = a_samples[(uint)block * SPARSE_SAMPLES + i];
+		outside |= value <= a_threshold;
+		inside |= value > a_threshold;
+	}
+
+	if (inside && outside)
+		a_activeList[atomic_inc(&a_counters[SPARSE_ACTIVE_COUNT])] = block;
+	else
+	{
+		a_blockKeys[block] = SPARSE_EMPTY;
+		a_blockStates[block] = SPARSE_FREE;
+		a_freeList[atomic_inc(&a_counters[SPARSE_FREE_COUNT])] = block;
+	}
+}
+
+// one work-item per cube of each block of the pool, polygonising the active
+// ones from the block's samples rather than the field
+kernel void marchingCubesSparse(int a_maxFaces,
+								global uint* a_faceCount, // atomic index into vertices
+								global VERTEX_TYPE* a_vertices,
+								float a_threshold,
+								read_only global int* a_activeList,
+								read_only global uint* a_blockKeys,
+								read_only global float* a_samples,
+								read_only global int* a_counters,
+								FIELD_ARGS
+								TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	uint id = get_global_id(0);
+	if (id / BRICK_VOLUME >= (uint)a_counters[SPARSE_ACTIVE_COUNT])
+		return;
+
+	int block = a_activeList[id / BRICK_VOLUME];
+
+	// the brick at 0 gives the cube within the brick in the usual order
+	int4 cube = brickCube(0, id % BRICK_VOLUME);
+
+	float cornerVolumes[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		int4 corner = cube + convert_int4(CUBE_CORNERS[i]);
+		cornerVolumes[i] = a_samples[sparseSample(block, corner.x, corner.y, corner.z)];
+	}
+
+	float4 cubeCorner = convert_float4(sparseBrick(a_blockKeys[block]) * BRICK_SIZE + cube);
+	polygoniseCorners(cubeCorner, 1.0f, cornerVolumes, a_maxFaces, a_faceCount, a_vertices, a_threshold, 0, FIELD_PARAMS TABLE_PARAMS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// incremental extraction
+//
+// only the bricks whose field has changed since they were last polygonised
+// are extracted again, each into its own range of a pooled vertex buffer
+// that the host allocates. countBrickFaces counts the triangles each dirty
+// brick needs so the host can size its range, then marchingCubesDirtyBricks
+// fills the ranges. both run one work-item per cube of each dirty brick.
+
+kernel void countBrickFaces(float a_threshold,
+							int4 a_gridSize,
+							read_only global uint* a_dirtyBricks,
+							global uint* a_brickFaces, // atomic count per dirty brick
+							FIELD_ARGS
+							TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	uint id = get_global_id(0);
+	uint dirty = id / BRICK_VOLUME;
+	int4 cube = brickCube(a_dirtyBricks[dirty], id % BRICK_VOLUME);
+
+	// bricks on the far edges of the grid may be partially filled
+	if (cube.x >= a_gridSize.x || cube.y >= a_gridSize.y || cube.z >= a_gridSize.z)
+		return;
+
+	float cornerVolumes[8];
+	sampleCorners(convert_float4(cube), 1.0f, cornerVolumes, FIELD_PARAMS);
+
+	int triangleCount = (int)caseEntry(cubeCase(cornerVolumes, a_threshold) TABLE_PARAMS).w;
+	if (triangleCount > 0)
+		atomic_add(&a_brickFaces[dirty], triangleCount);
+}
+
+kernel void marchingCubesDirtyBricks(global uint* a_brickCursor, // atomic index into each dirty brick's range
+									 global VERTEX_TYPE* a_vertices,
+									 float a_threshold,
+									 int4 a_gridSize,
+									 read_only global uint* a_dirtyBricks,
+									 read_only global uint2* a_brickRanges, // first face and face count of each range
+									 FIELD_ARGS
+									 TABLE_KERNEL_ARGS)
+{
+	LOAD_TABLES
+
+	uint id = get_global_id(0);
+	uint dirty = id / BRICK_VOLUME;
+	uint2 range = a_brickRanges[dirty];
+
+	// bricks the surface has left have no range
+	if (range.y == 0)
+		return;
+
+	int4 cube = brickCube(a_dirtyBricks[dirty], id % BRICK_VOLUME);
+	if (cube.x >= a_gridSize.x || cube.y >= a_gridSize.y || cube.z >= a_gridSize.z)
+		return;
+
+	polygonise(convert_float4(cube), (int)range.y, &a_brickCursor[dirty], a_vertices + range.x * 3 * VERTEX_STRIDE,
+			   a_threshold, FIELD_PARAMS TABLE_PARAMS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// indirect draw
+//
+// writes the face count straight into an opengl DrawArraysIndirectCommand
+// { count, instanceCount, first, baseInstance } so that the host never has
+// to read it back before drawing. run as a single work-item.
+
+kernel void writeDrawCommand(int a_maxFaces,
+							 read_only global uint* a_faceCount,
+							 write_only global uint* a_command)
+{
+	// the face count keeps counting past the end of the buffer, so clamp it
+	a_command[0] = min(*a_faceCount, (uint)a_maxFaces) * 3;
+	a_command[1] = 1;
+	a_command[2] = 0;
+	a_command[3] = 0;
+}
@@ -0,0 +1,100 @@
+#include "bins.h"
+#include <math.h>
+
+bool createBins(BinData& bins, cl_context context, cl_program program,
+				const size_t gridSize[3], cl_float radius, cl_int particleCount)
+{
+	cl_int result = CL_SUCCESS;
+
+	bins.radius = radius;
+	bins.cellCount = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		bins.cellDims[i] = (cl_int)ceil(gridSize[i] / radius);
+		bins.cellCount *= bins.cellDims[i];
+	}
+	bins.cellDims[3] = 0;
+
+	bins.binKernel = clCreateKernel(program, "binParticles", &result);
+	CL_CHECK(clCreateKernel, result);
+	bins.scatterKernel = clCreateKernel(program, "scatterParticles", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	bins.cellCountLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * bins.cellCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	bins.cellStartLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * bins.cellCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	bins.particleCellLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * particleCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	bins.particleRankLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * particleCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	bins.sortedParticleLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float4) * particleCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	if (!createScan(bins.scan, context, program, bins.cellCount))
+		return false;
+
+	result = clSetKernelArg(bins.binKernel, 2, sizeof(cl_float), &bins.radius);
+	result |= clSetKernelArg(bins.binKernel, 3, sizeof(cl_int) * 4, bins.cellDims);
+	result |= clSetKernelArg(bins.binKernel, 4, sizeof(cl_mem), &bins.cellCountLink);
+	result |= clSetKernelArg(bins.binKernel, 5, sizeof(cl_mem), &bins.particleCellLink);
+	result |= clSetKernelArg(bins.binKernel, 6, sizeof(cl_mem), &bins.particleRankLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(bins.scatterKernel, 2, sizeof(cl_mem), &bins.particleCellLink);
+	result |= clSetKernelArg(bins.scatterKernel, 3, sizeof(cl_mem), &bins.particleRankLink);
+	result |= clSetKernelArg(bins.scatterKernel, 4, sizeof(cl_mem), &bins.cellStartLink);
+	result |= clSetKernelArg(bins.scatterKernel, 5, sizeof(cl_mem), &bins.sortedParticleLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseBins(BinData& bins)
+{
+	releaseScan(bins.scan);
+	clReleaseMemObject(bins.sortedParticleLink);
+	clReleaseMemObject(bins.particleRankLink);
+	clReleaseMemObject(bins.particleCellLink);
+	clReleaseMemObject(bins.cellStartLink);
+	clReleaseMemObject(bins.cellCountLink);
+	clReleaseKernel(bins.scatterKernel);
+	clReleaseKernel(bins.binKernel);
+}
+
+void enqueueBinParticles(cl_command_queue queue, BinData& bins, cl_mem particleLink, cl_int particleCount,
+						 cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+	size_t globalWorkSize = particleCount;
+	cl_event events[4] = { 0, 0, 0, 0 };
+
+	// empty the cells
+	cl_uint zero = 0;
+	result = clEnqueueFillBuffer(queue, bins.cellCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * bins.cellCount, numWaitEvents, waitEvents, &events[0]);
+	CL_CHECK(clEnqueueFillBuffer, result);
+
+	// count the particles within each cell, ranking them as we go
+	result = clSetKernelArg(bins.binKernel, 0, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(bins.binKernel, 1, sizeof(cl_mem), &particleLink);
+	CL_CHECK(clSetKernelArg, result);
+	result = clEnqueueNDRangeKernel(queue, bins.binKernel, 1, 0, &globalWorkSize, 0, 1, &events[0], &events[1]);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	// cell start offsets are the exclusive sum of the counts
+	result = clEnqueueCopyBuffer(queue, bins.cellCountLink, bins.cellStartLink, 0, 0, sizeof(cl_uint) * bins.cellCount, 1, &events[1], &events[2]);
+	CL_CHECK(clEnqueueCopyBuffer, result);
+	enqueueScan(queue, bins.scan, bins.cellStartLink, bins.cellCount, 1, &events[2], &events[3]);
+
+	// write each particle into its cell's range
+	result = clSetKernelArg(bins.scatterKernel, 0, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(bins.scatterKernel, 1, sizeof(cl_mem), &particleLink);
+	CL_CHECK(clSetKernelArg, result);
+	result = clEnqueueNDRangeKernel(queue, bins.scatterKernel, 1, 0, &globalWorkSize, 0, 1, &events[3], event);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	for (int i = 0; i < 4; ++i)
+		clReleaseEvent(events[i]);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "scan.h"
+
+// uniform grid of cells used to bin particles for the compact-support field
+// cells are the size of the kernel radius so a sample only needs to visit
+// the cells within one radius of it
+struct BinData
+{
+	cl_kernel	binKernel;
+	cl_kernel	scatterKernel;
+	ScanData	scan;
+
+	cl_float	radius;
+	cl_int		cellDims[4];
+	size_t		cellCount;
+
+	cl_mem		cellCountLink;
+	cl_mem		cellStartLink;
+	cl_mem		particleCellLink;
+	cl_mem		particleRankLink;
+	cl_mem		sortedParticleLink;
+};
+
+// creates the cell grid covering a volume of gridSize samples for up to particleCount particles
+bool createBins(BinData& bins, cl_context context, cl_program program,
+				const size_t gridSize[3], cl_float radius, cl_int particleCount);
+void releaseBins(BinData& bins);
+
+// counting sort of particleLink into the cells, leaving the binned particles
+// in sortedParticleLink and each cell's range in cellStartLink / cellCountLink
+void enqueueBinParticles(cl_command_queue queue, BinData& bins, cl_mem particleLink, cl_int particleCount,
+						 cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
@@ -0,0 +1,36 @@
+#pragma once
+
+// CL_HEADLESS leaves out opengl, for the tools that share the extraction
+// modules without a window
+#if defined(__APPLE__) || defined(MACOSX)
+    #include <OpenCL/cl.h>
+    #include <OpenCL/cl_gl_ext.h>
+	#ifndef CL_HEADLESS
+	#include <OpenGL/OpenGL.h>
+	#endif
+#elif defined(WIN32)
+	#include <CL/cl.h>
+	#include <CL/cl_gl_ext.h>
+	#ifndef CL_HEADLESS
+	#include <GL/GL.h>
+	#include <windows.h>
+	#endif
+#else
+	#ifndef CL_HEADLESS
+	#include <GL/glx.h>
+	#include <GL/gl.h>
+	#endif
+	#include <CL/cl.h>
+	#include <CL/cl_gl.h>
+#endif
+
+#include <stdio.h>
+
+// helper macros for checking for opencl errors
+#define CL_CHECK(str, result) if (result != CL_SUCCESS) { printf("Error: %s - %i\n", #str, result); }
+
+// on windows / linux we need to get access to the extension function handle to determine which
+// device is sharable as the opencl / opengl context
+#if !defined(__APPLE__) && !defined(MACOSX)
+	typedef CL_API_ENTRY cl_int (CL_API_CALL *clGetGLContextInfoKHRfunc)(const cl_context_properties*,cl_gl_context_info,size_t,void*,size_t*);
+#endif
@@ -0,0 +1,249 @@
+#include "cpumc.h"
+#include "mctables.h"
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPUMC_SSE2
+#include <emmintrin.h>
+#endif
+
+// the kernel's float4 tables, as glm
+static const glm::vec4 CUBE_CORNERS[8] =
+{
+	glm::vec4(0, 0, 0, 1), glm::vec4(1, 0, 0, 1), glm::vec4(1, 1, 0, 1), glm::vec4(0, 1, 0, 1),
+	glm::vec4(0, 0, 1, 1), glm::vec4(1, 0, 1, 1), glm::vec4(1, 1, 1, 1), glm::vec4(0, 1, 1, 1)
+};
+
+static const glm::vec4 EDGE_DIRECTIONS[12] =
+{
+	glm::vec4(1, 0, 0, 0), glm::vec4(0, 1, 0, 0), glm::vec4(-1, 0, 0, 0), glm::vec4(0, -1, 0, 0),
+	glm::vec4(1, 0, 0, 0), glm::vec4(0, 1, 0, 0), glm::vec4(-1, 0, 0, 0), glm::vec4(0, -1, 0, 0),
+	glm::vec4(0, 0, 1, 0), glm::vec4(0, 0, 1, 0), glm::vec4(0, 0, 1, 0), glm::vec4(0, 0, 1, 0)
+};
+
+void createCPUMC(CPUMCData& data, unsigned int threadCount, size_t slabDepth)
+{
+	createThreadPool(data.pool, threadCount);
+	data.slabDepth = slabDepth;
+}
+
+void releaseCPUMC(CPUMCData& data)
+{
+	releaseThreadPool(data.pool);
+	data.slabVertices.clear();
+}
+
+// metaball field, matching sampleVolume in the kernel
+static float sampleMetaballs(const glm::vec4& v, const glm::vec4* particles, int particleCount)
+{
+	float d = 0;
+	for (int i = 0; i < particleCount; ++i)
+	{
+		glm::vec3 vp = glm::vec3(v) - glm::vec3(particles[i]);
+		d += 1.0f / glm::dot(vp, vp);
+	}
+	return d;
+}
+
+struct SlabField
+{
+	size_t				gridSize[3];
+	float				threshold;
+	const glm::vec4*	particles;
+	int					particleCount;
+};
+
+// samples a plane of (gridSize.x + 1) * (gridSize.y + 1) corners at sample z, and flags
+// those at or below the threshold with 1 as the kernel does when classifying corners
+static void samplePlane(const SlabField& field, size_t z, float* values, int* below)
+{
+	size_t width = field.gridSize[0] + 1;
+	for (size_t y = 0; y <= field.gridSize[1]; ++y)
+	{
+		float* rowValues = values + y * width;
+		int* rowBelow = below + y * width;
+
+		size_t x = 0;
+#ifdef CPUMC_SSE2
+		// four corners along x at a time
+		const __m128 threshold = _mm_set1_ps(field.threshold);
+		const __m128i one = _mm_set1_epi32(1);
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128 xs = _mm_set_ps((float)x + 3, (float)x + 2, (float)x + 1, (float)x);
+			__m128 d = _mm_setzero_ps();
+			for (int i = 0; i < field.particleCount; ++i)
+			{
+				const glm::vec4& p = field.particles[i];
+				float dy = y - p.y;
+				float dz = z - p.z;
+				__m128 dx = _mm_sub_ps(xs, _mm_set1_ps(p.x));
+				__m128 distanceSqr = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_set1_ps(dy * dy + dz * dz));
+				d = _mm_add_ps(d, _mm_div_ps(_mm_set1_ps(1.0f), distanceSqr));
+			}
+
+			_mm_storeu_ps(rowValues + x, d);
+			_mm_storeu_si128((__m128i*)(rowBelow + x), _mm_and_si128(_mm_castps_si128(_mm_cmple_ps(d, threshold)), one));
+		}
+#endif
+		for (; x < width; ++x)
+		{
+			rowValues[x] = sampleMetaballs(glm::vec4(x, y, z, 1), field.particles, field.particleCount);
+			rowBelow[x] = rowValues[x] <= field.threshold ? 1 : 0;
+		}
+	}
+}
+
+// builds the 8-bit case index of a row of cubes from the below flags of the four rows of corners around it
+static void classifyRow(const int* below0, const int* below1, const int* below2, const int* below3,
+						size_t cubes, int* cubeIndices)
+{
+	// corners 0-3 run around the lower face of the cube and 4-7 around the upper face
+	// below0 / below1 are rows y and y + 1 of the lower plane, below2 / below3 of the upper plane
+	size_t x = 0;
+#ifdef CPUMC_SSE2
+	for (; x + 4 <= cubes; x += 4)
+	{
+		__m128i index = _mm_loadu_si128((const __m128i*)(below0 + x));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below0 + x + 1)), 1));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below1 + x + 1)), 2));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below1 + x)), 3));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below2 + x)), 4));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below2 + x + 1)), 5));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below3 + x + 1)), 6));
+		index = _mm_or_si128(index, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(below3 + x)), 7));
+		_mm_storeu_si128((__m128i*)(cubeIndices + x), index);
+	}
+#endif
+	for (; x < cubes; ++x)
+	{
+		cubeIndices[x] = below0[x] | (below0[x + 1] << 1) | (below1[x + 1] << 2) | (below1[x] << 3) |
+			(below2[x] << 4) | (below2[x + 1] << 5) | (below3[x + 1] << 6) | (below3[x] << 7);
+	}
+}
+
+// polygonise a single cube from its corner values, the same as polygoniseCorners in the kernel
+static void polygonise(const SlabField& field, const glm::vec4& cubeCorner, const float* cornerVolumes,
+					   int flagIndex, std::vector<glm::vec4>& vertices)
+{
+	glm::vec4 edgePosition[12];
+	glm::vec4 edgeNormal[12];
+
+	for (int edgeIndex = 0; edgeIndex < 12; ++edgeIndex)
+	{
+		if ((EDGE_FLAGS[flagIndex] & (1 << edgeIndex)) == 0)
+			continue;
+
+		float delta = cornerVolumes[EDGE_INDICES[edgeIndex][1]] - cornerVolumes[EDGE_INDICES[edgeIndex][0]];
+		float offset = delta == 0.0f ? 0.5f : (field.threshold - cornerVolumes[EDGE_INDICES[edgeIndex][0]]) / delta;
+
+		glm::vec4 p = cubeCorner + (CUBE_CORNERS[EDGE_INDICES[edgeIndex][0]] + EDGE_DIRECTIONS[edgeIndex] * offset);
+		edgePosition[edgeIndex] = p;
+
+		// central differences, pointing away from the denser field
+		glm::vec4 n;
+		n.x = sampleMetaballs(p - glm::vec4(0.01f, 0, 0, 0), field.particles, field.particleCount) -
+			sampleMetaballs(p + glm::vec4(0.01f, 0, 0, 0), field.particles, field.particleCount);
+		n.y = sampleMetaballs(p - glm::vec4(0, 0.01f, 0, 0), field.particles, field.particleCount) -
+			sampleMetaballs(p + glm::vec4(0, 0.01f, 0, 0), field.particles, field.particleCount);
+		n.z = sampleMetaballs(p - glm::vec4(0, 0, 0.01f, 0), field.particles, field.particleCount) -
+			sampleMetaballs(p + glm::vec4(0, 0, 0.01f, 0), field.particles, field.particleCount);
+		n.w = 0;
+
+		if (glm::dot(n, n) > 0)
+			n = glm::normalize(n);
+		edgeNormal[edgeIndex] = n;
+	}
+
+	for (int triangleIndex = 0; triangleIndex < 5 && TRIANGLE_TABLE[flagIndex][3 * triangleIndex] >= 0; ++triangleIndex)
+	{
+		for (int triangleVertex = 0; triangleVertex < 3; ++triangleVertex)
+		{
+			int vertexIndex = TRIANGLE_TABLE[flagIndex][3 * triangleIndex + triangleVertex];
+			vertices.push_back(edgePosition[vertexIndex]);
+			vertices.push_back(edgeNormal[vertexIndex]);
+		}
+	}
+}
+
+// polygonises the cubes from z0 up to z1, two planes of corners at a time
+static void polygoniseSlab(const SlabField& field, size_t z0, size_t z1, std::vector<glm::vec4>& vertices)
+{
+	size_t width = field.gridSize[0] + 1;
+	size_t planeSize = width * (field.gridSize[1] + 1);
+
+	std::vector<float> values[2] = { std::vector<float>(planeSize), std::vector<float>(planeSize) };
+	std::vector<int> below[2] = { std::vector<int>(planeSize), std::vector<int>(planeSize) };
+	std::vector<int> cubeIndices(field.gridSize[0]);
+
+	int lower = 0;
+	samplePlane(field, z0, values[lower].data(), below[lower].data());
+	for (size_t z = z0; z < z1; ++z)
+	{
+		int upper = 1 - lower;
+		samplePlane(field, z + 1, values[upper].data(), below[upper].data());
+
+		for (size_t y = 0; y < field.gridSize[1]; ++y)
+		{
+			size_t row = y * width;
+			classifyRow(below[lower].data() + row, below[lower].data() + row + width,
+						below[upper].data() + row, below[upper].data() + row + width,
+						field.gridSize[0], cubeIndices.data());
+
+			for (size_t x = 0; x < field.gridSize[0]; ++x)
+			{
+				int flagIndex = cubeIndices[x];
+				if (EDGE_FLAGS[flagIndex] == 0)
+					continue;
+
+				const float* v0 = values[lower].data() + row + x;
+				const float* v1 = values[upper].data() + row + x;
+				float cornerVolumes[8] = { v0[0], v0[1], v0[width + 1], v0[width], v1[0], v1[1], v1[width + 1], v1[width] };
+
+				polygonise(field, glm::vec4(x, y, z, 0), cornerVolumes, flagIndex, vertices);
+			}
+		}
+
+		lower = upper;
+	}
+}
+
+size_t cpuMarchingCubes(CPUMCData& data, const size_t gridSize[3], float threshold,
+						const glm::vec4* particles, int particleCount,
+						size_t maxFaces, glm::vec4* vertices)
+{
+	SlabField field = { { gridSize[0], gridSize[1], gridSize[2] }, threshold, particles, particleCount };
+
+	// a few slabs per thread so that uneven slabs still balance out
+	size_t slabDepth = data.slabDepth;
+	if (slabDepth == 0)
+		slabDepth = std::max(gridSize[2] / ((data.pool.threads.size() + 1) * 4), (size_t)1);
+	size_t slabCount = (gridSize[2] + slabDepth - 1) / slabDepth;
+
+	if (data.slabVertices.size() < slabCount)
+		data.slabVertices.resize(slabCount);
+
+	runJobs(data.pool, slabCount, [&](size_t slab)
+	{
+		std::vector<glm::vec4>& slabVertices = data.slabVertices[slab];
+		slabVertices.clear();
+		polygoniseSlab(field, slab * slabDepth, std::min((slab + 1) * slabDepth, gridSize[2]), slabVertices);
+	});
+
+	// concatenate in slab order, dropping whatever doesn't fit but still counting it
+	size_t faceCount = 0;
+	for (size_t slab = 0; slab < slabCount; ++slab)
+	{
+		const std::vector<glm::vec4>& slabVertices = data.slabVertices[slab];
+		size_t slabFaces = slabVertices.size() / 6;
+		if (faceCount < maxFaces)
+		{
+			size_t copyFaces = std::min(slabFaces, maxFaces - faceCount);
+			memcpy(vertices + faceCount * 6, slabVertices.data(), sizeof(glm::vec4) * 6 * copyFaces);
+		}
+		faceCount += slabFaces;
+	}
+
+	return faceCount;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "threadpool.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// cpu reference implementation of the marching cubes kernel over the default
+// metaball field, using the same lookup tables (mctables.h) and writing the
+// same output of a float4 position and float4 normal per vertex.
+//
+// the grid is split into slabs of slabDepth cubes along z which are
+// polygonised in parallel. each slab samples the field a plane of corners at
+// a time, so corners are shared between neighbouring cubes, and classifies a
+// row of cubes at a time with SSE2 where it is available. slabs append to
+// their own vertex lists, which are then concatenated in slab order, so the
+// output is deterministic.
+struct CPUMCData
+{
+	ThreadPool								pool;
+	size_t									slabDepth;		// 0 picks a few slabs per thread
+	std::vector<std::vector<glm::vec4>>		slabVertices;	// kept between calls to reuse their allocations
+};
+
+void createCPUMC(CPUMCData& data, unsigned int threadCount, size_t slabDepth);
+void releaseCPUMC(CPUMCData& data);
+
+// polygonises the field into vertices, which has room for maxFaces triangles
+// (6 vec4s each). like the kernel it returns the number of triangles the
+// surface needed, even when only the first maxFaces were written
+size_t cpuMarchingCubes(CPUMCData& data, const size_t gridSize[3], float threshold,
+						const glm::vec4* particles, int particleCount,
+						size_t maxFaces, glm::vec4* vertices);
@@ -0,0 +1,527 @@
+#include "export.h"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <math.h>
+#include <string.h>
+
+// float positions within this many cubes of each other on every axis are
+// welded, well above the float error between neighbouring cubes' copies of an
+// edge vertex. compact copies can round to neighbouring 16-bit steps instead,
+// which are gridSize / 65535 cubes apart and so further than this past a 64^3
+// grid, so they're welded within a step
+static const float WELD_DISTANCE = 1.0f / 1024.0f;
+
+struct WeldKey
+{
+	int x, y, z;
+
+	bool operator == (const WeldKey& other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct WeldKeyHash
+{
+	size_t operator () (const WeldKey& key) const
+	{
+		return (size_t)key.x * 73856093u ^ (size_t)key.y * 19349663u ^ (size_t)key.z * 83492791u;
+	}
+};
+
+// vertices decoded from the staging buffer and the triangles indexing them
+struct ExportMesh
+{
+	std::vector<float>			positions;	// xyz per vertex
+	std::vector<float>			normals;
+	std::vector<unsigned int>	indices;	// 3 per triangle
+};
+
+static void writerThread(MeshExporter* exporter);
+
+bool createExporter(MeshExporter& exporter, cl_context context, cl_command_queue queue, const char* path, bool weld,
+					float simplifyRatio, float simplifyError)
+{
+	exporter.context = context;
+	exporter.queue = queue;
+	exporter.weld = weld;
+	exporter.nextFrame = 0;
+	exporter.quit = false;
+
+	// collapsing edges needs the triangles to share their vertices
+	exporter.simplify = weld && (simplifyRatio < 1.0f || simplifyError > 0.0f);
+	exporter.simplifyRatio = simplifyRatio;
+	exporter.simplifySettings.targetTriangles = 0;
+	exporter.simplifySettings.maxError = simplifyError;
+	exporter.simplifySettings.cellsPerAxis = 0;
+	exporter.simplifySettings.maxPasses = 0;
+	if (exporter.simplify)
+		createThreadPool(exporter.simplifyPool, 0);
+
+	// the format follows the extension, binary PLY unless asked for OBJ
+	std::string fullPath = path;
+	size_t dot = fullPath.find_last_of('.');
+	size_t slash = fullPath.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+	{
+		exporter.basePath = fullPath.substr(0, dot);
+		exporter.extension = fullPath.substr(dot);
+	}
+	else
+	{
+		exporter.basePath = fullPath;
+		exporter.extension = ".ply";
+	}
+
+	std::string extension = exporter.extension;
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	exporter.format = extension == ".obj" ? EXPORT_OBJ : EXPORT_PLY;
+
+	for (int i = 0; i < EXPORT_BUFFERS; ++i)
+	{
+		exporter.staging[i].link = 0;
+		exporter.staging[i].data = nullptr;
+		exporter.staging[i].size = 0;
+		exporter.staging[i].busy = false;
+	}
+
+	exporter.thread = std::thread(writerThread, &exporter);
+
+	return true;
+}
+
+void releaseExporter(MeshExporter& exporter)
+{
+	{
+		std::lock_guard<std::mutex> lock(exporter.mutex);
+		exporter.quit = true;
+	}
+	exporter.wake.notify_one();
+	exporter.thread.join();
+
+	if (exporter.simplify)
+		releaseThreadPool(exporter.simplifyPool);
+
+	for (int i = 0; i < EXPORT_BUFFERS; ++i)
+	{
+		if (exporter.staging[i].link == 0)
+			continue;
+
+		clEnqueueUnmapMemObject(exporter.queue, exporter.staging[i].link, exporter.staging[i].data, 0, nullptr, nullptr);
+		clReleaseMemObject(exporter.staging[i].link);
+	}
+	clFinish(exporter.queue);
+}
+
+// waits for a free staging buffer of at least size bytes, returns -1 if it can't be allocated
+static int acquireStaging(MeshExporter& exporter, size_t size)
+{
+	int index = -1;
+	{
+		std::unique_lock<std::mutex> lock(exporter.mutex);
+		for (;;)
+		{
+			for (int i = 0; i < EXPORT_BUFFERS && index < 0; ++i)
+				if (!exporter.staging[i].busy)
+					index = i;
+			if (index >= 0)
+				break;
+
+			// the writer is behind, which only stalls the capture
+			exporter.stagingFree.wait(lock);
+		}
+		exporter.staging[index].busy = true;
+	}
+
+	ExportStaging& staging = exporter.staging[index];
+	if (size <= staging.size)
+		return index;
+
+	// grow with some headroom so an animated surface doesn't reallocate every frame
+	cl_int result = CL_SUCCESS;
+	if (staging.link != 0)
+	{
+		clEnqueueUnmapMemObject(exporter.queue, staging.link, staging.data, 0, nullptr, nullptr);
+		clReleaseMemObject(staging.link);
+	}
+	staging.size = size + size / 2;
+
+	// allocating through opencl and mapping gives us pinned host memory the device can copy straight into
+	staging.link = clCreateBuffer(exporter.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, staging.size, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result == CL_SUCCESS)
+	{
+		staging.data = clEnqueueMapBuffer(exporter.queue, staging.link, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, staging.size, 0, nullptr, nullptr, &result);
+		CL_CHECK(clEnqueueMapBuffer, result);
+	}
+
+	if (result != CL_SUCCESS)
+	{
+		if (staging.link != 0)
+			clReleaseMemObject(staging.link);
+		staging.link = 0;
+		staging.data = nullptr;
+		staging.size = 0;
+
+		std::lock_guard<std::mutex> lock(exporter.mutex);
+		staging.busy = false;
+		return -1;
+	}
+
+	return index;
+}
+
+static void queueJob(MeshExporter& exporter, const ExportJob& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(exporter.mutex);
+		exporter.jobs.push_back(job);
+	}
+	exporter.wake.notify_one();
+}
+
+static std::string nextPath(MeshExporter& exporter)
+{
+	char frame[16];
+	sprintf(frame, "_%04i", exporter.nextFrame++);
+	return exporter.basePath + frame + exporter.extension;
+}
+
+bool exportSurface(MeshExporter& exporter, cl_mem vertices, size_t faceCount, size_t vertexSize,
+				   bool compact, float positionScale, cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* readEvent)
+{
+	cl_int result = CL_SUCCESS;
+	size_t size = faceCount * 3 * vertexSize;
+
+	int index = acquireStaging(exporter, std::max(size, (size_t)1));
+	if (index < 0)
+	{
+		printf("Unable to stage %u triangles for export\n", (unsigned int)faceCount);
+		return false;
+	}
+
+	ExportJob job = { index, 0, nextPath(exporter), faceCount, compact, positionScale };
+
+	// an empty surface still needs an event to order the release against
+	if (size > 0)
+	{
+		result = clEnqueueReadBuffer(exporter.queue, vertices, CL_FALSE, 0, size, exporter.staging[index].data, numWaitEvents, waitEvents, &job.readEvent);
+		CL_CHECK(clEnqueueReadBuffer, result);
+	}
+	else
+	{
+		result = clEnqueueMarkerWithWaitList(exporter.queue, numWaitEvents, waitEvents, &job.readEvent);
+		CL_CHECK(clEnqueueMarkerWithWaitList, result);
+	}
+
+	// the writer waits on the read itself
+	*readEvent = job.readEvent;
+	clRetainEvent(job.readEvent);
+	clFlush(exporter.queue);
+
+	queueJob(exporter, job);
+	return true;
+}
+
+bool exportSurface(MeshExporter& exporter, const cl_float4* vertices, size_t faceCount)
+{
+	size_t size = faceCount * 6 * sizeof(cl_float4);
+
+	int index = acquireStaging(exporter, std::max(size, (size_t)1));
+	if (index < 0)
+	{
+		printf("Unable to stage %u triangles for export\n", (unsigned int)faceCount);
+		return false;
+	}
+
+	memcpy(exporter.staging[index].data, vertices, size);
+
+	ExportJob job = { index, 0, nextPath(exporter), faceCount, false, 1.0f };
+	queueJob(exporter, job);
+	return true;
+}
+
+// inverse of the kernel's octahedralEncode
+static void octahedralDecode(float x, float y, float* n)
+{
+	n[0] = x;
+	n[1] = y;
+	n[2] = 1.0f - fabs(x) - fabs(y);
+
+	// unfold the lower hemisphere
+	if (n[2] < 0)
+	{
+		n[0] = (1.0f - fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+		n[1] = (1.0f - fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+	}
+
+	float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (length > 0)
+		for (int i = 0; i < 3; ++i)
+			n[i] /= length;
+}
+
+static void decodeVertex(const ExportJob& job, const void* data, size_t vertex, float* position, float* normal)
+{
+	if (job.compact)
+	{
+		const cl_uint* v = (const cl_uint*)data + vertex * 3;
+		position[0] = (v[0] & 0xffff) / job.positionScale;
+		position[1] = (v[0] >> 16) / job.positionScale;
+		position[2] = (v[1] & 0xffff) / job.positionScale;
+		octahedralDecode((short)(v[2] & 0xffff) / 32767.0f, (short)(v[2] >> 16) / 32767.0f, normal);
+	}
+	else
+	{
+		const cl_float4* v = (const cl_float4*)data + vertex * 2;
+		memcpy(position, &v[0], sizeof(float) * 3);
+		memcpy(normal, &v[1], sizeof(float) * 3);
+	}
+}
+
+// the welded vertex within distance of position on every axis, or -1. the
+// vertices are bucketed into cells distance across, so a match is always in
+// the cell of position or one of the cells around it, whichever side of a
+// cell boundary the two copies fall
+static int findWelded(const std::unordered_multimap<WeldKey, unsigned int, WeldKeyHash>& welded,
+					  const std::vector<float>& positions, const WeldKey& cell, const float* position, float distance)
+{
+	for (int z = -1; z <= 1; ++z)
+	for (int y = -1; y <= 1; ++y)
+	for (int x = -1; x <= 1; ++x)
+	{
+		WeldKey key = { cell.x + x, cell.y + y, cell.z + z };
+		auto range = welded.equal_range(key);
+		for (auto found = range.first; found != range.second; ++found)
+		{
+			const float* other = &positions[found->second * 3];
+			if (fabs(other[0] - position[0]) <= distance &&
+				fabs(other[1] - position[1]) <= distance &&
+				fabs(other[2] - position[2]) <= distance)
+				return (int)found->second;
+		}
+	}
+	return -1;
+}
+
+static void buildMesh(const MeshExporter& exporter, const ExportJob& job, const void* data, ExportMesh& mesh)
+{
+	size_t vertexCount = job.faceCount * 3;
+	mesh.indices.resize(vertexCount);
+	mesh.positions.reserve(vertexCount * 3);
+	mesh.normals.reserve(vertexCount * 3);
+
+	float distance = job.compact ? std::max(WELD_DISTANCE, 1.0f / job.positionScale) : WELD_DISTANCE;
+
+	std::unordered_multimap<WeldKey, unsigned int, WeldKeyHash> welded;
+	if (exporter.weld)
+		welded.reserve(vertexCount / 2);
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		float position[3], normal[3];
+		decodeVertex(job, data, i, position, normal);
+
+		// the first copy of a welded vertex keeps its normal, the others are within rounding of it
+		if (exporter.weld)
+		{
+			WeldKey cell = { (int)floor(position[0] / distance), (int)floor(position[1] / distance), (int)floor(position[2] / distance) };
+			int found = findWelded(welded, mesh.positions, cell, position, distance);
+			if (found >= 0)
+			{
+				mesh.indices[i] = (unsigned int)found;
+				continue;
+			}
+			welded.insert(std::make_pair(cell, (unsigned int)(mesh.positions.size() / 3)));
+		}
+
+		mesh.indices[i] = (unsigned int)(mesh.positions.size() / 3);
+		mesh.positions.insert(mesh.positions.end(), position, position + 3);
+		mesh.normals.insert(mesh.normals.end(), normal, normal + 3);
+	}
+}
+
+// collapses the welded mesh down and gives the vertices that are left
+// normals averaged from their triangles, as they've moved off the field's
+// gradient
+static void simplifyExportMesh(MeshExporter& exporter, ExportMesh& mesh)
+{
+	size_t vertexCount = mesh.positions.size() / 3;
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		positions[v] = glm::vec3(mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2]);
+
+	SimplifySettings settings = exporter.simplifySettings;
+	if (exporter.simplifyRatio < 1.0f)
+		settings.targetTriangles = std::max((size_t)(mesh.indices.size() / 3 * exporter.simplifyRatio), (size_t)1);
+
+	simplifyMesh(exporter.simplifyPool, positions, mesh.indices, settings);
+
+	vertexCount = positions.size();
+	mesh.positions.resize(vertexCount * 3);
+	for (size_t v = 0; v < vertexCount; ++v)
+		for (int k = 0; k < 3; ++k)
+			mesh.positions[v * 3 + k] = positions[v][k];
+
+	// area weighted, as the cross products are twice the triangles' areas
+	std::vector<glm::vec3> normals(vertexCount, glm::vec3(0.0f));
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		const unsigned int* tri = &mesh.indices[i];
+		glm::vec3 normal = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+		for (int k = 0; k < 3; ++k)
+			normals[tri[k]] += normal;
+	}
+
+	mesh.normals.resize(vertexCount * 3);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		float length = glm::length(normals[v]);
+		for (int k = 0; k < 3; ++k)
+			mesh.normals[v * 3 + k] = length > 0.0f ? normals[v][k] / length : 0.0f;
+	}
+}
+
+static bool writePLY(FILE* file, const ExportMesh& mesh)
+{
+	size_t vertexCount = mesh.positions.size() / 3;
+	size_t faceCount = mesh.indices.size() / 3;
+
+	fprintf(file, "ply\nformat binary_little_endian 1.0\n");
+	fprintf(file, "element vertex %u\n", (unsigned int)vertexCount);
+	fprintf(file, "property float x\nproperty float y\nproperty float z\n");
+	fprintf(file, "property float nx\nproperty float ny\nproperty float nz\n");
+	fprintf(file, "element face %u\n", (unsigned int)faceCount);
+	fprintf(file, "property list uchar uint vertex_indices\n");
+	fprintf(file, "end_header\n");
+
+	// interleave into a block at a time rather than writing every value separately
+	const size_t BLOCK_SIZE = 1 << 20;
+	std::vector<unsigned char> block;
+	block.reserve(BLOCK_SIZE + 64);
+	bool success = true;
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const unsigned char* p = (const unsigned char*)&mesh.positions[i * 3];
+		const unsigned char* n = (const unsigned char*)&mesh.normals[i * 3];
+		block.insert(block.end(), p, p + sizeof(float) * 3);
+		block.insert(block.end(), n, n + sizeof(float) * 3);
+		if (block.size() >= BLOCK_SIZE)
+		{
+			success &= fwrite(block.data(), 1, block.size(), file) == block.size();
+			block.clear();
+		}
+	}
+
+	for (size_t i = 0; i < faceCount; ++i)
+	{
+		const unsigned char* indices = (const unsigned char*)&mesh.indices[i * 3];
+		block.push_back(3);
+		block.insert(block.end(), indices, indices + sizeof(unsigned int) * 3);
+		if (block.size() >= BLOCK_SIZE)
+		{
+			success &= fwrite(block.data(), 1, block.size(), file) == block.size();
+			block.clear();
+		}
+	}
+
+	if (!block.empty())
+		success &= fwrite(block.data(), 1, block.size(), file) == block.size();
+
+	return success;
+}
+
+static bool writeOBJ(FILE* file, const ExportMesh& mesh)
+{
+	size_t vertexCount = mesh.positions.size() / 3;
+	size_t faceCount = mesh.indices.size() / 3;
+
+	for (size_t i = 0; i < vertexCount; ++i)
+		fprintf(file, "v %g %g %g\n", mesh.positions[i * 3], mesh.positions[i * 3 + 1], mesh.positions[i * 3 + 2]);
+	for (size_t i = 0; i < vertexCount; ++i)
+		fprintf(file, "vn %g %g %g\n", mesh.normals[i * 3], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2]);
+
+	// obj indices start at 1
+	for (size_t i = 0; i < faceCount; ++i)
+	{
+		unsigned int a = mesh.indices[i * 3] + 1, b = mesh.indices[i * 3 + 1] + 1, c = mesh.indices[i * 3 + 2] + 1;
+		fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+	}
+
+	return ferror(file) == 0;
+}
+
+static void writeJob(MeshExporter& exporter, const ExportJob& job)
+{
+	// time the readback from the device, if there was one
+	double readbackTime = 0;
+	if (job.readEvent != 0)
+	{
+		clWaitForEvents(1, &job.readEvent);
+
+		cl_ulong start = 0, end = 0;
+		clGetEventProfilingInfo(job.readEvent, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr);
+		clGetEventProfilingInfo(job.readEvent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr);
+		readbackTime = end > start ? (end - start) * 1e-9 : 0;
+		clReleaseEvent(job.readEvent);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ExportMesh mesh;
+	buildMesh(exporter, job, exporter.staging[job.staging].data, mesh);
+	if (exporter.simplify)
+		simplifyExportMesh(exporter, mesh);
+
+	FILE* file = fopen(job.path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		printf("Unable to write '%s'\n", job.path.c_str());
+		return;
+	}
+
+	bool success = exporter.format == EXPORT_OBJ ? writeOBJ(file, mesh) : writePLY(file, mesh);
+	double megabytes = ftell(file) / (1024.0 * 1024.0);
+	fclose(file);
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!success)
+	{
+		printf("Failed writing '%s'\n", job.path.c_str());
+		return;
+	}
+
+	double readbackMegabytes = job.faceCount * 3 * (job.compact ? sizeof(cl_uint) * 3 : sizeof(cl_float4) * 2) / (1024.0 * 1024.0);
+	printf("Exported %s: %u triangles, %u vertices, %.2f MB in %.1f ms (%.1f MB/s)", job.path.c_str(),
+		   (unsigned int)(mesh.indices.size() / 3), (unsigned int)(mesh.positions.size() / 3), megabytes,
+		   seconds * 1000.0, seconds > 0 ? megabytes / seconds : 0.0);
+	if (job.readEvent != 0 && readbackTime > 0)
+		printf(", readback %.2f ms (%.1f MB/s)", readbackTime * 1000.0, readbackMegabytes / readbackTime);
+	printf("\n");
+}
+
+static void writerThread(MeshExporter* exporter)
+{
+	std::unique_lock<std::mutex> lock(exporter->mutex);
+
+	for (;;)
+	{
+		while (!exporter->quit && exporter->jobs.empty())
+			exporter->wake.wait(lock);
+
+		// everything queued is written before the exporter closes
+		if (exporter->jobs.empty())
+			return;
+
+		ExportJob job = exporter->jobs.front();
+		exporter->jobs.pop_front();
+
+		lock.unlock();
+		writeJob(*exporter, job);
+		lock.lock();
+
+		exporter->staging[job.staging].busy = false;
+		exporter->stagingFree.notify_one();
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "clcommon.h"
+#include "simplify.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// staging buffers that surfaces are read back into, so a capture only waits
+// for the writer thread when every one of them is still queued
+const int EXPORT_BUFFERS = 2;
+
+enum ExportFormat
+{
+	EXPORT_PLY,		// binary little-endian
+	EXPORT_OBJ,
+};
+
+// host memory a surface is read back into. it is allocated by opencl and
+// mapped, so the device can copy into it directly rather than through a
+// driver-side bounce buffer
+struct ExportStaging
+{
+	cl_mem		link;
+	void*		data;
+	size_t		size;
+	bool		busy;		// queued or being written
+};
+
+struct ExportJob
+{
+	int			staging;
+	cl_event	readEvent;		// 0 once the vertices are on the host
+	std::string	path;
+	size_t		faceCount;
+	bool		compact;		// vertices are in the kernel's COMPACT_VERTICES format
+	float		positionScale;	// POSITION_SCALE of compact vertices
+};
+
+// writes extracted surfaces out on a background thread as binary PLY or OBJ,
+// picked by the extension of the path. every capture is numbered, so
+// "surface.ply" becomes surface_0000.ply, surface_0001.ply and so on.
+//
+// vertices that only differ by float rounding between the cubes that share
+// an edge are welded unless writing triangle soup, so the files are indexed.
+// welded surfaces can also be simplified (simplify.h) before they're written,
+// on a thread pool of the exporter's own.
+struct MeshExporter
+{
+	cl_context				context;
+	cl_command_queue		queue;
+
+	std::string				basePath;		// path without its extension
+	std::string				extension;
+	ExportFormat			format;
+	bool					weld;
+	int						nextFrame;
+
+	bool					simplify;
+	SimplifySettings		simplifySettings;
+	float					simplifyRatio;	// fraction of each surface's triangles to keep
+	ThreadPool				simplifyPool;
+
+	ExportStaging			staging[EXPORT_BUFFERS];
+
+	std::thread				thread;
+	std::mutex				mutex;
+	std::condition_variable	wake;			// a job was queued or the exporter is closing
+	std::condition_variable	stagingFree;	// the writer has finished with a staging buffer
+	std::deque<ExportJob>	jobs;
+	bool					quit;
+};
+
+// simplifyRatio below 1, or a simplifyError above 0 (in cubes), simplifies
+// welded surfaces before writing them
+bool createExporter(MeshExporter& exporter, cl_context context, cl_command_queue queue, const char* path, bool weld,
+					float simplifyRatio, float simplifyError);
+
+// writes out any surfaces still queued before returning
+void releaseExporter(MeshExporter& exporter);
+
+// queues a non-blocking read of faceCount triangles from a device vertex
+// buffer, which the writer thread writes out once it lands. shared buffers
+// must already be acquired by opencl, and readEvent can be waited on before
+// releasing them. returns false, with no event, if the surface couldn't be
+// staged
+bool exportSurface(MeshExporter& exporter, cl_mem vertices, size_t faceCount, size_t vertexSize,
+				   bool compact, float positionScale, cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* readEvent);
+
+// copies float4 position / normal vertices already on the host
+bool exportSurface(MeshExporter& exporter, const cl_float4* vertices, size_t faceCount);
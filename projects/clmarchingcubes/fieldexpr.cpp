@@ -0,0 +1,252 @@
+#include "fieldexpr.h"
+#include <glm/ext.hpp>
+#include <string.h>
+#include <stdio.h>
+
+static int addNode(FieldExpression& expr, FieldNodeType type, int a, int b,
+				   float p0 = 0, float p1 = 0, float p2 = 0, float p3 = 0, float p4 = 0, float p5 = 0)
+{
+	FieldNode node = { type, { a, b }, { p0, p1, p2, p3, p4, p5 }, glm::mat4(1) };
+	expr.nodes.push_back(node);
+	return (int)expr.nodes.size() - 1;
+}
+
+int fieldSphere(FieldExpression& expr, const glm::vec3& centre, float radius)
+{
+	return addNode(expr, FIELD_NODE_SPHERE, -1, -1, centre.x, centre.y, centre.z, radius);
+}
+
+int fieldBox(FieldExpression& expr, const glm::vec3& centre, const glm::vec3& halfSize)
+{
+	return addNode(expr, FIELD_NODE_BOX, -1, -1, centre.x, centre.y, centre.z, halfSize.x, halfSize.y, halfSize.z);
+}
+
+int fieldTorus(FieldExpression& expr, const glm::vec3& centre, float majorRadius, float minorRadius)
+{
+	return addNode(expr, FIELD_NODE_TORUS, -1, -1, centre.x, centre.y, centre.z, majorRadius, minorRadius);
+}
+
+int fieldPlane(FieldExpression& expr, const glm::vec3& normal, float offset)
+{
+	glm::vec3 n = glm::normalize(normal);
+	return addNode(expr, FIELD_NODE_PLANE, -1, -1, n.x, n.y, n.z, offset);
+}
+
+int fieldParticles(FieldExpression& expr, float radius)
+{
+	return addNode(expr, FIELD_NODE_PARTICLES, -1, -1, radius);
+}
+
+int fieldUnion(FieldExpression& expr, int a, int b)
+{
+	return addNode(expr, FIELD_NODE_UNION, a, b);
+}
+
+int fieldIntersection(FieldExpression& expr, int a, int b)
+{
+	return addNode(expr, FIELD_NODE_INTERSECTION, a, b);
+}
+
+int fieldDifference(FieldExpression& expr, int a, int b)
+{
+	return addNode(expr, FIELD_NODE_DIFFERENCE, a, b);
+}
+
+int fieldSmoothUnion(FieldExpression& expr, int a, int b, float blend)
+{
+	return addNode(expr, FIELD_NODE_SMOOTH_UNION, a, b, glm::max(blend, 1e-6f));
+}
+
+// the child is evaluated at the inverse of the transform, and its distances
+// scaled back up, which keeps them distances for uniform scales
+static int addTransform(FieldExpression& expr, int child, const glm::mat4& transform, float scale)
+{
+	int node = addNode(expr, FIELD_NODE_TRANSFORM, child, -1, scale);
+	expr.nodes[node].transform = glm::inverse(transform);
+	return node;
+}
+
+int fieldTranslate(FieldExpression& expr, int child, const glm::vec3& offset)
+{
+	return addTransform(expr, child, glm::translate(offset), 1.0f);
+}
+
+int fieldRotate(FieldExpression& expr, int child, const glm::vec3& axis, float radians)
+{
+	return addTransform(expr, child, glm::rotate(radians, glm::normalize(axis)), 1.0f);
+}
+
+int fieldScale(FieldExpression& expr, int child, float scale)
+{
+	return addTransform(expr, child, glm::scale(glm::vec3(scale)), scale);
+}
+
+int fieldNoise(FieldExpression& expr, int child, float frequency, float amplitude, int octaves)
+{
+	return addNode(expr, FIELD_NODE_NOISE, child, -1, frequency, amplitude, (float)glm::max(octaves, 1));
+}
+
+// a float literal that opencl won't take for a double or an int
+static std::string literal(float value)
+{
+	char text[32];
+	sprintf(text, "%.9g", value);
+	std::string s = text;
+	if (s.find_first_of(".e") == std::string::npos)
+		s += ".0";
+	return s + "f";
+}
+
+static std::string vector3(float x, float y, float z)
+{
+	return "(float3)(" + literal(x) + ", " + literal(y) + ", " + literal(z) + ")";
+}
+
+// writes the statements evaluating a node at point and returns the variable
+// holding its distance. a node shared by several parents is written once for
+// each of them, as they may evaluate it at different points
+static std::string writeNode(const FieldExpression& expr, int index, const std::string& point, std::string& body, int& variables)
+{
+	const FieldNode& node = expr.nodes[index];
+	const float* p = node.params;
+
+	std::string a, b, value;
+	switch (node.type)
+	{
+	case FIELD_NODE_SPHERE:
+		value = "distance(" + point + ", " + vector3(p[0], p[1], p[2]) + ") - " + literal(p[3]);
+		break;
+	case FIELD_NODE_BOX:
+		value = "boxDistance(" + point + " - " + vector3(p[0], p[1], p[2]) + ", " + vector3(p[3], p[4], p[5]) + ")";
+		break;
+	case FIELD_NODE_TORUS:
+		value = "torusDistance(" + point + " - " + vector3(p[0], p[1], p[2]) + ", " + literal(p[3]) + ", " + literal(p[4]) + ")";
+		break;
+	case FIELD_NODE_PLANE:
+		value = "dot(" + point + ", " + vector3(p[0], p[1], p[2]) + ") - " + literal(p[3]);
+		break;
+	case FIELD_NODE_PARTICLES:
+		value = "particleDistance(" + point + ", " + literal(p[0]) + ", FIELD_PARAMS)";
+		break;
+	case FIELD_NODE_UNION:
+		a = writeNode(expr, node.children[0], point, body, variables);
+		b = writeNode(expr, node.children[1], point, body, variables);
+		value = "fmin(" + a + ", " + b + ")";
+		break;
+	case FIELD_NODE_INTERSECTION:
+		a = writeNode(expr, node.children[0], point, body, variables);
+		b = writeNode(expr, node.children[1], point, body, variables);
+		value = "fmax(" + a + ", " + b + ")";
+		break;
+	case FIELD_NODE_DIFFERENCE:
+		a = writeNode(expr, node.children[0], point, body, variables);
+		b = writeNode(expr, node.children[1], point, body, variables);
+		value = "fmax(" + a + ", -" + b + ")";
+		break;
+	case FIELD_NODE_SMOOTH_UNION:
+		a = writeNode(expr, node.children[0], point, body, variables);
+		b = writeNode(expr, node.children[1], point, body, variables);
+		value = "smoothMin(" + a + ", " + b + ", " + literal(p[0]) + ")";
+		break;
+	case FIELD_NODE_TRANSFORM:
+	{
+		// glm is column-major, m[column][row]
+		const glm::mat4& m = node.transform;
+		std::string childPoint = "p" + std::to_string(variables++);
+		body += "\tfloat3 " + childPoint + " = (float3)(";
+		for (int row = 0; row < 3; ++row)
+		{
+			body += literal(m[0][row]) + " * " + point + ".x + " + literal(m[1][row]) + " * " + point + ".y + " +
+				literal(m[2][row]) + " * " + point + ".z + " + literal(m[3][row]);
+			body += row < 2 ? ",\n\t\t" : ");\n";
+		}
+		a = writeNode(expr, node.children[0], childPoint, body, variables);
+		value = a + " * " + literal(p[0]);
+		break;
+	}
+	case FIELD_NODE_NOISE:
+		a = writeNode(expr, node.children[0], point, body, variables);
+		value = a + " + " + literal(p[1]) + " * fractalNoise(" + point + " * " + literal(p[0]) + ", " + std::to_string((int)p[2]) + ")";
+		break;
+	}
+
+	std::string result = "d" + std::to_string(variables++);
+	body += "\tfloat " + result + " = " + value + ";\n";
+	return result;
+}
+
+// how much a node's distance can change per cube moved. the primitives are
+// exact distances, the operators never exceed the steeper of their children,
+// and the particles' 1/sqrt of their 1/r^2 sum is also within 1. value
+// noise changes by at most 1.5 * 2 per lattice cell along each axis, and its
+// octaves trade amplitude for frequency evenly
+static float lipschitzBound(const FieldExpression& expr, int index)
+{
+	const FieldNode& node = expr.nodes[index];
+	switch (node.type)
+	{
+	case FIELD_NODE_UNION:
+	case FIELD_NODE_INTERSECTION:
+	case FIELD_NODE_DIFFERENCE:
+	case FIELD_NODE_SMOOTH_UNION:
+		return glm::max(lipschitzBound(expr, node.children[0]), lipschitzBound(expr, node.children[1]));
+	case FIELD_NODE_TRANSFORM:
+		return lipschitzBound(expr, node.children[0]);
+	case FIELD_NODE_NOISE:
+		return lipschitzBound(expr, node.children[0]) + node.params[2] * node.params[1] * node.params[0] * 3.0f * sqrtf(3.0f);
+	default:
+		return 1.0f;
+	}
+}
+
+std::string generateFieldSource(const FieldExpression& expr)
+{
+	std::string body;
+	int variables = 1;
+	int root = (int)expr.nodes.size() - 1;
+	std::string result = writeNode(expr, root, "p0", body, variables);
+
+	std::string source = "\n// generated from a field expression, see fieldexpr.h\n";
+	source += "float fieldExpression(float3 p0, FIELD_ARGS)\n{\n" + body + "\treturn " + result + ";\n}\n\n";
+
+	// the field within a box is within its value at the centre plus how far it can change out to the corners
+	source += "void boundFieldExpression(float3 boxMin, float3 boxMax, float* distanceMin, float* distanceMax, FIELD_ARGS)\n{\n";
+	source += "\tfloat3 centre = (boxMin + boxMax) * 0.5f;\n";
+	source += "\tfloat reach = " + literal(lipschitzBound(expr, root)) + " * distance(boxMax, centre);\n";
+	source += "\tfloat d = fieldExpression(centre, FIELD_PARAMS);\n";
+	source += "\t*distanceMin = d - reach;\n";
+	source += "\t*distanceMax = d + reach;\n}\n";
+	return source;
+}
+
+bool buildExampleField(FieldExpression& expr, const char* name, const size_t gridSize[3])
+{
+	glm::vec3 centre = glm::vec3(gridSize[0], gridSize[1], gridSize[2]) * 0.5f;
+	float size = (float)glm::min(gridSize[0], glm::min(gridSize[1], gridSize[2]));
+	expr.nodes.clear();
+
+	if (strcmp(name, "csg") == 0)
+	{
+		// a rounded cube with a tilted ring cut out of it
+		int cube = fieldIntersection(expr, fieldBox(expr, centre, glm::vec3(size * 0.3f)), fieldSphere(expr, centre, size * 0.4f));
+		int ring = fieldTorus(expr, glm::vec3(0), size * 0.3f, size * 0.08f);
+		ring = fieldTranslate(expr, fieldRotate(expr, ring, glm::vec3(1, 0, 1), 0.6f), centre);
+		fieldDifference(expr, cube, ring);
+	}
+	else if (strcmp(name, "blobs") == 0)
+	{
+		// the metaballs melting into a floor
+		int blobs = fieldParticles(expr, size * 0.08f);
+		int floor = fieldPlane(expr, glm::vec3(0, 1, 0), size * 0.2f);
+		fieldSmoothUnion(expr, blobs, floor, size * 0.1f);
+	}
+	else if (strcmp(name, "rock") == 0)
+	{
+		// a sphere roughened by a few octaves of noise
+		fieldNoise(expr, fieldSphere(expr, centre, size * 0.35f), 4.0f / size, size * 0.06f, 4);
+	}
+	else
+		return false;
+
+	return true;
+}
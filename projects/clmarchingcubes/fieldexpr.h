@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// a signed distance field, negative inside the surface, built as a graph of
+// primitives, operators and transforms and turned into the opencl source of
+// the FIELD_EXPRESSION field. each node becomes a statement with its
+// parameters written as literals, so the compiler can inline and fold the
+// whole field rather than the device interpreting the graph.
+enum FieldNodeType
+{
+	FIELD_NODE_SPHERE,			// params: centre, radius
+	FIELD_NODE_BOX,				// params: centre, half size
+	FIELD_NODE_TORUS,			// params: centre, major and minor radius, around y
+	FIELD_NODE_PLANE,			// params: unit normal, offset along it, inside behind it
+	FIELD_NODE_PARTICLES,		// params: radius of a lone particle's metaball
+	FIELD_NODE_UNION,
+	FIELD_NODE_INTERSECTION,
+	FIELD_NODE_DIFFERENCE,		// the first child with the second cut out
+	FIELD_NODE_SMOOTH_UNION,	// params: distance the children blend over
+	FIELD_NODE_TRANSFORM,		// params: scale of the child's distances, transform: grid to child space
+	FIELD_NODE_NOISE,			// params: frequency, amplitude and octaves of the displacement
+};
+
+struct FieldNode
+{
+	FieldNodeType	type;
+	int				children[2];
+	float			params[6];
+	glm::mat4		transform;
+};
+
+// nodes only refer to nodes before them, and the last one is the root
+struct FieldExpression
+{
+	std::vector<FieldNode>	nodes;
+};
+
+// each appends a node, returning its index for later nodes to take as a child
+int fieldSphere(FieldExpression& expr, const glm::vec3& centre, float radius);
+int fieldBox(FieldExpression& expr, const glm::vec3& centre, const glm::vec3& halfSize);
+int fieldTorus(FieldExpression& expr, const glm::vec3& centre, float majorRadius, float minorRadius);
+int fieldPlane(FieldExpression& expr, const glm::vec3& normal, float offset);
+int fieldParticles(FieldExpression& expr, float radius);
+int fieldUnion(FieldExpression& expr, int a, int b);
+int fieldIntersection(FieldExpression& expr, int a, int b);
+int fieldDifference(FieldExpression& expr, int a, int b);
+int fieldSmoothUnion(FieldExpression& expr, int a, int b, float blend);
+int fieldTranslate(FieldExpression& expr, int child, const glm::vec3& offset);
+int fieldRotate(FieldExpression& expr, int child, const glm::vec3& axis, float radians);
+int fieldScale(FieldExpression& expr, int child, float scale);
+int fieldNoise(FieldExpression& expr, int child, float frequency, float amplitude, int octaves);
+
+// fieldExpression and boundFieldExpression for the kernel, compiled after it
+std::string generateFieldSource(const FieldExpression& expr);
+
+// named example shapes fitted to the grid, false if there's none by that name
+bool buildExampleField(FieldExpression& expr, const char* name, const size_t gridSize[3]);
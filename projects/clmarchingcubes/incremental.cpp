@@ -0,0 +1,362 @@
+#include "incremental.h"
+#include <algorithm>
+#include <math.h>
+
+const cl_uint NO_SLOT = ~0u;
+
+bool createIncremental(IncrementalData& data, cl_context context, cl_program program, const size_t gridSize[3],
+					   size_t brickSize, cl_float threshold, cl_uint poolFaces, float tolerance)
+{
+	cl_int result = CL_SUCCESS;
+
+	data.brickSize = brickSize;
+	data.totalBricks = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		data.gridSize[i] = gridSize[i];
+		data.brickCount[i] = (gridSize[i] + brickSize - 1) / brickSize;
+		data.totalBricks *= data.brickCount[i];
+	}
+	data.tolerance = tolerance;
+	data.extractedBricks = 0;
+
+	data.countKernel = clCreateKernel(program, "countBrickFaces", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.extractKernel = clCreateKernel(program, "marchingCubesDirtyBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	data.dirtyBrickLink = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * data.totalBricks, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.brickFacesLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * data.totalBricks, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.brickRangeLink = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * 2 * data.totalBricks, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	cl_int grid[4] = { (cl_int)gridSize[0], (cl_int)gridSize[1], (cl_int)gridSize[2], 0 };
+	result = clSetKernelArg(data.countKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.countKernel, 1, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(data.countKernel, 2, sizeof(cl_mem), &data.dirtyBrickLink);
+	result |= clSetKernelArg(data.countKernel, 3, sizeof(cl_mem), &data.brickFacesLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(data.extractKernel, 0, sizeof(cl_mem), &data.brickFacesLink);
+	result |= clSetKernelArg(data.extractKernel, 2, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.extractKernel, 3, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(data.extractKernel, 4, sizeof(cl_mem), &data.dirtyBrickLink);
+	result |= clSetKernelArg(data.extractKernel, 5, sizeof(cl_mem), &data.brickRangeLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	resetIncremental(data, poolFaces);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseIncremental(IncrementalData& data)
+{
+	clReleaseMemObject(data.brickRangeLink);
+	clReleaseMemObject(data.brickFacesLink);
+	clReleaseMemObject(data.dirtyBrickLink);
+	clReleaseKernel(data.extractKernel);
+	clReleaseKernel(data.countKernel);
+}
+
+void resetIncremental(IncrementalData& data, cl_uint poolFaces)
+{
+	data.poolSlots = poolFaces / SLOT_FACES;
+	data.freeSlots.clear();
+	if (data.poolSlots > 0)
+		data.freeSlots[0] = data.poolSlots;
+
+	data.brickFirstSlot.assign(data.totalBricks, NO_SLOT);
+	data.brickSlots.assign(data.totalBricks, 0);
+	data.brickFaces.assign(data.totalBricks, 0);
+	data.faceCount = 0;
+	data.drawCommands.clear();
+	data.drawCount = 0;
+
+	data.drift.assign(data.totalBricks, 0.0f);
+	data.dirty.assign(data.totalBricks, 0);
+	data.dirtyIndices.clear();
+	data.dirtyBricks.clear();
+	data.missedIndices.clear();
+	markBricksDirty(data, glm::vec3(0), glm::vec3(data.gridSize[0], data.gridSize[1], data.gridSize[2]));
+}
+
+static void markBrickDirty(IncrementalData& data, size_t x, size_t y, size_t z)
+{
+	size_t index = (z * data.brickCount[1] + y) * data.brickCount[0] + x;
+	if (data.dirty[index])
+		return;
+
+	data.dirty[index] = 1;
+	data.dirtyIndices.push_back((cl_uint)index);
+	data.dirtyBricks.push_back((cl_uint)x | ((cl_uint)y << 10) | ((cl_uint)z << 20));
+}
+
+void markBricksDirty(IncrementalData& data, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	// a cube samples its far corners and the normals a little beyond them,
+	// so the bricks a cube either side of the box are affected too
+	int lower[3], upper[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		lower[i] = (int)floor((boxMin[i] - 1.0f) / data.brickSize);
+		upper[i] = (int)floor((boxMax[i] + 1.0f) / data.brickSize);
+		lower[i] = glm::max(lower[i], 0);
+		upper[i] = glm::min(upper[i], (int)data.brickCount[i] - 1);
+		if (lower[i] > upper[i])
+			return;
+	}
+
+	for (int z = lower[2]; z <= upper[2]; ++z)
+	for (int y = lower[1]; y <= upper[1]; ++y)
+	for (int x = lower[0]; x <= upper[0]; ++x)
+		markBrickDirty(data, x, y, z);
+}
+
+void trackParticles(IncrementalData& data, const std::vector<glm::vec4>& particles, float supportRadius, cl_float threshold)
+{
+	// the first frame dirties everything anyway
+	if (data.previousParticles.size() != particles.size())
+	{
+		data.previousParticles = particles;
+		return;
+	}
+
+	float driftLimit = data.tolerance * threshold;
+
+	for (size_t i = 0; i < particles.size(); ++i)
+	{
+		glm::vec3 position(particles[i]);
+		if (position == glm::vec3(data.previousParticles[i]))
+			continue;
+
+		// compact support only reaches its radius around where the particle
+		// was and is
+		if (supportRadius > 0)
+		{
+			glm::vec3 previous(data.previousParticles[i]);
+			markBricksDirty(data, glm::min(position, previous) - supportRadius, glm::max(position, previous) + supportRadius);
+			continue;
+		}
+
+		// moving a metaball by d changes 1/r^2 by at most 2d/r^3 where r is
+		// the nearest it came, so each brick adds that up over the moves
+		// since it was extracted and is dirtied once it passes the tolerance.
+		// bricks right by the path are dirtied outright
+		glm::vec3 previous(data.previousParticles[i]);
+		glm::vec3 pathMin = glm::min(position, previous);
+		glm::vec3 pathMax = glm::max(position, previous);
+		float distance = glm::length(position - previous);
+
+		for (size_t z = 0; z < data.brickCount[2]; ++z)
+		for (size_t y = 0; y < data.brickCount[1]; ++y)
+		for (size_t x = 0; x < data.brickCount[0]; ++x)
+		{
+			size_t index = (z * data.brickCount[1] + y) * data.brickCount[0] + x;
+			if (data.dirty[index])
+				continue;
+
+			// the brick's cubes sample a cube beyond it, as in markBricksDirty
+			glm::vec3 brickMin = glm::vec3(x, y, z) * (float)data.brickSize - 1.0f;
+			glm::vec3 brickMax = glm::vec3(x + 1, y + 1, z + 1) * (float)data.brickSize + 1.0f;
+			glm::vec3 gap = glm::max(glm::max(brickMin - pathMax, pathMin - brickMax), glm::vec3(0));
+			float r = glm::length(gap);
+
+			if (r >= 1.0f)
+				data.drift[index] += 2.0f * distance / (r * r * r);
+			if (r < 1.0f || data.drift[index] > driftLimit)
+				markBrickDirty(data, x, y, z);
+		}
+	}
+
+	data.previousParticles = particles;
+}
+
+static void freeRange(IncrementalData& data, size_t brick)
+{
+	cl_uint first = data.brickFirstSlot[brick];
+	cl_uint count = data.brickSlots[brick];
+	data.faceCount -= data.brickFaces[brick];
+	data.brickFirstSlot[brick] = NO_SLOT;
+	data.brickSlots[brick] = 0;
+	data.brickFaces[brick] = 0;
+	if (first == NO_SLOT)
+		return;
+
+	// merge with the free runs either side
+	auto next = data.freeSlots.lower_bound(first);
+	if (next != data.freeSlots.end() && next->first == first + count)
+	{
+		count += next->second;
+		next = data.freeSlots.erase(next);
+	}
+	if (next != data.freeSlots.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == first)
+		{
+			previous->second += count;
+			return;
+		}
+	}
+	data.freeSlots[first] = count;
+}
+
+// first fit, which keeps the used part of the pool packed towards the start
+static cl_uint allocateRange(IncrementalData& data, cl_uint count)
+{
+	for (auto run = data.freeSlots.begin(); run != data.freeSlots.end(); ++run)
+	{
+		if (run->second < count)
+			continue;
+
+		cl_uint first = run->first;
+		cl_uint remaining = run->second - count;
+		data.freeSlots.erase(run);
+		if (remaining > 0)
+			data.freeSlots[first + count] = remaining;
+		return first;
+	}
+
+	return NO_SLOT;
+}
+
+static void buildDrawCommands(IncrementalData& data)
+{
+	std::vector<std::pair<cl_uint, cl_uint>> ranges;
+	for (size_t brick = 0; brick < data.totalBricks; ++brick)
+		if (data.brickFaces[brick] > 0)
+			ranges.push_back(std::make_pair(data.brickFirstSlot[brick] * SLOT_FACES, data.brickFaces[brick]));
+	std::sort(ranges.begin(), ranges.end());
+
+	data.drawCommands.clear();
+	for (const auto& range : ranges)
+	{
+		// a brick that filled its last slot runs straight into the next range
+		size_t last = data.drawCommands.size();
+		if (last > 0 && data.drawCommands[last - 2] + data.drawCommands[last - 4] == range.first * 3)
+		{
+			data.drawCommands[last - 4] += range.second * 3;
+			continue;
+		}
+
+		cl_uint command[4] = { range.second * 3, 1, range.first * 3, 0 };
+		data.drawCommands.insert(data.drawCommands.end(), command, command + 4);
+	}
+	data.drawCount = (cl_uint)(data.drawCommands.size() / 4);
+}
+
+bool allocateDirtyBricks(IncrementalData& data, cl_command_queue queue,
+						 cl_uint numWaitEvents, const cl_event* waitEvents, cl_uint& requiredFaces)
+{
+	cl_int result = CL_SUCCESS;
+	size_t dirtyCount = data.dirtyBricks.size();
+	size_t globalWorkSize = dirtyCount * data.brickSize * data.brickSize * data.brickSize;
+
+	// event list in case we use out-of-order computations
+	cl_event events[3] = { 0, 0, 0 };
+	result = clEnqueueWriteBuffer(queue, data.dirtyBrickLink, CL_FALSE, 0, sizeof(cl_uint) * dirtyCount, data.dirtyBricks.data(), numWaitEvents, waitEvents, &events[0]);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+	cl_uint zero = 0;
+	result = clEnqueueFillBuffer(queue, data.brickFacesLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * dirtyCount, 0, nullptr, &events[1]);
+	CL_CHECK(clEnqueueFillBuffer, result);
+	result = clEnqueueNDRangeKernel(queue, data.countKernel, 1, 0, &globalWorkSize, 0, 2, events, &events[2]);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	// the counts size the ranges, so we have to wait for them
+	data.dirtyFaces.resize(dirtyCount);
+	result = clEnqueueReadBuffer(queue, data.brickFacesLink, CL_TRUE, 0, sizeof(cl_uint) * dirtyCount, data.dirtyFaces.data(), 1, &events[2], nullptr);
+	CL_CHECK(clEnqueueReadBuffer, result);
+
+	for (int i = 0; i < 3; ++i)
+		clReleaseEvent(events[i]);
+
+	// free every old range first, so the new ones can reuse them
+	for (size_t i = 0; i < dirtyCount; ++i)
+		freeRange(data, data.dirtyIndices[i]);
+
+	size_t usedSlots = 0;
+	for (size_t brick = 0; brick < data.totalBricks; ++brick)
+		usedSlots += data.brickSlots[brick];
+
+	bool fitted = true;
+	data.missedIndices.clear();
+	data.dirtyRanges.resize(dirtyCount * 2);
+	for (size_t i = 0; i < dirtyCount; ++i)
+	{
+		size_t brick = data.dirtyIndices[i];
+		cl_uint faces = data.dirtyFaces[i];
+		cl_uint slots = (faces + SLOT_FACES - 1) / SLOT_FACES;
+		usedSlots += slots;
+
+		cl_uint first = slots > 0 ? allocateRange(data, slots) : NO_SLOT;
+		if (first == NO_SLOT)
+		{
+			fitted = fitted && slots == 0;
+			if (slots > 0)
+				data.missedIndices.push_back((cl_uint)brick);
+			data.dirtyRanges[i * 2] = 0;
+			data.dirtyRanges[i * 2 + 1] = 0;
+			continue;
+		}
+
+		data.brickFirstSlot[brick] = first;
+		data.brickSlots[brick] = slots;
+		data.brickFaces[brick] = faces;
+		data.faceCount += faces;
+		data.dirtyRanges[i * 2] = first * SLOT_FACES;
+		data.dirtyRanges[i * 2 + 1] = faces;
+	}
+
+	requiredFaces = (cl_uint)glm::min(usedSlots * SLOT_FACES, (size_t)~0u);
+	buildDrawCommands(data);
+
+	return fitted;
+}
+
+void enqueueExtractDirtyBricks(IncrementalData& data, cl_command_queue queue, cl_mem vertexLink, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+	size_t dirtyCount = data.dirtyBricks.size();
+	size_t globalWorkSize = dirtyCount * data.brickSize * data.brickSize * data.brickSize;
+
+	result = clSetKernelArg(data.extractKernel, 1, sizeof(cl_mem), &vertexLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the ranges are written before this returns and the dirty list went up
+	// for counting, so the host copies can be reused straight away
+	cl_event events[2] = { 0, 0 };
+	result = clEnqueueWriteBuffer(queue, data.brickRangeLink, CL_TRUE, 0, sizeof(cl_uint) * 2 * dirtyCount, data.dirtyRanges.data(), 0, nullptr, &events[0]);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+	cl_uint zero = 0;
+	result = clEnqueueFillBuffer(queue, data.brickFacesLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * dirtyCount, 0, nullptr, &events[1]);
+	CL_CHECK(clEnqueueFillBuffer, result);
+	result = clEnqueueNDRangeKernel(queue, data.extractKernel, 1, 0, &globalWorkSize, 0, 2, events, event);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	clReleaseEvent(events[0]);
+	clReleaseEvent(events[1]);
+
+	data.extractedBricks += dirtyCount;
+	for (cl_uint index : data.dirtyIndices)
+	{
+		data.dirty[index] = 0;
+		data.drift[index] = 0.0f;
+	}
+	data.dirtyIndices.clear();
+	data.dirtyBricks.clear();
+
+	// the bricks left empty for want of room try again next frame, when
+	// other bricks may have shrunk
+	for (cl_uint index : data.missedIndices)
+	{
+		size_t x = index % data.brickCount[0];
+		size_t y = index / data.brickCount[0] % data.brickCount[1];
+		size_t z = index / (data.brickCount[0] * data.brickCount[1]);
+		markBrickDirty(data, x, y, z);
+	}
+	data.missedIndices.clear();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "clcommon.h"
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+
+// faces per slot of the pooled vertex buffer, the unit brick ranges are
+// allocated in
+const cl_uint SLOT_FACES = 64;
+
+// incremental extraction, where only the bricks whose field has changed are
+// polygonised again. each brick with surface in it owns a range of whole
+// slots in a pooled vertex buffer that stays put until the brick is next
+// dirtied, and the ranges are drawn with one multi-draw indirect call.
+//
+// a dirty brick is re-extracted in two passes, first counting the triangles
+// it needs so the host can free its old range and allocate a new one, then
+// polygonising into that range. a frame with nothing dirty does no opencl
+// work at all.
+struct IncrementalData
+{
+	cl_kernel						countKernel;
+	cl_kernel						extractKernel;
+
+	size_t							brickSize;
+	size_t							brickCount[3];
+	size_t							totalBricks;
+	size_t							gridSize[3];
+
+	// the metaballs reach everywhere, so a brick is only dirtied once the
+	// field in it may have changed by more than this fraction of the
+	// threshold since it was last extracted
+	float							tolerance;
+	std::vector<glm::vec4>			previousParticles;		// as of the last frame
+	std::vector<float>				drift;					// per brick, bound on the field's change since its extraction
+
+	std::vector<unsigned char>		dirty;					// per brick
+	std::vector<cl_uint>			dirtyIndices;			// index of each dirty brick
+	std::vector<cl_uint>			dirtyBricks;			// packed the same way as the kernel's active bricks
+	std::vector<cl_uint>			dirtyFaces;				// counted by the device
+	std::vector<cl_uint>			dirtyRanges;			// first face and face count of each new range
+	std::vector<cl_uint>			missedIndices;			// dirty bricks the pool had no room for
+
+	// the pool, with each brick's range in slots and how many faces of it are used
+	cl_uint							poolSlots;
+	std::vector<cl_uint>			brickFirstSlot;
+	std::vector<cl_uint>			brickSlots;
+	std::vector<cl_uint>			brickFaces;
+	std::map<cl_uint, cl_uint>		freeSlots;				// first slot of each free run to its length, coalesced
+	cl_uint							faceCount;				// total over every brick
+
+	// DrawArraysIndirectCommand { count, instanceCount, first, baseInstance }
+	// for each run of faces, in pool order with touching ranges merged
+	std::vector<cl_uint>			drawCommands;
+	cl_uint							drawCount;
+
+	// per dirty brick, up to every brick of the grid
+	cl_mem							dirtyBrickLink;
+	cl_mem							brickFacesLink;			// counted faces, then the extraction's cursor
+	cl_mem							brickRangeLink;
+
+	size_t							extractedBricks;		// since the last report
+};
+
+// the field arguments of both kernels are left to the caller, from index 4
+// of countKernel and 6 of extractKernel
+bool createIncremental(IncrementalData& data, cl_context context, cl_program program, const size_t gridSize[3],
+					   size_t brickSize, cl_float threshold, cl_uint poolFaces, float tolerance);
+void releaseIncremental(IncrementalData& data);
+
+// forgets every range, such as once the pool has been reallocated, and
+// dirties the whole grid
+void resetIncremental(IncrementalData& data, cl_uint poolFaces);
+
+// marks the bricks whose cubes sample anywhere in the box, in cubes, so
+// edits to a volume can dirty the region they touched
+void markBricksDirty(IncrementalData& data, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+// dirties the bricks the particles' motion since the last frame reaches.
+// supportRadius is the compact-support field's radius, or 0 for metaballs,
+// whose moves are added to each brick's drift until it passes the tolerance
+void trackParticles(IncrementalData& data, const std::vector<glm::vec4>& particles, float supportRadius, cl_float threshold);
+
+// counts the dirty bricks' faces on the device, blocking until they're
+// back, then frees their old ranges and allocates new ones. returns false
+// if they didn't all fit, with requiredFaces the pool size they'd need
+// before fragmentation. bricks that missed out are left empty and dirtied
+// again once they've been extracted, so they're retried next frame
+bool allocateDirtyBricks(IncrementalData& data, cl_command_queue queue,
+						 cl_uint numWaitEvents, const cl_event* waitEvents, cl_uint& requiredFaces);
+
+// polygonises the dirty bricks into their new ranges of vertexLink, which
+// must already be acquired, and clears the dirty list
+void enqueueExtractDirtyBricks(IncrementalData& data, cl_command_queue queue, cl_mem vertexLink, cl_event* event);
@@ -0,0 +1,244 @@
+#include "lod.h"
+
+bool createLod(LodData& data, cl_context context, cl_program program, const size_t gridSize[3],
+			   cl_float threshold, float splitDistance)
+{
+	cl_int result = CL_SUCCESS;
+
+	data.context = context;
+	data.splitDistance = splitDistance;
+	data.extractedBlocks = 0;
+	data.extractedTransitions = 0;
+
+	// the root is the smallest block covering the whole grid
+	size_t largest = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		data.gridSize[i] = gridSize[i];
+		largest = glm::max(largest, gridSize[i]);
+	}
+	data.rootLevel = 0;
+	while ((LOD_BLOCK_SIZE << data.rootLevel) < largest)
+		++data.rootLevel;
+
+	data.blockKernel = clCreateKernel(program, "marchingCubesLod", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.transitionKernel = clCreateKernel(program, "transitionCells", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	data.blockCapacity = 1024;
+	data.blockLink = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_int4) * data.blockCapacity, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	cl_int grid[4] = { (cl_int)gridSize[0], (cl_int)gridSize[1], (cl_int)gridSize[2], 0 };
+	result = clSetKernelArg(data.blockKernel, 3, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.blockKernel, 4, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(data.transitionKernel, 3, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.transitionKernel, 4, sizeof(cl_int) * 4, grid);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseLod(LodData& data)
+{
+	clReleaseMemObject(data.blockLink);
+	clReleaseKernel(data.transitionKernel);
+	clReleaseKernel(data.blockKernel);
+}
+
+static int nodeSize(const LodNode& node)
+{
+	return (int)LOD_BLOCK_SIZE << node.level;
+}
+
+static bool inGrid(const LodData& data, const cl_int point[3])
+{
+	for (int i = 0; i < 3; ++i)
+		if (point[i] < 0 || point[i] >= (cl_int)data.gridSize[i])
+			return false;
+	return true;
+}
+
+static void splitNode(LodData& data, size_t index)
+{
+	int childSize = nodeSize(data.nodes[index]) / 2;
+	LodNode child = data.nodes[index];
+	child.level -= 1;
+	child.firstChild = -1;
+
+	data.nodes[index].firstChild = (int)data.nodes.size();
+	for (int i = 0; i < 8; ++i)
+	{
+		LodNode octant = child;
+		for (int axis = 0; axis < 3; ++axis)
+			octant.origin[axis] += ((i >> axis) & 1) * childSize;
+		data.nodes.push_back(octant);
+	}
+}
+
+// the deepest node containing point, going no finer than level
+static const LodNode& findNode(const LodData& data, const cl_int point[3], int level)
+{
+	const LodNode* node = &data.nodes[0];
+	while (node->level > level && node->firstChild >= 0)
+	{
+		int childSize = nodeSize(*node) / 2;
+		int octant = 0;
+		for (int axis = 0; axis < 3; ++axis)
+			octant |= (point[axis] - node->origin[axis] >= childSize) << axis;
+		node = &data.nodes[node->firstChild + octant];
+	}
+	return *node;
+}
+
+// a leaf touches a leaf more than a level finer if any of the nodes a level
+// down around it, across a face, edge or corner, has been split
+static bool touchesFinerLeaf(const LodData& data, const LodNode& leaf)
+{
+	int half = nodeSize(leaf) / 2;
+	for (int z = -1; z <= 2; ++z)
+	for (int y = -1; y <= 2; ++y)
+	for (int x = -1; x <= 2; ++x)
+	{
+		if (x >= 0 && x <= 1 && y >= 0 && y <= 1 && z >= 0 && z <= 1)
+			continue;
+
+		cl_int point[3] = { leaf.origin[0] + x * half, leaf.origin[1] + y * half, leaf.origin[2] + z * half };
+		if (!inGrid(data, point))
+			continue;
+
+		const LodNode& neighbour = findNode(data, point, leaf.level - 1);
+		if (neighbour.level == leaf.level - 1 && neighbour.firstChild >= 0)
+			return true;
+	}
+	return false;
+}
+
+void updateLod(LodData& data, const glm::vec3& eye)
+{
+	glm::vec3 gridMax((float)data.gridSize[0], (float)data.gridSize[1], (float)data.gridSize[2]);
+
+	// split every block in the grid that's close enough, top down
+	data.nodes.clear();
+	data.nodes.push_back({ { 0, 0, 0 }, data.rootLevel, -1 });
+	for (size_t i = 0; i < data.nodes.size(); ++i)
+	{
+		LodNode node = data.nodes[i];
+		if (node.level == 0 || !inGrid(data, node.origin))
+			continue;
+
+		glm::vec3 boxMin((float)node.origin[0], (float)node.origin[1], (float)node.origin[2]);
+		glm::vec3 boxMax = glm::min(boxMin + (float)nodeSize(node), gridMax);
+		float distance = glm::length(eye - glm::clamp(eye, boxMin, boxMax));
+		if (distance < data.splitDistance * nodeSize(node))
+			splitNode(data, i);
+	}
+
+	// then split the leaves that touch ones more than a level finer, which
+	// can cascade, until the tree is balanced
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+		for (size_t i = 0; i < data.nodes.size(); ++i)
+		{
+			LodNode node = data.nodes[i];
+			if (node.firstChild >= 0 || node.level == 0 || !inGrid(data, node.origin))
+				continue;
+
+			if (touchesFinerLeaf(data, node))
+			{
+				splitNode(data, i);
+				changed = true;
+			}
+		}
+	}
+
+	// a face needs transition cells where the block across it at the same
+	// level has been split, which balancing leaves as leaves a level finer
+	data.blocks.clear();
+	data.transitions.clear();
+	for (const LodNode& node : data.nodes)
+	{
+		if (node.firstChild >= 0 || !inGrid(data, node.origin))
+			continue;
+
+		data.blocks.push_back({ { node.origin[0], node.origin[1], node.origin[2], node.level } });
+		if (node.level == 0)
+			continue;
+
+		for (int face = 0; face < 6; ++face)
+		{
+			int axis = face >> 1;
+			cl_int across[3] = { node.origin[0], node.origin[1], node.origin[2] };
+			across[axis] += (face & 1) ? nodeSize(node) : -nodeSize(node);
+			if (!inGrid(data, across))
+				continue;
+
+			const LodNode& neighbour = findNode(data, across, node.level);
+			if (neighbour.level == node.level && neighbour.firstChild >= 0)
+				data.transitions.push_back({ { node.origin[0], node.origin[1], node.origin[2], node.level | (face << 8) } });
+		}
+	}
+}
+
+void enqueueExtractLod(LodData& data, cl_command_queue queue, std::vector<cl_int4>& upload,
+					   cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+
+	upload = data.blocks;
+	upload.insert(upload.end(), data.transitions.begin(), data.transitions.end());
+
+	// nothing of the grid is covered, such as an empty grid
+	if (data.blocks.empty())
+	{
+		result = clEnqueueMarkerWithWaitList(queue, numWaitEvents, waitEvents, event);
+		CL_CHECK(clEnqueueMarkerWithWaitList, result);
+		return;
+	}
+
+	// grow the block list, opencl keeps the old one until the queue is done with it
+	if (upload.size() > data.blockCapacity)
+	{
+		while (data.blockCapacity < upload.size())
+			data.blockCapacity *= 2;
+
+		clReleaseMemObject(data.blockLink);
+		data.blockLink = clCreateBuffer(data.context, CL_MEM_READ_ONLY, sizeof(cl_int4) * data.blockCapacity, nullptr, &result);
+		CL_CHECK(clCreateBuffer, result);
+	}
+
+	cl_uint firstTransition = (cl_uint)data.blocks.size();
+	result = clSetKernelArg(data.blockKernel, 5, sizeof(cl_mem), &data.blockLink);
+	result |= clSetKernelArg(data.transitionKernel, 5, sizeof(cl_mem), &data.blockLink);
+	result |= clSetKernelArg(data.transitionKernel, 6, sizeof(cl_uint), &firstTransition);
+	CL_CHECK(clSetKernelArg, result);
+
+	// event list in case we use out-of-order computations
+	cl_event events[2] = { 0, 0 };
+	result = clEnqueueWriteBuffer(queue, data.blockLink, CL_FALSE, 0, sizeof(cl_int4) * upload.size(), upload.data(), numWaitEvents, waitEvents, &events[0]);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+
+	size_t globalWorkSize = data.blocks.size() * LOD_BLOCK_SIZE * LOD_BLOCK_SIZE * LOD_BLOCK_SIZE;
+	result = clEnqueueNDRangeKernel(queue, data.blockKernel, 1, 0, &globalWorkSize, 0, 1, &events[0], data.transitions.empty() ? event : &events[1]);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	// both append to the same vertex buffer, so the transitions could run
+	// alongside the blocks on an out-of-order queue
+	if (!data.transitions.empty())
+	{
+		globalWorkSize = data.transitions.size() * LOD_BLOCK_SIZE * LOD_BLOCK_SIZE;
+		result = clEnqueueNDRangeKernel(queue, data.transitionKernel, 1, 0, &globalWorkSize, 0, 1, &events[1], event);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+	}
+
+	for (int i = 0; i < 2; ++i)
+		if (events[i] != 0)
+			clReleaseEvent(events[i]);
+
+	data.extractedBlocks += data.blocks.size();
+	data.extractedTransitions += data.transitions.size();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "clcommon.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// cubes along each side of a level of detail block, whatever its level
+// must match LOD_BLOCK_SIZE in the kernel, which we pass as a build option,
+// and be a power of two
+const size_t LOD_BLOCK_SIZE = 16;
+
+struct LodNode
+{
+	cl_int		origin[3];		// lower corner, in samples
+	int			level;			// cubes are 2^level samples on a side
+	int			firstChild;		// index of the first of 8 children, -1 for a leaf
+};
+
+// multi-resolution extraction, where the grid is covered by an octree of
+// blocks that each polygonise LOD_BLOCK_SIZE^3 cubes, so a block at level n
+// spans 2^n times as many samples with the same work as one at level 0.
+// blocks are split while the camera is closer than splitDistance times their
+// size, so the cubes project to roughly the same size on screen and the work
+// follows screen-space detail rather than the size of the grid.
+//
+// the tree is balanced so that no two touching blocks are more than a level
+// apart, and the faces a block shares with finer ones get transition cells
+// that stitch the two resolutions together.
+struct LodData
+{
+	cl_kernel				blockKernel;
+	cl_kernel				transitionKernel;
+	cl_context				context;
+
+	size_t					gridSize[3];
+	int						rootLevel;
+	float					splitDistance;
+
+	std::vector<LodNode>	nodes;				// nodes[0] is the root
+	std::vector<cl_int4>	blocks;				// leaves in the grid, xyz their corner and w their level
+	std::vector<cl_int4>	transitions;		// a block's corner and level, with the face towards finer blocks in w from bit 8
+
+	// blocks then transitions, grown as needed
+	cl_mem					blockLink;
+	size_t					blockCapacity;
+
+	// blocks and transition faces extracted since the last report
+	size_t					extractedBlocks;
+	size_t					extractedTransitions;
+};
+
+// the field arguments of both kernels, and the output arguments 0 to 2, are
+// left to the caller, from index 6 of blockKernel and 7 of transitionKernel
+bool createLod(LodData& data, cl_context context, cl_program program, const size_t gridSize[3],
+			   cl_float threshold, float splitDistance);
+void releaseLod(LodData& data);
+
+// rebuilds the tree around the eye, in samples, and finds the faces that
+// need transition cells
+void updateLod(LodData& data, const glm::vec3& eye);
+
+// polygonises the blocks and then the transition cells, appending to the
+// vertex buffer set on the kernels. upload holds the host copy of the
+// blocks until the write has finished
+void enqueueExtractLod(LodData& data, cl_command_queue queue, std::vector<cl_int4>& upload,
+					   cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
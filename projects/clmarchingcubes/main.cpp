@@ -1,53 +1,186 @@
 #include "utilities.h"
+#include "clcommon.h"
+#include "bins.h"
+#include "volume.h"
+#include "volumefilter.h"
+#include "stream.h"
+#include "cpumc.h"
+#include "export.h"
+#include "incremental.h"
+#include "lod.h"
+#include "nets.h"
+#include "raycast.h"
+#include "sparse.h"
+#include "fieldexpr.h"
+#include "programcache.h"
+#include "mctables.h"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <vector>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
 
-#if defined(__APPLE__) || defined(MACOSX)
-    #include <OpenCL/cl.h>
-    #include <OpenCL/cl_gl_ext.h>
-	#include <OpenGL/OpenGL.h>
-#elif defined(WIN32)
-	#include <CL/cl.h>
-	#include <CL/cl_gl_ext.h>
-	#include <GL/GL.h>
-	#include <windows.h>
-#else
-	#include <GL/glx.h>
-	#include <GL/gl.h>
-	#include <CL/cl.h>
-	#include <CL/cl_gl.h>
+// kernels, and the headers they share with the host, are loaded from -kernels,
+// by default the kernel directory of the source tree the build was configured from
+#ifndef KERNEL_DIR
+#define KERNEL_DIR "bin/kernels/cl"
 #endif
 
-// helper macros for checking for opencl errors
-#define CL_CHECK(str, result) if (result != CL_SUCCESS) { printf("Error: %s - %i\n", #str, result); }
+// the surface is extracted into one of a ring of output buffers while the
+// previous one is drawn, so opencl and opengl can overlap
+const int MAX_OUTPUT_BUFFERS = 3;
 
-// on windows / linux we need to get access to the extension function handle to determine which
-// device is sharable as the opencl / opengl context
-#if !defined(__APPLE__) && !defined(MACOSX)
-	typedef CL_API_ENTRY cl_int (CL_API_CALL *clGetGLContextInfoKHRfunc)(const cl_context_properties*,cl_gl_context_info,size_t,void*,size_t*);
-#endif
+// the buffers grow to fit the surface over the first frames, so -frames
+// leaves these out of its measurement
+const int MEASURE_WARMUP_FRAMES = 60;
 
 struct GLData
 {
 	// shader program
 	GLuint	program;
 
-	// marching cube vertex data
-	GLuint	blobVAO;
-	GLuint	blobVBO;
+	// marching cube vertex data, one per output buffer
+	GLuint	blobVAO[MAX_OUTPUT_BUFFERS];
+	GLuint	blobVBO[MAX_OUTPUT_BUFFERS];
+
+	// indirect draw command for each blob, written by opencl
+	GLuint	drawCommandBuffer[MAX_OUTPUT_BUFFERS];
+
+	// signalled once opengl has finished drawing from each output buffer
+	GLsync	blobFence[MAX_OUTPUT_BUFFERS];
+
+	// draw commands for the brick ranges of the incremental pool, drawn in
+	// one call where glMultiDrawArraysIndirect (4.3) is available
+	GLuint	brickCommandBuffer;
+	bool	multiDrawIndirect;
 
 	// border square vertex data
 	GLuint	boxVAO;
 	GLuint	boxVBO;
+
+	// image the isosurface is ray cast into, drawn over the window by a
+	// quad whose corners come from gl_VertexID
+	GLuint	raycastTexture;
+	size_t	raycastSize[2];
+	GLuint	quadProgram;
+	GLuint	quadVAO;
 };
 
+// cubes along each side of a brick used for empty-space skipping
+// must match BRICK_SIZE in the kernel, which we pass as a build option, and
+// be a power of two so a brick's cubes fill a morton range
+const size_t BRICK_SIZE = 8;
+
+// default distance, in multiples of a level of detail block's size, the
+// camera has to be within for the block to be split
+const float LOD_SPLIT_DISTANCE = 2.0f;
+
+// default blocks in the sparse brick pool to start with, it doubles as needed
+const cl_uint SPARSE_BLOCKS = 4096;
+
+// default fraction of the threshold the metaballs' field can drift by before
+// incremental extraction re-extracts a brick
+const float DIRTY_TOLERANCE = 0.01f;
+
+// output capacity management, the vertex buffer doubles when the surface
+// overflows it and shrinks once it has been under a quarter full for a while
+const cl_uint MIN_FACES = 1 << 14;
+const cl_uint SHRINK_FRAMES = 120;
+
+// bytes per output vertex, a float4 position and normal or, with compact
+// vertices, 16-bit quantised positions and an octahedral-encoded normal
+const size_t VERTEX_SIZE = sizeof(glm::vec4) * 2;
+const size_t COMPACT_VERTEX_SIZE = sizeof(cl_uint) * 3;
+
+// most isovalues extracted together, which the kernel takes as a float8
+const int MAX_LEVELS = 8;
+
 struct MCData
 {
 	size_t		gridSize[3];
 	cl_float	threshold;
 	cl_uint		maxFaces;
 	cl_uint		faceCount;
+	cl_uint		maxFaceLimit;		// most triangles the device can allocate for
+	cl_uint		lowUsageFrames;		// consecutive frames using under a quarter of maxFaces
+
+	// brick-level empty-space skipping
+	bool		useBricks;
+	size_t		brickCount[3];
+
+	// draw from a command written on the device, rather than from the face
+	// count on the host
+	bool		useIndirect;
+
+	// ring of output buffers, outputIndex is the one extracted into next
+	int			outputCount;
+	int			outputIndex;
+	cl_uint		outputFaceCount[MAX_OUTPUT_BUFFERS];
+
+	// polygonise the whole grid in work-groups that share their corners through local memory
+	bool		useTiles;
+	size_t		tileSize[3];		// local work size, 0 picks one for the device
+	size_t		tiledGridSize[3];	// grid size rounded up to whole tiles
+
+	// output vertex format, must match COMPACT_VERTICES in the kernel
+	bool		compactVertices;
+	size_t		vertexSize;
+
+	// only re-extract the bricks whose field changed, into a persistent pool
+	bool		useIncremental;
+
+	// walk the cubes of each brick in morton order, launching the whole grid
+	// as a 1d range of bricks, must match MORTON_ORDER in the kernel
+	bool		useMorton;
+
+	// polygonise an octree of blocks at resolutions chosen by camera distance
+	bool		useLod;
+
+	// extract a surface net rather than marching cubes, placing its vertices
+	// by dual contouring with useDualContouring, which must match
+	// DUAL_CONTOURING in the kernel
+	bool		useNets;
+	bool		useDualContouring;
+
+	// draw the isosurface by casting rays through the field rather than extracting a mesh
+	bool		useRaycast;
+
+	// nested surfaces at several isovalues from one pass over the field,
+	// each in its own range of maxFaces triangles in the vertex buffer
+	bool		useLevels;
+	int			levelCount;
+	cl_float	levels[MAX_LEVELS];
+	cl_uint		outputLevelFaceCount[MAX_OUTPUT_BUFFERS][MAX_LEVELS];
+
+	// only sample the bricks the surface passes through, found through a
+	// hash table on the device, rather than a fixed grid
+	bool		useSparse;
+};
+
+// scalar field that is polygonised
+// must match the FIELD_ define in the kernel, which we pass as a build option
+enum FieldType
+{
+	METABALLS,	// 1/r^2 summed over every particle
+	WYVILL,		// compact-support kernel with the particles binned on the device
+	VOLUME,		// raw volume file mapped from disk
+	EXPRESSION,	// shape generated from a field expression, compiled with the kernels
+};
+
+struct FieldData
+{
+	FieldType	type;
+	cl_int		particleCount;
+	cl_float	radius;			// cutoff radius of the compact-support kernel
+
+	RawVolume	volume;
+	cl_int		volumeDims[4];
+
+	FieldExpression	expression;
+
+	// move the particles on the device each frame rather than uploading them
+	bool		animateOnDevice;
 };
 
 struct CLData
@@ -55,24 +188,560 @@ struct CLData
 	cl_context			context;
 	cl_command_queue	queue;
 	cl_program			program;
+	ProgramCache		programCache;
 	cl_kernel			kernel;
+	cl_kernel			brickKernel;
+	cl_kernel			brickMarchingCubesKernel;
+	cl_kernel			drawCommandKernel;
+	cl_kernel			tiledKernel;
+	cl_kernel			mortonKernel;
+	cl_kernel			animateKernel;		// animateOnDevice only
+	cl_kernel			levelsKernel;
 
-	cl_mem				vboLink;
+	cl_mem				vboLink[MAX_OUTPUT_BUFFERS];
 	cl_mem				faceCountLink;
 	cl_mem				particleLink;
+	cl_mem				particleSeedLink;	// animateOnDevice only
+	cl_mem				activeBrickCountLink;
+	cl_mem				activeBrickLink;
+	cl_mem				volumeLink;
+	cl_mem				drawCommandLink[MAX_OUTPUT_BUFFERS];
+	cl_mem				tableImage;			// TABLE_LAYOUT_IMAGE only
+
+	BinData				bins;
+	LodData				lod;
+	NetData				nets;
+	RaycastData			raycast;
+	SparseData			sparse;
+	cl_mem				raycastImageLink;	// raycastTexture, useRaycast only
+
+	// first and last commands of the extraction into each output buffer
+	cl_event			outputStartEvent[MAX_OUTPUT_BUFFERS];
+	cl_event			outputReadyEvent[MAX_OUTPUT_BUFFERS];
+
+	// time opencl spent extracting since the last report, from queue profiling
+	cl_ulong			busyTime;
+
+	// host copies of the particles and level of detail blocks for each output buffer's pending upload
+	std::vector<glm::vec4> particleUpload[MAX_OUTPUT_BUFFERS];
+	std::vector<cl_int4> lodUpload[MAX_OUTPUT_BUFFERS];
+
+	// true if releasing shared objects orders later opengl commands (cl_khr_gl_event)
+	bool				implicitGLSync;
 };
 
 // method to initialise all opengl settings and buffers
 void setupGL(GLData& glData, const MCData& mcData);
 
+// sets the trailing field arguments of a kernel starting at index firstArg
+cl_int setFieldArgs(cl_kernel kernel, cl_uint firstArg, const FieldData& fieldData, CLData& clData);
+
+// largest side of the grid, which compact positions are quantised relative to
+size_t maxGridSize(const MCData& mcData);
+
+// ranges of maxFaces triangles in each vertex buffer, one per isovalue level
+cl_uint outputRanges(const MCData& mcData);
+
+// picks the largest roughly cubic local work size for the tiled kernel that the device supports
+void chooseTileSize(cl_device_id device, cl_kernel kernel, size_t tileSize[3]);
+
+// whether a tile fits in one of the tiled kernel's work-groups and its corners in local memory,
+// printing which limit it breaks when report is set
+bool tileFits(cl_device_id device, cl_kernel kernel, const size_t tileSize[3], bool report);
+
+// reallocates the shared vertex buffers to hold capacity triangles and relinks them to opencl
+void resizeOutput(GLData& glData, MCData& mcData, CLData& clData, cl_uint capacity);
+
+// reallocates just the opengl vertex buffers, for the cpu path which opencl never writes
+void resizeCPUOutput(GLData& glData, MCData& mcData, cl_uint capacity);
+
+// the capacity the vertex buffer should have for the last frame's face count,
+// mcData.maxFaces if it should stay as it is
+cl_uint chooseOutputCapacity(MCData& mcData);
+
+// grows or shrinks the vertex buffers to suit the face count of the buffer about to be drawn.
+// returns true if they were reallocated, losing what was extracted into them
+bool manageOutputCapacity(GLData& glData, MCData& mcData, CLData& clData);
+
+// the same for the cpu path, without going through opencl
+bool manageCPUOutputCapacity(GLData& glData, MCData& mcData);
+
+// runs a frame of extraction from the field into the current output buffer without waiting for it
+void extractSurface(GLData& glData, MCData& mcData, const FieldData& fieldData, CLData& clData, std::vector<glm::vec4>& particles);
+
+// waits for opencl to release an output buffer so that opengl can draw it, taking its face count
+void waitForOutput(MCData& mcData, CLData& clData, int output);
+
+// waits for opengl to finish drawing from an output buffer so that opencl can write it
+void waitForDrawing(GLData& glData, int output);
+
+// brings the particles on the device up to date for an extraction into output, animating
+// them there or uploading the host's copy, and signals event once the field can be sampled
+void enqueueParticleUpdate(const FieldData& fieldData, CLData& clData, const std::vector<glm::vec4>& particles,
+						   int output, cl_event* event);
+
+// adds the opencl time of an output buffer's finished extraction to the busy time
+void collectBusyTime(CLData& clData, int output);
+
+// ray casts the isosurface through the current camera into the raycast texture,
+// waiting for it unless opengl synchronises with opencl itself
+void raycastSurface(GLData& glData, const FieldData& fieldData, CLData& clData,
+					std::vector<glm::vec4>& particles, const glm::mat4& pvm);
+
+// reallocates the raycast texture to match a resized window and relinks it to opencl
+void resizeRaycastImage(GLData& glData, CLData& clData, GLint width, GLint height);
+
+// re-extracts the bricks the field has changed in since the last frame into the pool
+void extractIncremental(GLData& glData, MCData& mcData, const FieldData& fieldData, CLData& clData,
+						IncrementalData& incData, std::vector<glm::vec4>& particles);
+
+// animates the metaballs, the default 8 follow hand-written paths while
+// larger sets drift around randomly placed seeds
+void animateParticles(std::vector<glm::vec4>& particles, const std::vector<glm::vec4>& seeds,
+					  float time, const MCData& mcData);
+
+// polygonises the particles on the cpu into the current output buffer
+void extractSurfaceCPU(GLData& glData, MCData& mcData, CPUMCData& cpuData,
+					   const std::vector<glm::vec4>& particles, std::vector<glm::vec4>& vertices);
+
+// times the cpu implementation over a number of animated frames without opening a window
+void benchmarkCPU(MCData& mcData, std::vector<glm::vec4>& particles, const std::vector<glm::vec4>& seeds,
+				  unsigned int threadCount, int frames);
+
+// writes a size^3 8-bit volume of a few blended blobs for testing the volume loader
+bool writeTestVolume(const char* path, unsigned int size);
+
+// reads an output buffer back for the exporter once its extraction has finished,
+// returns false if nothing has been extracted into it yet
+bool captureSurface(MCData& mcData, CLData& clData, MeshExporter& exporter, int output);
+
 int main(int argc, char* argv[])
 {
 	// setup initial data
-	MCData mcData = { { 64, 64, 64 }, 0.04f, 250000, 0 };
+	MCData mcData = { { 64, 64, 64 }, 0.04f, 1 << 16, 0, 0, 0, true, { 0, 0, 0 }, true, 2, 0 };
 	GLData glData = { 0 };
 	CLData clData;
-	const int particleCount = 8;
-	glm::vec4 particles[particleCount];
+	FieldData fieldData = { METABALLS, 8, 8.0f };
+	const char* volumePath = nullptr;
+	std::vector<VolumeFilter> volumeFilters;
+	const char* shapeName = nullptr;
+	const char* programCachePath = nullptr;
+	std::string kernelDir = KERNEL_DIR;
+	bool streaming = false;
+	const char* streamPath = nullptr;
+	StreamSettings streamSettings = { 0 };
+	bool thresholdSet = false;
+	bool useCPU = false;
+	unsigned int cpuThreads = 0;
+	int cpuBenchmarkFrames = 0;
+	int measureFrames = 0;
+	const char* exportPath = nullptr;
+	int exportFrames = 1;
+	bool exportWeld = true;
+	float exportSimplifyRatio = 1.0f;
+	float exportSimplifyError = 0.0f;
+	float dirtyTolerance = DIRTY_TOLERANCE;
+	float lodSplitDistance = LOD_SPLIT_DISTANCE;
+	cl_uint sparseBlocks = SPARSE_BLOCKS;
+	TableLayout tableLayout = TABLE_LAYOUT_FULL;
+
+	// command-line options
+	// -nobricks			polygonise every cube of the grid rather than only the active bricks
+	// -noindirect			read the face count back each frame rather than drawing indirectly
+	// -buffers n			output buffers to rotate through, 1 waits for each extraction before drawing
+	// -frames n			draw n frames without vsync after a warm-up, print their average frame rate,
+	//						opencl idle time and time spent waiting for opencl and exit, to compare -buffers 1, 2 and 3
+	// -tiled				polygonise the whole grid in tiles sharing corners through local memory
+	// -tile n				cubes along each side of a tile, rather than choosing for the device
+	// -incremental			only re-extract the bricks the field changed in, P pauses the animation
+	// -tolerance t			fraction of the threshold the metaballs can drift by before a brick is re-extracted
+	// -morton				polygonise the cubes of each brick in morton order rather than in rows,
+	//						and with -nobricks the whole grid as a 1d range of bricks
+	// -lod					polygonise blocks at resolutions chosen by distance from the camera,
+	//						stitched together with transition cells
+	// -loddistance d		split blocks closer to the camera than d times their size (default 2)
+	// -nets				polygonise a surface net, a vertex per crossed cube and a quad per crossed edge
+	// -dualcontouring		place the surface net's vertices by dual contouring, keeping sharp features
+	// -raycast				draw the isosurface by casting a ray per pixel through the field each frame
+	// -levels t,t,...		polygonise nested surfaces at up to 8 isovalues in one pass, coloured by level
+	// -sparse				track the particles' surface through hashed bricks rather than a fixed grid
+	// -sparseblocks n		bricks the sparse pool starts with room for (default 4096)
+	// -compact				write 12-byte quantised vertices rather than 32-byte float ones
+	// -tables full|packed|local|image	lookup table layout, see mcbenchmark -tables for which suits the device
+	// -cpu					polygonise the metaballs with the multithreaded cpu implementation
+	// -threads n			cpu threads, including the main thread (default one per hardware thread)
+	// -cpubenchmark n		time n frames of the cpu implementation without a window and exit
+	// -grid n				cubes along each side of the grid
+	// -particles n			number of particles making up the field
+	// -deviceanimation		animate the particles on the device rather than uploading them each frame
+	// -field wyvill		compact-support field with device-side binning (default metaballs)
+	// -radius r			cutoff radius of the compact-support field
+	// -threshold t			isovalue of the surface
+	// -volume path			polygonise a raw volume file rather than particles
+	// -shape csg|blobs|rock	polygonise an example field expression, blobs melting the particles into a floor
+	// -programcache path	keep built programs in path so later runs skip compiling them
+	// -kernels dir			directory holding marchingcubes.cl and mctables.h
+	// -filter f			smooth the volume on the device first with gaussian[:sigma], box[:radius] or median,
+	//						repeated to chain filters in order
+	// -makevolume path n	write an n^3 test volume and exit
+	// -stream				extract the volume once in z-slabs rather than uploading it whole
+	// -slab n				cubes along z per streamed slab
+	// -streamout path		append streamed triangles to a file rather than keeping them on the host
+	// -export path			write the first frame's surface to path_0000.ply (or .obj), E captures more
+	// -exportframes n		write a numbered sequence of the first n frames
+	// -exportsoup			write every triangle's own vertices rather than welding shared ones
+	// -exportsimplify r	simplify exported surfaces down to r of their triangles
+	// -exportsimplifyerror e	let simplification move the surface by at most e cubes
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-nobricks") == 0)
+			mcData.useBricks = false;
+		else if (strcmp(argv[i], "-noindirect") == 0)
+			mcData.useIndirect = false;
+		else if (strcmp(argv[i], "-tiled") == 0)
+			mcData.useTiles = true;
+		else if (strcmp(argv[i], "-incremental") == 0)
+			mcData.useIncremental = true;
+		else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc)
+			dirtyTolerance = glm::max((float)atof(argv[++i]), 1e-6f);
+		else if (strcmp(argv[i], "-tile") == 0 && i + 1 < argc)
+		{
+			// the device's limits are checked once it has been chosen
+			int tile = atoi(argv[++i]);
+			if (tile < 1)
+			{
+				printf("Invalid tile size %s, expected a positive number of cubes\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+			mcData.useTiles = true;
+			mcData.tileSize[0] = mcData.tileSize[1] = mcData.tileSize[2] = (size_t)tile;
+		}
+		else if (strcmp(argv[i], "-cpu") == 0)
+			useCPU = true;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			cpuThreads = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-cpubenchmark") == 0 && i + 1 < argc)
+			cpuBenchmarkFrames = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-tables") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			for (int j = 0; j < TABLE_LAYOUT_COUNT; ++j)
+				if (strcmp(name, TABLE_LAYOUT_NAMES[j]) == 0)
+					tableLayout = (TableLayout)j;
+		}
+		else if (strcmp(argv[i], "-morton") == 0)
+			mcData.useMorton = true;
+		else if (strcmp(argv[i], "-lod") == 0)
+			mcData.useLod = true;
+		else if (strcmp(argv[i], "-loddistance") == 0 && i + 1 < argc)
+		{
+			mcData.useLod = true;
+			lodSplitDistance = glm::max((float)atof(argv[++i]), 0.0f);
+		}
+		else if (strcmp(argv[i], "-nets") == 0)
+			mcData.useNets = true;
+		else if (strcmp(argv[i], "-dualcontouring") == 0)
+		{
+			mcData.useNets = true;
+			mcData.useDualContouring = true;
+		}
+		else if (strcmp(argv[i], "-raycast") == 0)
+			mcData.useRaycast = true;
+		else if (strcmp(argv[i], "-levels") == 0 && i + 1 < argc)
+		{
+			mcData.useLevels = true;
+			mcData.levelCount = 0;
+			for (char* level = strtok(argv[++i], ","); level != nullptr && mcData.levelCount < MAX_LEVELS; level = strtok(nullptr, ","))
+				mcData.levels[mcData.levelCount++] = (float)atof(level);
+		}
+		else if (strcmp(argv[i], "-sparse") == 0)
+			mcData.useSparse = true;
+		else if (strcmp(argv[i], "-sparseblocks") == 0 && i + 1 < argc)
+		{
+			mcData.useSparse = true;
+			sparseBlocks = (cl_uint)glm::max(atoi(argv[++i]), 1);
+		}
+		else if (strcmp(argv[i], "-compact") == 0)
+			mcData.compactVertices = true;
+		else if (strcmp(argv[i], "-buffers") == 0 && i + 1 < argc)
+			mcData.outputCount = glm::clamp(atoi(argv[++i]), 1, MAX_OUTPUT_BUFFERS);
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			measureFrames = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-grid") == 0 && i + 1 < argc)
+			mcData.gridSize[0] = mcData.gridSize[1] = mcData.gridSize[2] = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-particles") == 0 && i + 1 < argc)
+			fieldData.particleCount = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-deviceanimation") == 0)
+			fieldData.animateOnDevice = true;
+		else if (strcmp(argv[i], "-field") == 0 && i + 1 < argc)
+			fieldData.type = strcmp(argv[++i], "wyvill") == 0 ? WYVILL : METABALLS;
+		else if (strcmp(argv[i], "-radius") == 0 && i + 1 < argc)
+		{
+			// the particles are binned into cells the size of the radius
+			fieldData.radius = (float)atof(argv[++i]);
+			if (!(fieldData.radius > 0.0f))
+			{
+				printf("-radius must be greater than 0\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc)
+		{
+			mcData.threshold = (float)atof(argv[++i]);
+			thresholdSet = true;
+		}
+		else if (strcmp(argv[i], "-volume") == 0 && i + 1 < argc)
+		{
+			fieldData.type = VOLUME;
+			volumePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-shape") == 0 && i + 1 < argc)
+		{
+			fieldData.type = EXPRESSION;
+			shapeName = argv[++i];
+		}
+		else if (strcmp(argv[i], "-kernels") == 0 && i + 1 < argc)
+			kernelDir = argv[++i];
+		else if (strcmp(argv[i], "-programcache") == 0 && i + 1 < argc)
+			programCachePath = argv[++i];
+		else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+		{
+			VolumeFilter filter;
+			if (!parseVolumeFilter(argv[++i], filter))
+			{
+				printf("Unknown filter %s, expected gaussian[:sigma], box[:radius] or median\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+			volumeFilters.push_back(filter);
+		}
+		else if (strcmp(argv[i], "-stream") == 0)
+			streaming = true;
+		else if (strcmp(argv[i], "-slab") == 0 && i + 1 < argc)
+			streamSettings.slabDepth = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-streamout") == 0 && i + 1 < argc)
+			streamPath = argv[++i];
+		else if (strcmp(argv[i], "-export") == 0 && i + 1 < argc)
+			exportPath = argv[++i];
+		else if (strcmp(argv[i], "-exportframes") == 0 && i + 1 < argc)
+			exportFrames = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-exportsoup") == 0)
+			exportWeld = false;
+		else if (strcmp(argv[i], "-exportsimplify") == 0 && i + 1 < argc)
+			exportSimplifyRatio = glm::clamp((float)atof(argv[++i]), 0.0f, 1.0f);
+		else if (strcmp(argv[i], "-exportsimplifyerror") == 0 && i + 1 < argc)
+			exportSimplifyError = glm::max((float)atof(argv[++i]), 0.0f);
+		else if (strcmp(argv[i], "-makevolume") == 0 && i + 2 < argc)
+		{
+			const char* path = argv[++i];
+			exit(writeTestVolume(path, atoi(argv[++i])) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	// tiles cover the whole grid, so they replace brick skipping
+	if (mcData.useTiles)
+		mcData.useBricks = false;
+
+	// the pool is updated in place and drawn from commands built alongside it
+	if (mcData.useIncremental)
+	{
+		if (useCPU || mcData.useTiles || streaming)
+		{
+			printf("-incremental can't be combined with -cpu, -tiled or -stream\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.outputCount = 1;
+		mcData.useIndirect = true;
+	}
+
+	// blocks replace brick skipping, and are chosen afresh as the camera moves
+	if (mcData.useLod)
+	{
+		if (useCPU || mcData.useTiles || mcData.useIncremental || streaming)
+		{
+			printf("-lod can't be combined with -cpu, -tiled, -incremental or -stream\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.useBricks = false;
+	}
+
+	// the net is extracted from a cache of the whole grid's samples
+	if (mcData.useNets)
+	{
+		if (useCPU || mcData.useTiles || mcData.useIncremental || mcData.useLod || streaming)
+		{
+			printf("-nets can't be combined with -cpu, -tiled, -incremental, -lod or -stream\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.useBricks = false;
+	}
+
+	// nothing is extracted, the rays are cast into a single image as it's drawn
+	if (mcData.useRaycast)
+	{
+		if (useCPU || mcData.useTiles || mcData.useIncremental || mcData.useLod || mcData.useNets || streaming)
+		{
+			printf("-raycast can't be combined with -cpu, -tiled, -incremental, -lod, -nets or -stream\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.useBricks = false;
+		mcData.outputCount = 1;
+	}
+
+	// every level is polygonised over the whole grid, as bricks are only
+	// classified against the one threshold, and drawn from its own range
+	if (mcData.useLevels)
+	{
+		if (useCPU || mcData.useTiles || mcData.useIncremental || mcData.useLod || mcData.useNets ||
+			mcData.useRaycast || mcData.useMorton || streaming || exportPath != nullptr)
+		{
+			printf("-levels can't be combined with -cpu, -tiled, -incremental, -lod, -nets, -raycast, -morton, -stream or -export\n");
+			exit(EXIT_FAILURE);
+		}
+		if (mcData.levelCount == 0)
+		{
+			printf("-levels needs at least one isovalue\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.useBricks = false;
+		mcData.useIndirect = false;
+	}
+
+	// the bricks are seeded from the particles and can leave the grid, where
+	// compact positions would saturate, so there's no grid of bricks to skip
+	if (mcData.useSparse)
+	{
+		if (useCPU || mcData.useTiles || mcData.useIncremental || mcData.useLod || mcData.useNets ||
+			mcData.useRaycast || mcData.useLevels || mcData.compactVertices || streaming)
+		{
+			printf("-sparse can't be combined with -cpu, -tiled, -incremental, -lod, -nets, -raycast, -levels, -compact or -stream\n");
+			exit(EXIT_FAILURE);
+		}
+		if (fieldData.type != METABALLS && fieldData.type != WYVILL)
+		{
+			printf("-sparse only supports the particle fields\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.useBricks = false;
+	}
+
+	// the cpu implementation writes float vertices of the metaball field
+	if (useCPU || cpuBenchmarkFrames > 0)
+	{
+		if (fieldData.type != METABALLS)
+		{
+			printf("-cpu only supports the metaball field\n");
+			exit(EXIT_FAILURE);
+		}
+		mcData.compactVertices = false;
+	}
+
+	// the host never sees the particles, which the cpu and incremental tracking need
+	if (fieldData.animateOnDevice && (useCPU || cpuBenchmarkFrames > 0 || mcData.useIncremental))
+	{
+		printf("-deviceanimation can't be combined with -cpu, -cpubenchmark or -incremental\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// simplification collapses the edges that welded triangles share, and
+	// triangle soup shares none
+	if (!exportWeld && (exportSimplifyRatio < 1.0f || exportSimplifyError > 0.0f))
+	{
+		printf("-exportsoup can't be combined with -exportsimplify or -exportsimplifyerror\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// the compact-support kernel peaks at 1 rather than growing without bound
+	if (fieldData.type == WYVILL && !thresholdSet)
+		mcData.threshold = 0.25f;
+
+	// expressions are distances, so their surface is at 0. -incremental only
+	// dirties bricks by how far the particles move, which misses what the shape does
+	if (fieldData.type == EXPRESSION)
+	{
+		if (!buildExampleField(fieldData.expression, shapeName, mcData.gridSize))
+		{
+			printf("Unknown shape %s, expected csg, blobs or rock\n", shapeName);
+			exit(EXIT_FAILURE);
+		}
+		if (mcData.useIncremental)
+		{
+			printf("-incremental can't be combined with -shape\n");
+			exit(EXIT_FAILURE);
+		}
+		if (!thresholdSet)
+			mcData.threshold = 0.0f;
+	}
+
+	// volumes are mapped rather than read so that only the pages opencl touches are loaded,
+	// and the grid is sized to fit the volume's samples
+	if (fieldData.type == VOLUME)
+	{
+		if (!openRawVolume(fieldData.volume, volumePath))
+			exit(EXIT_FAILURE);
+
+		const VolumeHeader& header = fieldData.volume.header;
+		for (int i = 0; i < 3; ++i)
+		{
+			fieldData.volumeDims[i] = (cl_int)header.dims[i];
+			mcData.gridSize[i] = header.dims[i] - 1;
+		}
+		fieldData.volumeDims[3] = 0;
+
+		printf("Volume: %u x %u x %u, %u byte samples\n", header.dims[0], header.dims[1], header.dims[2], header.format);
+
+		// samples are normalised so halfway is a sensible default
+		if (!thresholdSet)
+			mcData.threshold = 0.5f;
+
+		// default to slabs of roughly 64MB
+		if (streaming && streamSettings.slabDepth == 0)
+		{
+			size_t sliceBytes = (size_t)header.dims[0] * header.dims[1] * header.format;
+			streamSettings.slabDepth = glm::max((size_t)(64 << 20) / sliceBytes, (size_t)1);
+		}
+	}
+	else if (streaming)
+	{
+		printf("-stream requires a -volume\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// slabs would need filtering with the neighbouring slabs' samples
+	if (!volumeFilters.empty() && (fieldData.type != VOLUME || streaming))
+	{
+		printf("-filter requires a -volume and can't be combined with -stream\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// a streamed volume is extracted once, so there is nothing to overlap,
+	// and its slabs are read back and stitched together as float vertices
+	if (streaming)
+	{
+		mcData.outputCount = 1;
+		mcData.compactVertices = false;
+	}
+	mcData.vertexSize = mcData.compactVertices ? COMPACT_VERTEX_SIZE : VERTEX_SIZE;
+
+	// random seeds for animating large particle sets, w is a phase offset
+	std::vector<glm::vec4> particles(fieldData.particleCount);
+	std::vector<glm::vec4> particleSeeds(fieldData.particleCount);
+	glm::vec3 gridExtents(mcData.gridSize[0], mcData.gridSize[1], mcData.gridSize[2]);
+	for (auto& seed : particleSeeds)
+		seed = glm::vec4(glm::linearRand(gridExtents * 0.1f, gridExtents * 0.9f), glm::linearRand(0.0f, 6.2831853f));
+
+	if (cpuBenchmarkFrames > 0)
+	{
+		benchmarkCPU(mcData, particles, particleSeeds, cpuThreads, cpuBenchmarkFrames);
+		exit(EXIT_SUCCESS);
+	}
+
+	// round up so that partially filled bricks cover the far edges of the grid
+	size_t totalBricks = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		mcData.brickCount[i] = (mcData.gridSize[i] + BRICK_SIZE - 1) / BRICK_SIZE;
+		totalBricks *= mcData.brickCount[i];
+	}
 
 	// window creation and opengl initialisaion
 	GLFWwindow* window = createWindow(1280, 720, "Marching Cubes");
@@ -80,6 +749,10 @@ int main(int argc, char* argv[])
 		exit(EXIT_FAILURE);
 
 	setupGL(glData, mcData);
+
+	// a measurement is of how fast the frames can go, not the display's refresh
+	if (measureFrames > 0)
+		glfwSwapInterval(0);
     
     // opencl setup
 	cl_uint numPlatforms = 0;
@@ -152,19 +825,60 @@ int main(int argc, char* argv[])
 #endif
     
 	// create a command queue for the device so that we can fire off opencl calls
-    clData.queue = clCreateCommandQueue(clData.context, cl_gl_device, 0, &result);
+    // profiling lets us report how long opencl sits idle each frame
+    clData.queue = clCreateCommandQueue(clData.context, cl_gl_device, CL_QUEUE_PROFILING_ENABLE, &result);
     CL_CHECK(clCreateCommandQueue, result);
 
-	// load kernel code
+	// built programs are reused within the run, and across runs given a directory
+	createProgramCache(clData.programCache, clData.context, cl_gl_device, programCachePath);
+
+	// load kernel code, followed by the generated field expression
 	size_t size = 0;
-	char* kernelSource = readFileContents(
-		"/Users/AIE/Development/GitHub/gpusandbox/bin/kernels/cl/marchingcubes.cl", &size);
+	char* kernelSource = readFileContents((kernelDir + "/marchingcubes.cl").c_str(), &size);
+	std::string fieldSource;
+	if (fieldData.type == EXPRESSION)
+		fieldSource = generateFieldSource(fieldData.expression);
+	const char* sources[2] = { kernelSource, fieldSource.c_str() };
+	size_t sourceLengths[2] = { size, fieldSource.size() };
+
+	const char* fieldOptions = "";
+	if (fieldData.type == WYVILL)
+		fieldOptions = " -D FIELD_WYVILL";
+	else if (fieldData.type == VOLUME && fieldData.volume.header.format == VOLUME_UINT8)
+		fieldOptions = " -D FIELD_VOLUME -D VOLUME_TYPE=uchar -D VOLUME_SCALE=(1.0f/255.0f) -D VOLUME_STORE=convert_uchar_sat_rte";
+	else if (fieldData.type == VOLUME && fieldData.volume.header.format == VOLUME_UINT16)
+		fieldOptions = " -D FIELD_VOLUME -D VOLUME_TYPE=ushort -D VOLUME_SCALE=(1.0f/65535.0f) -D VOLUME_STORE=convert_ushort_sat_rte";
+	else if (fieldData.type == VOLUME)
+		fieldOptions = " -D FIELD_VOLUME";
+	else if (fieldData.type == EXPRESSION)
+		fieldOptions = " -D FIELD_EXPRESSION";
+
+	// compact positions are quantised relative to the largest side of the grid
+	char vertexOptions[64] = "";
+	if (mcData.compactVertices)
+		sprintf(vertexOptions, " -D COMPACT_VERTICES -D POSITION_SCALE=(65535.0f/%i)", (int)maxGridSize(mcData));
+
+	// not every device can sample images
+	cl_bool imageSupport = CL_FALSE;
+	clGetDeviceInfo(cl_gl_device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &imageSupport, nullptr);
+	if (tableLayout == TABLE_LAYOUT_IMAGE && !imageSupport)
+	{
+		printf("Device doesn't support images, using packed tables in constant memory\n");
+		tableLayout = TABLE_LAYOUT_PACKED;
+	}
+
+	// the kernel includes mctables.h from its own directory
+	char defineOptions[512];
+	sprintf(defineOptions, " -D BRICK_SIZE=%i -D LOD_BLOCK_SIZE=%i -D SCAN_GROUP_SIZE=%i%s%s%s%s%s",
+			(int)BRICK_SIZE, (int)LOD_BLOCK_SIZE, (int)SCAN_GROUP_SIZE, fieldOptions, vertexOptions, TABLE_LAYOUT_OPTIONS[tableLayout],
+			mcData.useMorton ? " -D MORTON_ORDER" : "", mcData.useDualContouring ? " -D DUAL_CONTOURING" : "");
+	std::string buildOptions = "-I " + kernelDir + defineOptions;
 
 	// build program for the selected device and context
-	clData.program = clCreateProgramWithSource(clData.context, 1, (const char**)&kernelSource, &size, &result);
+	clData.program = buildCachedProgram(clData.programCache, fieldSource.empty() ? 1 : 2, sources, sourceLengths, buildOptions.c_str(), &result);
 	delete[] kernelSource;
-	CL_CHECK(clCreateProgramWithSource, result);
-	result = clBuildProgram(clData.program, 1, &cl_gl_device, 0, 0, 0);
+	if (clData.program == nullptr)
+		exit(EXIT_FAILURE);
 	if (result != CL_SUCCESS)
 	{
 		size_t len = 0;
@@ -175,88 +889,420 @@ int main(int argc, char* argv[])
 		delete[] log;
 
 		clReleaseProgram(clData.program);
+		releaseProgramCache(clData.programCache);
 		clReleaseCommandQueue(clData.queue);
 		clReleaseContext(clData.context);
 		glDeleteBuffers(1, &glData.boxVBO);
 		glDeleteVertexArrays(1, &glData.boxVAO);
-		glDeleteBuffers(1, &glData.blobVBO);
-		glDeleteVertexArrays(1, &glData.blobVAO);
+		glDeleteBuffers(mcData.outputCount, glData.drawCommandBuffer);
+		glDeleteBuffers(mcData.outputCount, glData.blobVBO);
+		glDeleteVertexArrays(mcData.outputCount, glData.blobVAO);
 		glDeleteProgram(glData.program);
 
 		exit(EXIT_FAILURE);
 	}
 
-	// extract the kernel
+	// one uint4 texel of packed tables per cube case
+	clData.tableImage = 0;
+	if (tableLayout == TABLE_LAYOUT_IMAGE)
+	{
+		cl_uint texels[256][4];
+		packTableTexels(texels);
+
+		cl_image_format format = { CL_RGBA, CL_UNSIGNED_INT32 };
+		cl_image_desc desc = { 0 };
+		desc.image_type = CL_MEM_OBJECT_IMAGE1D;
+		desc.image_width = 256;
+		clData.tableImage = clCreateImage(clData.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &desc, texels, &result);
+		CL_CHECK(clCreateImage, result);
+	}
+
+	// extract the kernels
 	clData.kernel = clCreateKernel(clData.program, "marchingCubes", &result);
 	CL_CHECK(clCreateKernel, result);
+	clData.brickKernel = clCreateKernel(clData.program, "classifyBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	clData.brickMarchingCubesKernel = clCreateKernel(clData.program, "marchingCubesBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	clData.drawCommandKernel = clCreateKernel(clData.program, "writeDrawCommand", &result);
+	CL_CHECK(clCreateKernel, result);
+	clData.tiledKernel = clCreateKernel(clData.program, "marchingCubesTiled", &result);
+	CL_CHECK(clCreateKernel, result);
+	clData.mortonKernel = clCreateKernel(clData.program, "marchingCubesMorton", &result);
+	CL_CHECK(clCreateKernel, result);
+	clData.levelsKernel = clCreateKernel(clData.program, "marchingCubesLevels", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	// round the grid up to whole tiles, the kernel skips the padding cubes
+	if (mcData.tileSize[0] == 0)
+		chooseTileSize(cl_gl_device, clData.tiledKernel, mcData.tileSize);
+	else if (!tileFits(cl_gl_device, clData.tiledKernel, mcData.tileSize, true))
+		exit(EXIT_FAILURE);
+	for (int i = 0; i < 3; ++i)
+		mcData.tiledGridSize[i] = (mcData.gridSize[i] + mcData.tileSize[i] - 1) / mcData.tileSize[i] * mcData.tileSize[i];
+	if (mcData.useTiles)
+		printf("Tiles: %i x %i x %i\n", (int)mcData.tileSize[0], (int)mcData.tileSize[1], (int)mcData.tileSize[2]);
+
+	// without implicit synchronisation we have to finish opencl before opengl can draw
+	size_t extensionsSize = 0;
+	clGetDeviceInfo(cl_gl_device, CL_DEVICE_EXTENSIONS, 0, nullptr, &extensionsSize);
+	std::vector<char> extensions(extensionsSize + 1, 0);
+	clGetDeviceInfo(cl_gl_device, CL_DEVICE_EXTENSIONS, extensionsSize, extensions.data(), nullptr);
+	clData.implicitGLSync = strstr(extensions.data(), "cl_khr_gl_event") != nullptr;
+	clData.busyTime = 0;
+
+	// the vertex buffer can grow until it hits the device's allocation limit
+	cl_ulong maxAllocation = 0;
+	clGetDeviceInfo(cl_gl_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocation, nullptr);
+	mcData.maxFaceLimit = (cl_uint)glm::min(maxAllocation / (mcData.vertexSize * 3 * outputRanges(mcData)), (cl_ulong)(1u << 31));
 
 	// create opencl memory object links
-	clData.vboLink = clCreateFromGLBuffer(clData.context, CL_MEM_WRITE_ONLY, glData.blobVBO, &result);
-	CL_CHECK(clCreateFromGLBuffer, result);
-	clData.faceCountLink = clCreateBuffer(clData.context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(cl_uint), &mcData.faceCount, &result);
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		clData.vboLink[i] = clCreateFromGLBuffer(clData.context, CL_MEM_WRITE_ONLY, glData.blobVBO[i], &result);
+		CL_CHECK(clCreateFromGLBuffer, result);
+		clData.drawCommandLink[i] = clCreateFromGLBuffer(clData.context, CL_MEM_WRITE_ONLY, glData.drawCommandBuffer[i], &result);
+		CL_CHECK(clCreateFromGLBuffer, result);
+		clData.outputStartEvent[i] = 0;
+		clData.outputReadyEvent[i] = 0;
+	}
+	clData.faceCountLink = clCreateBuffer(clData.context, CL_MEM_READ_WRITE, sizeof(cl_uint) * MAX_LEVELS, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	clData.particleLink = clCreateBuffer(clData.context, fieldData.animateOnDevice ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY,
+		sizeof(glm::vec4) * fieldData.particleCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	clData.activeBrickCountLink = clCreateBuffer(clData.context, CL_MEM_READ_WRITE, sizeof(cl_uint), nullptr, &result);
 	CL_CHECK(clCreateBuffer, result);
-	clData.particleLink = clCreateBuffer(clData.context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, sizeof(glm::vec4) * particleCount, particles, &result);
+	clData.activeBrickLink = clCreateBuffer(clData.context, CL_MEM_READ_WRITE, sizeof(cl_uint) * totalBricks, nullptr, &result);
 	CL_CHECK(clCreateBuffer, result);
 
+	// the volume's samples are used in place from the mapping, with no copy on the host
+	clData.volumeLink = nullptr;
+	if (fieldData.type == VOLUME && !streaming)
+	{
+		if (fieldData.volume.sampleBytes > maxAllocation)
+			printf("Warning: volume is larger than the device's maximum allocation (%llu bytes)\n", (unsigned long long)maxAllocation);
+
+		// filtering writes the samples, so they're copied from the read-only mapping once
+		cl_mem_flags volumeFlags = volumeFilters.empty() ? CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR : CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR;
+		clData.volumeLink = clCreateBuffer(clData.context, volumeFlags,
+			fieldData.volume.sampleBytes, (void*)fieldData.volume.samples, &result);
+		CL_CHECK(clCreateBuffer, result);
+
+		// the volume is static, so it's filtered once and then polygonised as usual
+		if (!volumeFilters.empty())
+		{
+			FilterData filterData;
+			if (!createVolumeFilters(filterData, clData.context, cl_gl_device, clData.program, fieldData.volumeDims, fieldData.volume.sampleBytes))
+			{
+				printf("Failed to create volume filters\n");
+				exit(EXIT_FAILURE);
+			}
+
+			auto filterStart = std::chrono::high_resolution_clock::now();
+			cl_event filterEvent = 0;
+			enqueueVolumeFilters(filterData, clData.queue, clData.volumeLink, fieldData.volume.sampleBytes, volumeFilters, 0, nullptr, &filterEvent);
+			clWaitForEvents(1, &filterEvent);
+			clReleaseEvent(filterEvent);
+			releaseVolumeFilters(filterData);
+
+			std::chrono::duration<double, std::milli> filterTime = std::chrono::high_resolution_clock::now() - filterStart;
+			printf("Volume filtered in %.1f ms (%zu filters)\n", filterTime.count(), volumeFilters.size());
+		}
+	}
+
+	// the compact-support field samples the particles through a uniform grid of bins
+	if (fieldData.type == WYVILL &&
+		!createBins(clData.bins, clData.context, clData.program, mcData.gridSize, fieldData.radius, fieldData.particleCount))
+	{
+		printf("Failed to create particle bins\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// the seeds are all the device needs to animate the particles, so they're sent once
+	clData.animateKernel = 0;
+	clData.particleSeedLink = 0;
+	if (fieldData.animateOnDevice && fieldData.type != VOLUME)
+	{
+		clData.animateKernel = clCreateKernel(clData.program, "animateParticles", &result);
+		CL_CHECK(clCreateKernel, result);
+		clData.particleSeedLink = clCreateBuffer(clData.context, CL_MEM_READ_ONLY, sizeof(glm::vec4) * fieldData.particleCount, nullptr, &result);
+		CL_CHECK(clCreateBuffer, result);
+		result = clEnqueueWriteBuffer(clData.queue, clData.particleSeedLink, CL_TRUE, 0, sizeof(glm::vec4) * fieldData.particleCount, particleSeeds.data(), 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueWriteBuffer, result);
+
+		// the same placement as animateParticles on the host
+		glm::vec4 centre = glm::vec4(gridExtents, 0) * 0.5f;
+		cl_float scale = mcData.gridSize[0] / (float)128;
+		cl_float amplitude = mcData.gridSize[0] * 0.05f;
+		result = clSetKernelArg(clData.animateKernel, 1, sizeof(cl_float) * 4, glm::value_ptr(centre));
+		result |= clSetKernelArg(clData.animateKernel, 2, sizeof(cl_float), &scale);
+		result |= clSetKernelArg(clData.animateKernel, 3, sizeof(cl_float), &amplitude);
+		result |= clSetKernelArg(clData.animateKernel, 4, sizeof(cl_int), &fieldData.particleCount);
+		result |= clSetKernelArg(clData.animateKernel, 5, sizeof(cl_mem), &clData.particleSeedLink);
+		result |= clSetKernelArg(clData.animateKernel, 6, sizeof(cl_mem), &clData.particleLink);
+		CL_CHECK(clSetKernelArg, result);
+	}
+
 	// set the kernel arguments
+	// the output buffer arguments are set each frame as the buffers rotate
 	result = clSetKernelArg(clData.kernel, 0, sizeof(cl_int), &mcData.maxFaces);
 	result |= clSetKernelArg(clData.kernel, 1, sizeof(cl_mem), &clData.faceCountLink);
-	result |= clSetKernelArg(clData.kernel, 2, sizeof(cl_mem), &clData.vboLink);
 	result |= clSetKernelArg(clData.kernel, 3, sizeof(cl_float), &mcData.threshold);
-	result |= clSetKernelArg(clData.kernel, 4, sizeof(cl_int), &particleCount);
-	result |= clSetKernelArg(clData.kernel, 5, sizeof(cl_mem), &clData.particleLink);
+	result |= setFieldArgs(clData.kernel, 4, fieldData, clData);
 	CL_CHECK(clSetKernelArg, result);
-	
-	// loop
-	while (!glfwWindowShouldClose(window) && 
-		   !glfwGetKey(window, GLFW_KEY_ESCAPE)) 
+
+	cl_int gridSize[4] = { (cl_int)mcData.gridSize[0], (cl_int)mcData.gridSize[1], (cl_int)mcData.gridSize[2], 0 };
+	result = clSetKernelArg(clData.brickKernel, 0, sizeof(cl_float), &mcData.threshold);
+	result |= clSetKernelArg(clData.brickKernel, 1, sizeof(cl_int) * 4, gridSize);
+	result |= clSetKernelArg(clData.brickKernel, 2, sizeof(cl_mem), &clData.activeBrickCountLink);
+	result |= clSetKernelArg(clData.brickKernel, 3, sizeof(cl_mem), &clData.activeBrickLink);
+	result |= setFieldArgs(clData.brickKernel, 4, fieldData, clData);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(clData.brickMarchingCubesKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 3, sizeof(cl_float), &mcData.threshold);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 4, sizeof(cl_int) * 4, gridSize);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 5, sizeof(cl_mem), &clData.activeBrickLink);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 6, sizeof(cl_mem), &clData.activeBrickCountLink);
+	result |= setFieldArgs(clData.brickMarchingCubesKernel, 7, fieldData, clData);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(clData.drawCommandKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.drawCommandKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the local tile holds the corners of every cube in the work-group
+	size_t tileCorners = (mcData.tileSize[0] + 1) * (mcData.tileSize[1] + 1) * (mcData.tileSize[2] + 1);
+	result = clSetKernelArg(clData.tiledKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.tiledKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+	result |= clSetKernelArg(clData.tiledKernel, 3, sizeof(cl_float), &mcData.threshold);
+	result |= clSetKernelArg(clData.tiledKernel, 4, sizeof(cl_int) * 4, gridSize);
+	result |= clSetKernelArg(clData.tiledKernel, 5, sizeof(cl_float) * tileCorners, nullptr);
+	result |= setFieldArgs(clData.tiledKernel, 6, fieldData, clData);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(clData.mortonKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.mortonKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+	result |= clSetKernelArg(clData.mortonKernel, 3, sizeof(cl_float), &mcData.threshold);
+	result |= clSetKernelArg(clData.mortonKernel, 4, sizeof(cl_int) * 4, gridSize);
+	result |= setFieldArgs(clData.mortonKernel, 5, fieldData, clData);
+	CL_CHECK(clSetKernelArg, result);
+
+	// unused levels are padding in the float8, the kernel stops at the count
+	result = clSetKernelArg(clData.levelsKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.levelsKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+	result |= clSetKernelArg(clData.levelsKernel, 3, sizeof(cl_float) * MAX_LEVELS, mcData.levels);
+	result |= clSetKernelArg(clData.levelsKernel, 4, sizeof(cl_int), &mcData.levelCount);
+	result |= setFieldArgs(clData.levelsKernel, 5, fieldData, clData);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the incremental pool starts as large as the output buffer and every brick dirty
+	IncrementalData incData;
+	if (mcData.useIncremental)
 	{
-		float time = (float)glfwGetTime();
+		if (!createIncremental(incData, clData.context, clData.program, mcData.gridSize, BRICK_SIZE,
+							   mcData.threshold, mcData.maxFaces, dirtyTolerance))
+		{
+			printf("Failed to create incremental extraction\n");
+			exit(EXIT_FAILURE);
+		}
+		result = setFieldArgs(incData.countKernel, 4, fieldData, clData);
+		result |= setFieldArgs(incData.extractKernel, 6, fieldData, clData);
+		CL_CHECK(clSetKernelArg, result);
 
-		// our sample volume is made of meta balls (they were placed based on a 128^3 grid)
-		// simple animation of the balls for now
-		float scale = mcData.gridSize[0] / (float)128;
-		particles[0] = glm::vec4(mcData.gridSize[0], mcData.gridSize[1], mcData.gridSize[2], 0)  * 0.5f;
-		particles[1] = glm::vec4(sin(time) * 32, cos(time * 0.5f) * 32, sin(time * 2) * 16, 0) * scale + particles[0];
-		particles[2] = glm::vec4(cos(-time * 0.25f) * 8, cos(time * 0.5f), cos(time) * 32, 0) * scale + particles[0];
-		particles[3] = glm::vec4(sin(time) * 32, cos(time * 0.5f) * 32, cos(-time * 2) * 16, 0) * scale + particles[0];
-		particles[4] = glm::vec4(sin(time) * 16, sin(time * 1.5f) * 16, sin(time * 2) * 32, 0) * scale + particles[0];
-		particles[5] = glm::vec4(cos(time * 0.3f) * 32, cos(time * 1.5f) * 32, sin(time * 2) * 32, 0) * scale + particles[0];
-		particles[6] = glm::vec4(sin(time) * 16, sin(time * 1.5f) * 16, sin(time * 2) * 32, 0) * scale + particles[0];
-		particles[7] = glm::vec4(sin(-time) * 32, sin(time * 1.5f) * 32, cos(time * 4) * 32, 0) * scale + particles[0];
+		// room for a command per brick, should no two ranges touch
+		glGenBuffers(1, &glData.brickCommandBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.brickCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(cl_uint) * 4 * incData.totalBricks, nullptr, GL_DYNAMIC_DRAW);
+		glData.multiDrawIndirect = ogl_IsVersionGEQ(4, 3) != 0;
+	}
 
-		// ensure opengl is complete
-		glFinish();
+	// the level of detail blocks are picked each frame, before extraction
+	if (mcData.useLod)
+	{
+		if (!createLod(clData.lod, clData.context, clData.program, mcData.gridSize, mcData.threshold, lodSplitDistance))
+		{
+			printf("Failed to create level of detail extraction\n");
+			exit(EXIT_FAILURE);
+		}
+		result = clSetKernelArg(clData.lod.blockKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+		result |= clSetKernelArg(clData.lod.blockKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+		result |= setFieldArgs(clData.lod.blockKernel, 6, fieldData, clData);
+		result |= clSetKernelArg(clData.lod.transitionKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+		result |= clSetKernelArg(clData.lod.transitionKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+		result |= setFieldArgs(clData.lod.transitionKernel, 7, fieldData, clData);
+		CL_CHECK(clSetKernelArg, result);
+	}
 
-		// reset marching cube face count
-		mcData.faceCount = 0;
+	// the surface net caches the field each frame before placing its vertices
+	if (mcData.useNets)
+	{
+		if (!createNets(clData.nets, clData.context, clData.program, mcData.gridSize, mcData.threshold))
+		{
+			printf("Failed to create surface nets extraction\n");
+			exit(EXIT_FAILURE);
+		}
+		result = setFieldArgs(clData.nets.sampleKernel, 2, fieldData, clData);
+		result |= setFieldArgs(clData.nets.vertexKernel, 6, fieldData, clData);
+		result |= clSetKernelArg(clData.nets.quadKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+		result |= clSetKernelArg(clData.nets.quadKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+		CL_CHECK(clSetKernelArg, result);
+	}
 
-		// we set up write events in case we use out-of-order computations
-		cl_event writeEvents[3] = { 0, 0, 0 };
+	// the sparse bricks are seeded from the particles as they are before binning
+	if (mcData.useSparse)
+	{
+		if (!createSparse(clData.sparse, clData.context, clData.program, BRICK_SIZE, sparseBlocks, mcData.threshold))
+		{
+			printf("Failed to create sparse brick extraction\n");
+			exit(EXIT_FAILURE);
+		}
+		result = clSetKernelArg(clData.sparse.seedKernel, 2, sizeof(cl_mem), &clData.particleLink);
+		result |= setFieldArgs(clData.sparse.seedKernel, 9, fieldData, clData);
+		result |= setFieldArgs(clData.sparse.sampleKernel, 4, fieldData, clData);
+		result |= clSetKernelArg(clData.sparse.extractKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+		result |= clSetKernelArg(clData.sparse.extractKernel, 1, sizeof(cl_mem), &clData.faceCountLink);
+		result |= setFieldArgs(clData.sparse.extractKernel, 8, fieldData, clData);
+		CL_CHECK(clSetKernelArg, result);
+	}
 
-		// send data to the device for opencl to use, aquiring the opengl buffer for opencl use
-		 result = clEnqueueAcquireGLObjects(clData.queue, 1, &clData.vboLink, 0, 0, &writeEvents[0]);
-		CL_CHECK(clEnqueueAcquireGLObjects, result);
-		result = clEnqueueWriteBuffer(clData.queue, clData.faceCountLink, CL_FALSE, 0, sizeof(unsigned int), &mcData.faceCount, 0, nullptr, &writeEvents[1]);
-		CL_CHECK(clEnqueueWriteBuffer, result);
-		result = clEnqueueWriteBuffer(clData.queue, clData.particleLink, CL_FALSE, 0, sizeof(glm::vec4) * particleCount, particles, 0, nullptr, &writeEvents[2]);
-		CL_CHECK(clEnqueueWriteBuffer, result);
+	// the rays are shaded straight into the texture that's drawn over the window
+	if (mcData.useRaycast)
+	{
+		if (!createRaycast(clData.raycast, clData.context, clData.program, mcData.gridSize, BRICK_SIZE, mcData.threshold,
+						   fieldData.type == VOLUME))
+		{
+			printf("Failed to create ray casting\n");
+			exit(EXIT_FAILURE);
+		}
+		result = setFieldArgs(clData.raycast.sampleKernel, 2, fieldData, clData);
+		CL_CHECK(clSetKernelArg, result);
 
-		// execute the marching cubes kernel
-		cl_event processEvent = 0;
-		result = clEnqueueNDRangeKernel(clData.queue, clData.kernel, 3, 0, mcData.gridSize, 0, 3, writeEvents, &processEvent);
-		CL_CHECK(clEnqueueNDRangeKernel, result);
+		clData.raycastImageLink = clCreateFromGLTexture(clData.context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, glData.raycastTexture, &result);
+		CL_CHECK(clCreateFromGLTexture, result);
+	}
+
+	// stream the volume through the device a slab at a time, then show as much
+	// of the result as fits in the vertex buffer
+	if (streaming)
+	{
+		StreamMesh mesh = { std::vector<cl_float4>(), nullptr, 0 };
+		if (streamPath != nullptr)
+		{
+			mesh.file = fopen(streamPath, "wb");
+			if (mesh.file == nullptr)
+				printf("Failed to open '%s'\n", streamPath);
+		}
+
+		streamSettings.maxFaces = mcData.maxFaces;
+		streamSettings.threshold = mcData.threshold;
+		streamSettings.tableImage = clData.tableImage;
+		streamVolume(clData.context, cl_gl_device, clData.program, fieldData.volume, streamSettings, mesh);
+
+		if (mesh.file != nullptr)
+			fclose(mesh.file);
+
+		size_t meshFaces = mesh.vertices.size() / 6;
+		if (meshFaces > mcData.maxFaces)
+			resizeOutput(glData, mcData, clData, (cl_uint)glm::min(meshFaces, (size_t)mcData.maxFaceLimit));
+
+		mcData.faceCount = (cl_uint)glm::min(meshFaces, (size_t)mcData.maxFaces);
+		mcData.outputFaceCount[0] = mcData.faceCount;
+		glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(cl_float4) * 6 * mcData.faceCount, mesh.vertices.data());
+
+		GLuint drawCommand[4] = { mcData.faceCount * 3, 1, 0, 0 };
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.drawCommandBuffer[0]);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(drawCommand), drawCommand);
+	}
+	
+	CPUMCData cpuData;
+	std::vector<glm::vec4> cpuVertices;
+	if (useCPU)
+		createCPUMC(cpuData, cpuThreads, 0);
+
+	// surfaces are written out on a background thread, a streamed volume is
+	// already written by -streamout
+	if (exportPath != nullptr && mcData.useIncremental)
+		printf("-export isn't supported with -incremental, the pool has gaps between its ranges\n");
+	MeshExporter exporter;
+	bool exporting = exportPath != nullptr && !streaming && !mcData.useIncremental && !mcData.useRaycast &&
+		createExporter(exporter, clData.context, clData.queue, exportPath, exportWeld,
+					   exportSimplifyRatio, exportSimplifyError);
+	bool exportKeyDown = false;
+
+	// frame rate and opencl idle time are reported once a second
+	int reportFrames = 0;
+	double reportTime = glfwGetTime();
+
+	// -frames totals the busy time over every report, and how long the host sat
+	// waiting for extractions, which is what the ring of buffers should hide
+	int measuredFrames = 0;
+	double measureStartTime = 0;
+	cl_ulong totalBusyTime = 0;
+	cl_ulong measureStartBusyTime = 0;
+	double outputWaitTime = 0;
+
+	// P pauses the animation, leaving the field still
+	float animationTime = 0;
+	float lastTime = (float)glfwGetTime();
+	bool paused = false;
+	bool pauseKeyDown = false;
+
+	// loop
+	while (!glfwWindowShouldClose(window) && 
+		   !glfwGetKey(window, GLFW_KEY_ESCAPE)) 
+	{
+		float time = (float)glfwGetTime();
+
+		bool pauseKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+		if (pauseKey && !pauseKeyDown)
+			paused = !paused;
+		pauseKeyDown = pauseKey;
+		if (!paused)
+			animationTime += time - lastTime;
+		lastTime = time;
 
-		// release the opengl buffer from opencl so that it can be drawn
-		result = clEnqueueReleaseGLObjects(clData.queue, 1, &clData.vboLink, 1, &processEvent, 0);
-		CL_CHECK(clEnqueueReleaseGLObjects, result);
+		// draw the surface extracted last frame, a streamed volume only has the one buffer
+		int drawIndex = 0;
+		if (!streaming)
+		{
+			drawIndex = (mcData.outputIndex + mcData.outputCount - 1) % mcData.outputCount;
+			double waitStart = glfwGetTime();
+			waitForOutput(mcData, clData, drawIndex);
+			outputWaitTime += glfwGetTime() - waitStart;
 
-		// read how many triangles to draw
-		result = clEnqueueReadBuffer(clData.queue, clData.faceCountLink, CL_FALSE, 0, sizeof(unsigned int), &mcData.faceCount, 1, &processEvent, 0);
-		CL_CHECK(clEnqueueReadBuffer, result);
+			// the buffer's own count says whether it overflowed, in which case it is extracted
+			// again into the grown buffers rather than drawn truncated. a shrink loses it too
+			if (!useCPU && !mcData.useIncremental && !mcData.useRaycast && manageOutputCapacity(glData, mcData, clData))
+			{
+				int extractIndex = mcData.outputIndex;
+				mcData.outputIndex = drawIndex;
+				extractSurface(glData, mcData, fieldData, clData, particles);
+				mcData.outputIndex = extractIndex;
+				waitForOutput(mcData, clData, drawIndex);
+			}
+		}
 
-		// wait until opencl has finished before we draw
-		clFinish(clData.queue);
+		// capture the surface we're about to draw for the first exportFrames frames and whenever E is pressed
+		if (exporting)
+		{
+			bool keyDown = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
+			if (exportFrames > 0 || (keyDown && !exportKeyDown))
+			{
+				bool captured = false;
+				if (useCPU)
+					captured = !cpuVertices.empty() &&
+						exportSurface(exporter, (const cl_float4*)cpuVertices.data(), mcData.outputFaceCount[drawIndex]);
+				else
+					captured = captureSurface(mcData, clData, exporter, drawIndex);
+				if (captured && exportFrames > 0)
+					--exportFrames;
+			}
+			exportKeyDown = keyDown;
+		}
 
 		// draw
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -269,36 +1315,232 @@ int main(int argc, char* argv[])
 		// bind the projection-view-model (pvm) matrix
 		glUniformMatrix4fv(glGetUniformLocation(glData.program, "pvm"), 1, GL_FALSE, glm::value_ptr(pvm));
 
-		// draw marching cube blob
-		glBindVertexArray(glData.blobVAO);
-		glDrawArrays(GL_TRIANGLES, 0, glm::min(mcData.faceCount, mcData.maxFaces) * 3);
+		// draw marching cube blob, or cast this frame's rays and draw the image behind the box
+		glUniform1i(glGetUniformLocation(glData.program, "compactVertices"), mcData.compactVertices);
+		glUniform1f(glGetUniformLocation(glData.program, "positionScale"), (float)maxGridSize(mcData));
+		glBindVertexArray(glData.blobVAO[drawIndex]);
+		if (mcData.useRaycast)
+		{
+			raycastSurface(glData, fieldData, clData, particles, pvm);
+
+			glUseProgram(glData.quadProgram);
+			glBindTexture(GL_TEXTURE_2D, glData.raycastTexture);
+			glBindVertexArray(glData.quadVAO);
+			glDepthMask(GL_FALSE);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			glDepthMask(GL_TRUE);
+			glUseProgram(glData.program);
+		}
+		else if (mcData.useIncremental)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.brickCommandBuffer);
+			if (glData.multiDrawIndirect)
+				glMultiDrawArraysIndirect(GL_TRIANGLES, 0, incData.drawCount, 0);
+			else
+			{
+				for (cl_uint i = 0; i < incData.drawCount; ++i)
+					glDrawArraysIndirect(GL_TRIANGLES, (const void*)(sizeof(cl_uint) * 4 * i));
+			}
+		}
+		else if (mcData.useIndirect)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.drawCommandBuffer[drawIndex]);
+			glDrawArraysIndirect(GL_TRIANGLES, 0);
+		}
+		else if (mcData.useLevels)
+		{
+			// each level from the start of its own range
+			glUniform1i(glGetUniformLocation(glData.program, "levelCount"), mcData.levelCount);
+			for (int i = 0; i < mcData.levelCount; ++i)
+				glDrawArrays(GL_TRIANGLES, i * mcData.maxFaces * 3, glm::min(mcData.outputLevelFaceCount[drawIndex][i], mcData.maxFaces) * 3);
+		}
+		else
+			glDrawArrays(GL_TRIANGLES, 0, glm::min(mcData.outputFaceCount[drawIndex], mcData.maxFaces) * 3);
 		
 		// draw box around grid
+		glUniform1i(glGetUniformLocation(glData.program, "compactVertices"), 0);
+		glUniform1i(glGetUniformLocation(glData.program, "levelCount"), 0);
 		glBindVertexArray(glData.boxVAO);
 		glDrawArrays(GL_LINES, 0, 48);
 
+		// opencl can't write this buffer again until opengl is done drawing it
+		if (glData.blobFence[drawIndex] != 0)
+			glDeleteSync(glData.blobFence[drawIndex]);
+		glData.blobFence[drawIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		// polygonise the next frame into another output buffer while opengl draws this one
+		// a streamed volume was extracted once up front so there is nothing to do
+		if (!streaming)
+		{
+			// the device picks the time up when it next animates the particles
+			if (clData.animateKernel != 0)
+			{
+				result = clSetKernelArg(clData.animateKernel, 0, sizeof(cl_float), &animationTime);
+				CL_CHECK(clSetKernelArg, result);
+			}
+			else if (fieldData.type != VOLUME)
+				animateParticles(particles, particleSeeds, animationTime, mcData);
+
+			// blocks are split around where the camera is now
+			if (mcData.useLod)
+				updateLod(clData.lod, target + eye);
+
+			if (useCPU)
+				extractSurfaceCPU(glData, mcData, cpuData, particles, cpuVertices);
+			else if (mcData.useIncremental)
+				extractIncremental(glData, mcData, fieldData, clData, incData, particles);
+			else if (!mcData.useRaycast)
+				extractSurface(glData, mcData, fieldData, clData, particles);
+		}
+
 		// present
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		// busy time only covers the extractions that have been collected, so it trails by a frame or two
+		++reportFrames;
+		double now = glfwGetTime();
+
+		if (measureFrames > 0 && !streaming)
+		{
+			++measuredFrames;
+			if (measuredFrames == MEASURE_WARMUP_FRAMES)
+			{
+				measureStartTime = now;
+				measureStartBusyTime = totalBusyTime + clData.busyTime;
+				outputWaitTime = 0;
+			}
+			else if (measuredFrames == MEASURE_WARMUP_FRAMES + measureFrames)
+			{
+				double seconds = now - measureStartTime;
+				double busy = (totalBusyTime + clData.busyTime - measureStartBusyTime) * 1e-9;
+				printf("Measured %i frames: FPS: %.1f, CL idle: %.1f%%, %.2f ms waiting for CL per frame (%i output buffer%s)\n",
+					   measureFrames, measureFrames / seconds, glm::clamp(100.0 * (1.0 - busy / seconds), 0.0, 100.0),
+					   outputWaitTime * 1000.0 / measureFrames, mcData.outputCount, mcData.outputCount > 1 ? "s" : "");
+				break;
+			}
+		}
+
+		if (!streaming && now - reportTime >= 1.0)
+		{
+			double busy = clData.busyTime * 1e-9;
+			printf("FPS: %.1f, CL idle: %.1f%% (%i output buffer%s)", reportFrames / (now - reportTime),
+				   glm::clamp(100.0 * (1.0 - busy / (now - reportTime)), 0.0, 100.0), mcData.outputCount, mcData.outputCount > 1 ? "s" : "");
+			if (mcData.useIncremental)
+			{
+				printf(", %.1f bricks re-extracted per frame, %u triangles in %u draws", (double)incData.extractedBricks / reportFrames,
+					   incData.faceCount, incData.drawCount);
+				incData.extractedBricks = 0;
+			}
+			if (mcData.useLod)
+			{
+				printf(", %.1f blocks and %.1f transition faces per frame", (double)clData.lod.extractedBlocks / reportFrames,
+					   (double)clData.lod.extractedTransitions / reportFrames);
+				clData.lod.extractedBlocks = 0;
+				clData.lod.extractedTransitions = 0;
+			}
+			if (mcData.useNets)
+			{
+				printf(", %.1f net vertices per frame", (double)clData.nets.extractedVertices / reportFrames);
+				clData.nets.extractedVertices = 0;
+			}
+			if (mcData.useSparse)
+			{
+				printf(", %.1f sparse bricks per frame, %u of %u blocks live", (double)clData.sparse.extractedBlocks / reportFrames,
+					   clData.sparse.liveBlocks, clData.sparse.blockCapacity);
+				clData.sparse.extractedBlocks = 0;
+			}
+			printf("\n");
+			reportFrames = 0;
+			reportTime = now;
+			totalBusyTime += clData.busyTime;
+			clData.busyTime = 0;
+		}
 	}
 
+	if (useCPU)
+		releaseCPUMC(cpuData);
+
+	// finish writing any captured surfaces
+	if (exporting)
+		releaseExporter(exporter);
+
 	// cleanup cl
 	clFinish(clData.queue);
-	clReleaseMemObject(clData.vboLink);
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		if (clData.outputStartEvent[i] != 0)
+			clReleaseEvent(clData.outputStartEvent[i]);
+		if (clData.outputReadyEvent[i] != 0)
+			clReleaseEvent(clData.outputReadyEvent[i]);
+		clReleaseMemObject(clData.vboLink[i]);
+		clReleaseMemObject(clData.drawCommandLink[i]);
+	}
 	clReleaseMemObject(clData.faceCountLink);
+	clReleaseMemObject(clData.particleLink);
+	if (clData.particleSeedLink != 0)
+		clReleaseMemObject(clData.particleSeedLink);
+	clReleaseMemObject(clData.activeBrickCountLink);
+	clReleaseMemObject(clData.activeBrickLink);
+	if (mcData.useIncremental)
+		releaseIncremental(incData);
+	if (mcData.useLod)
+		releaseLod(clData.lod);
+	if (mcData.useNets)
+		releaseNets(clData.nets);
+	if (mcData.useSparse)
+		releaseSparse(clData.sparse);
+	if (mcData.useRaycast)
+	{
+		clReleaseMemObject(clData.raycastImageLink);
+		releaseRaycast(clData.raycast);
+	}
+	if (fieldData.type == WYVILL)
+		releaseBins(clData.bins);
+	if (clData.volumeLink != nullptr)
+		clReleaseMemObject(clData.volumeLink);
+	if (clData.tableImage != 0)
+		clReleaseMemObject(clData.tableImage);
+	if (clData.animateKernel != 0)
+		clReleaseKernel(clData.animateKernel);
+	clReleaseKernel(clData.levelsKernel);
+	clReleaseKernel(clData.mortonKernel);
+	clReleaseKernel(clData.tiledKernel);
+	clReleaseKernel(clData.drawCommandKernel);
+	clReleaseKernel(clData.brickMarchingCubesKernel);
+	clReleaseKernel(clData.brickKernel);
 	clReleaseKernel(clData.kernel);
 	clReleaseProgram(clData.program);
+	releaseProgramCache(clData.programCache);
 	clReleaseCommandQueue(clData.queue);
 	clReleaseContext(clData.context);
 
 	// cleanup gl
+	if (mcData.useIncremental)
+		glDeleteBuffers(1, &glData.brickCommandBuffer);
+	if (mcData.useRaycast)
+	{
+		glDeleteVertexArrays(1, &glData.quadVAO);
+		glDeleteProgram(glData.quadProgram);
+		glDeleteTextures(1, &glData.raycastTexture);
+	}
 	glDeleteBuffers(1, &glData.boxVBO);
 	glDeleteVertexArrays(1, &glData.boxVAO);
-	glDeleteBuffers(1, &glData.blobVBO);
-	glDeleteVertexArrays(1, &glData.blobVAO);
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		if (glData.blobFence[i] != 0)
+			glDeleteSync(glData.blobFence[i]);
+	}
+	glDeleteBuffers(mcData.outputCount, glData.drawCommandBuffer);
+	glDeleteBuffers(mcData.outputCount, glData.blobVBO);
+	glDeleteVertexArrays(mcData.outputCount, glData.blobVAO);
 	glDeleteProgram(glData.program);
 	glfwTerminate();
 
+	if (fieldData.type == VOLUME)
+		closeRawVolume(fieldData.volume);
+
 	exit(EXIT_SUCCESS);
 }
 
@@ -307,22 +1549,42 @@ void setupGL(GLData& glData, const MCData& mcData)
 	glClearColor(0, 0, 0, 1);
 	glEnable(GL_DEPTH_TEST);
 
-	// shader
+	// shader, compact vertices arrive as normalised 16-bit positions and an octahedral-encoded normal
 	char* vsSource = STRINGIFY(#version 330\n
 		layout(location = 0) in vec4 Position;
 		layout(location = 1) in vec4 Normal;
+		layout(location = 2) in float Level;
 		out vec4 N;
+		out float L;
 		uniform mat4 pvm;
+		uniform int compactVertices;
+		uniform float positionScale;
 		void main() {
-			gl_Position = pvm * Position;
-			N = Normal;
+			if (compactVertices != 0) {
+				vec3 n = vec3(Normal.xy, 1.0 - abs(Normal.x) - abs(Normal.y));
+				if (n.z < 0.0)
+					n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+				gl_Position = pvm * vec4(Position.xyz * positionScale, 1);
+				N = vec4(normalize(n), 0);
+			}
+			else {
+				gl_Position = pvm * Position;
+				N = Normal;
+			}
+			L = Level;
 		});
 	char* fsSource = STRINGIFY(#version 330\n
 		in vec4 N;
+		in float L;
 		out vec4 Colour;
+		uniform int levelCount;
 		void main() {
 			float d = dot(normalize(N.xyz), normalize(vec3(1)));
 			Colour = vec4(mix(vec3(0, 0, 0.75), vec3(0, 0.75, 1), d), 1);
+			if (levelCount > 1) {
+				vec3 tint = mix(vec3(1, 0.4, 0.1), vec3(0.1, 0.6, 1), L / float(levelCount - 1));
+				Colour = vec4(tint * (0.5 + 0.5 * d), 1);
+			}
 		});
 
 	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
@@ -342,21 +1604,43 @@ void setupGL(GLData& glData, const MCData& mcData)
 	glDeleteShader(vs);
 	glDeleteShader(fs);
 	
-	// mesh data for marching cube blob
-	glGenBuffers(1, &glData.blobVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4) * 2 * mcData.maxFaces * 3, 0, GL_STATIC_DRAW);
+	// mesh data for marching cube blob, one per output buffer
+	glGenBuffers(mcData.outputCount, glData.blobVBO);
+	glGenVertexArrays(mcData.outputCount, glData.blobVAO);
+	glGenBuffers(mcData.outputCount, glData.drawCommandBuffer);
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[i]);
+		glBufferData(GL_ARRAY_BUFFER, mcData.vertexSize * mcData.maxFaces * 3 * outputRanges(mcData), 0, GL_STATIC_DRAW);
 
-	glGenVertexArrays(1, &glData.blobVAO);
-	glBindVertexArray(glData.blobVAO);
+		glBindVertexArray(glData.blobVAO[i]);
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4) * 2, 0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(glm::vec4) * 2, ((char*)0) + sizeof(glm::vec4));
-	glBindVertexArray(0);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		if (mcData.compactVertices)
+		{
+			// x, y and z ushorts, the level in the ushort after z, then the two snorm halves of the normal
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)mcData.vertexSize, 0);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, (GLsizei)mcData.vertexSize, ((char*)0) + sizeof(cl_uint) * 2);
+			glVertexAttribPointer(2, 1, GL_UNSIGNED_SHORT, GL_FALSE, (GLsizei)mcData.vertexSize, ((char*)0) + sizeof(cl_ushort) * 3);
+		}
+		else
+		{
+			// the level is in the normal's w
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4) * 2, 0);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(glm::vec4) * 2, ((char*)0) + sizeof(glm::vec4));
+			glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(glm::vec4) * 2, ((char*)0) + sizeof(glm::vec4) + sizeof(float) * 3);
+		}
+		glBindVertexArray(0);
 
-	glBindVertexArray(0);
+		// draw command { count, instanceCount, first, baseInstance } for the blob
+		GLuint drawCommand[4] = { 0, 1, 0, 0 };
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.drawCommandBuffer[i]);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(drawCommand), drawCommand, GL_STATIC_DRAW);
+	}
+
+	glBindVertexArray(0);
 
 	// hand-coded crappy box around the marching cube blob
 	glm::vec4 lines[] = {
@@ -397,4 +1681,836 @@ void setupGL(GLData& glData, const MCData& mcData)
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(glm::vec4) * 2, ((char*)0) + sizeof(glm::vec4));
 	glBindVertexArray(0);
-}
\ No newline at end of file
+
+	// ray cast image covering the window, and a shader drawing it on a quad
+	if (mcData.useRaycast)
+	{
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glData.raycastSize[0] = viewport[2];
+		glData.raycastSize[1] = viewport[3];
+
+		glGenTextures(1, &glData.raycastTexture);
+		glBindTexture(GL_TEXTURE_2D, glData.raycastTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, viewport[2], viewport[3], 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		char* quadVsSource = STRINGIFY(#version 330\n
+			out vec2 UV;
+			void main() {
+				UV = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+				gl_Position = vec4(UV * 2.0 - 1.0, 0, 1);
+			});
+		char* quadFsSource = STRINGIFY(#version 330\n
+			in vec2 UV;
+			out vec4 Colour;
+			uniform sampler2D image;
+			void main() {
+				Colour = texture(image, UV);
+			});
+
+		vs = glCreateShader(GL_VERTEX_SHADER);
+		fs = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(vs, 1, &quadVsSource, 0);
+		glShaderSource(fs, 1, &quadFsSource, 0);
+		glCompileShader(vs);
+		glCompileShader(fs);
+
+		glData.quadProgram = glCreateProgram();
+		glAttachShader(glData.quadProgram, vs);
+		glAttachShader(glData.quadProgram, fs);
+		glLinkProgram(glData.quadProgram);
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+
+		// no attributes, but core profiles won't draw without a vertex array bound
+		glGenVertexArrays(1, &glData.quadVAO);
+	}
+}
+
+cl_int setFieldArgs(cl_kernel kernel, cl_uint firstArg, const FieldData& fieldData, CLData& clData)
+{
+	cl_int result = CL_SUCCESS;
+
+	if (fieldData.type == WYVILL)
+	{
+		// the binned field samples the particles in cell order
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_int), &fieldData.particleCount);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_mem), &clData.bins.sortedParticleLink);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_mem), &clData.bins.cellStartLink);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_mem), &clData.bins.cellCountLink);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_float), &clData.bins.radius);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_int) * 4, clData.bins.cellDims);
+	}
+	else if (fieldData.type == VOLUME)
+	{
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_mem), &clData.volumeLink);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_int) * 4, fieldData.volumeDims);
+	}
+	else
+	{
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_int), &fieldData.particleCount);
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_mem), &clData.particleLink);
+	}
+
+	// the image tables trail the field arguments of the kernels that polygonise
+	cl_uint argCount = 0;
+	clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &argCount, nullptr);
+	if (clData.tableImage != 0 && firstArg < argCount)
+		result |= clSetKernelArg(kernel, firstArg++, sizeof(cl_mem), &clData.tableImage);
+
+	return result;
+}
+
+void animateParticles(std::vector<glm::vec4>& particles, const std::vector<glm::vec4>& seeds,
+					  float time, const MCData& mcData)
+{
+	if (particles.size() == 8)
+	{
+		// our sample volume is made of meta balls (they were placed based on a 128^3 grid)
+		// simple animation of the balls for now
+		float scale = mcData.gridSize[0] / (float)128;
+		particles[0] = glm::vec4(mcData.gridSize[0], mcData.gridSize[1], mcData.gridSize[2], 0)  * 0.5f;
+		particles[1] = glm::vec4(sin(time) * 32, cos(time * 0.5f) * 32, sin(time * 2) * 16, 0) * scale + particles[0];
+		particles[2] = glm::vec4(cos(-time * 0.25f) * 8, cos(time * 0.5f), cos(time) * 32, 0) * scale + particles[0];
+		particles[3] = glm::vec4(sin(time) * 32, cos(time * 0.5f) * 32, cos(-time * 2) * 16, 0) * scale + particles[0];
+		particles[4] = glm::vec4(sin(time) * 16, sin(time * 1.5f) * 16, sin(time * 2) * 32, 0) * scale + particles[0];
+		particles[5] = glm::vec4(cos(time * 0.3f) * 32, cos(time * 1.5f) * 32, sin(time * 2) * 32, 0) * scale + particles[0];
+		particles[6] = glm::vec4(sin(time) * 16, sin(time * 1.5f) * 16, sin(time * 2) * 32, 0) * scale + particles[0];
+		particles[7] = glm::vec4(sin(-time) * 32, sin(time * 1.5f) * 32, cos(time * 4) * 32, 0) * scale + particles[0];
+		return;
+	}
+
+	// each particle wobbles around its seed, out of phase with its neighbours
+	float amplitude = mcData.gridSize[0] * 0.05f;
+	for (size_t i = 0; i < particles.size(); ++i)
+	{
+		float phase = seeds[i].w;
+		glm::vec3 offset(sin(time + phase), cos(time * 0.7f + phase * 2), sin(time * 1.3f + phase * 3));
+		particles[i] = glm::vec4(glm::vec3(seeds[i]) + offset * amplitude, 0);
+	}
+}
+
+bool writeTestVolume(const char* path, unsigned int size)
+{
+	// the samples are spread from 0 to 1 across the volume, and a volume
+	// needs two samples along each axis to hold a cube
+	if (size < 2 || size > VOLUME_MAX_DIM)
+	{
+		printf("Test volumes must be 2 to %u samples across\n", VOLUME_MAX_DIM);
+		return false;
+	}
+
+	unsigned int dims[3] = { size, size, size };
+	std::vector<unsigned char> samples((size_t)size * size * size);
+
+	// a large blob with two smaller ones fused onto it, falling off with distance
+	glm::vec3 centres[3] = { glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.75f, 0.6f, 0.5f), glm::vec3(0.35f, 0.3f, 0.65f) };
+	float radii[3] = { 0.25f, 0.15f, 0.12f };
+
+	size_t index = 0;
+	for (unsigned int z = 0; z < size; ++z)
+	for (unsigned int y = 0; y < size; ++y)
+	for (unsigned int x = 0; x < size; ++x)
+	{
+		glm::vec3 p = glm::vec3(x, y, z) / (float)(size - 1);
+
+		float d = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			float r = glm::length(p - centres[i]) / radii[i];
+			d += 1.0f / (1.0f + r * r);
+		}
+
+		samples[index++] = (unsigned char)(glm::min(d, 1.0f) * 255);
+	}
+
+	if (!writeRawVolume(path, dims, VOLUME_UINT8, samples.data()))
+		return false;
+
+	printf("Wrote %u^3 test volume to '%s'\n", size, path);
+	return true;
+}
+
+void extractSurface(GLData& glData, MCData& mcData, const FieldData& fieldData, CLData& clData, std::vector<glm::vec4>& particles)
+{
+	cl_int result = CL_SUCCESS;
+	int output = mcData.outputIndex;
+	mcData.outputIndex = (output + 1) % mcData.outputCount;
+
+	waitForDrawing(glData, output);
+	collectBusyTime(clData, output);
+
+	// point the kernels at this frame's output buffer
+	result = clSetKernelArg(clData.kernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	result |= clSetKernelArg(clData.tiledKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	result |= clSetKernelArg(clData.mortonKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	result |= clSetKernelArg(clData.levelsKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	result |= clSetKernelArg(clData.drawCommandKernel, 2, sizeof(cl_mem), &clData.drawCommandLink[output]);
+	if (mcData.useLod)
+	{
+		result |= clSetKernelArg(clData.lod.blockKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+		result |= clSetKernelArg(clData.lod.transitionKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	}
+	if (mcData.useNets)
+		result |= clSetKernelArg(clData.nets.quadKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	if (mcData.useSparse)
+		result |= clSetKernelArg(clData.sparse.extractKernel, 2, sizeof(cl_mem), &clData.vboLink[output]);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the vertex buffer, and the draw command when drawing indirectly
+	cl_mem glLinks[2] = { clData.vboLink[output], clData.drawCommandLink[output] };
+	cl_uint glLinkCount = mcData.useIndirect ? 2 : 1;
+
+	// we set up write events in case we use out-of-order computations
+	cl_event writeEvents[3] = { 0, 0, 0 };
+
+	// send data to the device for opencl to use, aquiring the opengl buffer for opencl use
+	result = clEnqueueAcquireGLObjects(clData.queue, glLinkCount, glLinks, 0, 0, &writeEvents[0]);
+	CL_CHECK(clEnqueueAcquireGLObjects, result);
+	clData.outputStartEvent[output] = writeEvents[0];
+	clRetainEvent(writeEvents[0]);
+
+	// reset marching cube face count, one per level
+	cl_uint zero = 0;
+	result = clEnqueueFillBuffer(clData.queue, clData.faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint) * outputRanges(mcData), 0, nullptr, &writeEvents[1]);
+	CL_CHECK(clEnqueueFillBuffer, result);
+	enqueueParticleUpdate(fieldData, clData, particles, output, &writeEvents[2]);
+
+	// re-bin the particles now that they have moved, the field is ready once binned
+	if (fieldData.type == WYVILL)
+	{
+		cl_event binEvent = 0;
+		enqueueBinParticles(clData.queue, clData.bins, clData.particleLink, fieldData.particleCount, 1, &writeEvents[2], &binEvent);
+		clReleaseEvent(writeEvents[2]);
+		writeEvents[2] = binEvent;
+	}
+
+	// execute the marching cubes kernel
+	cl_event processEvent = 0;
+	if (mcData.useBricks)
+	{
+		// find the bricks that could contain the surface
+		cl_event brickEvents[2] = { 0, 0 };
+		result = clEnqueueFillBuffer(clData.queue, clData.activeBrickCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 1, &writeEvents[2], &brickEvents[0]);
+		CL_CHECK(clEnqueueFillBuffer, result);
+		result = clEnqueueNDRangeKernel(clData.queue, clData.brickKernel, 3, 0, mcData.brickCount, 0, 1, &brickEvents[0], &brickEvents[1]);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+
+		// polygonise only the cubes within active bricks, the count stays on the device
+		// so the launch covers every brick and the work-items past the count return
+		cl_event generateEvents[3] = { writeEvents[0], writeEvents[1], brickEvents[1] };
+		size_t globalWorkSize = mcData.brickCount[0] * mcData.brickCount[1] * mcData.brickCount[2] * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+		result = clEnqueueNDRangeKernel(clData.queue, clData.brickMarchingCubesKernel, 1, 0, &globalWorkSize, 0, 3, generateEvents, &processEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+		clReleaseEvent(brickEvents[0]);
+		clReleaseEvent(brickEvents[1]);
+	}
+	else if (mcData.useTiles)
+	{
+		result = clEnqueueNDRangeKernel(clData.queue, clData.tiledKernel, 3, 0, mcData.tiledGridSize, mcData.tileSize, 3, writeEvents, &processEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+	}
+	else if (mcData.useLod)
+		enqueueExtractLod(clData.lod, clData.queue, clData.lodUpload[output], 3, writeEvents, &processEvent);
+	else if (mcData.useNets)
+		enqueueExtractNets(clData.nets, clData.queue, 3, writeEvents, &processEvent);
+	else if (mcData.useSparse)
+		enqueueExtractSparse(clData.sparse, clData.queue, (cl_uint)fieldData.particleCount, 3, writeEvents, &processEvent);
+	else if (mcData.useLevels)
+	{
+		result = clEnqueueNDRangeKernel(clData.queue, clData.levelsKernel, 3, 0, mcData.gridSize, 0, 3, writeEvents, &processEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+	}
+	else if (mcData.useMorton)
+	{
+		// every brick of the grid, the kernel skips the padding cubes
+		size_t globalWorkSize = mcData.brickCount[0] * mcData.brickCount[1] * mcData.brickCount[2] * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+		result = clEnqueueNDRangeKernel(clData.queue, clData.mortonKernel, 1, 0, &globalWorkSize, 0, 3, writeEvents, &processEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+	}
+	else
+	{
+		result = clEnqueueNDRangeKernel(clData.queue, clData.kernel, 3, 0, mcData.gridSize, 0, 3, writeEvents, &processEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+	}
+
+	// the draw command is written from the count on the device, which every path
+	// has finished with once processEvent completes
+	cl_event readWaitEvent = processEvent;
+	cl_event commandEvent = 0;
+	if (mcData.useIndirect)
+	{
+		size_t one = 1;
+		result = clEnqueueNDRangeKernel(clData.queue, clData.drawCommandKernel, 1, 0, &one, 0, 1, &processEvent, &commandEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+		readWaitEvent = commandEvent;
+	}
+
+	// read back this buffer's count of each level, which tells whether it overflowed before it is drawn
+	cl_event readEvent = 0;
+	cl_uint* faceCounts = mcData.useLevels ? mcData.outputLevelFaceCount[output] : &mcData.outputFaceCount[output];
+	result = clEnqueueReadBuffer(clData.queue, clData.faceCountLink, CL_FALSE, 0, sizeof(cl_uint) * outputRanges(mcData), faceCounts, 1, &readWaitEvent, &readEvent);
+	CL_CHECK(clEnqueueReadBuffer, result);
+
+	// release the opengl buffers from opencl so that they can be drawn
+	result = clEnqueueReleaseGLObjects(clData.queue, glLinkCount, glLinks, 1, &readEvent, &clData.outputReadyEvent[output]);
+	CL_CHECK(clEnqueueReleaseGLObjects, result);
+	clReleaseEvent(readEvent);
+	if (commandEvent != 0)
+		clReleaseEvent(commandEvent);
+
+	// start opencl working, we only wait for it once the buffer is about to be drawn
+	clFlush(clData.queue);
+
+	for (int i = 0; i < 3; ++i)
+		clReleaseEvent(writeEvents[i]);
+	if (processEvent != 0)
+		clReleaseEvent(processEvent);
+}
+
+void raycastSurface(GLData& glData, const FieldData& fieldData, CLData& clData,
+					std::vector<glm::vec4>& particles, const glm::mat4& pvm)
+{
+	cl_int result = CL_SUCCESS;
+
+	waitForDrawing(glData, 0);
+	collectBusyTime(clData, 0);
+
+	// a ray per pixel of the window as it is now, a minimised one still casts one
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLint width = glm::max(viewport[2], 1);
+	GLint height = glm::max(viewport[3], 1);
+	if ((size_t)width != glData.raycastSize[0] || (size_t)height != glData.raycastSize[1])
+		resizeRaycastImage(glData, clData, width, height);
+
+	// we set up write events in case we use out-of-order computations
+	cl_event writeEvents[2] = { 0, 0 };
+
+	result = clEnqueueAcquireGLObjects(clData.queue, 1, &clData.raycastImageLink, 0, 0, &writeEvents[0]);
+	CL_CHECK(clEnqueueAcquireGLObjects, result);
+	clData.outputStartEvent[0] = writeEvents[0];
+	clRetainEvent(writeEvents[0]);
+
+	enqueueParticleUpdate(fieldData, clData, particles, 0, &writeEvents[1]);
+
+	// re-bin the particles now that they have moved, the field is ready once binned
+	if (fieldData.type == WYVILL)
+	{
+		cl_event binEvent = 0;
+		enqueueBinParticles(clData.queue, clData.bins, clData.particleLink, fieldData.particleCount, 1, &writeEvents[1], &binEvent);
+		clReleaseEvent(writeEvents[1]);
+		writeEvents[1] = binEvent;
+	}
+
+	cl_event castEvent = 0;
+	enqueueRaycast(clData.raycast, clData.queue, clData.raycastImageLink, glData.raycastSize, glm::inverse(pvm), 2, writeEvents, &castEvent);
+
+	// release the texture from opencl so that it can be drawn
+	result = clEnqueueReleaseGLObjects(clData.queue, 1, &clData.raycastImageLink, 1, &castEvent, &clData.outputReadyEvent[0]);
+	CL_CHECK(clEnqueueReleaseGLObjects, result);
+	clFlush(clData.queue);
+
+	// the image is drawn straight away, so unless opengl waits on the release itself we have to
+	if (!clData.implicitGLSync)
+		clWaitForEvents(1, &clData.outputReadyEvent[0]);
+
+	for (int i = 0; i < 2; ++i)
+		clReleaseEvent(writeEvents[i]);
+	clReleaseEvent(castEvent);
+}
+
+void resizeRaycastImage(GLData& glData, CLData& clData, GLint width, GLint height)
+{
+	cl_int result = CL_SUCCESS;
+
+	// opencl has to be done with the old image before its storage goes
+	clFinish(clData.queue);
+	clReleaseMemObject(clData.raycastImageLink);
+
+	glData.raycastSize[0] = width;
+	glData.raycastSize[1] = height;
+	glBindTexture(GL_TEXTURE_2D, glData.raycastTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glFinish();
+
+	clData.raycastImageLink = clCreateFromGLTexture(clData.context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, glData.raycastTexture, &result);
+	CL_CHECK(clCreateFromGLTexture, result);
+}
+
+void extractIncremental(GLData& glData, MCData& mcData, const FieldData& fieldData, CLData& clData,
+						IncrementalData& incData, std::vector<glm::vec4>& particles)
+{
+	cl_int result = CL_SUCCESS;
+
+	if (fieldData.type != VOLUME)
+		trackParticles(incData, particles, fieldData.type == WYVILL ? fieldData.radius : 0.0f, mcData.threshold);
+
+	// nothing has changed, so the pool and its draw commands are still good
+	if (incData.dirtyBricks.empty())
+		return;
+
+	collectBusyTime(clData, 0);
+
+	// we set up write events in case we use out-of-order computations
+	cl_event writeEvents[2] = { 0, 0 };
+	enqueueParticleUpdate(fieldData, clData, particles, 0, &writeEvents[0]);
+	clData.outputStartEvent[0] = writeEvents[0];
+	clRetainEvent(writeEvents[0]);
+
+	cl_event fieldEvent = writeEvents[0];
+	if (fieldData.type == WYVILL)
+	{
+		enqueueBinParticles(clData.queue, clData.bins, clData.particleLink, fieldData.particleCount, 1, &writeEvents[0], &writeEvents[1]);
+		fieldEvent = writeEvents[1];
+	}
+
+	// counting doesn't touch the pool, so it can run while opengl is still drawing it
+	cl_uint requiredFaces = 0;
+	while (!allocateDirtyBricks(incData, clData.queue, 1, &fieldEvent, requiredFaces))
+	{
+		cl_uint capacity = mcData.maxFaces;
+		while (capacity < requiredFaces + requiredFaces / 4 && capacity < mcData.maxFaceLimit)
+			capacity = glm::min(capacity * 2, mcData.maxFaceLimit);
+
+		// already as large as the device allows, the bricks that missed out stay
+		// empty this frame and are dirtied again to retry the next
+		if (capacity == mcData.maxFaces)
+		{
+			printf("Warning: the pool can't hold every brick's triangles\n");
+			break;
+		}
+
+		// every range is lost with the old storage, so start over with every brick dirty
+		cl_uint previousFaces = mcData.maxFaces;
+		resizeOutput(glData, mcData, clData, capacity);
+		if (mcData.maxFaces == previousFaces)
+			break;
+		resetIncremental(incData, mcData.maxFaces);
+	}
+
+	// freed ranges may be reused, so opengl has to be done with the pool
+	waitForDrawing(glData, 0);
+
+	cl_event extractEvents[2] = { 0, 0 };
+	result = clEnqueueAcquireGLObjects(clData.queue, 1, &clData.vboLink[0], 0, 0, &extractEvents[0]);
+	CL_CHECK(clEnqueueAcquireGLObjects, result);
+	enqueueExtractDirtyBricks(incData, clData.queue, clData.vboLink[0], &extractEvents[1]);
+	result = clEnqueueReleaseGLObjects(clData.queue, 1, &clData.vboLink[0], 1, &extractEvents[1], &clData.outputReadyEvent[0]);
+	CL_CHECK(clEnqueueReleaseGLObjects, result);
+	clFlush(clData.queue);
+
+	// opengl orders the command upload after the draws that used the old ones
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.brickCommandBuffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(cl_uint) * incData.drawCommands.size(), incData.drawCommands.data());
+	mcData.faceCount = incData.faceCount;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (writeEvents[i] != 0)
+			clReleaseEvent(writeEvents[i]);
+		clReleaseEvent(extractEvents[i]);
+	}
+}
+
+void extractSurfaceCPU(GLData& glData, MCData& mcData, CPUMCData& cpuData,
+					   const std::vector<glm::vec4>& particles, std::vector<glm::vec4>& vertices)
+{
+	int output = mcData.outputIndex;
+	mcData.outputIndex = (output + 1) % mcData.outputCount;
+
+	vertices.resize((size_t)mcData.maxFaces * 6);
+	mcData.faceCount = (cl_uint)cpuMarchingCubes(cpuData, mcData.gridSize, mcData.threshold,
+		particles.data(), (int)particles.size(), mcData.maxFaces, vertices.data());
+
+	// the surface didn't fit so polygonise it again once the buffers have grown
+	if (manageCPUOutputCapacity(glData, mcData))
+	{
+		vertices.resize((size_t)mcData.maxFaces * 6);
+		mcData.faceCount = (cl_uint)cpuMarchingCubes(cpuData, mcData.gridSize, mcData.threshold,
+			particles.data(), (int)particles.size(), mcData.maxFaces, vertices.data());
+	}
+
+	// upload the triangles and the matching draw command, opengl orders these against earlier draws
+	cl_uint faceCount = glm::min(mcData.faceCount, mcData.maxFaces);
+	mcData.outputFaceCount[output] = faceCount;
+	glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[output]);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec4) * 6 * faceCount, vertices.data());
+
+	GLuint drawCommand[4] = { faceCount * 3, 1, 0, 0 };
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, glData.drawCommandBuffer[output]);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(drawCommand), drawCommand);
+}
+
+void benchmarkCPU(MCData& mcData, std::vector<glm::vec4>& particles, const std::vector<glm::vec4>& seeds,
+				  unsigned int threadCount, int frames)
+{
+	CPUMCData cpuData;
+	createCPUMC(cpuData, threadCount, 0);
+
+	std::vector<glm::vec4> vertices((size_t)mcData.maxFaces * 6);
+	double seconds = 0;
+	size_t totalFaces = 0;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		animateParticles(particles, seeds, frame / 60.0f, mcData);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t faceCount = cpuMarchingCubes(cpuData, mcData.gridSize, mcData.threshold,
+			particles.data(), (int)particles.size(), vertices.size() / 6, vertices.data());
+		seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// keep every triangle so each frame does the full amount of work
+		if (faceCount * 6 > vertices.size())
+			vertices.resize(faceCount * 6);
+		totalFaces += faceCount;
+	}
+
+	double cubes = (double)mcData.gridSize[0] * mcData.gridSize[1] * mcData.gridSize[2] * frames;
+	printf("CPU: %u threads, %i^3 grid, %.2f ms/frame, %.1f M cubes/s, %.2f M triangles/s, %.0f triangles/frame\n",
+		   (unsigned int)cpuData.pool.threads.size() + 1, (int)mcData.gridSize[0], seconds * 1000 / frames,
+		   cubes / seconds * 1e-6, totalFaces / seconds * 1e-6, (double)totalFaces / frames);
+
+	releaseCPUMC(cpuData);
+}
+
+void waitForDrawing(GLData& glData, int output)
+{
+	// ensure opengl has finished drawing from this buffer, rather than waiting on everything with glFinish
+	if (glData.blobFence[output] != 0)
+	{
+		while (glClientWaitSync(glData.blobFence[output], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(glData.blobFence[output]);
+		glData.blobFence[output] = 0;
+	}
+	glFlush();
+}
+
+void enqueueParticleUpdate(const FieldData& fieldData, CLData& clData, const std::vector<glm::vec4>& particles,
+						   int output, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+
+	if (fieldData.type == VOLUME)
+	{
+		// the volume is static so there is nothing to send
+		result = clEnqueueMarkerWithWaitList(clData.queue, 0, nullptr, event);
+		CL_CHECK(clEnqueueMarkerWithWaitList, result);
+	}
+	else if (clData.animateKernel != 0)
+	{
+		// the particles are written where the field reads them, nothing crosses the bus
+		size_t globalWorkSize = fieldData.particleCount;
+		result = clEnqueueNDRangeKernel(clData.queue, clData.animateKernel, 1, 0, &globalWorkSize, 0, 0, nullptr, event);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+	}
+	else
+	{
+		// upload from a copy so the particles can be animated again while the write is pending
+		std::vector<glm::vec4>& upload = clData.particleUpload[output];
+		upload = particles;
+		result = clEnqueueWriteBuffer(clData.queue, clData.particleLink, CL_FALSE, 0, sizeof(glm::vec4) * fieldData.particleCount, upload.data(), 0, nullptr, event);
+		CL_CHECK(clEnqueueWriteBuffer, result);
+	}
+}
+
+void collectBusyTime(CLData& clData, int output)
+{
+	// the buffer's last extraction has long finished, so collect how long it kept opencl busy
+	if (clData.outputReadyEvent[output] != 0)
+	{
+		clWaitForEvents(1, &clData.outputReadyEvent[output]);
+
+		cl_ulong start = 0, end = 0;
+		clGetEventProfilingInfo(clData.outputStartEvent[output], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr);
+		clGetEventProfilingInfo(clData.outputReadyEvent[output], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr);
+		if (end > start)
+			clData.busyTime += end - start;
+
+		clReleaseEvent(clData.outputStartEvent[output]);
+		clReleaseEvent(clData.outputReadyEvent[output]);
+		clData.outputStartEvent[output] = 0;
+		clData.outputReadyEvent[output] = 0;
+	}
+}
+
+void waitForOutput(MCData& mcData, CLData& clData, int output)
+{
+	if (clData.outputReadyEvent[output] == 0)
+		return;
+
+	// the pool and the ray cast image have no count to check, so opengl waits on the release
+	// itself if it can. an extracted buffer's count has to be back before it's drawn
+	bool countNeeded = !mcData.useIncremental && !mcData.useRaycast;
+	if (countNeeded || !clData.implicitGLSync)
+		clWaitForEvents(1, &clData.outputReadyEvent[output]);
+	if (!countNeeded)
+		return;
+
+	// the buffer is sized by the level that needed the most room
+	if (mcData.useLevels)
+	{
+		mcData.outputFaceCount[output] = 0;
+		for (int i = 0; i < mcData.levelCount; ++i)
+			mcData.outputFaceCount[output] = glm::max(mcData.outputFaceCount[output], mcData.outputLevelFaceCount[output][i]);
+	}
+
+	mcData.faceCount = mcData.outputFaceCount[output];
+}
+
+bool captureSurface(MCData& mcData, CLData& clData, MeshExporter& exporter, int output)
+{
+	cl_int result = CL_SUCCESS;
+
+	if (clData.outputReadyEvent[output] == 0)
+		return false;
+
+	// event list in case we use out-of-order computations
+	cl_event events[3] = { 0, 0, 0 };
+	result = clEnqueueAcquireGLObjects(clData.queue, 1, &clData.vboLink[output], 1, &clData.outputReadyEvent[output], &events[0]);
+	CL_CHECK(clEnqueueAcquireGLObjects, result);
+
+	// every extraction reads its buffer's count back ahead of releasing it, and
+	// waitForOutput has already waited for that, so nothing here blocks
+	cl_uint faceCount = glm::min(mcData.outputFaceCount[output], mcData.maxFaces);
+
+	float positionScale = 65535.0f / maxGridSize(mcData);
+	bool captured = exportSurface(exporter, clData.vboLink[output], faceCount, mcData.vertexSize, mcData.compactVertices,
+								  positionScale, 1, &events[0], &events[1]);
+
+	// opengl can draw from the buffer again once it's been read
+	result = clEnqueueReleaseGLObjects(clData.queue, 1, &clData.vboLink[output], captured ? 1 : 0, captured ? &events[1] : nullptr, &events[2]);
+	CL_CHECK(clEnqueueReleaseGLObjects, result);
+	clFlush(clData.queue);
+
+	// without implicit synchronisation the read has to finish before we draw
+	if (!clData.implicitGLSync)
+		clWaitForEvents(1, &events[2]);
+
+	for (int i = 0; i < 3; ++i)
+		if (events[i] != 0)
+			clReleaseEvent(events[i]);
+
+	return captured;
+}
+
+void resizeOutput(GLData& glData, MCData& mcData, CLData& clData, cl_uint capacity)
+{
+	cl_int result = CL_SUCCESS;
+
+	// opencl must be done with the buffers before we can replace their storage
+	clFinish(clData.queue);
+	glFinish();
+
+	while (glGetError() != GL_NO_ERROR);
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		clReleaseMemObject(clData.vboLink[i]);
+
+		glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[i]);
+		glBufferData(GL_ARRAY_BUFFER, mcData.vertexSize * capacity * 3 * outputRanges(mcData), 0, GL_STATIC_DRAW);
+		if (glGetError() != GL_NO_ERROR)
+		{
+			printf("Failed to resize output to %u triangles\n", capacity);
+			capacity = mcData.maxFaces;
+			for (int j = 0; j <= i; ++j)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[j]);
+				glBufferData(GL_ARRAY_BUFFER, mcData.vertexSize * capacity * 3 * outputRanges(mcData), 0, GL_STATIC_DRAW);
+			}
+		}
+	}
+	glFinish();
+
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		clData.vboLink[i] = clCreateFromGLBuffer(clData.context, CL_MEM_WRITE_ONLY, glData.blobVBO[i], &result);
+		CL_CHECK(clCreateFromGLBuffer, result);
+	}
+
+	mcData.maxFaces = capacity;
+	mcData.lowUsageFrames = 0;
+
+	result = clSetKernelArg(clData.kernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.brickMarchingCubesKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.tiledKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.mortonKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.levelsKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	result |= clSetKernelArg(clData.drawCommandKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	if (mcData.useLod)
+	{
+		result |= clSetKernelArg(clData.lod.blockKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+		result |= clSetKernelArg(clData.lod.transitionKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	}
+	if (mcData.useNets)
+		result |= clSetKernelArg(clData.nets.quadKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	if (mcData.useSparse)
+		result |= clSetKernelArg(clData.sparse.extractKernel, 0, sizeof(cl_int), &mcData.maxFaces);
+	CL_CHECK(clSetKernelArg, result);
+
+	printf("Output resized to %u triangles (%.1f MB)\n", capacity, mcData.vertexSize * 3.0 * capacity * outputRanges(mcData) / (1024 * 1024));
+}
+
+void resizeCPUOutput(GLData& glData, MCData& mcData, cl_uint capacity)
+{
+	// opengl orphans the old storage while it's still being drawn from, so
+	// nothing waits. the buffers' opencl links go stale, but the cpu path
+	// never acquires them
+	while (glGetError() != GL_NO_ERROR);
+	for (int i = 0; i < mcData.outputCount; ++i)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[i]);
+		glBufferData(GL_ARRAY_BUFFER, mcData.vertexSize * capacity * 3 * outputRanges(mcData), 0, GL_STATIC_DRAW);
+		if (glGetError() != GL_NO_ERROR)
+		{
+			printf("Failed to resize output to %u triangles\n", capacity);
+			capacity = mcData.maxFaces;
+			for (int j = 0; j <= i; ++j)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, glData.blobVBO[j]);
+				glBufferData(GL_ARRAY_BUFFER, mcData.vertexSize * capacity * 3 * outputRanges(mcData), 0, GL_STATIC_DRAW);
+			}
+		}
+	}
+
+	mcData.maxFaces = capacity;
+	mcData.lowUsageFrames = 0;
+
+	printf("Output resized to %u triangles (%.1f MB)\n", capacity, mcData.vertexSize * 3.0 * capacity * outputRanges(mcData) / (1024 * 1024));
+}
+
+cl_uint chooseOutputCapacity(MCData& mcData)
+{
+	// the kernel keeps counting past the end of the buffer, so we know exactly how much room is needed
+	// when it's already as large as the device allows, the draw is clamped instead
+	if (mcData.faceCount > mcData.maxFaces)
+	{
+		cl_uint capacity = mcData.maxFaces;
+		while (capacity < mcData.faceCount && capacity < mcData.maxFaceLimit)
+			capacity = glm::min(capacity * 2, mcData.maxFaceLimit);
+		return capacity;
+	}
+
+	// shrink after a sustained period of low usage, rather than on every dip
+	if (mcData.faceCount < mcData.maxFaces / 4 && mcData.maxFaces > MIN_FACES)
+	{
+		if (++mcData.lowUsageFrames >= SHRINK_FRAMES)
+		{
+			cl_uint capacity = mcData.maxFaces;
+			while (capacity / 2 >= MIN_FACES && mcData.faceCount < capacity / 4)
+				capacity /= 2;
+			return capacity;
+		}
+	}
+	else
+		mcData.lowUsageFrames = 0;
+
+	return mcData.maxFaces;
+}
+
+bool manageOutputCapacity(GLData& glData, MCData& mcData, CLData& clData)
+{
+	cl_uint capacity = chooseOutputCapacity(mcData);
+	if (capacity == mcData.maxFaces)
+		return false;
+
+	resizeOutput(glData, mcData, clData, capacity);
+	return true;
+}
+
+bool manageCPUOutputCapacity(GLData& glData, MCData& mcData)
+{
+	bool overflowed = mcData.faceCount > mcData.maxFaces;
+	cl_uint capacity = chooseOutputCapacity(mcData);
+	if (capacity == mcData.maxFaces)
+		return false;
+
+	resizeCPUOutput(glData, mcData, capacity);
+	return overflowed;
+}
+
+cl_uint outputRanges(const MCData& mcData)
+{
+	return mcData.useLevels ? (cl_uint)mcData.levelCount : 1;
+}
+
+size_t maxGridSize(const MCData& mcData)
+{
+	return glm::max(mcData.gridSize[0], glm::max(mcData.gridSize[1], mcData.gridSize[2]));
+}
+
+void chooseTileSize(cl_device_id device, cl_kernel kernel, size_t tileSize[3])
+{
+	// grow the tile an axis at a time, x first so neighbouring work-items sample neighbouring corners,
+	// while it fits in a work-group and its corners fit in local memory. cpus have no real local
+	// memory, so they end up with whatever the group size allows
+	tileSize[0] = tileSize[1] = tileSize[2] = 1;
+	for (bool grown = true; grown; )
+	{
+		grown = false;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (tileSize[axis] >= 16)
+				continue;
+
+			size_t size[3] = { tileSize[0], tileSize[1], tileSize[2] };
+			size[axis] *= 2;
+			if (tileFits(device, kernel, size, false))
+			{
+				tileSize[axis] = size[axis];
+				grown = true;
+			}
+		}
+	}
+}
+
+bool tileFits(cl_device_id device, cl_kernel kernel, const size_t tileSize[3], bool report)
+{
+	// the kernel's own group size limit is never more than the device's, and
+	// its local memory use is whatever it needs besides the tile
+	size_t maxGroupSize = 0;
+	size_t maxItemSizes[3] = { 1, 1, 1 };
+	cl_ulong localMemSize = 0;
+	cl_ulong kernelLocalMemSize = 0;
+	clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, nullptr);
+	clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &kernelLocalMemSize, nullptr);
+	clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(maxItemSizes), maxItemSizes, nullptr);
+	clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, nullptr);
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (tileSize[axis] > maxItemSizes[axis])
+		{
+			if (report)
+				printf("Tile size %i is too large, the device allows at most %i work-items along axis %i\n",
+					   (int)tileSize[axis], (int)maxItemSizes[axis], axis);
+			return false;
+		}
+	}
+
+	size_t groupSize = tileSize[0] * tileSize[1] * tileSize[2];
+	if (groupSize > maxGroupSize)
+	{
+		if (report)
+			printf("Tile size %i x %i x %i is too large, its %i work-items exceed the tiled kernel's work-group size of %i\n",
+				   (int)tileSize[0], (int)tileSize[1], (int)tileSize[2], (int)groupSize, (int)maxGroupSize);
+		return false;
+	}
+
+	cl_ulong tileBytes = sizeof(cl_float) * (tileSize[0] + 1) * (tileSize[1] + 1) * (tileSize[2] + 1);
+	if (tileBytes + kernelLocalMemSize > localMemSize)
+	{
+		if (report)
+			printf("Tile size %i x %i x %i is too large, its corners need %llu bytes of local memory and the device has %llu\n",
+				   (int)tileSize[0], (int)tileSize[1], (int)tileSize[2], (unsigned long long)(tileBytes + kernelLocalMemSize),
+				   (unsigned long long)localMemSize);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,167 @@
+#include "nets.h"
+#include <algorithm>
+
+bool createNets(NetData& nets, cl_context context, cl_program program, const size_t gridSize[3], cl_float threshold)
+{
+	cl_int result = CL_SUCCESS;
+
+	nets.context = context;
+	nets.cubeCount = 1;
+	size_t sampleTotal = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		nets.gridSize[i] = gridSize[i];
+		nets.sampleCount[i] = gridSize[i] + 1;
+		nets.cubeCount *= gridSize[i];
+		sampleTotal *= nets.sampleCount[i];
+	}
+	nets.vertexCapacity = (cl_uint)std::min(nets.cubeCount, (size_t)1 << 14);
+	nets.vertexCount = 0;
+	nets.pendingVertexCount = 0;
+	nets.vertexCountEvent = 0;
+	nets.extractedVertices = 0;
+
+	nets.sampleKernel = clCreateKernel(program, "sampleField", &result);
+	CL_CHECK(clCreateKernel, result);
+	nets.flagKernel = clCreateKernel(program, "flagNetCubes", &result);
+	CL_CHECK(clCreateKernel, result);
+	nets.vertexKernel = clCreateKernel(program, "placeNetVertices", &result);
+	CL_CHECK(clCreateKernel, result);
+	nets.quadKernel = clCreateKernel(program, "netQuads", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	nets.sampleLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * sampleTotal, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	nets.cubeVertexLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * nets.cubeCount, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	nets.netVertexLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float4) * 2 * nets.vertexCapacity, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	if (!createScan(nets.scan, context, program, nets.cubeCount))
+		return false;
+
+	cl_int grid[4] = { (cl_int)gridSize[0], (cl_int)gridSize[1], (cl_int)gridSize[2], 0 };
+	result = clSetKernelArg(nets.sampleKernel, 0, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(nets.sampleKernel, 1, sizeof(cl_mem), &nets.sampleLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(nets.flagKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(nets.flagKernel, 1, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(nets.flagKernel, 2, sizeof(cl_mem), &nets.sampleLink);
+	result |= clSetKernelArg(nets.flagKernel, 3, sizeof(cl_mem), &nets.cubeVertexLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(nets.vertexKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(nets.vertexKernel, 1, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(nets.vertexKernel, 2, sizeof(cl_mem), &nets.sampleLink);
+	result |= clSetKernelArg(nets.vertexKernel, 3, sizeof(cl_mem), &nets.cubeVertexLink);
+	result |= clSetKernelArg(nets.vertexKernel, 4, sizeof(cl_mem), &nets.netVertexLink);
+	result |= clSetKernelArg(nets.vertexKernel, 5, sizeof(cl_uint), &nets.vertexCapacity);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(nets.quadKernel, 3, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(nets.quadKernel, 4, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(nets.quadKernel, 5, sizeof(cl_mem), &nets.sampleLink);
+	result |= clSetKernelArg(nets.quadKernel, 6, sizeof(cl_mem), &nets.cubeVertexLink);
+	result |= clSetKernelArg(nets.quadKernel, 7, sizeof(cl_mem), &nets.netVertexLink);
+	result |= clSetKernelArg(nets.quadKernel, 8, sizeof(cl_uint), &nets.vertexCapacity);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseNets(NetData& nets)
+{
+	if (nets.vertexCountEvent != 0)
+	{
+		clWaitForEvents(1, &nets.vertexCountEvent);
+		clReleaseEvent(nets.vertexCountEvent);
+	}
+	releaseScan(nets.scan);
+	clReleaseMemObject(nets.netVertexLink);
+	clReleaseMemObject(nets.cubeVertexLink);
+	clReleaseMemObject(nets.sampleLink);
+	clReleaseKernel(nets.quadKernel);
+	clReleaseKernel(nets.vertexKernel);
+	clReleaseKernel(nets.flagKernel);
+	clReleaseKernel(nets.sampleKernel);
+}
+
+void enqueueExtractNets(NetData& nets, cl_command_queue queue,
+						cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+
+	// pick up the vertex count of an earlier frame if its readback has landed
+	if (nets.vertexCountEvent != 0)
+	{
+		cl_int status = CL_QUEUED;
+		clGetEventInfo(nets.vertexCountEvent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, nullptr);
+		if (status == CL_COMPLETE)
+		{
+			nets.vertexCount = nets.pendingVertexCount;
+			clReleaseEvent(nets.vertexCountEvent);
+			nets.vertexCountEvent = 0;
+		}
+	}
+
+	// grow the vertex buffer, opencl keeps the old one until the queue is done
+	// with it. there is at most a vertex per cube
+	if (nets.vertexCount > nets.vertexCapacity)
+	{
+		cl_uint capacity = nets.vertexCapacity;
+		while (capacity < nets.vertexCount)
+			capacity *= 2;
+		capacity = (cl_uint)std::min((size_t)capacity, nets.cubeCount);
+
+		cl_mem vertexLink = clCreateBuffer(nets.context, CL_MEM_READ_WRITE, sizeof(cl_float4) * 2 * capacity, nullptr, &result);
+		CL_CHECK(clCreateBuffer, result);
+		if (result == CL_SUCCESS)
+		{
+			clReleaseMemObject(nets.netVertexLink);
+			nets.netVertexLink = vertexLink;
+			nets.vertexCapacity = capacity;
+
+			result = clSetKernelArg(nets.vertexKernel, 4, sizeof(cl_mem), &nets.netVertexLink);
+			result |= clSetKernelArg(nets.vertexKernel, 5, sizeof(cl_uint), &nets.vertexCapacity);
+			result |= clSetKernelArg(nets.quadKernel, 7, sizeof(cl_mem), &nets.netVertexLink);
+			result |= clSetKernelArg(nets.quadKernel, 8, sizeof(cl_uint), &nets.vertexCapacity);
+			CL_CHECK(clSetKernelArg, result);
+		}
+	}
+
+	// event list in case we use out-of-order computations
+	cl_event events[4] = { 0, 0, 0, 0 };
+
+	// cache the field at every sample, then flag and number the crossed cubes
+	result = clEnqueueNDRangeKernel(queue, nets.sampleKernel, 3, 0, nets.sampleCount, 0, numWaitEvents, waitEvents, &events[0]);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+	result = clEnqueueNDRangeKernel(queue, nets.flagKernel, 3, 0, nets.gridSize, 0, 1, &events[0], &events[1]);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+	enqueueScan(queue, nets.scan, nets.cubeVertexLink, nets.cubeCount, 1, &events[1], &events[2]);
+
+	// the count is only needed to size the vertex buffer, so don't wait for it
+	if (nets.vertexCountEvent == 0)
+	{
+		result = clEnqueueReadBuffer(queue, nets.scan.groupSums.back(), CL_FALSE, 0, sizeof(cl_uint), &nets.pendingVertexCount, 1, &events[2], &nets.vertexCountEvent);
+		CL_CHECK(clEnqueueReadBuffer, result);
+	}
+
+	// the vertices and quads that don't fit are skipped by the kernels
+	result = clEnqueueNDRangeKernel(queue, nets.vertexKernel, 3, 0, nets.gridSize, 0, 1, &events[2], &events[3]);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	// the quads start at the samples with all of their cubes in the grid,
+	// which leaves out the far faces
+	result = clEnqueueNDRangeKernel(queue, nets.quadKernel, 3, 0, nets.gridSize, 0, 1, &events[3], event);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	for (int i = 0; i < 4; ++i)
+		if (events[i] != 0)
+			clReleaseEvent(events[i]);
+
+	// as of the last count to land
+	nets.extractedVertices += std::min(nets.vertexCount, nets.vertexCapacity);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "scan.h"
+
+// surface nets extraction, a dual alternative to marching cubes that places
+// a vertex in each cube the surface crosses and joins the four cubes around
+// each crossed edge with a quad. the field is cached once per frame in a
+// volume of samples that every pass reads, and the crossed cubes are
+// numbered with the same scan the particle bins use.
+struct NetData
+{
+	cl_kernel	sampleKernel;
+	cl_kernel	flagKernel;
+	cl_kernel	vertexKernel;
+	cl_kernel	quadKernel;
+	ScanData	scan;
+	cl_context	context;
+
+	size_t		gridSize[3];
+	size_t		sampleCount[3];		// a sample more than the grid has cubes along each side
+	size_t		cubeCount;
+
+	cl_mem		sampleLink;			// the field at every sample of the grid
+	cl_mem		cubeVertexLink;		// 1 for each crossed cube, scanned into its vertex index
+	cl_mem		netVertexLink;		// position and normal of each vertex, grown as needed
+	cl_uint		vertexCapacity;
+
+	// the vertex count read back without waiting, which grows the vertex
+	// buffer once it has landed
+	cl_uint		vertexCount;
+	cl_uint		pendingVertexCount;
+	cl_event	vertexCountEvent;
+
+	// vertices placed since the last report
+	size_t		extractedVertices;
+};
+
+// the field arguments of sampleKernel from index 2 and vertexKernel from index
+// 6, and the output arguments 0 to 2 of quadKernel, are left to the caller
+bool createNets(NetData& nets, cl_context context, cl_program program, const size_t gridSize[3], cl_float threshold);
+void releaseNets(NetData& nets);
+
+// samples the field, places the vertices and appends two triangles per
+// crossed edge to the vertex buffer set on quadKernel. the vertex count is
+// read back without waiting and grows the vertex buffer in a later frame, so
+// a frame that outgrows it drops the vertices that don't fit
+void enqueueExtractNets(NetData& nets, cl_command_queue queue,
+						cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
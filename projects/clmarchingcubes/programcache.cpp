@@ -0,0 +1,241 @@
+#include "programcache.h"
+#include <functional>
+#include <set>
+#include <sstream>
+#include <vector>
+
+void createProgramCache(ProgramCache& cache, cl_context context, cl_device_id device, const char* directory)
+{
+	cache.context = context;
+	cache.device = device;
+	cache.directory = directory != nullptr ? directory : "";
+
+	// binaries only load on the device and driver that built them
+	char name[256] = "";
+	char version[256] = "";
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, nullptr);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(version), version, nullptr);
+	cache.deviceKey = std::string(name) + '\n' + version;
+}
+
+void releaseProgramCache(ProgramCache& cache)
+{
+	for (auto& entry : cache.programs)
+		clReleaseProgram(entry.second);
+	cache.programs.clear();
+}
+
+// file holding the binary of a key, named by its hash
+static std::string binaryPath(const ProgramCache& cache, const std::string& key)
+{
+	char name[32];
+	sprintf(name, "/%016llx.clbin", (unsigned long long)std::hash<std::string>()(key));
+	return cache.directory + name;
+}
+
+// the -I directories of the build options
+static std::vector<std::string> includeDirectories(const char* options)
+{
+	std::vector<std::string> directories;
+	std::istringstream stream(options);
+	std::string token;
+	while (stream >> token)
+	{
+		if (token == "-I" && stream >> token)
+			directories.push_back(token);
+		else if (token.compare(0, 2, "-I") == 0 && token.size() > 2)
+			directories.push_back(token.substr(2));
+	}
+	return directories;
+}
+
+// appends the name and contents of every header the source includes with
+// quotes, and the headers they include in turn, each once
+static void appendIncludes(const std::vector<std::string>& directories, const char* source, size_t length,
+						   std::set<std::string>& visited, std::string& includes)
+{
+	std::istringstream lines(std::string(source, length));
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+			continue;
+
+		size_t open = line.find('"', start + 8);
+		size_t close = open != std::string::npos ? line.find('"', open + 1) : std::string::npos;
+		if (close == std::string::npos)
+			continue;
+
+		std::string name = line.substr(open + 1, close - open - 1);
+		if (!visited.insert(name).second)
+			continue;
+
+		// the first directory that has it, as the compiler searches them
+		for (const std::string& directory : directories)
+		{
+			FILE* file = fopen((directory + '/' + name).c_str(), "rb");
+			if (file == nullptr)
+				continue;
+
+			std::string contents;
+			char buffer[4096];
+			size_t count = 0;
+			while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+				contents.append(buffer, count);
+			fclose(file);
+
+			includes += name + '\n' + contents + '\n';
+			appendIncludes(directories, contents.data(), contents.size(), visited, includes);
+			break;
+		}
+	}
+}
+
+// what a binary was built from, written ahead of it. the source and the
+// headers it includes are hashed with fnv-1a rather than std::hash, which
+// already names the file
+static std::string binaryHeader(const ProgramCache& cache, cl_uint sourceCount, const char** sources, const size_t* lengths,
+								const std::string& includes, const char* options)
+{
+	unsigned long long sourceHash = 14695981039346656037ull;
+	size_t sourceLength = 0;
+	for (cl_uint i = 0; i <= sourceCount; ++i)
+	{
+		const char* source = i < sourceCount ? sources[i] : includes.data();
+		size_t length = i < sourceCount ? lengths[i] : includes.size();
+		for (size_t j = 0; j < length; ++j)
+			sourceHash = (sourceHash ^ (unsigned char)source[j]) * 1099511628211ull;
+		sourceLength += length;
+	}
+
+	char source[64];
+	sprintf(source, "%016llx %llu", sourceHash, (unsigned long long)sourceLength);
+	return cache.deviceKey + '\n' + options + '\n' + source + '\n';
+}
+
+static cl_program loadBinary(ProgramCache& cache, const std::string& path, const std::string& header, const char* options)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return nullptr;
+
+	// a binary of some other source whose key hashed to the same name
+	cl_uint headerSize = 0;
+	std::string fileHeader;
+	if (fread(&headerSize, sizeof(headerSize), 1, file) == 1 && headerSize == header.size())
+	{
+		fileHeader.resize(headerSize);
+		if (fread(&fileHeader[0], 1, headerSize, file) != headerSize)
+			fileHeader.clear();
+	}
+	if (fileHeader != header)
+	{
+		fclose(file);
+		return nullptr;
+	}
+
+	std::vector<unsigned char> binary;
+	unsigned char buffer[4096];
+	size_t count = 0;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		binary.insert(binary.end(), buffer, buffer + count);
+	fclose(file);
+
+	// a stale or corrupt binary just falls back to compiling the source
+	cl_int result = CL_SUCCESS;
+	cl_int status = CL_SUCCESS;
+	size_t size = binary.size();
+	const unsigned char* data = binary.data();
+	cl_program program = clCreateProgramWithBinary(cache.context, 1, &cache.device, &size, &data, &status, &result);
+	if (result != CL_SUCCESS || status != CL_SUCCESS)
+	{
+		if (program != nullptr)
+			clReleaseProgram(program);
+		return nullptr;
+	}
+
+	if (clBuildProgram(program, 1, &cache.device, options, 0, 0) != CL_SUCCESS)
+	{
+		clReleaseProgram(program);
+		return nullptr;
+	}
+	return program;
+}
+
+static void saveBinary(ProgramCache& cache, const std::string& path, const std::string& header, cl_program program)
+{
+	size_t size = 0;
+	clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, nullptr);
+	if (size == 0)
+		return;
+
+	std::vector<unsigned char> binary(size);
+	unsigned char* data = binary.data();
+	clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &data, nullptr);
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		printf("Failed to write program binary '%s'\n", path.c_str());
+		return;
+	}
+	cl_uint headerSize = (cl_uint)header.size();
+	fwrite(&headerSize, sizeof(headerSize), 1, file);
+	fwrite(header.data(), 1, headerSize, file);
+	fwrite(binary.data(), 1, size, file);
+	fclose(file);
+}
+
+cl_program buildCachedProgram(ProgramCache& cache, cl_uint sourceCount, const char** sources, const size_t* lengths,
+							  const char* options, cl_int* result)
+{
+	// the included headers are read each build, so editing one is a new key
+	std::vector<std::string> directories = includeDirectories(options);
+	std::set<std::string> visited;
+	std::string includes;
+	for (cl_uint i = 0; i < sourceCount; ++i)
+		appendIncludes(directories, sources[i], lengths[i], visited, includes);
+
+	std::string key = cache.deviceKey + '\n' + options + '\n' + includes + '\n';
+	for (cl_uint i = 0; i < sourceCount; ++i)
+		key.append(sources[i], lengths[i]);
+
+	*result = CL_SUCCESS;
+	auto cached = cache.programs.find(key);
+	if (cached != cache.programs.end())
+	{
+		clRetainProgram(cached->second);
+		return cached->second;
+	}
+
+	std::string path;
+	std::string header;
+	cl_program program = nullptr;
+	if (!cache.directory.empty())
+	{
+		path = binaryPath(cache, key);
+		header = binaryHeader(cache, sourceCount, sources, lengths, includes, options);
+		program = loadBinary(cache, path, header, options);
+	}
+
+	if (program == nullptr)
+	{
+		program = clCreateProgramWithSource(cache.context, sourceCount, sources, lengths, result);
+		CL_CHECK(clCreateProgramWithSource, *result);
+		if (*result != CL_SUCCESS)
+			return nullptr;
+
+		*result = clBuildProgram(program, 1, &cache.device, options, 0, 0);
+		if (*result != CL_SUCCESS)
+			return program;
+
+		if (!path.empty())
+			saveBinary(cache, path, header, program);
+	}
+
+	// one reference for the cache and one for the caller
+	clRetainProgram(program);
+	cache.programs[key] = program;
+	return program;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "clcommon.h"
+#include <string>
+#include <unordered_map>
+
+// built programs keyed by their source and build options, so that building
+// the same source again, such as a field expression that is switched back
+// to, reuses the program rather than compiling it. given a directory the
+// binaries are kept there too, so later runs on the same device and driver
+// skip the compile. the key covers the headers the source includes with
+// quotes from the options' -I directories, so editing one such as the
+// lookup tables builds afresh. files are named by a hash of the key and
+// start with the device, options and a second hash of the source and its
+// headers, which are checked on load so a name collision recompiles rather
+// than loading the wrong program
+struct ProgramCache
+{
+	cl_context		context;
+	cl_device_id	device;
+	std::string		directory;		// empty to only keep programs in memory
+	std::string		deviceKey;		// device name and driver version, part of every key
+
+	std::unordered_map<std::string, cl_program>	programs;
+};
+
+void createProgramCache(ProgramCache& cache, cl_context context, cl_device_id device, const char* directory);
+void releaseProgramCache(ProgramCache& cache);
+
+// the program built from the concatenated sources with options, retained for
+// the caller, who releases it as usual. when the build fails the program is
+// still returned, uncached, so that the caller can read its build log
+cl_program buildCachedProgram(ProgramCache& cache, cl_uint sourceCount, const char** sources, const size_t* lengths,
+							  const char* options, cl_int* result);
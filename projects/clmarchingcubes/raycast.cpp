@@ -0,0 +1,101 @@
+#include "raycast.h"
+#include <glm/ext.hpp>
+
+bool createRaycast(RaycastData& data, cl_context context, cl_program program, const size_t gridSize[3],
+				   size_t brickSize, cl_float threshold, bool staticField)
+{
+	cl_int result = CL_SUCCESS;
+
+	data.staticField = staticField;
+	data.sampled = false;
+
+	size_t sampleTotal = 1;
+	size_t brickTotal = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		data.sampleCount[i] = gridSize[i] + 1;
+		data.brickCount[i] = (gridSize[i] + brickSize - 1) / brickSize;
+		sampleTotal *= data.sampleCount[i];
+		brickTotal *= data.brickCount[i];
+	}
+
+	data.sampleKernel = clCreateKernel(program, "sampleField", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.boundKernel = clCreateKernel(program, "boundSampleBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.rayKernel = clCreateKernel(program, "castRays", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	data.sampleLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * sampleTotal, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.brickRangeLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float2) * brickTotal, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	cl_int grid[4] = { (cl_int)gridSize[0], (cl_int)gridSize[1], (cl_int)gridSize[2], 0 };
+	cl_int bricks[4] = { (cl_int)data.brickCount[0], (cl_int)data.brickCount[1], (cl_int)data.brickCount[2], 0 };
+	result = clSetKernelArg(data.sampleKernel, 0, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(data.sampleKernel, 1, sizeof(cl_mem), &data.sampleLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(data.boundKernel, 0, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(data.boundKernel, 1, sizeof(cl_mem), &data.sampleLink);
+	result |= clSetKernelArg(data.boundKernel, 2, sizeof(cl_mem), &data.brickRangeLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(data.rayKernel, 2, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.rayKernel, 3, sizeof(cl_int) * 4, grid);
+	result |= clSetKernelArg(data.rayKernel, 4, sizeof(cl_int) * 4, bricks);
+	result |= clSetKernelArg(data.rayKernel, 5, sizeof(cl_mem), &data.sampleLink);
+	result |= clSetKernelArg(data.rayKernel, 6, sizeof(cl_mem), &data.brickRangeLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseRaycast(RaycastData& data)
+{
+	clReleaseMemObject(data.brickRangeLink);
+	clReleaseMemObject(data.sampleLink);
+	clReleaseKernel(data.rayKernel);
+	clReleaseKernel(data.boundKernel);
+	clReleaseKernel(data.sampleKernel);
+}
+
+void enqueueRaycast(RaycastData& data, cl_command_queue queue, cl_mem image, const size_t imageSize[2],
+					const glm::mat4& inversePvm, cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+
+	// event list in case we use out-of-order computations
+	cl_event events[2] = { 0, 0 };
+
+	// cache the field at every sample, then bound each brick's samples, which
+	// a static field keeps from the first frame
+	cl_uint numRayWaitEvents = numWaitEvents;
+	const cl_event* rayWaitEvents = waitEvents;
+	if (!data.staticField || !data.sampled)
+	{
+		result = clEnqueueNDRangeKernel(queue, data.sampleKernel, 3, 0, data.sampleCount, 0, numWaitEvents, waitEvents, &events[0]);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+		result = clEnqueueNDRangeKernel(queue, data.boundKernel, 3, 0, data.brickCount, 0, 1, &events[0], &events[1]);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+		numRayWaitEvents = 1;
+		rayWaitEvents = &events[1];
+		data.sampled = true;
+	}
+
+	// a ray per pixel
+	result = clSetKernelArg(data.rayKernel, 0, sizeof(cl_mem), &image);
+	result |= clSetKernelArg(data.rayKernel, 1, sizeof(cl_float) * 16, glm::value_ptr(inversePvm));
+	CL_CHECK(clSetKernelArg, result);
+	result = clEnqueueNDRangeKernel(queue, data.rayKernel, 2, 0, imageSize, 0, numRayWaitEvents, rayWaitEvents, event);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (events[i] != 0)
+			clReleaseEvent(events[i]);
+	}
+}
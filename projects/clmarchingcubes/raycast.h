@@ -0,0 +1,36 @@
+#pragma once
+
+#include "clcommon.h"
+#include <glm/glm.hpp>
+
+// renders the isosurface directly by casting a ray through the field for
+// every pixel, rather than extracting a mesh to draw. the field is cached in
+// a volume of samples each frame, and the rays skip the bricks whose samples
+// are all on one side of the threshold. a static field is only sampled and
+// bounded on the first frame
+struct RaycastData
+{
+	cl_kernel	sampleKernel;
+	cl_kernel	boundKernel;
+	cl_kernel	rayKernel;
+
+	size_t		sampleCount[3];		// a sample more than the grid has cubes along each side
+	size_t		brickCount[3];
+
+	bool		staticField;		// the field never changes, such as a volume
+	bool		sampled;			// the samples and bounds are up to date
+
+	cl_mem		sampleLink;			// the field at every sample of the grid
+	cl_mem		brickRangeLink;		// smallest and largest sample in each brick
+};
+
+// the field arguments of sampleKernel, from index 2, are left to the caller
+bool createRaycast(RaycastData& data, cl_context context, cl_program program, const size_t gridSize[3],
+				   size_t brickSize, cl_float threshold, bool staticField);
+void releaseRaycast(RaycastData& data);
+
+// caches the field, bounds the bricks and shades a pixel per ray into image,
+// an acquired opengl texture of imageSize pixels. inversePvm takes clip space
+// back to the grid
+void enqueueRaycast(RaycastData& data, cl_command_queue queue, cl_mem image, const size_t imageSize[2],
+					const glm::mat4& inversePvm, cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
@@ -0,0 +1,110 @@
+#include "scan.h"
+#include <algorithm>
+
+// an empty level still launches one group so the totals are written
+static size_t groupCount(size_t count)
+{
+	return std::max<size_t>((count + SCAN_GROUP_SIZE - 1) / SCAN_GROUP_SIZE, 1);
+}
+
+bool createScan(ScanData& scan, cl_context context, cl_program program, size_t maxCount)
+{
+	cl_int result = CL_SUCCESS;
+
+	scan.maxCount = maxCount;
+	scan.scanKernel = clCreateKernel(program, "scanGroups", &result);
+	CL_CHECK(clCreateKernel, result);
+	if (result != CL_SUCCESS)
+		return false;
+	scan.addKernel = clCreateKernel(program, "addGroupSums", &result);
+	CL_CHECK(clCreateKernel, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	// one buffer of group totals per level until a single group remains
+	size_t count = maxCount;
+	do
+	{
+		count = groupCount(count);
+		cl_mem sums = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * count, nullptr, &result);
+		CL_CHECK(clCreateBuffer, result);
+		if (result != CL_SUCCESS)
+			return false;
+		scan.groupSums.push_back(sums);
+	} while (count > 1);
+
+	return true;
+}
+
+void releaseScan(ScanData& scan)
+{
+	for (auto sums : scan.groupSums)
+		clReleaseMemObject(sums);
+	scan.groupSums.clear();
+	clReleaseKernel(scan.addKernel);
+	clReleaseKernel(scan.scanKernel);
+}
+
+void enqueueScan(cl_command_queue queue, ScanData& scan, cl_mem data, size_t count,
+				 cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+	size_t localWorkSize = SCAN_GROUP_SIZE;
+	size_t levels = scan.groupSums.size();
+
+	// element counts and buffers of every level, level 0 being the data itself
+	std::vector<size_t> counts(levels + 1);
+	std::vector<cl_mem> buffers(levels + 1);
+	counts[0] = count;
+	buffers[0] = data;
+	for (size_t i = 0; i < levels; ++i)
+	{
+		counts[i + 1] = groupCount(counts[i]);
+		buffers[i + 1] = scan.groupSums[i];
+	}
+
+	// scan each level, writing its group totals into the next
+	// we always run every level so that the final total ends up in the last buffer
+	cl_event lastEvent = 0;
+	for (size_t i = 0; i < levels; ++i)
+	{
+		cl_uint levelCount = (cl_uint)counts[i];
+		size_t globalWorkSize = groupCount(counts[i]) * SCAN_GROUP_SIZE;
+
+		result = clSetKernelArg(scan.scanKernel, 0, sizeof(cl_mem), &buffers[i]);
+		result |= clSetKernelArg(scan.scanKernel, 1, sizeof(cl_mem), &buffers[i + 1]);
+		result |= clSetKernelArg(scan.scanKernel, 2, sizeof(cl_uint), &levelCount);
+		CL_CHECK(clSetKernelArg, result);
+
+		cl_event scanEvent = 0;
+		result = clEnqueueNDRangeKernel(queue, scan.scanKernel, 1, 0, &globalWorkSize, &localWorkSize,
+			lastEvent ? 1 : numWaitEvents, lastEvent ? &lastEvent : waitEvents, &scanEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+		if (lastEvent != 0)
+			clReleaseEvent(lastEvent);
+		lastEvent = scanEvent;
+	}
+
+	// fold each level's scanned group totals back into the level below it
+	for (size_t i = levels - 1; i > 0; --i)
+	{
+		cl_uint levelCount = (cl_uint)counts[i - 1];
+		size_t globalWorkSize = groupCount(counts[i - 1]) * SCAN_GROUP_SIZE;
+
+		result = clSetKernelArg(scan.addKernel, 0, sizeof(cl_mem), &buffers[i - 1]);
+		result |= clSetKernelArg(scan.addKernel, 1, sizeof(cl_mem), &buffers[i]);
+		result |= clSetKernelArg(scan.addKernel, 2, sizeof(cl_uint), &levelCount);
+		CL_CHECK(clSetKernelArg, result);
+
+		cl_event addEvent = 0;
+		result = clEnqueueNDRangeKernel(queue, scan.addKernel, 1, 0, &globalWorkSize, &localWorkSize, 1, &lastEvent, &addEvent);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+		clReleaseEvent(lastEvent);
+		lastEvent = addEvent;
+	}
+
+	if (event != nullptr)
+		*event = lastEvent;
+	else
+		clReleaseEvent(lastEvent);
+}
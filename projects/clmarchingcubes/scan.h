@@ -0,0 +1,30 @@
+#pragma once
+
+#include "clcommon.h"
+#include <vector>
+
+// work-group size of the scan kernels
+// must match SCAN_GROUP_SIZE in the kernel, which we pass as a build option
+const size_t SCAN_GROUP_SIZE = 256;
+
+// exclusive prefix sum of a cl_uint buffer using the scanGroups / addGroupSums
+// kernels. each level of the recursion scans the group totals of the level
+// below it, down to a single group whose total is the sum of every element.
+struct ScanData
+{
+	cl_kernel			scanKernel;
+	cl_kernel			addKernel;
+
+	// group totals for each level, the last level holds a single element
+	std::vector<cl_mem>	groupSums;
+	size_t				maxCount;
+};
+
+// creates the kernels and intermediate buffers for scans of up to maxCount elements
+bool createScan(ScanData& scan, cl_context context, cl_program program, size_t maxCount);
+void releaseScan(ScanData& scan);
+
+// scans the first count elements of data in place
+// the sum of all count elements is left in scan.groupSums.back()
+void enqueueScan(cl_command_queue queue, ScanData& scan, cl_mem data, size_t count,
+				 cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
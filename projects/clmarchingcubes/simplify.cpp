@@ -0,0 +1,601 @@
+#include "simplify.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <queue>
+#include <unordered_map>
+
+const int DEFAULT_PASSES = 4;
+
+// open edges, such as where the surface leaves the grid, get a plane through
+// them perpendicular to their triangle, weighted so the outline keeps its shape
+const double BOUNDARY_WEIGHT = 10.0;
+
+// symmetric 4x4 matrix, stored as a2 ab ac ad b2 bc bd c2 cd d2
+struct Quadric
+{
+	double		m[10];
+};
+
+struct Collapse
+{
+	double			cost;
+	unsigned int	from;
+	unsigned int	to;
+	unsigned int	fromVersion;
+	unsigned int	toVersion;
+	glm::vec3		position;
+
+	// std::priority_queue pops the largest, so order by decreasing cost
+	bool operator<(const Collapse& other) const { return cost > other.cost; }
+};
+
+// the triangles of one cell with their own copy of their vertices
+struct CellMesh
+{
+	std::vector<unsigned int>				globalVertex;
+	std::vector<glm::vec3>					positions;
+	std::vector<Quadric>					quadrics;
+	std::vector<unsigned char>				removed;
+	std::vector<unsigned int>				versions;		// incremented whenever a vertex changes, to spot stale collapses
+	std::vector<std::vector<unsigned int>>	vertexTriangles;
+
+	std::vector<unsigned int>				triangles;
+	std::vector<unsigned char>				triangleRemoved;
+	size_t									liveTriangles;
+};
+
+static void addPlane(Quadric& q, const glm::dvec3& n, double d, double weight)
+{
+	q.m[0] += weight * n.x * n.x;
+	q.m[1] += weight * n.x * n.y;
+	q.m[2] += weight * n.x * n.z;
+	q.m[3] += weight * n.x * d;
+	q.m[4] += weight * n.y * n.y;
+	q.m[5] += weight * n.y * n.z;
+	q.m[6] += weight * n.y * d;
+	q.m[7] += weight * n.z * n.z;
+	q.m[8] += weight * n.z * d;
+	q.m[9] += weight * d * d;
+}
+
+static Quadric addQuadrics(const Quadric& a, const Quadric& b)
+{
+	Quadric q;
+	for (int i = 0; i < 10; ++i)
+		q.m[i] = a.m[i] + b.m[i];
+	return q;
+}
+
+// sum of squared distances from p to the quadric's planes
+static double evaluateQuadric(const Quadric& q, const glm::dvec3& p)
+{
+	double error = q.m[0] * p.x * p.x + 2.0 * q.m[1] * p.x * p.y + 2.0 * q.m[2] * p.x * p.z + 2.0 * q.m[3] * p.x
+				 + q.m[4] * p.y * p.y + 2.0 * q.m[5] * p.y * p.z + 2.0 * q.m[6] * p.y
+				 + q.m[7] * p.z * p.z + 2.0 * q.m[8] * p.z
+				 + q.m[9];
+	return std::max(error, 0.0);
+}
+
+// the position that minimises the quadric, false if the planes don't pin
+// one down (a flat or creased neighbourhood)
+static bool optimalPosition(const Quadric& q, glm::dvec3& p)
+{
+	double a00 = q.m[0], a01 = q.m[1], a02 = q.m[2];
+	double a11 = q.m[4], a12 = q.m[5], a22 = q.m[7];
+
+	// cofactors of the symmetric 3x3 part
+	double c00 = a11 * a22 - a12 * a12;
+	double c01 = a02 * a12 - a01 * a22;
+	double c02 = a01 * a12 - a02 * a11;
+	double c11 = a00 * a22 - a02 * a02;
+	double c12 = a01 * a02 - a00 * a12;
+	double c22 = a00 * a11 - a01 * a01;
+
+	double det = a00 * c00 + a01 * c01 + a02 * c02;
+	double trace = a00 + a11 + a22;
+	if (fabs(det) <= 1e-6 * trace * trace * trace)
+		return false;
+
+	double b0 = -q.m[3], b1 = -q.m[6], b2 = -q.m[8];
+	p.x = (c00 * b0 + c01 * b1 + c02 * b2) / det;
+	p.y = (c01 * b0 + c11 * b1 + c12 * b2) / det;
+	p.z = (c02 * b0 + c12 * b1 + c22 * b2) / det;
+	return true;
+}
+
+static void computeCollapse(const CellMesh& cell, unsigned int from, unsigned int to, Collapse& collapse)
+{
+	Quadric q = addQuadrics(cell.quadrics[from], cell.quadrics[to]);
+	glm::dvec3 a(cell.positions[from]), b(cell.positions[to]);
+	glm::dvec3 middle = (a + b) * 0.5;
+
+	// only trust the optimum while it stays near the edge
+	glm::dvec3 position;
+	double cost;
+	if (optimalPosition(q, position) && glm::length(position - middle) <= glm::length(b - a))
+	{
+		cost = evaluateQuadric(q, position);
+	}
+	else
+	{
+		position = middle;
+		cost = evaluateQuadric(q, middle);
+
+		double costA = evaluateQuadric(q, a), costB = evaluateQuadric(q, b);
+		if (costA < cost)
+		{
+			position = a;
+			cost = costA;
+		}
+		if (costB < cost)
+		{
+			position = b;
+			cost = costB;
+		}
+	}
+
+	collapse.cost = cost;
+	collapse.from = from;
+	collapse.to = to;
+	collapse.fromVersion = cell.versions[from];
+	collapse.toVersion = cell.versions[to];
+	collapse.position = glm::vec3(position);
+}
+
+static void gatherNeighbours(const CellMesh& cell, unsigned int v, std::vector<unsigned int>& neighbours)
+{
+	neighbours.clear();
+	for (unsigned int t : cell.vertexTriangles[v])
+	{
+		if (cell.triangleRemoved[t])
+			continue;
+
+		for (int k = 0; k < 3; ++k)
+			if (cell.triangles[t * 3 + k] != v)
+				neighbours.push_back(cell.triangles[t * 3 + k]);
+	}
+
+	std::sort(neighbours.begin(), neighbours.end());
+	neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
+
+static bool triangleHas(const CellMesh& cell, unsigned int t, unsigned int v)
+{
+	const unsigned int* tri = &cell.triangles[t * 3];
+	return tri[0] == v || tri[1] == v || tri[2] == v;
+}
+
+// rejects collapses that would make the surface non-manifold or fold a
+// triangle over
+static bool collapseIsValid(const CellMesh& cell, const Collapse& collapse,
+							std::vector<unsigned int>& fromNeighbours, std::vector<unsigned int>& toNeighbours)
+{
+	// link condition: the vertices the two ends share must be exactly the
+	// apexes of the triangles on the edge
+	size_t edgeTriangles = 0;
+	for (unsigned int t : cell.vertexTriangles[collapse.from])
+		if (!cell.triangleRemoved[t] && triangleHas(cell, t, collapse.to))
+			++edgeTriangles;
+
+	if (edgeTriangles == 0)
+		return false;
+
+	gatherNeighbours(cell, collapse.from, fromNeighbours);
+	gatherNeighbours(cell, collapse.to, toNeighbours);
+
+	size_t shared = 0;
+	for (size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();)
+	{
+		if (fromNeighbours[i] < toNeighbours[j])
+			++i;
+		else if (toNeighbours[j] < fromNeighbours[i])
+			++j;
+		else
+		{
+			++shared;
+			++i;
+			++j;
+		}
+	}
+
+	if (shared != edgeTriangles)
+		return false;
+
+	// the triangles that survive mustn't flip
+	for (int end = 0; end < 2; ++end)
+	{
+		unsigned int v = end == 0 ? collapse.from : collapse.to;
+		for (unsigned int t : cell.vertexTriangles[v])
+		{
+			if (cell.triangleRemoved[t] || (triangleHas(cell, t, collapse.from) && triangleHas(cell, t, collapse.to)))
+				continue;
+
+			glm::vec3 before[3], after[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				unsigned int corner = cell.triangles[t * 3 + k];
+				before[k] = cell.positions[corner];
+				after[k] = corner == v ? collapse.position : before[k];
+			}
+
+			glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(normalBefore, normalAfter) < 0.0f)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void performCollapse(CellMesh& cell, const Collapse& collapse)
+{
+	unsigned int from = collapse.from, to = collapse.to;
+
+	cell.positions[to] = collapse.position;
+	cell.quadrics[to] = addQuadrics(cell.quadrics[to], cell.quadrics[from]);
+	cell.removed[from] = 1;
+	++cell.versions[from];
+	++cell.versions[to];
+
+	for (unsigned int t : cell.vertexTriangles[from])
+	{
+		if (cell.triangleRemoved[t])
+			continue;
+
+		if (triangleHas(cell, t, to))
+		{
+			cell.triangleRemoved[t] = 1;
+			--cell.liveTriangles;
+			continue;
+		}
+
+		for (int k = 0; k < 3; ++k)
+			if (cell.triangles[t * 3 + k] == from)
+				cell.triangles[t * 3 + k] = to;
+		cell.vertexTriangles[to].push_back(t);
+	}
+
+	cell.vertexTriangles[from].clear();
+}
+
+// collapses edges of one cell's triangles until targetTriangles are left or
+// the cheapest collapse costs more than maxErrorSq. writes the triangles
+// that are left to output and returns the number of collapses
+static size_t simplifyCell(std::vector<glm::vec3>& positions, std::vector<Quadric>& quadrics,
+						   const std::vector<unsigned char>& locked, const std::vector<unsigned int>& indices,
+						   const unsigned int* cellTriangles, size_t triangleCount,
+						   size_t targetTriangles, double maxErrorSq, std::vector<unsigned int>& output)
+{
+	CellMesh cell;
+	std::unordered_map<unsigned int, unsigned int> localVertex;
+	localVertex.reserve(triangleCount);
+
+	cell.triangles.resize(triangleCount * 3);
+	cell.triangleRemoved.assign(triangleCount, 0);
+	cell.liveTriangles = triangleCount;
+
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int global = indices[cellTriangles[t] * 3 + k];
+			auto found = localVertex.insert(std::make_pair(global, (unsigned int)cell.globalVertex.size()));
+			if (found.second)
+			{
+				cell.globalVertex.push_back(global);
+				cell.positions.push_back(positions[global]);
+				cell.quadrics.push_back(quadrics[global]);
+			}
+
+			cell.triangles[t * 3 + k] = found.first->second;
+		}
+	}
+
+	size_t vertexCount = cell.globalVertex.size();
+	cell.removed.assign(vertexCount, 0);
+	cell.versions.assign(vertexCount, 0);
+	cell.vertexTriangles.resize(vertexCount);
+	for (size_t t = 0; t < triangleCount; ++t)
+		for (int k = 0; k < 3; ++k)
+			cell.vertexTriangles[cell.triangles[t * 3 + k]].push_back((unsigned int)t);
+
+	// every edge between two unlocked vertices. edges shared by two
+	// triangles go in twice, and the second copy is stale once either
+	// collapses
+	std::priority_queue<Collapse> heap;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int a = cell.triangles[t * 3 + k], b = cell.triangles[t * 3 + (k + 1) % 3];
+			if (locked[cell.globalVertex[a]] || locked[cell.globalVertex[b]])
+				continue;
+
+			Collapse collapse;
+			computeCollapse(cell, a, b, collapse);
+			heap.push(collapse);
+		}
+	}
+
+	size_t collapses = 0;
+	std::vector<unsigned int> fromNeighbours, toNeighbours;
+	while (!heap.empty() && cell.liveTriangles > targetTriangles)
+	{
+		Collapse collapse = heap.top();
+		heap.pop();
+
+		if (collapse.cost > maxErrorSq)
+			break;
+
+		if (cell.removed[collapse.from] || cell.removed[collapse.to] ||
+			cell.versions[collapse.from] != collapse.fromVersion || cell.versions[collapse.to] != collapse.toVersion)
+			continue;
+
+		if (!collapseIsValid(cell, collapse, fromNeighbours, toNeighbours))
+			continue;
+
+		performCollapse(cell, collapse);
+		++collapses;
+
+		// the edges around the kept vertex have new costs
+		gatherNeighbours(cell, collapse.to, toNeighbours);
+		for (unsigned int neighbour : toNeighbours)
+		{
+			if (locked[cell.globalVertex[neighbour]])
+				continue;
+
+			Collapse next;
+			computeCollapse(cell, neighbour, collapse.to, next);
+			heap.push(next);
+		}
+	}
+
+	// unlocked vertices are only ever in this cell, so they can be written
+	// straight back
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		unsigned int global = cell.globalVertex[v];
+		if (!locked[global] && !cell.removed[v])
+		{
+			positions[global] = cell.positions[v];
+			quadrics[global] = cell.quadrics[v];
+		}
+	}
+
+	output.clear();
+	output.reserve(cell.liveTriangles * 3);
+	for (size_t t = 0; t < triangleCount; ++t)
+		if (!cell.triangleRemoved[t])
+			for (int k = 0; k < 3; ++k)
+				output.push_back(cell.globalVertex[cell.triangles[t * 3 + k]]);
+
+	return collapses;
+}
+
+// one pass over a grid of cells, offset by shift cells. returns the number
+// of collapses
+static size_t simplifyPass(ThreadPool& pool, std::vector<glm::vec3>& positions, std::vector<Quadric>& quadrics,
+						   std::vector<unsigned int>& indices, int cellsPerAxis, float shift,
+						   size_t targetTriangles, double maxErrorSq)
+{
+	size_t vertexCount = positions.size();
+	size_t triangleCount = indices.size() / 3;
+
+	glm::vec3 lower(FLT_MAX), upper(-FLT_MAX);
+	for (const glm::vec3& p : positions)
+	{
+		lower = glm::min(lower, p);
+		upper = glm::max(upper, p);
+	}
+
+	// a shifted grid needs an extra cell along each axis to cover the bounds
+	int dim = cellsPerAxis + (shift > 0.0f ? 1 : 0);
+	glm::vec3 cellScale = float(cellsPerAxis) / glm::max(upper - lower, glm::vec3(FLT_MIN));
+
+	std::vector<unsigned int> vertexCell(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		glm::ivec3 c = glm::ivec3((positions[v] - lower) * cellScale + shift);
+		c = glm::clamp(c, glm::ivec3(0), glm::ivec3(dim - 1));
+		vertexCell[v] = (c.z * dim + c.y) * dim + c.x;
+	}
+
+	// triangles with all three vertices in one cell belong to it, the rest
+	// are left alone this pass along with all of their vertices
+	size_t cellCount = size_t(dim) * dim * dim;
+	std::vector<size_t> cellStart(cellCount + 1, 0);
+	std::vector<unsigned char> locked(vertexCount, 0);
+	std::vector<unsigned char> border(triangleCount, 0);
+	size_t borderTriangles = 0;
+
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const unsigned int* tri = &indices[t * 3];
+		unsigned int cell = vertexCell[tri[0]];
+		if (vertexCell[tri[1]] == cell && vertexCell[tri[2]] == cell)
+		{
+			++cellStart[cell + 1];
+		}
+		else
+		{
+			border[t] = 1;
+			locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = 1;
+			++borderTriangles;
+		}
+	}
+
+	for (size_t c = 0; c < cellCount; ++c)
+		cellStart[c + 1] += cellStart[c];
+
+	std::vector<unsigned int> cellTriangles(triangleCount - borderTriangles);
+	std::vector<size_t> cellFill(cellStart.begin(), cellStart.end() - 1);
+	for (size_t t = 0; t < triangleCount; ++t)
+		if (!border[t])
+			cellTriangles[cellFill[vertexCell[indices[t * 3]]]++] = (unsigned int)t;
+
+	// the border can't shrink this pass, so the cells share out everything
+	// that has to go in proportion to their size
+	size_t innerTriangles = triangleCount - borderTriangles;
+	size_t toRemove = targetTriangles && triangleCount > targetTriangles ? triangleCount - targetTriangles : 0;
+
+	std::vector<std::vector<unsigned int>> cellOutput(cellCount);
+	std::vector<size_t> cellCollapses(cellCount, 0);
+
+	runJobs(pool, cellCount, [&](size_t c)
+	{
+		size_t count = cellStart[c + 1] - cellStart[c];
+		if (count == 0)
+			return;
+
+		size_t cellTarget = 0;
+		if (targetTriangles)
+			cellTarget = count - std::min(count, (toRemove * count + innerTriangles - 1) / innerTriangles);
+
+		if (cellTarget == count)
+		{
+			cellOutput[c].resize(count * 3);
+			for (size_t t = 0; t < count; ++t)
+				for (int k = 0; k < 3; ++k)
+					cellOutput[c][t * 3 + k] = indices[cellTriangles[cellStart[c] + t] * 3 + k];
+			return;
+		}
+
+		cellCollapses[c] = simplifyCell(positions, quadrics, locked, indices, &cellTriangles[cellStart[c]], count,
+										cellTarget, maxErrorSq, cellOutput[c]);
+	});
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (size_t t = 0; t < triangleCount; ++t)
+		if (border[t])
+			output.insert(output.end(), &indices[t * 3], &indices[t * 3] + 3);
+
+	size_t collapses = 0;
+	for (size_t c = 0; c < cellCount; ++c)
+	{
+		output.insert(output.end(), cellOutput[c].begin(), cellOutput[c].end());
+		collapses += cellCollapses[c];
+	}
+
+	indices.swap(output);
+	return collapses;
+}
+
+static void computeQuadrics(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+							std::vector<Quadric>& quadrics)
+{
+	Quadric zero = {};
+	quadrics.assign(positions.size(), zero);
+
+	size_t triangleCount = indices.size() / 3;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const unsigned int* tri = &indices[t * 3];
+		glm::dvec3 p0(positions[tri[0]]), p1(positions[tri[1]]), p2(positions[tri[2]]);
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(normal);
+		if (length == 0.0)
+			continue;
+
+		// unweighted, so the error stays a squared distance
+		normal /= length;
+		double d = -glm::dot(normal, p0);
+		for (int k = 0; k < 3; ++k)
+			addPlane(quadrics[tri[k]], normal, d, 1.0);
+	}
+
+	// open edges are the ones only a single triangle uses
+	std::vector<std::pair<unsigned long long, unsigned int>> edges;
+	edges.reserve(indices.size());
+	for (size_t corner = 0; corner < indices.size(); ++corner)
+	{
+		unsigned long long a = indices[corner], b = indices[corner - corner % 3 + (corner + 1) % 3];
+		edges.push_back(std::make_pair(std::min(a, b) << 32 | std::max(a, b), (unsigned int)corner));
+	}
+	std::sort(edges.begin(), edges.end());
+
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j].first == edges[i].first)
+			++j;
+
+		if (j == i + 1)
+		{
+			size_t corner = edges[i].second, first = corner - corner % 3;
+			unsigned int a = indices[corner], b = indices[first + (corner + 1) % 3], c = indices[first + (corner + 2) % 3];
+			glm::dvec3 pa(positions[a]), pb(positions[b]), pc(positions[c]);
+			glm::dvec3 normal = glm::cross(pb - pa, pc - pa);
+			glm::dvec3 side = glm::cross(pb - pa, normal);
+			double length = glm::length(side);
+			if (length > 0.0)
+			{
+				side /= length;
+				double d = -glm::dot(side, pa);
+				addPlane(quadrics[a], side, d, BOUNDARY_WEIGHT);
+				addPlane(quadrics[b], side, d, BOUNDARY_WEIGHT);
+			}
+		}
+
+		i = j;
+	}
+}
+
+size_t simplifyMesh(ThreadPool& pool, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices,
+					const SimplifySettings& settings)
+{
+	// triangles that use a vertex twice have no edges worth keeping
+	size_t kept = 0;
+	for (size_t t = 0; t < indices.size() / 3; ++t)
+	{
+		unsigned int a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+		if (a == b || b == c || c == a)
+			continue;
+
+		indices[kept++] = a;
+		indices[kept++] = b;
+		indices[kept++] = c;
+	}
+	indices.resize(kept);
+
+	std::vector<Quadric> quadrics;
+	computeQuadrics(positions, indices, quadrics);
+
+	int passes = settings.maxPasses > 0 ? settings.maxPasses : DEFAULT_PASSES;
+	int cellsPerAxis = settings.cellsPerAxis;
+	if (cellsPerAxis <= 0)
+		cellsPerAxis = std::max(1, (int)ceil(cbrt(4.0 * (pool.threads.size() + 1))));
+
+	double maxErrorSq = settings.maxError > 0.0f ? double(settings.maxError) * settings.maxError : DBL_MAX;
+
+	// quarter-cell steps, so each pass's borders are inside the next pass's cells
+	static const float SHIFTS[4] = { 0.0f, 0.5f, 0.25f, 0.75f };
+
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		if (settings.targetTriangles && indices.size() / 3 <= settings.targetTriangles)
+			break;
+
+		bool last = pass == passes - 1;
+		simplifyPass(pool, positions, quadrics, indices, last ? 1 : cellsPerAxis, last ? 0.0f : SHIFTS[pass % 4],
+					 settings.targetTriangles, maxErrorSq);
+	}
+
+	// drop the vertices that were collapsed away
+	std::vector<unsigned int> remap(positions.size(), ~0u);
+	std::vector<glm::vec3> used;
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = (unsigned int)used.size();
+			used.push_back(positions[index]);
+		}
+		index = remap[index];
+	}
+	positions.swap(used);
+
+	return indices.size() / 3;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "threadpool.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// quadric error metric edge collapse (garland & heckbert) over an indexed
+// triangle mesh.
+//
+// each pass splits the mesh's bounds into a grid of cells that are
+// simplified in parallel. a triangle belongs to a cell when all three of its
+// vertices are in it, and vertices of triangles that straddle cells are
+// locked for the pass, so no two cells ever touch the same triangle or move
+// the same vertex. the grid is offset between passes so the previous borders
+// end up inside cells, and if the target still isn't reached the last pass
+// runs over the whole mesh as a single cell.
+struct SimplifySettings
+{
+	size_t		targetTriangles;	// stop once there are this many triangles, 0 to only use maxError
+	float		maxError;			// largest distance from the original surface a collapse may introduce, 0 for no bound
+	int			cellsPerAxis;		// cells along each axis per pass, 0 picks from the thread count
+	int			maxPasses;			// 0 uses a default
+};
+
+// simplifies positions / indices in place, dropping vertices that are no
+// longer used. returns the number of triangles left
+size_t simplifyMesh(ThreadPool& pool, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices,
+					const SimplifySettings& settings);
@@ -0,0 +1,324 @@
+#include "sparse.h"
+#include <vector>
+
+// must match SPARSE_EMPTY in the kernel
+const cl_uint SPARSE_EMPTY = 0xffffffff;
+
+// passes of growth per frame, which bounds how far the surface can move
+// between frames before part of it is lost until the next. they all run, as
+// the host doesn't wait to find out whether there's anything left to grow
+const int SPARSE_GROW_PASSES = 16;
+
+// points the kernels at the pool's buffers, which change when it grows
+static cl_int setPoolArgs(SparseData& data)
+{
+	cl_int result = CL_SUCCESS;
+	cl_uint tableMask = data.tableSize - 1;
+
+	result |= clSetKernelArg(data.rebuildKernel, 0, sizeof(cl_mem), &data.tableKeysLink);
+	result |= clSetKernelArg(data.rebuildKernel, 1, sizeof(cl_uint), &tableMask);
+	result |= clSetKernelArg(data.rebuildKernel, 2, sizeof(cl_mem), &data.blockKeysLink);
+	result |= clSetKernelArg(data.rebuildKernel, 3, sizeof(cl_mem), &data.blockStatesLink);
+
+	// seeding and growing allocate through the same arguments
+	cl_kernel allocateKernels[2] = { data.seedKernel, data.growKernel };
+	for (int i = 0; i < 2; ++i)
+	{
+		result |= clSetKernelArg(allocateKernels[i], 3, sizeof(cl_mem), &data.tableKeysLink);
+		result |= clSetKernelArg(allocateKernels[i], 4, sizeof(cl_uint), &tableMask);
+		result |= clSetKernelArg(allocateKernels[i], 5, sizeof(cl_mem), &data.blockKeysLink);
+		result |= clSetKernelArg(allocateKernels[i], 6, sizeof(cl_mem), &data.blockStatesLink);
+		result |= clSetKernelArg(allocateKernels[i], 7, sizeof(cl_mem), &data.freeListLink);
+		result |= clSetKernelArg(allocateKernels[i], 8, sizeof(cl_mem), &data.counterLink);
+	}
+	result |= clSetKernelArg(data.growKernel, 1, sizeof(cl_mem), &data.listLink);
+	result |= clSetKernelArg(data.growKernel, 2, sizeof(cl_mem), &data.sampleLink);
+
+	result |= clSetKernelArg(data.listKernel, 0, sizeof(cl_mem), &data.blockStatesLink);
+	result |= clSetKernelArg(data.listKernel, 1, sizeof(cl_mem), &data.listLink);
+	result |= clSetKernelArg(data.listKernel, 2, sizeof(cl_mem), &data.counterLink);
+
+	result |= clSetKernelArg(data.sampleKernel, 0, sizeof(cl_mem), &data.listLink);
+	result |= clSetKernelArg(data.sampleKernel, 1, sizeof(cl_mem), &data.blockKeysLink);
+	result |= clSetKernelArg(data.sampleKernel, 2, sizeof(cl_mem), &data.sampleLink);
+	result |= clSetKernelArg(data.sampleKernel, 3, sizeof(cl_mem), &data.counterLink);
+
+	result |= clSetKernelArg(data.freeKernel, 1, sizeof(cl_mem), &data.freeListLink);
+	result |= clSetKernelArg(data.freeKernel, 2, sizeof(cl_mem), &data.counterLink);
+
+	result |= clSetKernelArg(data.collectKernel, 1, sizeof(cl_mem), &data.sampleLink);
+	result |= clSetKernelArg(data.collectKernel, 2, sizeof(cl_mem), &data.blockKeysLink);
+	result |= clSetKernelArg(data.collectKernel, 3, sizeof(cl_mem), &data.blockStatesLink);
+	result |= clSetKernelArg(data.collectKernel, 4, sizeof(cl_mem), &data.freeListLink);
+	result |= clSetKernelArg(data.collectKernel, 5, sizeof(cl_mem), &data.counterLink);
+	result |= clSetKernelArg(data.collectKernel, 6, sizeof(cl_mem), &data.listLink);
+
+	result |= clSetKernelArg(data.extractKernel, 4, sizeof(cl_mem), &data.listLink);
+	result |= clSetKernelArg(data.extractKernel, 5, sizeof(cl_mem), &data.blockKeysLink);
+	result |= clSetKernelArg(data.extractKernel, 6, sizeof(cl_mem), &data.sampleLink);
+	result |= clSetKernelArg(data.extractKernel, 7, sizeof(cl_mem), &data.counterLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result;
+}
+
+// allocates the pool and table for blockCapacity blocks, with every block
+// free and stacked on the free list in order. on failure the buffers that
+// were allocated are released
+static bool allocatePool(SparseData& data)
+{
+	cl_int result = CL_SUCCESS;
+
+	data.tableSize = 1;
+	while (data.tableSize < data.blockCapacity * 2)
+		data.tableSize *= 2;
+
+	std::vector<cl_uint> blockKeys(data.blockCapacity, SPARSE_EMPTY);
+	std::vector<cl_uint> blockStates(data.blockCapacity, 0);
+	std::vector<cl_int> freeList(data.blockCapacity);
+	for (cl_uint block = 0; block < data.blockCapacity; ++block)
+		freeList[block] = (cl_int)block;
+
+	data.tableKeysLink = clCreateBuffer(data.context, CL_MEM_READ_WRITE, sizeof(cl_uint) * data.tableSize, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.blockKeysLink = clCreateBuffer(data.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * data.blockCapacity, blockKeys.data(), &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.blockStatesLink = clCreateBuffer(data.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * data.blockCapacity, blockStates.data(), &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.sampleLink = clCreateBuffer(data.context, CL_MEM_READ_WRITE, sizeof(cl_float) * data.blockSamples * data.blockCapacity, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.freeListLink = clCreateBuffer(data.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_int) * data.blockCapacity, freeList.data(), &result);
+	CL_CHECK(clCreateBuffer, result);
+	data.listLink = clCreateBuffer(data.context, CL_MEM_READ_WRITE, sizeof(cl_int) * data.blockCapacity, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+
+	// a failed allocation returns 0, so release the rest if any failed
+	cl_mem links[6] = { data.tableKeysLink, data.blockKeysLink, data.blockStatesLink,
+						data.sampleLink, data.freeListLink, data.listLink };
+	bool allocated = true;
+	for (cl_mem link : links)
+		allocated = allocated && link != 0;
+	if (!allocated)
+	{
+		for (cl_mem link : links)
+			if (link != 0)
+				clReleaseMemObject(link);
+		return false;
+	}
+
+	return true;
+}
+
+static void releasePool(SparseData& data)
+{
+	clReleaseMemObject(data.listLink);
+	clReleaseMemObject(data.freeListLink);
+	clReleaseMemObject(data.sampleLink);
+	clReleaseMemObject(data.blockStatesLink);
+	clReleaseMemObject(data.blockKeysLink);
+	clReleaseMemObject(data.tableKeysLink);
+}
+
+// doubles the pool, keeping the live blocks and the free list where they are
+// and stacking the new blocks on it. the table is rebuilt at its new size
+// each frame. if the device can't hold the bigger pool the old one is kept
+static void growPool(SparseData& data, cl_command_queue queue)
+{
+	cl_int result = CL_SUCCESS;
+
+	SparseData old = data;
+	data.blockCapacity *= 2;
+	if (!allocatePool(data))
+	{
+		data = old;
+		data.poolFull = false;
+		data.poolGrowable = false;
+		printf("Unable to grow the sparse block pool past %u blocks\n", data.blockCapacity);
+		return;
+	}
+
+	result = setPoolArgs(data);
+
+	// opencl keeps the old buffers until the queue is done copying from them.
+	// the free list is copied whole, as only the device knows how much of it is in use
+	result |= clEnqueueCopyBuffer(queue, old.blockKeysLink, data.blockKeysLink, 0, 0, sizeof(cl_uint) * old.blockCapacity, 0, nullptr, nullptr);
+	result |= clEnqueueCopyBuffer(queue, old.blockStatesLink, data.blockStatesLink, 0, 0, sizeof(cl_uint) * old.blockCapacity, 0, nullptr, nullptr);
+	result |= clEnqueueCopyBuffer(queue, old.sampleLink, data.sampleLink, 0, 0, sizeof(cl_float) * old.blockSamples * old.blockCapacity, 0, nullptr, nullptr);
+	result |= clEnqueueCopyBuffer(queue, old.freeListLink, data.freeListLink, 0, 0, sizeof(cl_int) * old.blockCapacity, 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueCopyBuffer, result);
+	releasePool(old);
+
+	// the new blocks go on top of the free ones
+	cl_int firstBlock = (cl_int)old.blockCapacity;
+	size_t newBlocks = data.blockCapacity - old.blockCapacity;
+	result = clSetKernelArg(data.freeKernel, 0, sizeof(cl_int), &firstBlock);
+	CL_CHECK(clSetKernelArg, result);
+	result = clEnqueueNDRangeKernel(queue, data.freeKernel, 1, 0, &newBlocks, 0, 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+
+	data.poolFull = false;
+}
+
+bool createSparse(SparseData& data, cl_context context, cl_program program, size_t brickSize,
+				  cl_uint blockCapacity, cl_float threshold)
+{
+	cl_int result = CL_SUCCESS;
+
+	data.context = context;
+	data.brickSize = brickSize;
+	data.blockSamples = (brickSize + 1) * (brickSize + 1) * (brickSize + 1);
+	data.blockCapacity = blockCapacity;
+	data.threshold = threshold;
+	data.pendingCapacity = blockCapacity;
+	data.counterEvent = 0;
+	data.liveBlocks = 0;
+	data.activeBlocks = 0;
+	data.poolFull = false;
+	data.poolGrowable = true;
+	data.extractedBlocks = 0;
+
+	data.freeKernel = clCreateKernel(program, "freeSparseBlocks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.rebuildKernel = clCreateKernel(program, "rebuildSparseHash", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.seedKernel = clCreateKernel(program, "seedSparseBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.listKernel = clCreateKernel(program, "listSparseBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.sampleKernel = clCreateKernel(program, "sampleSparseBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.growKernel = clCreateKernel(program, "growSparseBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.collectKernel = clCreateKernel(program, "collectSparseBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.extractKernel = clCreateKernel(program, "marchingCubesSparse", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	// every block starts on the free list
+	cl_int counters[4] = { (cl_int)blockCapacity, 0, 0, 0 };
+	data.counterLink = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_int) * 4, counters, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	if (!allocatePool(data) || setPoolArgs(data) != CL_SUCCESS)
+		return false;
+
+	result = clSetKernelArg(data.seedKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.growKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.collectKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(data.extractKernel, 3, sizeof(cl_float), &threshold);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseSparse(SparseData& data)
+{
+	if (data.counterEvent != 0)
+	{
+		clWaitForEvents(1, &data.counterEvent);
+		clReleaseEvent(data.counterEvent);
+	}
+	releasePool(data);
+	clReleaseMemObject(data.counterLink);
+	clReleaseKernel(data.extractKernel);
+	clReleaseKernel(data.collectKernel);
+	clReleaseKernel(data.growKernel);
+	clReleaseKernel(data.sampleKernel);
+	clReleaseKernel(data.listKernel);
+	clReleaseKernel(data.seedKernel);
+	clReleaseKernel(data.rebuildKernel);
+	clReleaseKernel(data.freeKernel);
+}
+
+// enqueues a 1d launch of kernel after last, which it replaces with the launch's event
+static void enqueueAfter(cl_command_queue queue, cl_kernel kernel, size_t globalWorkSize, cl_event& last)
+{
+	cl_event next = 0;
+	cl_int result = clEnqueueNDRangeKernel(queue, kernel, 1, 0, &globalWorkSize, 0, 1, &last, &next);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+	clReleaseEvent(last);
+	last = next;
+}
+
+// zeroes count counters from first after last, which it replaces with the fill's event
+static void resetCounters(cl_command_queue queue, cl_mem counterLink, int first, int count, cl_event& last)
+{
+	cl_event next = 0;
+	cl_int zero = 0;
+	cl_int result = clEnqueueFillBuffer(queue, counterLink, &zero, sizeof(cl_int), sizeof(cl_int) * first, sizeof(cl_int) * count, 1, &last, &next);
+	CL_CHECK(clEnqueueFillBuffer, result);
+	clReleaseEvent(last);
+	last = next;
+}
+
+void enqueueExtractSparse(SparseData& data, cl_command_queue queue, cl_uint seedCount,
+						  cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+
+	// pick up the counts of an earlier frame if their readback has landed
+	if (data.counterEvent != 0)
+	{
+		cl_int status = CL_QUEUED;
+		clGetEventInfo(data.counterEvent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, nullptr);
+		if (status == CL_COMPLETE)
+		{
+			data.liveBlocks = data.pendingCapacity - (cl_uint)data.pendingCounters[SPARSE_FREE_COUNT];
+			data.activeBlocks = (cl_uint)data.pendingCounters[SPARSE_ACTIVE_COUNT];
+
+			// a pool that has grown since the counts were read may have room
+			data.poolFull = data.pendingCounters[SPARSE_FAILED_COUNT] > 0 && data.pendingCapacity == data.blockCapacity;
+			clReleaseEvent(data.counterEvent);
+			data.counterEvent = 0;
+		}
+	}
+
+	// an earlier frame ran out of blocks, the bricks it missed are found again in this one
+	if (data.poolFull && data.poolGrowable)
+		growPool(data, queue);
+
+	result = clSetKernelArg(data.seedKernel, 1, sizeof(cl_int), &seedCount);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the table is rebuilt from the live blocks each frame, so the blocks
+	// collected last frame leave no deleted slots behind to probe past
+	cl_event last = 0;
+	cl_uint empty = SPARSE_EMPTY;
+	result = clEnqueueFillBuffer(queue, data.tableKeysLink, &empty, sizeof(cl_uint), 0, sizeof(cl_uint) * data.tableSize, numWaitEvents, waitEvents, &last);
+	CL_CHECK(clEnqueueFillBuffer, result);
+	enqueueAfter(queue, data.rebuildKernel, data.blockCapacity, last);
+	resetCounters(queue, data.counterLink, SPARSE_LIST_COUNT, 3, last);
+	enqueueAfter(queue, data.seedKernel, seedCount > 0 ? seedCount : 1, last);
+
+	// sample the blocks allocated so far, then allocate the bricks across
+	// their crossed faces. the listed count stays on the device, so sampling
+	// and growing cover every block the list could hold
+	for (int pass = 0; pass < SPARSE_GROW_PASSES; ++pass)
+	{
+		resetCounters(queue, data.counterLink, SPARSE_LIST_COUNT, 1, last);
+		enqueueAfter(queue, data.listKernel, data.blockCapacity, last);
+		enqueueAfter(queue, data.sampleKernel, data.blockCapacity * data.blockSamples, last);
+		enqueueAfter(queue, data.growKernel, data.blockCapacity * 6, last);
+	}
+
+	// free the blocks the surface has left and list the active ones
+	enqueueAfter(queue, data.collectKernel, data.blockCapacity, last);
+
+	// the counts only report the pool and grow it, so don't wait for them
+	if (data.counterEvent == 0)
+	{
+		result = clEnqueueReadBuffer(queue, data.counterLink, CL_FALSE, 0, sizeof(data.pendingCounters), data.pendingCounters, 1, &last, &data.counterEvent);
+		CL_CHECK(clEnqueueReadBuffer, result);
+		data.pendingCapacity = data.blockCapacity;
+	}
+
+	// every cube of every block, the kernel skips the blocks past the active count
+	size_t globalWorkSize = data.blockCapacity * data.brickSize * data.brickSize * data.brickSize;
+	result = clEnqueueNDRangeKernel(queue, data.extractKernel, 1, 0, &globalWorkSize, 0, 1, &last, event);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+	clReleaseEvent(last);
+
+	data.extractedBlocks += data.activeBlocks;
+}
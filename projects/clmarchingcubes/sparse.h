@@ -0,0 +1,76 @@
+#pragma once
+
+#include "clcommon.h"
+
+// must match the a_counters indices in the kernel
+const int SPARSE_FREE_COUNT = 0;
+const int SPARSE_LIST_COUNT = 1;
+const int SPARSE_ACTIVE_COUNT = 2;
+const int SPARSE_FAILED_COUNT = 3;
+
+// sparse voxel hashing, where the field is only sampled in the bricks the
+// surface passes through rather than over a fixed grid, so the surface can
+// wander anywhere within +-512 bricks of the origin. each live brick has a
+// block of (brickSize + 1)^3 samples in a pool, found through a hash table
+// of brick coordinates that the device allocates into without locks.
+//
+// the bricks are found by walking from seeds, the particles, to their
+// surfaces and growing across every face the surface crosses, and the blocks
+// of bricks the surface has left are collected each frame, so the memory in
+// use follows the area of the surface. the pool doubles when it runs out.
+// the counts are read back without waiting, so the kernels are launched over
+// the whole pool and a full pool is only noticed once its counts have landed.
+struct SparseData
+{
+	cl_kernel	freeKernel;
+	cl_kernel	rebuildKernel;
+	cl_kernel	seedKernel;
+	cl_kernel	listKernel;
+	cl_kernel	sampleKernel;
+	cl_kernel	growKernel;
+	cl_kernel	collectKernel;
+	cl_kernel	extractKernel;
+	cl_context	context;
+
+	size_t		brickSize;
+	size_t		blockSamples;		// (brickSize + 1)^3
+	cl_uint		blockCapacity;
+	cl_uint		tableSize;			// a power of two, at least twice the blocks
+	cl_float	threshold;
+
+	cl_mem		tableKeysLink;		// packed brick coordinates, or empty
+	cl_mem		blockKeysLink;		// brick of each block, or empty when free
+	cl_mem		blockStatesLink;	// free, waiting to be sampled or sampled
+	cl_mem		sampleLink;			// the field at every sample of every block
+	cl_mem		freeListLink;		// stack of free blocks
+	cl_mem		listLink;			// blocks to sample, then blocks to polygonise
+	cl_mem		counterLink;		// free, listed, active and failed allocation counts
+
+	// the counters read back without waiting, and the capacity of the pool
+	// they were counted in
+	cl_int		pendingCounters[4];
+	cl_uint		pendingCapacity;
+	cl_event	counterEvent;
+
+	// blocks in use and polygonised as of the last counts to land
+	cl_uint		liveBlocks;
+	cl_uint		activeBlocks;
+	bool		poolFull;
+	bool		poolGrowable;		// cleared when the device can't hold a bigger pool
+
+	// blocks polygonised since the last report
+	size_t		extractedBlocks;
+};
+
+// the seeds, argument 2 of seedKernel, the field arguments of seedKernel from
+// index 9, sampleKernel from 4 and extractKernel from 8, and the output
+// arguments 0 to 2 of extractKernel, are left to the caller
+bool createSparse(SparseData& data, cl_context context, cl_program program, size_t brickSize,
+				  cl_uint blockCapacity, cl_float threshold);
+void releaseSparse(SparseData& data);
+
+// tracks the surface from the seeds, polygonising every brick it crosses
+// into the vertex buffer set on extractKernel. a frame that runs out of
+// blocks misses part of the surface, the pool grows once its counts land
+void enqueueExtractSparse(SparseData& data, cl_command_queue queue, cl_uint seedCount,
+						  cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
@@ -0,0 +1,271 @@
+#include "stream.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+// everything belonging to one of the two slab buffers
+struct Slab
+{
+	cl_mem		volumeLink;
+	cl_mem		vertexLink;
+	cl_mem		faceCountLink;
+	cl_uint		capacity;		// triangles vertexLink can hold
+
+	// the slab's cubes, and the first sample uploaded which may be one below them
+	size_t		cubeStart;
+	size_t		cubeEnd;
+	size_t		sampleStart;
+	size_t		sampleEnd;
+
+	cl_uint		faceCount;
+
+	// the triangles the vertex readback holds, apart from the fields above
+	// that the next use of the buffer overwrites before they are appended
+	cl_uint		readFaceCount;
+	size_t		readSampleStart;
+
+	cl_event	uploadEvent;
+	cl_event	processEvent;
+	cl_event	countEvent;
+	cl_event	readEvent;
+};
+
+static void releaseEvent(cl_event& event)
+{
+	if (event != 0)
+		clReleaseEvent(event);
+	event = 0;
+}
+
+static bool createSlabOutput(cl_context context, Slab& slab, cl_uint capacity)
+{
+	cl_int result = CL_SUCCESS;
+
+	if (slab.vertexLink != nullptr)
+		clReleaseMemObject(slab.vertexLink);
+
+	// 3 vertices of position + normal per triangle
+	slab.capacity = capacity;
+	slab.vertexLink = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, sizeof(cl_float4) * 6 * capacity, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+
+	return result == CL_SUCCESS;
+}
+
+// queues the upload of slab index's samples, waiting for the buffer's previous extraction to stop reading it
+static void enqueueUpload(cl_command_queue transferQueue, const RawVolume& volume, const StreamSettings& settings,
+						  size_t index, Slab& slab)
+{
+	const VolumeHeader& header = volume.header;
+	size_t cubesZ = header.dims[2] - 1;
+	size_t sliceBytes = (size_t)header.dims[0] * header.dims[1] * header.format;
+
+	// a halo sample either side keeps the normals across slab seams the same as
+	// extracting the volume whole
+	slab.cubeStart = index * settings.slabDepth;
+	slab.cubeEnd = std::min(slab.cubeStart + settings.slabDepth, cubesZ);
+	slab.sampleStart = slab.cubeStart > 0 ? slab.cubeStart - 1 : 0;
+	slab.sampleEnd = std::min(slab.cubeEnd + 1, (size_t)header.dims[2] - 1);
+
+	const char* samples = (const char*)volume.samples + slab.sampleStart * sliceBytes;
+	size_t bytes = (slab.sampleEnd - slab.sampleStart + 1) * sliceBytes;
+
+	releaseEvent(slab.uploadEvent);
+	cl_int result = clEnqueueWriteBuffer(transferQueue, slab.volumeLink, CL_FALSE, 0, bytes, samples,
+		slab.processEvent ? 1 : 0, slab.processEvent ? &slab.processEvent : nullptr, &slab.uploadEvent);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+	clFlush(transferQueue);
+}
+
+// queues extraction of an uploaded slab followed by the readback of its triangle count,
+// waiting for the buffer's previous readbacks before its output is overwritten.
+// the count follows the kernel on the compute queue, so it never waits behind
+// another slab's vertex readback
+static void enqueueProcess(cl_command_queue computeQueue, cl_kernel kernel,
+						   const RawVolume& volume, const StreamSettings& settings, Slab& slab)
+{
+	cl_int result = CL_SUCCESS;
+	const VolumeHeader& header = volume.header;
+
+	cl_int slabDims[4] = { (cl_int)header.dims[0], (cl_int)header.dims[1], (cl_int)(slab.sampleEnd - slab.sampleStart + 1), 0 };
+	result = clSetKernelArg(kernel, 0, sizeof(cl_int), &slab.capacity);
+	result |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &slab.faceCountLink);
+	result |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &slab.vertexLink);
+	result |= clSetKernelArg(kernel, 3, sizeof(cl_float), &settings.threshold);
+	result |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &slab.volumeLink);
+	result |= clSetKernelArg(kernel, 5, sizeof(cl_int) * 4, slabDims);
+	if (settings.tableImage != 0)
+		result |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &settings.tableImage);
+	CL_CHECK(clSetKernelArg, result);
+
+	cl_event readEvents[2];
+	cl_uint readEventCount = 0;
+	if (slab.countEvent != 0)
+		readEvents[readEventCount++] = slab.countEvent;
+	if (slab.readEvent != 0)
+		readEvents[readEventCount++] = slab.readEvent;
+
+	cl_event fillEvent = 0;
+	cl_uint zero = 0;
+	result = clEnqueueFillBuffer(computeQueue, slab.faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint),
+		readEventCount, readEventCount > 0 ? readEvents : nullptr, &fillEvent);
+	CL_CHECK(clEnqueueFillBuffer, result);
+
+	// the global offset skips the halo sample below the slab's cubes
+	cl_event waitEvents[2] = { slab.uploadEvent, fillEvent };
+	size_t globalWorkOffset[3] = { 0, 0, slab.cubeStart - slab.sampleStart };
+	size_t globalWorkSize[3] = { header.dims[0] - 1, header.dims[1] - 1, slab.cubeEnd - slab.cubeStart };
+	releaseEvent(slab.processEvent);
+	result = clEnqueueNDRangeKernel(computeQueue, kernel, 3, globalWorkOffset, globalWorkSize, 0, 2, waitEvents, &slab.processEvent);
+	CL_CHECK(clEnqueueNDRangeKernel, result);
+	clReleaseEvent(fillEvent);
+
+	releaseEvent(slab.countEvent);
+	result = clEnqueueReadBuffer(computeQueue, slab.faceCountLink, CL_FALSE, 0, sizeof(cl_uint), &slab.faceCount, 1, &slab.processEvent, &slab.countEvent);
+	CL_CHECK(clEnqueueReadBuffer, result);
+	clFlush(computeQueue);
+}
+
+// appends a slab's triangles once their readback has landed, moving them from slab to volume space
+static void appendSlab(StreamMesh& mesh, std::vector<cl_float4>& vertices, const Slab& slab)
+{
+	if (slab.readEvent != 0)
+		clWaitForEvents(1, &slab.readEvent);
+
+	cl_uint faceCount = slab.readFaceCount;
+	float zOffset = (float)slab.readSampleStart;
+
+	for (size_t i = 0; i < faceCount * 6; i += 2)
+		vertices[i].s[2] += zOffset;
+
+	if (mesh.file != nullptr)
+		fwrite(vertices.data(), sizeof(cl_float4), faceCount * 6, mesh.file);
+	else
+		mesh.vertices.insert(mesh.vertices.end(), vertices.begin(), vertices.begin() + faceCount * 6);
+
+	mesh.faceCount += faceCount;
+}
+
+bool streamVolume(cl_context context, cl_device_id device, cl_program program,
+				  const RawVolume& volume, const StreamSettings& settings, StreamMesh& mesh)
+{
+	cl_int result = CL_SUCCESS;
+	const VolumeHeader& header = volume.header;
+
+	size_t cubesZ = header.dims[2] - 1;
+	size_t slabCount = (cubesZ + settings.slabDepth - 1) / settings.slabDepth;
+	size_t sliceBytes = (size_t)header.dims[0] * header.dims[1] * header.format;
+	size_t slabBytes = (settings.slabDepth + 3) * sliceBytes;
+
+	// uploads and vertex readbacks go through queues of their own so that
+	// neither waits behind the other or behind extraction
+	cl_command_queue computeQueue = clCreateCommandQueue(context, device, 0, &result);
+	CL_CHECK(clCreateCommandQueue, result);
+	cl_command_queue transferQueue = clCreateCommandQueue(context, device, 0, &result);
+	CL_CHECK(clCreateCommandQueue, result);
+	cl_command_queue readbackQueue = clCreateCommandQueue(context, device, 0, &result);
+	CL_CHECK(clCreateCommandQueue, result);
+	cl_kernel kernel = clCreateKernel(program, "marchingCubes", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	Slab slabs[2];
+	memset(slabs, 0, sizeof(slabs));
+	for (auto& slab : slabs)
+	{
+		slab.volumeLink = clCreateBuffer(context, CL_MEM_READ_ONLY, slabBytes, nullptr, &result);
+		CL_CHECK(clCreateBuffer, result);
+		slab.faceCountLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), nullptr, &result);
+		CL_CHECK(clCreateBuffer, result);
+		createSlabOutput(context, slab, settings.maxFaces);
+	}
+
+	if (result != CL_SUCCESS)
+		printf("Failed to create slab buffers (%zu bytes each)\n", slabBytes);
+
+	std::vector<cl_float4> slabVertices[2];
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// prime the pipeline with the first slab
+	if (result == CL_SUCCESS && slabCount > 0)
+	{
+		enqueueUpload(transferQueue, volume, settings, 0, slabs[0]);
+		enqueueProcess(computeQueue, kernel, volume, settings, slabs[0]);
+	}
+
+	for (size_t i = 0; result == CL_SUCCESS && i < slabCount; ++i)
+	{
+		Slab& slab = slabs[i % 2];
+
+		// start the next slab moving while we collect this one
+		if (i + 1 < slabCount)
+		{
+			Slab& next = slabs[(i + 1) % 2];
+			enqueueUpload(transferQueue, volume, settings, i + 1, next);
+			enqueueProcess(computeQueue, kernel, volume, settings, next);
+		}
+
+		clWaitForEvents(1, &slab.countEvent);
+
+		// the kernel drops triangles past its capacity but still counts them,
+		// so grow the output to fit and redo the slab
+		while (result == CL_SUCCESS && slab.faceCount > slab.capacity)
+		{
+			if (!createSlabOutput(context, slab, slab.faceCount + slab.faceCount / 4))
+				result = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+			else
+			{
+				enqueueProcess(computeQueue, kernel, volume, settings, slab);
+				clWaitForEvents(1, &slab.countEvent);
+			}
+		}
+		if (result != CL_SUCCESS)
+			break;
+
+		// read this slab's triangles back without waiting, while the previous
+		// slab's are appended and the next slab is extracted
+		std::vector<cl_float4>& vertices = slabVertices[i % 2];
+		vertices.resize(std::max(vertices.size(), (size_t)slab.faceCount * 6));
+		slab.readFaceCount = slab.faceCount;
+		slab.readSampleStart = slab.sampleStart;
+		releaseEvent(slab.readEvent);
+		if (slab.faceCount > 0)
+		{
+			result = clEnqueueReadBuffer(readbackQueue, slab.vertexLink, CL_FALSE, 0, sizeof(cl_float4) * 6 * slab.faceCount, vertices.data(),
+				1, &slab.processEvent, &slab.readEvent);
+			CL_CHECK(clEnqueueReadBuffer, result);
+			clFlush(readbackQueue);
+		}
+
+		if (i > 0)
+			appendSlab(mesh, slabVertices[(i - 1) % 2], slabs[(i - 1) % 2]);
+		if (i + 1 == slabCount)
+			appendSlab(mesh, vertices, slab);
+	}
+
+	clFinish(computeQueue);
+	clFinish(transferQueue);
+	clFinish(readbackQueue);
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	double uploadBytes = (double)header.dims[2] * sliceBytes;
+	printf("Streamed %zu slabs in %.3fs: %zu triangles, %.1f MB/s of volume, %.1f MB peak device memory\n",
+		slabCount, seconds, mesh.faceCount, uploadBytes / seconds / (1024 * 1024),
+		(2 * slabBytes + sizeof(cl_float4) * 6 * (slabs[0].capacity + (size_t)slabs[1].capacity)) / (1024.0 * 1024.0));
+
+	for (auto& slab : slabs)
+	{
+		releaseEvent(slab.uploadEvent);
+		releaseEvent(slab.processEvent);
+		releaseEvent(slab.countEvent);
+		releaseEvent(slab.readEvent);
+		clReleaseMemObject(slab.faceCountLink);
+		clReleaseMemObject(slab.vertexLink);
+		clReleaseMemObject(slab.volumeLink);
+	}
+	clReleaseKernel(kernel);
+	clReleaseCommandQueue(readbackQueue);
+	clReleaseCommandQueue(transferQueue);
+	clReleaseCommandQueue(computeQueue);
+
+	return result == CL_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "clcommon.h"
+#include "volume.h"
+#include <vector>
+
+// mesh that slabs of triangles are appended to, either kept on the host or
+// written straight out to a file as the same position / normal float4 pairs
+// the kernel produces
+struct StreamMesh
+{
+	std::vector<cl_float4>	vertices;
+	FILE*					file;
+	size_t					faceCount;
+};
+
+// out-of-core extraction settings
+struct StreamSettings
+{
+	size_t		slabDepth;		// cubes along z per slab
+	cl_uint		maxFaces;		// initial triangle capacity per slab, grows on overflow
+	cl_float	threshold;
+	cl_mem		tableImage;		// lookup tables for a program built with TABLES_IMAGE, otherwise 0
+};
+
+// polygonises a volume too large for the device in z-slabs with a one-voxel
+// overlap. slabs are double buffered, with uploads and readbacks on queues
+// of their own, so the transfer of one slab overlaps the extraction of the
+// previous and the readback of the one before that.
+// program must have been built with FIELD_VOLUME for the volume's format.
+// peak device memory is two slabs plus two slab outputs.
+bool streamVolume(cl_context context, cl_device_id device, cl_program program,
+				  const RawVolume& volume, const StreamSettings& settings, StreamMesh& mesh);
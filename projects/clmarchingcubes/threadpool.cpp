@@ -0,0 +1,74 @@
+#include "threadpool.h"
+#include <algorithm>
+
+static void runPendingJobs(ThreadPool& pool, std::unique_lock<std::mutex>& lock)
+{
+	while (pool.nextJob < pool.jobCount)
+	{
+		size_t job = pool.nextJob++;
+
+		lock.unlock();
+		pool.job(job);
+		lock.lock();
+
+		if (++pool.jobsDone == pool.jobCount)
+			pool.finished.notify_all();
+	}
+}
+
+static void workerThread(ThreadPool* pool)
+{
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	unsigned int batch = pool->batch;
+	for (;;)
+	{
+		pool->wake.wait(lock, [&]() { return pool->quit || pool->batch != batch; });
+		if (pool->quit)
+			return;
+
+		batch = pool->batch;
+		runPendingJobs(*pool, lock);
+	}
+}
+
+void createThreadPool(ThreadPool& pool, unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	pool.jobCount = pool.nextJob = pool.jobsDone = 0;
+	pool.batch = 0;
+	pool.quit = false;
+
+	// the calling thread is the last worker
+	for (unsigned int i = 1; i < threadCount; ++i)
+		pool.threads.push_back(std::thread(workerThread, &pool));
+}
+
+void releaseThreadPool(ThreadPool& pool)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.quit = true;
+	}
+	pool.wake.notify_all();
+
+	for (auto& thread : pool.threads)
+		thread.join();
+	pool.threads.clear();
+}
+
+void runJobs(ThreadPool& pool, size_t jobCount, const std::function<void(size_t)>& job)
+{
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.job = job;
+	pool.jobCount = jobCount;
+	pool.nextJob = 0;
+	pool.jobsDone = 0;
+	++pool.batch;
+	pool.wake.notify_all();
+
+	runPendingJobs(pool, lock);
+	pool.finished.wait(lock, [&]() { return pool.jobsDone == pool.jobCount; });
+	pool.job = nullptr;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads that run batches of numbered jobs. the thread
+// that starts a batch works through it too, and returns once every job of
+// the batch has finished
+struct ThreadPool
+{
+	std::vector<std::thread>	threads;
+	std::mutex					mutex;
+	std::condition_variable		wake;			// a batch has started or the pool is closing
+	std::condition_variable		finished;		// the last job of a batch has finished
+
+	std::function<void(size_t)>	job;
+	size_t						jobCount;
+	size_t						nextJob;
+	size_t						jobsDone;
+	unsigned int				batch;			// incremented for each batch so sleeping workers notice it
+	bool						quit;
+};
+
+// threadCount of 0 uses one thread per hardware thread, including the caller
+void createThreadPool(ThreadPool& pool, unsigned int threadCount);
+void releaseThreadPool(ThreadPool& pool);
+
+// runs job(0) to job(jobCount - 1) across the pool and waits for them all
+void runJobs(ThreadPool& pool, size_t jobCount, const std::function<void(size_t)>& job);
@@ -0,0 +1,154 @@
+#include "volume.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(WIN32)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// page alignment of the samples within files we write
+static const unsigned int VOLUME_DATA_ALIGNMENT = 4096;
+
+bool openRawVolume(RawVolume& volume, const char* path)
+{
+	memset(&volume, 0, sizeof(RawVolume));
+#if !defined(WIN32)
+	volume.fileHandle = -1;
+#endif
+
+#if defined(WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Failed to open volume '%s'\n", path);
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (view == nullptr)
+	{
+		printf("Failed to map volume '%s'\n", path);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	volume.fileHandle = file;
+	volume.mappingHandle = mapping;
+	volume.mapping = view;
+	volume.mappingSize = (size_t)fileSize.QuadPart;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		printf("Failed to open volume '%s'\n", path);
+		return false;
+	}
+
+	struct stat fileInfo;
+	fstat(file, &fileInfo);
+	void* view = mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_SHARED, file, 0);
+	if (view == MAP_FAILED)
+	{
+		printf("Failed to map volume '%s'\n", path);
+		close(file);
+		return false;
+	}
+
+	// we stream through the samples front to back when uploading
+	madvise(view, fileInfo.st_size, MADV_SEQUENTIAL);
+
+	volume.fileHandle = file;
+	volume.mapping = view;
+	volume.mappingSize = (size_t)fileInfo.st_size;
+#endif
+
+	// validate the header against the size of the file
+	bool valid = volume.mappingSize >= sizeof(VolumeHeader);
+	if (valid)
+	{
+		memcpy(&volume.header, volume.mapping, sizeof(VolumeHeader));
+
+		// the dims are checked before they're multiplied, so a corrupt header
+		// can't wrap the size of its samples round to fit the file
+		const VolumeHeader& header = volume.header;
+		valid = memcmp(header.magic, "RVOL", 4) == 0 &&
+			(header.format == VOLUME_UINT8 || header.format == VOLUME_UINT16 || header.format == VOLUME_FLOAT);
+		for (int i = 0; i < 3; ++i)
+			valid = valid && header.dims[i] > 1 && header.dims[i] <= VOLUME_MAX_DIM;
+
+		if (valid)
+		{
+			volume.sampleBytes = (size_t)header.dims[0] * header.dims[1] * header.dims[2] * header.format;
+			valid = header.dataOffset >= sizeof(VolumeHeader) &&
+				header.dataOffset <= volume.mappingSize &&
+				volume.sampleBytes <= volume.mappingSize - header.dataOffset;
+		}
+	}
+
+	if (!valid)
+	{
+		printf("Invalid volume '%s'\n", path);
+		closeRawVolume(volume);
+		return false;
+	}
+
+	volume.samples = (const char*)volume.mapping + volume.header.dataOffset;
+
+	return true;
+}
+
+void closeRawVolume(RawVolume& volume)
+{
+#if defined(WIN32)
+	if (volume.mapping != nullptr)
+		UnmapViewOfFile(volume.mapping);
+	if (volume.mappingHandle != nullptr)
+		CloseHandle(volume.mappingHandle);
+	if (volume.fileHandle != nullptr)
+		CloseHandle(volume.fileHandle);
+#else
+	if (volume.mapping != nullptr)
+		munmap(volume.mapping, volume.mappingSize);
+	if (volume.fileHandle >= 0)
+		close(volume.fileHandle);
+#endif
+
+	memset(&volume, 0, sizeof(RawVolume));
+#if !defined(WIN32)
+	volume.fileHandle = -1;
+#endif
+}
+
+bool writeRawVolume(const char* path, const unsigned int dims[3], VolumeFormat format, const void* samples)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		printf("Failed to write volume '%s'\n", path);
+		return false;
+	}
+
+	VolumeHeader header = { { 'R', 'V', 'O', 'L' }, { dims[0], dims[1], dims[2] }, (unsigned int)format, VOLUME_DATA_ALIGNMENT };
+	char padding[VOLUME_DATA_ALIGNMENT] = { 0 };
+	memcpy(padding, &header, sizeof(VolumeHeader));
+
+	size_t sampleBytes = (size_t)dims[0] * dims[1] * dims[2] * format;
+	bool success = fwrite(padding, 1, VOLUME_DATA_ALIGNMENT, file) == VOLUME_DATA_ALIGNMENT &&
+		fwrite(samples, 1, sampleBytes, file) == sampleBytes;
+	fclose(file);
+
+	if (!success)
+		printf("Failed to write volume '%s'\n", path);
+
+	return success;
+}
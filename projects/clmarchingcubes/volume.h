@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+
+// raw volume files are a small header followed by tightly packed samples,
+// x varying fastest then y then z
+struct VolumeHeader
+{
+	char			magic[4];		// "RVOL"
+	unsigned int	dims[3];		// samples along each axis
+	unsigned int	format;			// bytes per sample, see VolumeFormat
+	unsigned int	dataOffset;		// byte offset of the first sample from the start of the file
+};
+
+// most samples along each axis of a volume, which keeps the size of its
+// samples well within a size_t
+const unsigned int VOLUME_MAX_DIM = 1 << 16;
+
+// integer formats are unsigned and normalised to [0,1] when sampled
+enum VolumeFormat
+{
+	VOLUME_UINT8 = 1,
+	VOLUME_UINT16 = 2,
+	VOLUME_FLOAT = 4,
+};
+
+// a memory-mapped raw volume
+// samples points straight into the mapping so nothing is copied on the host
+struct RawVolume
+{
+	VolumeHeader	header;
+	const void*		samples;
+	size_t			sampleBytes;
+
+	// platform mapping handles
+	void*			mapping;
+	size_t			mappingSize;
+#if defined(WIN32)
+	void*			fileHandle;
+	void*			mappingHandle;
+#else
+	int				fileHandle;
+#endif
+};
+
+// maps a raw volume file, returning false if it can't be opened or the header is invalid
+bool openRawVolume(RawVolume& volume, const char* path);
+void closeRawVolume(RawVolume& volume);
+
+// writes a raw volume, samples is dims[0] * dims[1] * dims[2] samples of the given format
+// the samples are page aligned in the file so that mapped volumes can be used by opencl in place
+bool writeRawVolume(const char* path, const unsigned int dims[3], VolumeFormat format, const void* samples);
@@ -0,0 +1,153 @@
+#include "volumefilter.h"
+#include <glm/glm.hpp>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+// work-items along the filtered axis, and lines of them across it
+static const size_t FILTER_LINE_LENGTH = 32;
+static const size_t FILTER_LINES = 8;
+
+bool parseVolumeFilter(const char* text, VolumeFilter& filter)
+{
+	const char* colon = strchr(text, ':');
+	size_t nameLength = colon != nullptr ? (size_t)(colon - text) : strlen(text);
+	float parameter = colon != nullptr ? (float)atof(colon + 1) : 0.0f;
+
+	if (strncmp(text, "gaussian", nameLength) == 0 && nameLength == 8)
+	{
+		// the weights are negligible past 3 sigma
+		filter.type = VOLUME_FILTER_GAUSSIAN;
+		filter.sigma = parameter > 0 ? parameter : 1.0f;
+		filter.radius = glm::clamp((int)ceilf(filter.sigma * 3), 1, MAX_FILTER_RADIUS);
+	}
+	else if (strncmp(text, "box", nameLength) == 0 && nameLength == 3)
+	{
+		filter.type = VOLUME_FILTER_BOX;
+		filter.sigma = 0;
+		filter.radius = glm::clamp(parameter > 0 ? (int)parameter : 1, 1, MAX_FILTER_RADIUS);
+	}
+	else if (strncmp(text, "median", nameLength) == 0 && nameLength == 6)
+	{
+		filter.type = VOLUME_FILTER_MEDIAN;
+		filter.sigma = 0;
+		filter.radius = 1;
+	}
+	else
+		return false;
+
+	return true;
+}
+
+bool createVolumeFilters(FilterData& data, cl_context context, cl_device_id device, cl_program program,
+						 const cl_int dims[4], size_t sampleBytes)
+{
+	cl_int result = CL_SUCCESS;
+
+	for (int i = 0; i < 4; ++i)
+		data.dims[i] = dims[i];
+
+	data.kernel = clCreateKernel(program, "filterVolume", &result);
+	CL_CHECK(clCreateKernel, result);
+	data.scratchLink = clCreateBuffer(context, CL_MEM_READ_WRITE, sampleBytes, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	// lines run along the axis, side by side along x or, for the x pass, y,
+	// so that the y and z passes still read rows of x together
+	size_t maxGroupSize = 0;
+	clGetKernelWorkGroupInfo(data.kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, nullptr);
+	size_t lines = glm::max(glm::min(FILTER_LINES, maxGroupSize / FILTER_LINE_LENGTH), (size_t)1);
+	size_t length = glm::min(FILTER_LINE_LENGTH, maxGroupSize / lines);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (int i = 0; i < 3; ++i)
+			data.localSize[axis][i] = 1;
+		data.localSize[axis][axis] = length;
+		data.localSize[axis][axis == 0 ? 1 : 0] = lines;
+	}
+
+	cl_int4 grid = { { dims[0], dims[1], dims[2], 0 } };
+	result = clSetKernelArg(data.kernel, 2, sizeof(cl_int4), &grid);
+	CL_CHECK(clSetKernelArg, result);
+
+	return result == CL_SUCCESS;
+}
+
+void releaseVolumeFilters(FilterData& data)
+{
+	clReleaseMemObject(data.scratchLink);
+	clReleaseKernel(data.kernel);
+}
+
+void enqueueVolumeFilters(FilterData& data, cl_command_queue queue, cl_mem volumeLink, size_t sampleBytes,
+						  const std::vector<VolumeFilter>& filters, cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event)
+{
+	cl_int result = CL_SUCCESS;
+
+	// the passes alternate between the volume and the scratch volume, each
+	// waiting on the last, which an in-order queue would do anyway
+	cl_mem buffers[2] = { volumeLink, data.scratchLink };
+	int source = 0;
+	cl_event last = 0;
+	if (numWaitEvents > 0)
+	{
+		result = clEnqueueMarkerWithWaitList(queue, numWaitEvents, waitEvents, &last);
+		CL_CHECK(clEnqueueMarkerWithWaitList, result);
+	}
+
+	for (const VolumeFilter& filter : filters)
+	{
+		cl_int type = filter.type;
+		result = clSetKernelArg(data.kernel, 4, sizeof(cl_int), &type);
+		result |= clSetKernelArg(data.kernel, 5, sizeof(cl_int), &filter.radius);
+		result |= clSetKernelArg(data.kernel, 6, sizeof(cl_float), &filter.sigma);
+		CL_CHECK(clSetKernelArg, result);
+
+		for (cl_int axis = 0; axis < 3; ++axis)
+		{
+			const size_t* localSize = data.localSize[axis];
+			size_t lineCount = localSize[0] * localSize[1] * localSize[2] / localSize[axis];
+			size_t tileSize = sizeof(cl_float) * lineCount * (localSize[axis] + 2 * filter.radius);
+
+			// whole work-groups, the kernel skips the work-items past the edges
+			size_t globalWorkSize[3];
+			for (int i = 0; i < 3; ++i)
+				globalWorkSize[i] = (data.dims[i] + localSize[i] - 1) / localSize[i] * localSize[i];
+
+			result = clSetKernelArg(data.kernel, 0, sizeof(cl_mem), &buffers[source]);
+			result |= clSetKernelArg(data.kernel, 1, sizeof(cl_mem), &buffers[1 - source]);
+			result |= clSetKernelArg(data.kernel, 3, sizeof(cl_int), &axis);
+			result |= clSetKernelArg(data.kernel, 7, tileSize, nullptr);
+			CL_CHECK(clSetKernelArg, result);
+
+			cl_event pass = 0;
+			result = clEnqueueNDRangeKernel(queue, data.kernel, 3, 0, globalWorkSize, localSize, last != 0 ? 1 : 0, last != 0 ? &last : nullptr, &pass);
+			CL_CHECK(clEnqueueNDRangeKernel, result);
+			if (last != 0)
+				clReleaseEvent(last);
+			last = pass;
+			source = 1 - source;
+		}
+	}
+
+	// an odd number of passes leaves the result in the scratch volume
+	if (source == 1)
+	{
+		cl_event copy = 0;
+		result = clEnqueueCopyBuffer(queue, data.scratchLink, volumeLink, 0, 0, sampleBytes, last != 0 ? 1 : 0, last != 0 ? &last : nullptr, &copy);
+		CL_CHECK(clEnqueueCopyBuffer, result);
+		if (last != 0)
+			clReleaseEvent(last);
+		last = copy;
+	}
+
+	// nothing to filter, so the volume is ready once the waits are
+	if (last == 0)
+	{
+		result = clEnqueueMarkerWithWaitList(queue, 0, nullptr, &last);
+		CL_CHECK(clEnqueueMarkerWithWaitList, result);
+	}
+	*event = last;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "clcommon.h"
+#include <vector>
+
+// must match the FILTER_ defines in the kernel
+enum VolumeFilterType
+{
+	VOLUME_FILTER_BOX,
+	VOLUME_FILTER_GAUSSIAN,
+	VOLUME_FILTER_MEDIAN,
+};
+
+// widest filter, in samples either side, so a tile's lines fit in local memory
+const int MAX_FILTER_RADIUS = 16;
+
+struct VolumeFilter
+{
+	VolumeFilterType	type;
+	int					radius;		// samples either side, 1 for the median
+	float				sigma;		// gaussian only
+};
+
+// smooths a volume's samples on the device before it's polygonised, so noisy
+// scans give fewer and smoother triangles without filtering on the host. every
+// filter is separable and run as a pass along each axis, ping-ponging through
+// a scratch volume, and the filtered samples end up back in the volume
+struct FilterData
+{
+	cl_kernel	kernel;
+	cl_mem		scratchLink;
+	cl_int		dims[4];
+	size_t		localSize[3][3];	// work-group of each axis' pass, long along the axis
+};
+
+// parses gaussian[:sigma], box[:radius] or median, returning false if it isn't one
+bool parseVolumeFilter(const char* text, VolumeFilter& filter);
+
+bool createVolumeFilters(FilterData& data, cl_context context, cl_device_id device, cl_program program,
+						 const cl_int dims[4], size_t sampleBytes);
+void releaseVolumeFilters(FilterData& data);
+
+// runs the filters in order over volumeLink, which must be writable
+void enqueueVolumeFilters(FilterData& data, cl_command_queue queue, cl_mem volumeLink, size_t sampleBytes,
+						  const std::vector<VolumeFilter>& filters, cl_uint numWaitEvents, const cl_event* waitEvents, cl_event* event);
@@ -0,0 +1,183 @@
+#include "headless.h"
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <stdlib.h>
+
+cl_device_type parseDeviceType(const char* name)
+{
+	if (strcmp(name, "cpu") == 0)
+		return CL_DEVICE_TYPE_CPU;
+	else if (strcmp(name, "gpu") == 0)
+		return CL_DEVICE_TYPE_GPU;
+	else if (strcmp(name, "all") == 0)
+		return CL_DEVICE_TYPE_ALL;
+	return CL_DEVICE_TYPE_DEFAULT;
+}
+
+bool setupCL(CLData& clData, cl_device_type deviceType)
+{
+	cl_int result = CL_SUCCESS;
+
+	cl_uint numPlatforms = 0;
+	result = clGetPlatformIDs(0, nullptr, &numPlatforms);
+	CL_CHECK(clGetPlatformIDs, result);
+	std::vector<cl_platform_id> platforms(numPlatforms);
+	if (numPlatforms > 0)
+		clGetPlatformIDs(numPlatforms, platforms.data(), nullptr);
+
+	// cpu implementations are usually a platform of their own, so look through them all
+	for (cl_platform_id platform : platforms)
+	{
+		cl_uint numDevices = 0;
+		if (clGetDeviceIDs(platform, deviceType, 1, &clData.device, &numDevices) == CL_SUCCESS && numDevices > 0)
+		{
+			clData.platform = platform;
+			break;
+		}
+	}
+	if (clData.platform == 0)
+	{
+		printf("No OpenCL device of the requested type\n");
+		return false;
+	}
+
+	char deviceName[256] = "";
+	clGetDeviceInfo(clData.device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, nullptr);
+	printf("Device: %s\n", deviceName);
+
+	clData.context = clCreateContext(nullptr, 1, &clData.device, 0, 0, &result);
+	CL_CHECK(clCreateContext, result);
+	if (result != CL_SUCCESS)
+		return false;
+
+	// profiling gives us the device time of each stage
+	clData.queue = clCreateCommandQueue(clData.context, clData.device, CL_QUEUE_PROFILING_ENABLE, &result);
+	CL_CHECK(clCreateCommandQueue, result);
+	if (result != CL_SUCCESS)
+	{
+		clReleaseContext(clData.context);
+		return false;
+	}
+
+	clGetDeviceInfo(clData.device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &clData.maxAllocation, nullptr);
+
+	return true;
+}
+
+void releaseCL(CLData& clData)
+{
+	clReleaseCommandQueue(clData.queue);
+	clReleaseContext(clData.context);
+}
+
+cl_mem createBuffer(CLData& clData, cl_mem_flags flags, size_t size)
+{
+	cl_int result = CL_SUCCESS;
+	cl_mem buffer = clCreateBuffer(clData.context, flags, size, nullptr, &result);
+	CL_CHECK(clCreateBuffer, result);
+	if (result != CL_SUCCESS)
+		return 0;
+
+	clData.allocated += size;
+	clData.peakAllocated = glm::max(clData.peakAllocated, clData.allocated);
+	return buffer;
+}
+
+void releaseBuffer(CLData& clData, cl_mem buffer)
+{
+	if (buffer == 0)
+		return;
+
+	size_t size = 0;
+	clGetMemObjectInfo(buffer, CL_MEM_SIZE, sizeof(size_t), &size, nullptr);
+	clData.allocated -= size;
+	clReleaseMemObject(buffer);
+}
+
+cl_program buildProgram(CLData& clData, const std::string& kernelDir, const char* defines)
+{
+	cl_int result = CL_SUCCESS;
+
+	// load kernel code
+	std::string path = kernelDir + "/marchingcubes.cl";
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+	{
+		printf("Unable to open %s\n", path.c_str());
+		return 0;
+	}
+	std::stringstream source;
+	source << file.rdbuf();
+	std::string kernelSource = source.str();
+	const char* sourcePointer = kernelSource.c_str();
+	size_t size = kernelSource.size();
+
+	cl_program program = clCreateProgramWithSource(clData.context, 1, &sourcePointer, &size, &result);
+	CL_CHECK(clCreateProgramWithSource, result);
+	if (result != CL_SUCCESS)
+		return 0;
+
+	char options[96];
+	sprintf(options, " -D BRICK_SIZE=%i -D LOD_BLOCK_SIZE=%i -D SCAN_GROUP_SIZE=%i ", (int)BRICK_SIZE, (int)LOD_BLOCK_SIZE, (int)SCAN_GROUP_SIZE);
+	std::string buildOptions = "-I " + kernelDir + options + defines;
+
+	result = clBuildProgram(program, 1, &clData.device, buildOptions.c_str(), 0, 0);
+	if (result != CL_SUCCESS)
+	{
+		size_t len = 0;
+		clGetProgramBuildInfo(program, clData.device, CL_PROGRAM_BUILD_LOG, 0, 0, &len);
+		std::vector<char> log(len + 1, 0);
+		clGetProgramBuildInfo(program, clData.device, CL_PROGRAM_BUILD_LOG, len, log.data(), 0);
+		printf("Kernel error:\n%s\n", log.data());
+
+		clReleaseProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+cl_mem createTableImage(CLData& clData)
+{
+	cl_bool imageSupport = CL_FALSE;
+	clGetDeviceInfo(clData.device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &imageSupport, nullptr);
+	if (!imageSupport)
+		return 0;
+
+	// one uint4 texel per cube case
+	cl_uint texels[256][4];
+	packTableTexels(texels);
+
+	cl_int result = CL_SUCCESS;
+	cl_image_format format = { CL_RGBA, CL_UNSIGNED_INT32 };
+	cl_image_desc desc = { 0 };
+	desc.image_type = CL_MEM_OBJECT_IMAGE1D;
+	desc.image_width = 256;
+	cl_mem image = clCreateImage(clData.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &desc, texels, &result);
+	CL_CHECK(clCreateImage, result);
+	return result == CL_SUCCESS ? image : 0;
+}
+
+std::vector<glm::vec4> makeParticles(int particleCount, size_t gridSize, unsigned int seed)
+{
+	std::vector<glm::vec4> particles(particleCount);
+
+	// a fixed seed so every run and every build polygonises the same surface
+	srand(seed);
+	for (auto& p : particles)
+	{
+		for (int i = 0; i < 3; ++i)
+			p[i] = (0.2f + 0.6f * (rand() / (float)RAND_MAX)) * gridSize;
+		p.w = 1;
+	}
+
+	return particles;
+}
+
+float metaballThreshold(size_t gridSize)
+{
+	// the 1/r^2 field falls with the square of the scale
+	float scale = 64.0f / gridSize;
+	return 0.04f * scale * scale;
+}
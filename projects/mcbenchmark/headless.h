@@ -0,0 +1,69 @@
+#pragma once
+
+#include "clcommon.h"
+#include "scan.h"
+#include "lod.h"
+#include "mctables.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+// opencl setup shared by the headless marching cubes tools, which run the
+// extraction kernels into plain buffers without a window or opengl context
+
+// default location of the kernels, and the headers they share with the host,
+// the kernel directory of the source tree the build was configured from
+#ifndef KERNEL_DIR
+#define KERNEL_DIR "bin/kernels/cl"
+#endif
+
+// must match the kernel's build options, as in clmarchingcubes. the level of
+// detail block and scan group sizes come from lod.h and scan.h
+const size_t BRICK_SIZE = 8;
+
+// bytes per output vertex, float4 position and normal or the compact format
+const size_t VERTEX_SIZE = sizeof(cl_float4) * 2;
+const size_t COMPACT_VERTEX_SIZE = sizeof(cl_uint) * 3;
+
+struct CLData
+{
+	cl_platform_id		platform;
+	cl_device_id		device;
+	cl_context			context;
+	cl_command_queue	queue;
+	cl_ulong			maxAllocation;
+
+	// device memory allocated through createBuffer, opencl has no portable
+	// way of asking how much a device is using so we total our own buffers
+	cl_ulong			allocated;
+	cl_ulong			peakAllocated;
+
+	// from createTableImage, for programs built with TABLES_IMAGE
+	cl_mem				tableImage;
+};
+
+// cpu, gpu or all, anything else is the platform default
+cl_device_type parseDeviceType(const char* name);
+
+// picks the first device of the requested type across every platform
+bool setupCL(CLData& clData, cl_device_type deviceType);
+void releaseCL(CLData& clData);
+
+// buffers that count towards the device memory total
+cl_mem createBuffer(CLData& clData, cl_mem_flags flags, size_t size);
+void releaseBuffer(CLData& clData, cl_mem buffer);
+
+// builds marchingcubes.cl from kernelDir with the given extra defines,
+// returns 0 on failure
+cl_program buildProgram(CLData& clData, const std::string& kernelDir, const char* defines);
+
+// the packed lookup tables as the image a program built with TABLES_IMAGE
+// reads them from, returns 0 if the device can't sample images
+cl_mem createTableImage(CLData& clData);
+
+// metaballs placed the same way for a given seed, spread over the middle of the grid
+std::vector<glm::vec4> makeParticles(int particleCount, size_t gridSize, unsigned int seed);
+
+// metaball isovalue that keeps the balls the same relative size as the 64^3 default
+float metaballThreshold(size_t gridSize);
\ No newline at end of file
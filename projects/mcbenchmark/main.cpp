@@ -0,0 +1,614 @@
+// headless throughput benchmark of the clmarchingcubes extraction kernels
+//
+// polygonises a sweep of grid sizes for each field into plain opencl buffers,
+// without a window or opengl context, so it runs on any opencl device
+// including cpu implementations on build machines. each run reports cubes and
+// triangles per second, the device time of each stage and the peak device
+// memory it allocated, and the whole sweep can be written out as json for
+// tracking over time.
+//
+// fields are scaled with the grid so that the surface keeps the same shape,
+// and its triangle count grows with the square of the grid size. every
+// lookup table layout is swept too, since which is fastest depends on the
+// device's constant cache, local memory and texture units, and so is the
+// order cubes are mapped to work-items in, rows or morton order within bricks,
+// with each morton run's speedup over its row run printed at the end.
+
+#include "headless.h"
+#include "cpumc.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// fields the benchmark sweeps, each built with its own FIELD_ define
+enum FieldType
+{
+	METABALLS,
+	NOISE,
+	SPHERE,
+
+	FIELD_TYPE_COUNT
+};
+
+const char* FIELD_NAMES[FIELD_TYPE_COUNT] = { "metaballs", "noise", "sphere" };
+const char* FIELD_OPTIONS[FIELD_TYPE_COUNT] = { "", " -D FIELD_NOISE", " -D FIELD_SPHERE" };
+
+// how work-items map to cubes, MORTON_ORDER in the kernel
+enum CubeMapping
+{
+	MAPPING_ROWS,		// x fastest, the 3d range of marchingCubes
+	MAPPING_MORTON,		// morton order within bricks, marchingCubesMorton without bricks
+
+	MAPPING_COUNT
+};
+
+const char* MAPPING_NAMES[MAPPING_COUNT] = { "rows", "morton" };
+
+struct BenchmarkSettings
+{
+	std::vector<size_t>	gridSizes;
+	bool				fields[FIELD_TYPE_COUNT];
+	bool				tables[TABLE_LAYOUT_COUNT];
+	bool				mappings[MAPPING_COUNT];
+	int					particleCount;
+	int					frames;				// timed frames per run, after one warm-up frame
+	bool				useBricks;
+	bool				compactVertices;
+	cl_device_type		deviceType;
+	std::string			kernelDir;
+	const char*			jsonPath;
+
+	// also time the cpu reference implementation over the metaballs
+	bool				useCPU;
+	unsigned int		cpuThreads;
+};
+
+// device time of each stage of a frame, in milliseconds
+enum Stage
+{
+	STAGE_UPLOAD,		// particle upload and counter resets
+	STAGE_CLASSIFY,		// brick classification and reading back the active brick count
+	STAGE_POLYGONISE,	// marching cubes over the active bricks or the whole grid
+	STAGE_READBACK,		// reading back the face count
+
+	STAGE_COUNT
+};
+
+const char* STAGE_NAMES[STAGE_COUNT] = { "upload", "classify", "polygonise", "readback" };
+
+struct BenchmarkResult
+{
+	const char*	backend;
+	FieldType	field;
+	TableLayout	tables;
+	CubeMapping	mapping;
+	size_t		gridSize;
+	cl_uint		faceCount;
+	bool		truncated;			// the surface needed more triangles than the device could allocate
+	double		frameTime;			// wall-clock ms per frame
+	double		stageTime[STAGE_COUNT];
+	cl_ulong	peakDeviceMemory;	// bytes
+};
+
+// times settings.frames frames of extraction on the device
+BenchmarkResult benchmarkCL(CLData& clData, const BenchmarkSettings& settings, FieldType field, TableLayout tables,
+							CubeMapping mapping, size_t gridSize);
+
+// times settings.frames frames of the cpu reference implementation
+BenchmarkResult benchmarkCPU(CPUMCData& cpuData, const BenchmarkSettings& settings, size_t gridSize);
+
+double stageMilliseconds(cl_event event);
+
+void printResult(const BenchmarkResult& result);
+
+// pairs each morton run with the row run of the same field, tables and grid and
+// prints how much faster it was, the comparison -mappings is there for
+void printMappingComparison(const std::vector<BenchmarkResult>& results);
+bool writeJSON(const char* path, const CLData& clData, const BenchmarkSettings& settings, const std::vector<BenchmarkResult>& results);
+
+int main(int argc, char* argv[])
+{
+	BenchmarkSettings settings;
+	settings.gridSizes = { 32, 64, 128, 256, 512 };
+	for (int i = 0; i < FIELD_TYPE_COUNT; ++i)
+		settings.fields[i] = true;
+	for (int i = 0; i < TABLE_LAYOUT_COUNT; ++i)
+		settings.tables[i] = true;
+	for (int i = 0; i < MAPPING_COUNT; ++i)
+		settings.mappings[i] = true;
+	settings.particleCount = 8;
+	settings.frames = 10;
+	settings.useBricks = true;
+	settings.compactVertices = false;
+	settings.deviceType = CL_DEVICE_TYPE_DEFAULT;
+	settings.kernelDir = KERNEL_DIR;
+	settings.jsonPath = nullptr;
+	settings.useCPU = false;
+	settings.cpuThreads = 0;
+
+	// command-line options
+	// -grids a,b,c			cubes along each side of the grids to sweep (default 32,64,128,256,512)
+	// -fields a,b			fields to sweep out of metaballs, noise and sphere (default all)
+	// -tables a,b			lookup table layouts to sweep out of full, packed, local and image (default all)
+	// -mappings a,b		cube orders to sweep out of rows and morton (default both)
+	// -particles n			number of metaballs
+	// -frames n			timed frames per run
+	// -nobricks			polygonise every cube of the grid rather than only the active bricks
+	// -compact				write 12-byte quantised vertices rather than 32-byte float ones
+	// -device cpu|gpu|all	type of opencl device to run on (default the platform default)
+	// -kernels dir			directory holding marchingcubes.cl and mctables.h
+	// -json path			write the results to a json file
+	// -cpu					also time the cpu reference implementation over the metaballs
+	// -threads n			cpu threads, including the main thread (default one per hardware thread)
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-grids") == 0 && i + 1 < argc)
+		{
+			settings.gridSizes.clear();
+			std::stringstream list(argv[++i]);
+			std::string size;
+			while (std::getline(list, size, ','))
+				if (atoi(size.c_str()) > 0)
+					settings.gridSizes.push_back(atoi(size.c_str()));
+		}
+		else if (strcmp(argv[i], "-fields") == 0 && i + 1 < argc)
+		{
+			for (int j = 0; j < FIELD_TYPE_COUNT; ++j)
+				settings.fields[j] = false;
+			std::stringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+				for (int j = 0; j < FIELD_TYPE_COUNT; ++j)
+					if (name == FIELD_NAMES[j])
+						settings.fields[j] = true;
+		}
+		else if (strcmp(argv[i], "-tables") == 0 && i + 1 < argc)
+		{
+			for (int j = 0; j < TABLE_LAYOUT_COUNT; ++j)
+				settings.tables[j] = false;
+			std::stringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+				for (int j = 0; j < TABLE_LAYOUT_COUNT; ++j)
+					if (name == TABLE_LAYOUT_NAMES[j])
+						settings.tables[j] = true;
+		}
+		else if (strcmp(argv[i], "-mappings") == 0 && i + 1 < argc)
+		{
+			for (int j = 0; j < MAPPING_COUNT; ++j)
+				settings.mappings[j] = false;
+			std::stringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+				for (int j = 0; j < MAPPING_COUNT; ++j)
+					if (name == MAPPING_NAMES[j])
+						settings.mappings[j] = true;
+		}
+		else if (strcmp(argv[i], "-particles") == 0 && i + 1 < argc)
+			settings.particleCount = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			settings.frames = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-nobricks") == 0)
+			settings.useBricks = false;
+		else if (strcmp(argv[i], "-compact") == 0)
+			settings.compactVertices = true;
+		else if (strcmp(argv[i], "-device") == 0 && i + 1 < argc)
+			settings.deviceType = parseDeviceType(argv[++i]);
+		else if (strcmp(argv[i], "-kernels") == 0 && i + 1 < argc)
+			settings.kernelDir = argv[++i];
+		else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+			settings.jsonPath = argv[++i];
+		else if (strcmp(argv[i], "-cpu") == 0)
+			settings.useCPU = true;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			settings.cpuThreads = glm::max(atoi(argv[++i]), 1);
+	}
+
+	CLData clData = { 0 };
+	if (!setupCL(clData, settings.deviceType))
+		exit(EXIT_FAILURE);
+
+	std::vector<BenchmarkResult> results;
+	bool failed = false;
+
+	// the image layout needs a device that can sample images
+	clData.tableImage = settings.tables[TABLE_LAYOUT_IMAGE] ? createTableImage(clData) : 0;
+	if (settings.tables[TABLE_LAYOUT_IMAGE] && clData.tableImage == 0)
+	{
+		printf("Device doesn't support images, skipping the image table layout\n");
+		settings.tables[TABLE_LAYOUT_IMAGE] = false;
+	}
+
+	for (int field = 0; field < FIELD_TYPE_COUNT; ++field)
+	for (int tables = 0; tables < TABLE_LAYOUT_COUNT; ++tables)
+	for (int mapping = 0; mapping < MAPPING_COUNT; ++mapping)
+	{
+		if (!settings.fields[field] || !settings.tables[tables] || !settings.mappings[mapping])
+			continue;
+
+		for (size_t gridSize : settings.gridSizes)
+		{
+			BenchmarkResult result = benchmarkCL(clData, settings, (FieldType)field, (TableLayout)tables, (CubeMapping)mapping, gridSize);
+			if (result.frameTime < 0)
+			{
+				failed = true;
+				continue;
+			}
+			printResult(result);
+			results.push_back(result);
+		}
+	}
+
+	printMappingComparison(results);
+
+	if (settings.useCPU && settings.fields[METABALLS])
+	{
+		CPUMCData cpuData;
+		createCPUMC(cpuData, settings.cpuThreads, 0);
+		for (size_t gridSize : settings.gridSizes)
+		{
+			BenchmarkResult result = benchmarkCPU(cpuData, settings, gridSize);
+			printResult(result);
+			results.push_back(result);
+		}
+		releaseCPUMC(cpuData);
+	}
+
+	if (settings.jsonPath != nullptr && !writeJSON(settings.jsonPath, clData, settings, results))
+		failed = true;
+
+	if (clData.tableImage != 0)
+		clReleaseMemObject(clData.tableImage);
+	releaseCL(clData);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+BenchmarkResult benchmarkCL(CLData& clData, const BenchmarkSettings& settings, FieldType field, TableLayout tables,
+							CubeMapping mapping, size_t gridSize)
+{
+	BenchmarkResult benchmark = { "opencl", field, tables, mapping, gridSize, 0, false, -1.0 };
+	cl_int result = CL_SUCCESS;
+
+	// compact positions are quantised relative to the side of the grid
+	char vertexOptions[64] = "";
+	if (settings.compactVertices)
+		sprintf(vertexOptions, " -D COMPACT_VERTICES -D POSITION_SCALE=(65535.0f/%i)", (int)gridSize);
+
+	char defines[256];
+	sprintf(defines, "%s%s%s%s", FIELD_OPTIONS[field], vertexOptions, TABLE_LAYOUT_OPTIONS[tables],
+			mapping == MAPPING_MORTON ? " -D MORTON_ORDER" : "");
+	cl_program program = buildProgram(clData, settings.kernelDir, defines);
+	if (program == 0)
+		return benchmark;
+
+	// without bricks, morton order launches the grid as a 1d range of bricks
+	bool morton = mapping == MAPPING_MORTON;
+	cl_kernel kernel = clCreateKernel(program, morton ? "marchingCubesMorton" : "marchingCubes", &result);
+	CL_CHECK(clCreateKernel, result);
+	cl_kernel brickKernel = clCreateKernel(program, "classifyBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+	cl_kernel brickMarchingCubesKernel = clCreateKernel(program, "marchingCubesBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	// the allocation total starts from nothing for each run
+	clData.allocated = 0;
+	clData.peakAllocated = 0;
+
+	size_t grid[3] = { gridSize, gridSize, gridSize };
+	size_t brickCount[3];
+	for (int i = 0; i < 3; ++i)
+		brickCount[i] = (gridSize + BRICK_SIZE - 1) / BRICK_SIZE;
+	size_t totalBricks = brickCount[0] * brickCount[1] * brickCount[2];
+	cl_int gridSizeArg[4] = { (cl_int)gridSize, (cl_int)gridSize, (cl_int)gridSize, 0 };
+
+	std::vector<glm::vec4> particles;
+	cl_float threshold = 0;
+	cl_float sphere[4] = { gridSize * 0.5f, gridSize * 0.5f, gridSize * 0.5f, gridSize * 0.4f };
+	cl_float noiseScale = 4.0f / gridSize;
+
+	cl_mem faceCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem activeBrickCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem activeBrickLink = settings.useBricks ? createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint) * totalBricks) : 0;
+	cl_mem particleLink = 0;
+	if (field == METABALLS)
+	{
+		particles = makeParticles(settings.particleCount, gridSize, 1);
+		threshold = metaballThreshold(gridSize);
+		particleLink = createBuffer(clData, CL_MEM_READ_ONLY, sizeof(glm::vec4) * particles.size());
+	}
+
+	// the field arguments trail every extraction kernel
+	cl_kernel fieldKernels[3] = { kernel, brickKernel, brickMarchingCubesKernel };
+	cl_uint firstFieldArgs[3] = { morton ? 5u : 4u, 4, 7 };
+	for (int i = 0; i < 3; ++i)
+	{
+		cl_uint arg = firstFieldArgs[i];
+		if (field == METABALLS)
+		{
+			cl_int particleCount = (cl_int)particles.size();
+			result = clSetKernelArg(fieldKernels[i], arg++, sizeof(cl_int), &particleCount);
+			result |= clSetKernelArg(fieldKernels[i], arg++, sizeof(cl_mem), &particleLink);
+		}
+		else if (field == SPHERE)
+			result = clSetKernelArg(fieldKernels[i], arg++, sizeof(cl_float) * 4, sphere);
+		else
+			result = clSetKernelArg(fieldKernels[i], arg++, sizeof(cl_float), &noiseScale);
+
+		// the image tables trail the field arguments of the kernels that polygonise
+		if (tables == TABLE_LAYOUT_IMAGE && fieldKernels[i] != brickKernel)
+			result |= clSetKernelArg(fieldKernels[i], arg++, sizeof(cl_mem), &clData.tableImage);
+		CL_CHECK(clSetKernelArg, result);
+	}
+
+	result = clSetKernelArg(kernel, 1, sizeof(cl_mem), &faceCountLink);
+	result |= clSetKernelArg(kernel, 3, sizeof(cl_float), &threshold);
+	if (morton)
+		result |= clSetKernelArg(kernel, 4, sizeof(cl_int) * 4, gridSizeArg);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(brickKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(brickKernel, 1, sizeof(cl_int) * 4, gridSizeArg);
+	result |= clSetKernelArg(brickKernel, 2, sizeof(cl_mem), &activeBrickCountLink);
+	result |= clSetKernelArg(brickKernel, 3, sizeof(cl_mem), &activeBrickLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(brickMarchingCubesKernel, 1, sizeof(cl_mem), &faceCountLink);
+	result |= clSetKernelArg(brickMarchingCubesKernel, 3, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(brickMarchingCubesKernel, 4, sizeof(cl_int) * 4, gridSizeArg);
+	result |= clSetKernelArg(brickMarchingCubesKernel, 5, sizeof(cl_mem), &activeBrickLink);
+	result |= clSetKernelArg(brickMarchingCubesKernel, 6, sizeof(cl_mem), &activeBrickCountLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	size_t vertexSize = settings.compactVertices ? COMPACT_VERTEX_SIZE : VERTEX_SIZE;
+	cl_uint maxFaceLimit = (cl_uint)glm::min(clData.maxAllocation / (vertexSize * 3), (cl_ulong)(1u << 31));
+	cl_uint maxFaces = 0;
+	cl_mem vertexLink = 0;
+	cl_uint faceCount = 0;
+	double frameTime = 0;
+
+	// the first pass runs with no room for triangles, which the kernels still
+	// count, to size the output exactly. the second is a warm-up
+	for (int frame = -2; frame < settings.frames; ++frame)
+	{
+		if (frame == -1)
+		{
+			maxFaces = glm::min(faceCount, maxFaceLimit);
+			benchmark.truncated = faceCount > maxFaceLimit;
+			releaseBuffer(clData, vertexLink);
+			vertexLink = 0;
+		}
+		if (vertexLink == 0)
+		{
+			// buffers can't be empty
+			vertexLink = createBuffer(clData, CL_MEM_WRITE_ONLY, glm::max(maxFaces, 1u) * vertexSize * 3);
+			result = clSetKernelArg(kernel, 0, sizeof(cl_int), &maxFaces);
+			result |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &vertexLink);
+			result |= clSetKernelArg(brickMarchingCubesKernel, 0, sizeof(cl_int), &maxFaces);
+			result |= clSetKernelArg(brickMarchingCubesKernel, 2, sizeof(cl_mem), &vertexLink);
+			CL_CHECK(clSetKernelArg, result);
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// event list in case we use out-of-order computations
+		cl_event writeEvents[3] = { 0, 0, 0 };
+		cl_event brickEvents[2] = { 0, 0 };
+		cl_event processEvent = 0;
+		cl_event readEvent = 0;
+
+		cl_uint zero = 0;
+		result = clEnqueueFillBuffer(clData.queue, faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, &writeEvents[0]);
+		CL_CHECK(clEnqueueFillBuffer, result);
+		result = clEnqueueFillBuffer(clData.queue, activeBrickCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, &writeEvents[1]);
+		CL_CHECK(clEnqueueFillBuffer, result);
+
+		// the particles are uploaded every frame as they would be when animated
+		cl_uint writeCount = 2;
+		if (particleLink != 0)
+		{
+			result = clEnqueueWriteBuffer(clData.queue, particleLink, CL_FALSE, 0, sizeof(glm::vec4) * particles.size(), particles.data(), 0, nullptr, &writeEvents[writeCount++]);
+			CL_CHECK(clEnqueueWriteBuffer, result);
+		}
+
+		if (settings.useBricks)
+		{
+			result = clEnqueueNDRangeKernel(clData.queue, brickKernel, 3, 0, brickCount, 0, writeCount, writeEvents, &brickEvents[0]);
+			CL_CHECK(clEnqueueNDRangeKernel, result);
+
+			// the active brick count stays on the device, so every brick of the
+			// grid is launched and the kernel skips those past the count
+			size_t globalWorkSize = totalBricks * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+			result = clEnqueueNDRangeKernel(clData.queue, brickMarchingCubesKernel, 1, 0, &globalWorkSize, 0, 1, &brickEvents[0], &processEvent);
+			CL_CHECK(clEnqueueNDRangeKernel, result);
+		}
+		else if (morton)
+		{
+			size_t globalWorkSize = totalBricks * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 1, 0, &globalWorkSize, 0, writeCount, writeEvents, &processEvent);
+			CL_CHECK(clEnqueueNDRangeKernel, result);
+		}
+		else
+		{
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 3, 0, grid, 0, writeCount, writeEvents, &processEvent);
+			CL_CHECK(clEnqueueNDRangeKernel, result);
+		}
+
+		result = clEnqueueReadBuffer(clData.queue, faceCountLink, CL_TRUE, 0, sizeof(cl_uint), &faceCount, 1, &processEvent, &readEvent);
+		CL_CHECK(clEnqueueReadBuffer, result);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		if (frame >= 0)
+		{
+			frameTime += std::chrono::duration<double, std::milli>(end - start).count();
+			for (cl_uint i = 0; i < writeCount; ++i)
+				benchmark.stageTime[STAGE_UPLOAD] += stageMilliseconds(writeEvents[i]);
+			for (int i = 0; i < 2; ++i)
+				benchmark.stageTime[STAGE_CLASSIFY] += stageMilliseconds(brickEvents[i]);
+			benchmark.stageTime[STAGE_POLYGONISE] += stageMilliseconds(processEvent);
+			benchmark.stageTime[STAGE_READBACK] += stageMilliseconds(readEvent);
+		}
+
+		for (cl_uint i = 0; i < writeCount; ++i)
+			clReleaseEvent(writeEvents[i]);
+		for (int i = 0; i < 2; ++i)
+			if (brickEvents[i] != 0)
+				clReleaseEvent(brickEvents[i]);
+		if (processEvent != 0)
+			clReleaseEvent(processEvent);
+		clReleaseEvent(readEvent);
+	}
+
+	benchmark.frameTime = frameTime / settings.frames;
+	for (int i = 0; i < STAGE_COUNT; ++i)
+		benchmark.stageTime[i] /= settings.frames;
+	benchmark.faceCount = faceCount;
+	benchmark.peakDeviceMemory = clData.peakAllocated;
+
+	releaseBuffer(clData, vertexLink);
+	releaseBuffer(clData, particleLink);
+	releaseBuffer(clData, activeBrickLink);
+	releaseBuffer(clData, activeBrickCountLink);
+	releaseBuffer(clData, faceCountLink);
+	clReleaseKernel(brickMarchingCubesKernel);
+	clReleaseKernel(brickKernel);
+	clReleaseKernel(kernel);
+	clReleaseProgram(program);
+
+	return benchmark;
+}
+
+BenchmarkResult benchmarkCPU(CPUMCData& cpuData, const BenchmarkSettings& settings, size_t gridSize)
+{
+	BenchmarkResult benchmark = { "cpu", METABALLS, TABLE_LAYOUT_FULL, MAPPING_ROWS, gridSize, 0, false, 0.0 };
+
+	size_t grid[3] = { gridSize, gridSize, gridSize };
+	std::vector<glm::vec4> particles = makeParticles(settings.particleCount, gridSize, 1);
+	float threshold = metaballThreshold(gridSize);
+
+	// size the output from a counting pass, then warm up
+	size_t faceCount = cpuMarchingCubes(cpuData, grid, threshold, particles.data(), (int)particles.size(), 0, nullptr);
+	std::vector<glm::vec4> vertices(faceCount * 6);
+
+	for (int frame = -1; frame < settings.frames; ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		faceCount = cpuMarchingCubes(cpuData, grid, threshold, particles.data(), (int)particles.size(), faceCount, vertices.data());
+		auto end = std::chrono::high_resolution_clock::now();
+
+		if (frame >= 0)
+			benchmark.frameTime += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// the cpu polygonises in a single stage
+	benchmark.frameTime /= settings.frames;
+	benchmark.stageTime[STAGE_POLYGONISE] = benchmark.frameTime;
+	benchmark.faceCount = (cl_uint)faceCount;
+
+	return benchmark;
+}
+
+double stageMilliseconds(cl_event event)
+{
+	if (event == 0)
+		return 0;
+
+	cl_ulong start = 0, end = 0;
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr);
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr);
+	return end > start ? (end - start) * 1e-6 : 0;
+}
+
+void printResult(const BenchmarkResult& result)
+{
+	double cubes = (double)result.gridSize * result.gridSize * result.gridSize;
+	printf("%-6s %-9s %-6s %-6s %4i^3: %9.3f ms/frame, %8.2f M cubes/s, %8.2f M tris/s, %u triangles%s, %.1f MB\n",
+		result.backend, FIELD_NAMES[result.field], TABLE_LAYOUT_NAMES[result.tables], MAPPING_NAMES[result.mapping],
+		(int)result.gridSize, result.frameTime,
+		cubes / (result.frameTime * 1000.0), result.faceCount / (result.frameTime * 1000.0),
+		result.faceCount, result.truncated ? " (truncated)" : "", result.peakDeviceMemory / (1024.0 * 1024.0));
+	printf("       stages:");
+	for (int i = 0; i < STAGE_COUNT; ++i)
+		printf(" %s %.3f ms", STAGE_NAMES[i], result.stageTime[i]);
+	printf("\n");
+}
+
+void printMappingComparison(const std::vector<BenchmarkResult>& results)
+{
+	for (const BenchmarkResult& morton : results)
+	{
+		if (morton.mapping != MAPPING_MORTON)
+			continue;
+
+		for (const BenchmarkResult& rows : results)
+		{
+			if (rows.mapping != MAPPING_ROWS || rows.field != morton.field || rows.tables != morton.tables ||
+				rows.gridSize != morton.gridSize)
+				continue;
+
+			printf("morton vs rows %-9s %-6s %4i^3: %9.3f ms/frame against %9.3f, %.2fx\n",
+				FIELD_NAMES[morton.field], TABLE_LAYOUT_NAMES[morton.tables], (int)morton.gridSize,
+				morton.frameTime, rows.frameTime, rows.frameTime / morton.frameTime);
+		}
+	}
+}
+
+bool writeJSON(const char* path, const CLData& clData, const BenchmarkSettings& settings, const std::vector<BenchmarkResult>& results)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		printf("Unable to write %s\n", path);
+		return false;
+	}
+
+	// device names are plain text, but strip anything that would need escaping
+	char deviceName[256] = "";
+	clGetDeviceInfo(clData.device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, nullptr);
+	for (char* c = deviceName; *c != 0; ++c)
+		if (*c == '"' || *c == '\\' || *c < ' ')
+			*c = ' ';
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"device\": \"%s\",\n", deviceName);
+	fprintf(file, "\t\"frames\": %i,\n", settings.frames);
+	fprintf(file, "\t\"particles\": %i,\n", settings.particleCount);
+	fprintf(file, "\t\"bricks\": %s,\n", settings.useBricks ? "true" : "false");
+	fprintf(file, "\t\"compactVertices\": %s,\n", settings.compactVertices ? "true" : "false");
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& result = results[i];
+		double cubes = (double)result.gridSize * result.gridSize * result.gridSize;
+
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"backend\": \"%s\",\n", result.backend);
+		fprintf(file, "\t\t\t\"field\": \"%s\",\n", FIELD_NAMES[result.field]);
+		fprintf(file, "\t\t\t\"tables\": \"%s\",\n", TABLE_LAYOUT_NAMES[result.tables]);
+		fprintf(file, "\t\t\t\"mapping\": \"%s\",\n", MAPPING_NAMES[result.mapping]);
+		fprintf(file, "\t\t\t\"grid\": %i,\n", (int)result.gridSize);
+		fprintf(file, "\t\t\t\"triangles\": %u,\n", result.faceCount);
+		fprintf(file, "\t\t\t\"truncated\": %s,\n", result.truncated ? "true" : "false");
+		fprintf(file, "\t\t\t\"msPerFrame\": %.6f,\n", result.frameTime);
+		fprintf(file, "\t\t\t\"cubesPerSecond\": %.1f,\n", cubes * 1000.0 / result.frameTime);
+		fprintf(file, "\t\t\t\"trianglesPerSecond\": %.1f,\n", result.faceCount * 1000.0 / result.frameTime);
+		fprintf(file, "\t\t\t\"stageMs\": {");
+		for (int j = 0; j < STAGE_COUNT; ++j)
+			fprintf(file, "%s \"%s\": %.6f", j > 0 ? "," : "", STAGE_NAMES[j], result.stageTime[j]);
+		fprintf(file, " },\n");
+		fprintf(file, "\t\t\t\"peakDeviceBytes\": %llu\n", (unsigned long long)result.peakDeviceMemory);
+		fprintf(file, "\t\t}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+
+	fclose(file);
+	printf("Results written to %s\n", path);
+	return true;
+}
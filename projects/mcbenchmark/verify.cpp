@@ -0,0 +1,1412 @@
+// differential test of the marching cubes kernels against the cpu reference
+//
+// runs every extraction path of marchingcubes.cl over a set of metaball fields
+// and compares the triangles with cpuMarchingCubes over the same field. the
+// dense, bricks, tiled, morton and level of detail paths run at full
+// resolution, each with float and compact vertices and each lookup table
+// layout. sparse voxel hashing runs with float vertices, starting from a pool
+// too small for any of the fields so that it grows the pool too, and only its
+// triangles within the grid are compared.
+//
+// the kernels append triangles in whatever order their atomics resolve, and
+// compact vertices and differing float evaluation move positions slightly, so
+// both meshes are first canonicalised: each triangle is rotated to start at
+// its smallest quantised vertex, keeping its winding, and the triangles are
+// sorted by their quantised positions. they are then compared by
+//
+//		triangle count
+//		unmatched triangles, which have no triangle in the other mesh with the
+//		same winding and all three vertices within the distance bound
+//		the hausdorff distance between the vertex sets
+//		the largest angle between the normals of corresponding vertices
+//
+// and the process fails if any run is out of bounds, so it can gate changes to
+// the kernels. -dump writes the canonical meshes of failing runs as obj files,
+// which diff line by line.
+//
+// the reference is checked first, with the same bounds, against the field
+// polygonised a cube at a time by a plain loop without cpuMarchingCubes'
+// threads and vectorisation.
+//
+// surface nets don't place their vertices where marching cubes does, and
+// neither do level of detail blocks split into more than one level, so these
+// are checked for holes instead: once coincident vertices are welded, every
+// edge away from the faces of the grid must be shared by a triangle running it
+// each way. the split blocks are only sound if the transition cells close the
+// cracks between the levels.
+//
+// the simplifier the exporter uses is checked on a closed sphere, which has
+// to come out with fewer triangles and still closed, every edge shared by
+// exactly one triangle running it each way.
+
+#include "headless.h"
+#include "cpumc.h"
+#include "lod.h"
+#include "nets.h"
+#include "simplify.h"
+#include "sparse.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+enum ExtractionPath
+{
+	PATH_DENSE,
+	PATH_BRICKS,
+	PATH_TILED,
+	PATH_MORTON,
+	PATH_LOD,
+	PATH_SPARSE,
+
+	PATH_COUNT
+};
+
+const char* PATH_NAMES[PATH_COUNT] = { "dense", "bricks", "tiled", "morton", "lod", "sparse" };
+const char* PATH_KERNELS[PATH_COUNT] = { "marchingCubes", "marchingCubesBricks", "marchingCubesTiled", "marchingCubesMorton", "marchingCubesLod", "marchingCubesSparse" };
+
+// blocks are split while the lower corner of the grid is closer than this
+// times their size, which always splits the block at the corner and none of
+// the others it's split into, so every grid bigger than a level 1 block has
+// more than one level
+const float LOD_SPLIT_DISTANCE = 0.5f;
+
+// blocks the sparse pool starts with, few enough that every field grows it
+const cl_uint SPARSE_START_BLOCKS = 8;
+
+// frames of sparse extraction to track the surface and grow the pool in
+const int SPARSE_FRAMES = 16;
+
+// times the octahedron is split into four for the sphere that is simplified,
+// giving 8 * 4^n triangles, and the fraction of them to simplify down to
+const int SIMPLIFY_SUBDIVISIONS = 4;
+const float SIMPLIFY_RATIO = 0.25f;
+
+struct VerifySettings
+{
+	std::vector<size_t>	gridSizes;
+	std::vector<int>	particleCounts;
+	int					seeds;				// fields per grid size and particle count
+	bool				tables[TABLE_LAYOUT_COUNT];
+	cl_device_type		deviceType;
+	std::string			kernelDir;
+	unsigned int		cpuThreads;
+	const char*			dumpDir;
+
+	float				quantum;			// cubes per step when quantising positions for the canonical order
+	float				distanceBound;		// cubes
+	float				normalBound;		// degrees
+	float				countTolerance;		// fraction of the reference triangles that may differ or go unmatched
+};
+
+// triangle soup with a position and normal per vertex, 3 vertices per triangle
+struct Mesh
+{
+	std::vector<glm::vec3>	positions;
+	std::vector<glm::vec3>	normals;
+};
+
+struct Comparison
+{
+	size_t	referenceTriangles;
+	size_t	testTriangles;
+	size_t	unmatchedTriangles;		// in either direction
+	float	hausdorffDistance;
+	float	normalDeviation;		// degrees
+};
+
+// vertices bucketed into unit cells, the size of a cube, for nearest-vertex queries
+typedef std::unordered_map<unsigned long long, std::vector<unsigned int>> VertexGrid;
+
+// polygonises the field with one of the kernels, sized exactly from a counting pass
+bool extractCL(CLData& clData, cl_program program, ExtractionPath path, bool compact, TableLayout tables,
+			   size_t gridSize, cl_float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh);
+
+// tracks the surface with sparse voxel hashing from a small pool, repeating
+// until the pool and the triangles fit, and keeps the triangles within the grid
+bool extractSparse(CLData& clData, cl_program program, TableLayout tables, size_t gridSize, cl_float threshold,
+				   const std::vector<glm::vec4>& particles, Mesh& mesh);
+
+// polygonises the field with level of detail blocks of two levels or more,
+// split around the grid's lower corner, and the transition cells between them
+bool extractLodStitched(CLData& clData, cl_program program, bool compact, TableLayout tables, size_t gridSize,
+						cl_float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh, size_t& transitionCount);
+
+// polygonises the field as a surface net, repeating until the vertices and triangles fit
+bool extractNets(CLData& clData, cl_program program, bool compact, size_t gridSize, cl_float threshold,
+				 const std::vector<glm::vec4>& particles, Mesh& mesh);
+
+// reads faceCount triangles back from a vertex buffer in either format
+bool readVertices(CLData& clData, cl_mem vertexLink, cl_uint faceCount, bool compact, size_t gridSize, Mesh& mesh);
+
+void extractCPU(CPUMCData& cpuData, size_t gridSize, float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh);
+
+// polygonises the field one cube at a time with none of cpuMarchingCubes' slabs,
+// shared corners or vectorisation, so it can check the reference itself
+void extractBruteForce(size_t gridSize, float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh);
+
+// inverse of the kernel's octahedralEncode
+glm::vec3 octahedralDecode(float x, float y);
+
+// rotates and sorts the triangles into an order that only depends on their quantised positions
+void canonicaliseMesh(Mesh& mesh, float quantum);
+
+Comparison compareMeshes(const Mesh& reference, const Mesh& test, float distanceBound);
+
+// edges that aren't matched by one running the other way once the vertices
+// within weldDistance are welded, leaving out those within a cube of the faces
+// of the grid where every extraction leaves the surface open
+size_t countOpenEdges(const Mesh& mesh, float weldDistance, size_t gridSize);
+
+bool writeOBJ(const char* path, const Mesh& mesh);
+
+// unit sphere made by splitting an octahedron's triangles into four and
+// pushing the new vertices out onto the sphere, closed and sharing its vertices
+void makeSphere(int subdivisions, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices);
+
+// edges of an indexed mesh that aren't shared by exactly one triangle running
+// them each way, 0 for a closed manifold surface
+size_t countUnpairedEdges(const std::vector<unsigned int>& indices);
+
+// simplifies a sphere and checks it has fewer triangles and is still closed
+bool verifySimplify(const VerifySettings& settings);
+
+// prints a run's PASS or FAIL line, the rest of it formatted like printf, and returns pass
+bool report(const char* name, bool pass, const char* format, ...);
+
+// compares a mesh with its reference within the settings' bounds and reports
+// it, dumping both meshes as dumpName with the suffixes if it fails
+bool compareAndReport(const VerifySettings& settings, const char* name, const Mesh& reference, const Mesh& test,
+					  const std::string& dumpName, const char* referenceSuffix, const char* testSuffix);
+
+// writes mesh to dumpName.obj in the dump directory, if there is one
+void dumpMesh(const VerifySettings& settings, const std::string& dumpName, const Mesh& mesh);
+
+int main(int argc, char* argv[])
+{
+	VerifySettings settings;
+	settings.gridSizes = { 32, 61 };
+	settings.particleCounts = { 1, 8, 32 };
+	settings.seeds = 2;
+	for (int i = 0; i < TABLE_LAYOUT_COUNT; ++i)
+		settings.tables[i] = true;
+	settings.deviceType = CL_DEVICE_TYPE_DEFAULT;
+	settings.kernelDir = KERNEL_DIR;
+	settings.cpuThreads = 0;
+	settings.dumpDir = nullptr;
+	settings.quantum = 1.0f / 64;
+	settings.distanceBound = 0.01f;
+	settings.normalBound = 2.0f;
+	settings.countTolerance = 0.001f;
+
+	// command-line options
+	// -grids a,b			cubes along each side of the grids to test (default 32,61)
+	// -particles a,b		metaball counts to test (default 1,8,32)
+	// -seeds n				particle placements per grid size and count
+	// -tables a,b			lookup table layouts to test out of full, packed, local and image (default all)
+	// -device cpu|gpu|all	type of opencl device to run on (default the platform default)
+	// -kernels dir			directory holding marchingcubes.cl and mctables.h
+	// -threads n			cpu threads, including the main thread (default one per hardware thread)
+	// -bound d				largest distance, in cubes, between corresponding vertices
+	// -normalbound a		largest angle, in degrees, between corresponding normals
+	// -tolerance f			fraction of triangles that may differ in count or go unmatched
+	// -dump dir			write the canonical meshes of failing runs to obj files
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-grids") == 0 && i + 1 < argc)
+		{
+			settings.gridSizes.clear();
+			std::stringstream list(argv[++i]);
+			std::string size;
+			while (std::getline(list, size, ','))
+				if (atoi(size.c_str()) > 0)
+					settings.gridSizes.push_back(atoi(size.c_str()));
+		}
+		else if (strcmp(argv[i], "-particles") == 0 && i + 1 < argc)
+		{
+			settings.particleCounts.clear();
+			std::stringstream list(argv[++i]);
+			std::string count;
+			while (std::getline(list, count, ','))
+				if (atoi(count.c_str()) > 0)
+					settings.particleCounts.push_back(atoi(count.c_str()));
+		}
+		else if (strcmp(argv[i], "-tables") == 0 && i + 1 < argc)
+		{
+			for (int j = 0; j < TABLE_LAYOUT_COUNT; ++j)
+				settings.tables[j] = false;
+			std::stringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+				for (int j = 0; j < TABLE_LAYOUT_COUNT; ++j)
+					if (name == TABLE_LAYOUT_NAMES[j])
+						settings.tables[j] = true;
+		}
+		else if (strcmp(argv[i], "-seeds") == 0 && i + 1 < argc)
+			settings.seeds = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-device") == 0 && i + 1 < argc)
+			settings.deviceType = parseDeviceType(argv[++i]);
+		else if (strcmp(argv[i], "-kernels") == 0 && i + 1 < argc)
+			settings.kernelDir = argv[++i];
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			settings.cpuThreads = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-bound") == 0 && i + 1 < argc)
+			settings.distanceBound = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-normalbound") == 0 && i + 1 < argc)
+			settings.normalBound = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc)
+			settings.countTolerance = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-dump") == 0 && i + 1 < argc)
+			settings.dumpDir = argv[++i];
+	}
+
+	CLData clData = { 0 };
+	if (!setupCL(clData, settings.deviceType))
+		exit(EXIT_FAILURE);
+
+	// the image layout needs a device that can sample images
+	clData.tableImage = settings.tables[TABLE_LAYOUT_IMAGE] ? createTableImage(clData) : 0;
+	if (settings.tables[TABLE_LAYOUT_IMAGE] && clData.tableImage == 0)
+	{
+		printf("Device doesn't support images, skipping the image table layout\n");
+		settings.tables[TABLE_LAYOUT_IMAGE] = false;
+	}
+
+	CPUMCData cpuData;
+	createCPUMC(cpuData, settings.cpuThreads, 0);
+
+	// surface nets don't read the tables, so they run with the first layout's programs
+	int netTables = 0;
+	while (netTables < TABLE_LAYOUT_COUNT && !settings.tables[netTables])
+		netTables++;
+
+	int runs = 1;
+	int failures = verifySimplify(settings) ? 0 : 1;
+
+	for (size_t gridSize : settings.gridSizes)
+	{
+		// compact positions are quantised relative to the side of the grid, so
+		// the compact programs are built per grid size
+		char compactOptions[64];
+		sprintf(compactOptions, " -D COMPACT_VERTICES -D POSITION_SCALE=(65535.0f/%i)", (int)gridSize);
+		cl_program programs[TABLE_LAYOUT_COUNT][2] = {};
+		bool built = true;
+		for (int tables = 0; tables < TABLE_LAYOUT_COUNT; ++tables)
+		{
+			if (!settings.tables[tables])
+				continue;
+
+			std::string options[2] = { TABLE_LAYOUT_OPTIONS[tables], std::string(compactOptions) + TABLE_LAYOUT_OPTIONS[tables] };
+			for (int compact = 0; compact < 2; ++compact)
+			{
+				programs[tables][compact] = buildProgram(clData, settings.kernelDir, options[compact].c_str());
+				built = built && programs[tables][compact] != 0;
+			}
+		}
+		if (!built)
+		{
+			failures++;
+			for (auto& layoutPrograms : programs)
+				for (cl_program program : layoutPrograms)
+					if (program != 0)
+						clReleaseProgram(program);
+			continue;
+		}
+
+		float threshold = metaballThreshold(gridSize);
+
+		for (int particleCount : settings.particleCounts)
+		for (int seed = 1; seed <= settings.seeds; ++seed)
+		{
+			std::vector<glm::vec4> particles = makeParticles(particleCount, gridSize, seed);
+
+			Mesh reference;
+			extractCPU(cpuData, gridSize, threshold, particles, reference);
+			canonicaliseMesh(reference, settings.quantum);
+
+			// the reference is only as good as its threads and vectorisation, so it
+			// is held to the same bounds against the plainest possible loop
+			{
+				char name[128];
+				sprintf(name, "%i^3 %2i particles seed %i %-6s", (int)gridSize, particleCount, seed, "cpu");
+				runs++;
+
+				Mesh bruteForce;
+				extractBruteForce(gridSize, threshold, particles, bruteForce);
+				canonicaliseMesh(bruteForce, settings.quantum);
+
+				char dumpName[128];
+				sprintf(dumpName, "%i_%i_%i_cpu", (int)gridSize, particleCount, seed);
+				if (!compareAndReport(settings, name, bruteForce, reference, dumpName, "_brute", "_cpu"))
+					failures++;
+			}
+
+			for (int tables = 0; tables < TABLE_LAYOUT_COUNT; ++tables)
+			for (int compact = 0; compact < 2; ++compact)
+			for (int path = 0; path < PATH_COUNT; ++path)
+			{
+				if (!settings.tables[tables])
+					continue;
+
+				// compact positions only cover the grid, and a sparse surface isn't bounded by one
+				if (path == PATH_SPARSE && compact)
+					continue;
+
+				char name[128];
+				sprintf(name, "%i^3 %2i particles seed %i %-6s %-7s %s", (int)gridSize, particleCount, seed,
+					PATH_NAMES[path], compact ? "compact" : "float", TABLE_LAYOUT_NAMES[tables]);
+				runs++;
+
+				Mesh test;
+				if (!extractCL(clData, programs[tables][compact], (ExtractionPath)path, compact != 0, (TableLayout)tables,
+							   gridSize, threshold, particles, test))
+				{
+					report(name, false, "extraction failed");
+					failures++;
+					continue;
+				}
+				canonicaliseMesh(test, settings.quantum);
+
+				char dumpName[128];
+				sprintf(dumpName, "%i_%i_%i_%s_%s_%s", (int)gridSize, particleCount, seed,
+					PATH_NAMES[path], compact ? "compact" : "float", TABLE_LAYOUT_NAMES[tables]);
+				if (!compareAndReport(settings, name, reference, test, dumpName, "_cpu", "_cl"))
+					failures++;
+			}
+
+			// blocks of different levels don't place their vertices where the
+			// reference does either, so the stitched mesh is checked for holes
+			for (int tables = 0; tables < TABLE_LAYOUT_COUNT; ++tables)
+			for (int compact = 0; compact < 2; ++compact)
+			{
+				if (!settings.tables[tables] || gridSize <= LOD_BLOCK_SIZE * 2)
+					continue;
+
+				char name[128];
+				sprintf(name, "%i^3 %2i particles seed %i %-6s %-7s %s", (int)gridSize, particleCount, seed,
+					"lod2", compact ? "compact" : "float", TABLE_LAYOUT_NAMES[tables]);
+				runs++;
+
+				Mesh stitched;
+				size_t transitionCount = 0;
+				if (!extractLodStitched(clData, programs[tables][compact], compact != 0, (TableLayout)tables, gridSize,
+										threshold, particles, stitched, transitionCount))
+				{
+					report(name, false, "extraction failed");
+					failures++;
+					continue;
+				}
+
+				size_t openEdges = countOpenEdges(stitched, settings.distanceBound, gridSize);
+				bool pass = openEdges == 0 && transitionCount > 0 && stitched.positions.empty() == reference.positions.empty();
+
+				if (!report(name, pass, "%u triangles, %u transition faces, %u open edges",
+							(unsigned int)(stitched.positions.size() / 3), (unsigned int)transitionCount, (unsigned int)openEdges))
+				{
+					failures++;
+
+					char dumpName[128];
+					sprintf(dumpName, "%i_%i_%i_lod2_%s_%s", (int)gridSize, particleCount, seed,
+						compact ? "compact" : "float", TABLE_LAYOUT_NAMES[tables]);
+					dumpMesh(settings, dumpName, stitched);
+				}
+			}
+
+			// a surface net has a quad where marching cubes has a cube's
+			// triangles, so it is checked for holes rather than against the reference
+			for (int compact = 0; compact < 2 && netTables < TABLE_LAYOUT_COUNT; ++compact)
+			{
+				char name[128];
+				sprintf(name, "%i^3 %2i particles seed %i %-6s %-7s", (int)gridSize, particleCount, seed,
+					"nets", compact ? "compact" : "float");
+				runs++;
+
+				Mesh nets;
+				if (!extractNets(clData, programs[netTables][compact], compact != 0, gridSize, threshold, particles, nets))
+				{
+					report(name, false, "extraction failed");
+					failures++;
+					continue;
+				}
+
+				size_t openEdges = countOpenEdges(nets, settings.distanceBound, gridSize);
+				bool pass = openEdges == 0 && nets.positions.empty() == reference.positions.empty();
+
+				if (!report(name, pass, "%u triangles, %u open edges", (unsigned int)(nets.positions.size() / 3), (unsigned int)openEdges))
+				{
+					failures++;
+
+					char dumpName[128];
+					sprintf(dumpName, "%i_%i_%i_nets_%s", (int)gridSize, particleCount, seed, compact ? "compact" : "float");
+					dumpMesh(settings, dumpName, nets);
+				}
+			}
+		}
+
+		for (auto& layoutPrograms : programs)
+			for (cl_program program : layoutPrograms)
+				if (program != 0)
+					clReleaseProgram(program);
+	}
+
+	releaseCPUMC(cpuData);
+	if (clData.tableImage != 0)
+		clReleaseMemObject(clData.tableImage);
+	releaseCL(clData);
+
+	printf("%i of %i runs passed\n", runs - failures, runs);
+	return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+bool extractCL(CLData& clData, cl_program program, ExtractionPath path, bool compact, TableLayout tables,
+			   size_t gridSize, cl_float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh)
+{
+	if (path == PATH_SPARSE)
+		return extractSparse(clData, program, tables, gridSize, threshold, particles, mesh);
+
+	cl_int result = CL_SUCCESS;
+
+	cl_kernel kernel = clCreateKernel(program, PATH_KERNELS[path], &result);
+	CL_CHECK(clCreateKernel, result);
+	cl_kernel brickKernel = clCreateKernel(program, "classifyBricks", &result);
+	CL_CHECK(clCreateKernel, result);
+
+	size_t grid[3] = { gridSize, gridSize, gridSize };
+	size_t brickCount[3];
+	for (int i = 0; i < 3; ++i)
+		brickCount[i] = (gridSize + BRICK_SIZE - 1) / BRICK_SIZE;
+	cl_int gridSizeArg[4] = { (cl_int)gridSize, (cl_int)gridSize, (cl_int)gridSize, 0 };
+	cl_int particleCount = (cl_int)particles.size();
+
+	cl_mem faceCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem activeBrickCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem activeBrickLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint) * brickCount[0] * brickCount[1] * brickCount[2]);
+	cl_mem particleLink = createBuffer(clData, CL_MEM_READ_ONLY, sizeof(glm::vec4) * particles.size());
+	result = clEnqueueWriteBuffer(clData.queue, particleLink, CL_TRUE, 0, sizeof(glm::vec4) * particles.size(), particles.data(), 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+
+	// level of detail blocks covering the grid, every one at the finest level
+	std::vector<cl_int4> lodBlocks;
+	for (size_t z = 0; z < gridSize; z += LOD_BLOCK_SIZE)
+	for (size_t y = 0; y < gridSize; y += LOD_BLOCK_SIZE)
+	for (size_t x = 0; x < gridSize; x += LOD_BLOCK_SIZE)
+		lodBlocks.push_back({ { (cl_int)x, (cl_int)y, (cl_int)z, 0 } });
+	cl_mem lodBlockLink = createBuffer(clData, CL_MEM_READ_ONLY, sizeof(cl_int4) * lodBlocks.size());
+	result = clEnqueueWriteBuffer(clData.queue, lodBlockLink, CL_TRUE, 0, sizeof(cl_int4) * lodBlocks.size(), lodBlocks.data(), 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+
+	// the largest cube of a tile that fits in a work-group
+	size_t tileSize[3] = { 8, 8, 8 };
+	size_t tiledGridSize[3];
+	size_t maxGroupSize = 0;
+	clGetKernelWorkGroupInfo(kernel, clData.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, nullptr);
+	while (tileSize[0] > 1 && tileSize[0] * tileSize[0] * tileSize[0] > maxGroupSize)
+		tileSize[0] = tileSize[1] = tileSize[2] = tileSize[0] / 2;
+	for (int i = 0; i < 3; ++i)
+		tiledGridSize[i] = (gridSize + tileSize[i] - 1) / tileSize[i] * tileSize[i];
+
+	// the field arguments trail every extraction kernel
+	cl_uint firstFieldArg = path == PATH_DENSE ? 4 : path == PATH_MORTON ? 5 : path == PATH_BRICKS ? 7 : 6;
+	result = clSetKernelArg(kernel, 1, sizeof(cl_mem), &faceCountLink);
+	result |= clSetKernelArg(kernel, 3, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(kernel, firstFieldArg, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(kernel, firstFieldArg + 1, sizeof(cl_mem), &particleLink);
+	if (tables == TABLE_LAYOUT_IMAGE)
+		result |= clSetKernelArg(kernel, firstFieldArg + 2, sizeof(cl_mem), &clData.tableImage);
+	if (path != PATH_DENSE)
+		result |= clSetKernelArg(kernel, 4, sizeof(cl_int) * 4, gridSizeArg);
+	if (path == PATH_BRICKS)
+	{
+		result |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &activeBrickLink);
+		result |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &activeBrickCountLink);
+	}
+	else if (path == PATH_TILED)
+		result |= clSetKernelArg(kernel, 5, sizeof(cl_float) * (tileSize[0] + 1) * (tileSize[1] + 1) * (tileSize[2] + 1), nullptr);
+	else if (path == PATH_LOD)
+		result |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &lodBlockLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	result = clSetKernelArg(brickKernel, 0, sizeof(cl_float), &threshold);
+	result |= clSetKernelArg(brickKernel, 1, sizeof(cl_int) * 4, gridSizeArg);
+	result |= clSetKernelArg(brickKernel, 2, sizeof(cl_mem), &activeBrickCountLink);
+	result |= clSetKernelArg(brickKernel, 3, sizeof(cl_mem), &activeBrickLink);
+	result |= clSetKernelArg(brickKernel, 4, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(brickKernel, 5, sizeof(cl_mem), &particleLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the first pass has no room for triangles but still counts them all,
+	// the second writes them into a buffer of exactly that size
+	size_t vertexSize = compact ? COMPACT_VERTEX_SIZE : VERTEX_SIZE;
+	cl_uint faceCount = 0;
+	cl_uint maxFaces = 0;
+	cl_mem vertexLink = 0;
+	bool success = true;
+
+	for (int pass = 0; pass < 2 && success; ++pass)
+	{
+		if (pass == 1)
+		{
+			maxFaces = faceCount;
+			if ((cl_ulong)maxFaces * vertexSize * 3 > clData.maxAllocation)
+			{
+				printf("%u triangles won't fit in a buffer\n", maxFaces);
+				success = false;
+				break;
+			}
+		}
+
+		// buffers can't be empty
+		releaseBuffer(clData, vertexLink);
+		vertexLink = createBuffer(clData, CL_MEM_WRITE_ONLY, glm::max(maxFaces, 1u) * vertexSize * 3);
+		result = clSetKernelArg(kernel, 0, sizeof(cl_int), &maxFaces);
+		result |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &vertexLink);
+		CL_CHECK(clSetKernelArg, result);
+
+		cl_uint zero = 0;
+		result = clEnqueueFillBuffer(clData.queue, faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, nullptr);
+		result |= clEnqueueFillBuffer(clData.queue, activeBrickCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueFillBuffer, result);
+
+		if (path == PATH_BRICKS)
+		{
+			result = clEnqueueNDRangeKernel(clData.queue, brickKernel, 3, 0, brickCount, 0, 0, nullptr, nullptr);
+			CL_CHECK(clEnqueueNDRangeKernel, result);
+
+			// every brick of the grid, as the app launches it, the kernel skips those past the count
+			size_t globalWorkSize = brickCount[0] * brickCount[1] * brickCount[2] * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 1, 0, &globalWorkSize, 0, 0, nullptr, nullptr);
+		}
+		else if (path == PATH_TILED)
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 3, 0, tiledGridSize, tileSize, 0, nullptr, nullptr);
+		else if (path == PATH_MORTON)
+		{
+			size_t globalWorkSize = brickCount[0] * brickCount[1] * brickCount[2] * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 1, 0, &globalWorkSize, 0, 0, nullptr, nullptr);
+		}
+		else if (path == PATH_LOD)
+		{
+			size_t globalWorkSize = lodBlocks.size() * LOD_BLOCK_SIZE * LOD_BLOCK_SIZE * LOD_BLOCK_SIZE;
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 1, 0, &globalWorkSize, 0, 0, nullptr, nullptr);
+		}
+		else
+			result = clEnqueueNDRangeKernel(clData.queue, kernel, 3, 0, grid, 0, 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueNDRangeKernel, result);
+
+		result |= clEnqueueReadBuffer(clData.queue, faceCountLink, CL_TRUE, 0, sizeof(cl_uint), &faceCount, 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueReadBuffer, result);
+		success = result == CL_SUCCESS;
+	}
+
+	// the count of the second pass must agree with the first
+	if (success && faceCount != maxFaces)
+	{
+		printf("Counted %u triangles then %u\n", maxFaces, faceCount);
+		success = false;
+	}
+
+	if (success)
+		success = readVertices(clData, vertexLink, faceCount, compact, gridSize, mesh);
+
+	releaseBuffer(clData, vertexLink);
+	releaseBuffer(clData, lodBlockLink);
+	releaseBuffer(clData, particleLink);
+	releaseBuffer(clData, activeBrickLink);
+	releaseBuffer(clData, activeBrickCountLink);
+	releaseBuffer(clData, faceCountLink);
+	clReleaseKernel(brickKernel);
+	clReleaseKernel(kernel);
+
+	return success;
+}
+
+bool extractSparse(CLData& clData, cl_program program, TableLayout tables, size_t gridSize, cl_float threshold,
+				   const std::vector<glm::vec4>& particles, Mesh& mesh)
+{
+	cl_int result = CL_SUCCESS;
+
+	SparseData sparse;
+	if (!createSparse(sparse, clData.context, program, BRICK_SIZE, SPARSE_START_BLOCKS, threshold))
+		return false;
+
+	cl_int particleCount = (cl_int)particles.size();
+	cl_mem faceCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem particleLink = createBuffer(clData, CL_MEM_READ_ONLY, sizeof(glm::vec4) * particles.size());
+	result = clEnqueueWriteBuffer(clData.queue, particleLink, CL_TRUE, 0, sizeof(glm::vec4) * particles.size(), particles.data(), 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+
+	// the particles seed the surface as well as make the field
+	result = clSetKernelArg(sparse.seedKernel, 2, sizeof(cl_mem), &particleLink);
+	result |= clSetKernelArg(sparse.seedKernel, 9, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(sparse.seedKernel, 10, sizeof(cl_mem), &particleLink);
+	result |= clSetKernelArg(sparse.sampleKernel, 4, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(sparse.sampleKernel, 5, sizeof(cl_mem), &particleLink);
+	result |= clSetKernelArg(sparse.extractKernel, 1, sizeof(cl_mem), &faceCountLink);
+	result |= clSetKernelArg(sparse.extractKernel, 8, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(sparse.extractKernel, 9, sizeof(cl_mem), &particleLink);
+	if (tables == TABLE_LAYOUT_IMAGE)
+		result |= clSetKernelArg(sparse.extractKernel, 10, sizeof(cl_mem), &clData.tableImage);
+	CL_CHECK(clSetKernelArg, result);
+
+	// each frame grows the pool from the counts of the one before, and sizes
+	// the vertex buffer from its triangle count, until a frame has room for both
+	cl_uint faceCount = 0;
+	cl_uint maxFaces = 0;
+	cl_mem vertexLink = 0;
+	bool fits = false;
+	bool success = true;
+
+	for (int frame = 0; frame < SPARSE_FRAMES && success && !fits; ++frame)
+	{
+		maxFaces = faceCount;
+		if ((cl_ulong)maxFaces * VERTEX_SIZE * 3 > clData.maxAllocation)
+		{
+			printf("%u triangles won't fit in a buffer\n", maxFaces);
+			success = false;
+			break;
+		}
+
+		// buffers can't be empty
+		releaseBuffer(clData, vertexLink);
+		vertexLink = createBuffer(clData, CL_MEM_WRITE_ONLY, glm::max(maxFaces, 1u) * VERTEX_SIZE * 3);
+		result = clSetKernelArg(sparse.extractKernel, 0, sizeof(cl_int), &maxFaces);
+		result |= clSetKernelArg(sparse.extractKernel, 2, sizeof(cl_mem), &vertexLink);
+		CL_CHECK(clSetKernelArg, result);
+
+		cl_uint zero = 0;
+		result = clEnqueueFillBuffer(clData.queue, faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueFillBuffer, result);
+
+		enqueueExtractSparse(sparse, clData.queue, (cl_uint)particles.size(), 0, nullptr, nullptr);
+
+		result = clEnqueueReadBuffer(clData.queue, faceCountLink, CL_TRUE, 0, sizeof(cl_uint), &faceCount, 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueReadBuffer, result);
+		result |= clFinish(clData.queue);
+		success = result == CL_SUCCESS;
+
+		// the counts have landed with the queue finished
+		fits = faceCount <= maxFaces && sparse.pendingCounters[SPARSE_FAILED_COUNT] == 0;
+	}
+
+	if (success && !fits)
+	{
+		printf("Sparse pool still didn't fit after %i frames, %u blocks\n", SPARSE_FRAMES, sparse.blockCapacity);
+		success = false;
+	}
+
+	if (success)
+		success = readVertices(clData, vertexLink, faceCount, false, gridSize, mesh);
+
+	// the reference stops at the faces of the grid
+	Mesh inside;
+	for (size_t t = 0; t < mesh.positions.size() / 3; ++t)
+	{
+		bool within = true;
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::vec3& p = mesh.positions[t * 3 + i];
+			within = within && p.x >= 0 && p.y >= 0 && p.z >= 0 && p.x <= gridSize && p.y <= gridSize && p.z <= gridSize;
+		}
+		if (!within)
+			continue;
+
+		inside.positions.insert(inside.positions.end(), &mesh.positions[t * 3], &mesh.positions[t * 3] + 3);
+		inside.normals.insert(inside.normals.end(), &mesh.normals[t * 3], &mesh.normals[t * 3] + 3);
+	}
+	mesh.positions.swap(inside.positions);
+	mesh.normals.swap(inside.normals);
+
+	releaseBuffer(clData, vertexLink);
+	releaseBuffer(clData, particleLink);
+	releaseBuffer(clData, faceCountLink);
+	releaseSparse(sparse);
+
+	return success;
+}
+
+bool extractLodStitched(CLData& clData, cl_program program, bool compact, TableLayout tables, size_t gridSize,
+						cl_float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh, size_t& transitionCount)
+{
+	cl_int result = CL_SUCCESS;
+
+	LodData lod;
+	size_t grid[3] = { gridSize, gridSize, gridSize };
+	if (!createLod(lod, clData.context, program, grid, threshold, LOD_SPLIT_DISTANCE))
+		return false;
+	updateLod(lod, glm::vec3(0.0f));
+	transitionCount = lod.transitions.size();
+
+	cl_int particleCount = (cl_int)particles.size();
+	cl_mem faceCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem particleLink = createBuffer(clData, CL_MEM_READ_ONLY, sizeof(glm::vec4) * particles.size());
+	result = clEnqueueWriteBuffer(clData.queue, particleLink, CL_TRUE, 0, sizeof(glm::vec4) * particles.size(), particles.data(), 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+
+	// the field arguments follow from 6 on the blocks and 7 on the transitions,
+	// and only the blocks read the tables
+	result = clSetKernelArg(lod.blockKernel, 1, sizeof(cl_mem), &faceCountLink);
+	result |= clSetKernelArg(lod.blockKernel, 6, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(lod.blockKernel, 7, sizeof(cl_mem), &particleLink);
+	if (tables == TABLE_LAYOUT_IMAGE)
+		result |= clSetKernelArg(lod.blockKernel, 8, sizeof(cl_mem), &clData.tableImage);
+	result |= clSetKernelArg(lod.transitionKernel, 1, sizeof(cl_mem), &faceCountLink);
+	result |= clSetKernelArg(lod.transitionKernel, 7, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(lod.transitionKernel, 8, sizeof(cl_mem), &particleLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	// counted then written into a buffer of exactly that size, as in extractCL
+	size_t vertexSize = compact ? COMPACT_VERTEX_SIZE : VERTEX_SIZE;
+	std::vector<cl_int4> upload;
+	cl_uint faceCount = 0;
+	cl_uint maxFaces = 0;
+	cl_mem vertexLink = 0;
+	bool success = true;
+
+	for (int pass = 0; pass < 2 && success; ++pass)
+	{
+		if (pass == 1)
+		{
+			maxFaces = faceCount;
+			if ((cl_ulong)maxFaces * vertexSize * 3 > clData.maxAllocation)
+			{
+				printf("%u triangles won't fit in a buffer\n", maxFaces);
+				success = false;
+				break;
+			}
+		}
+
+		// buffers can't be empty
+		releaseBuffer(clData, vertexLink);
+		vertexLink = createBuffer(clData, CL_MEM_WRITE_ONLY, glm::max(maxFaces, 1u) * vertexSize * 3);
+		result = clSetKernelArg(lod.blockKernel, 0, sizeof(cl_int), &maxFaces);
+		result |= clSetKernelArg(lod.blockKernel, 2, sizeof(cl_mem), &vertexLink);
+		result |= clSetKernelArg(lod.transitionKernel, 0, sizeof(cl_int), &maxFaces);
+		result |= clSetKernelArg(lod.transitionKernel, 2, sizeof(cl_mem), &vertexLink);
+		CL_CHECK(clSetKernelArg, result);
+
+		cl_uint zero = 0;
+		result = clEnqueueFillBuffer(clData.queue, faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueFillBuffer, result);
+
+		enqueueExtractLod(lod, clData.queue, upload, 0, nullptr, nullptr);
+
+		result = clEnqueueReadBuffer(clData.queue, faceCountLink, CL_TRUE, 0, sizeof(cl_uint), &faceCount, 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueReadBuffer, result);
+		success = result == CL_SUCCESS;
+	}
+
+	// the count of the second pass must agree with the first
+	if (success && faceCount != maxFaces)
+	{
+		printf("Counted %u triangles then %u\n", maxFaces, faceCount);
+		success = false;
+	}
+
+	if (success)
+		success = readVertices(clData, vertexLink, faceCount, compact, gridSize, mesh);
+
+	releaseBuffer(clData, vertexLink);
+	releaseBuffer(clData, particleLink);
+	releaseBuffer(clData, faceCountLink);
+	releaseLod(lod);
+
+	return success;
+}
+
+bool extractNets(CLData& clData, cl_program program, bool compact, size_t gridSize, cl_float threshold,
+				 const std::vector<glm::vec4>& particles, Mesh& mesh)
+{
+	cl_int result = CL_SUCCESS;
+
+	NetData nets;
+	size_t grid[3] = { gridSize, gridSize, gridSize };
+	if (!createNets(nets, clData.context, program, grid, threshold))
+		return false;
+
+	cl_int particleCount = (cl_int)particles.size();
+	cl_mem faceCountLink = createBuffer(clData, CL_MEM_READ_WRITE, sizeof(cl_uint));
+	cl_mem particleLink = createBuffer(clData, CL_MEM_READ_ONLY, sizeof(glm::vec4) * particles.size());
+	result = clEnqueueWriteBuffer(clData.queue, particleLink, CL_TRUE, 0, sizeof(glm::vec4) * particles.size(), particles.data(), 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueWriteBuffer, result);
+
+	result = clSetKernelArg(nets.sampleKernel, 2, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(nets.sampleKernel, 3, sizeof(cl_mem), &particleLink);
+	result |= clSetKernelArg(nets.vertexKernel, 6, sizeof(cl_int), &particleCount);
+	result |= clSetKernelArg(nets.vertexKernel, 7, sizeof(cl_mem), &particleLink);
+	result |= clSetKernelArg(nets.quadKernel, 1, sizeof(cl_mem), &faceCountLink);
+	CL_CHECK(clSetKernelArg, result);
+
+	// the vertex buffer grows from the count read back by the pass before, so
+	// a pass can drop vertices, and the quads that use them, as well as
+	// triangles that don't fit. the third pass has room for both
+	size_t vertexSize = compact ? COMPACT_VERTEX_SIZE : VERTEX_SIZE;
+	cl_uint faceCount = 0;
+	cl_uint maxFaces = 0;
+	cl_mem vertexLink = 0;
+	bool fits = false;
+	bool success = true;
+
+	for (int pass = 0; pass < 3 && success && !fits; ++pass)
+	{
+		maxFaces = faceCount;
+		if ((cl_ulong)maxFaces * vertexSize * 3 > clData.maxAllocation)
+		{
+			printf("%u triangles won't fit in a buffer\n", maxFaces);
+			success = false;
+			break;
+		}
+
+		// buffers can't be empty
+		releaseBuffer(clData, vertexLink);
+		vertexLink = createBuffer(clData, CL_MEM_WRITE_ONLY, glm::max(maxFaces, 1u) * vertexSize * 3);
+		result = clSetKernelArg(nets.quadKernel, 0, sizeof(cl_int), &maxFaces);
+		result |= clSetKernelArg(nets.quadKernel, 2, sizeof(cl_mem), &vertexLink);
+		CL_CHECK(clSetKernelArg, result);
+
+		cl_uint zero = 0;
+		result = clEnqueueFillBuffer(clData.queue, faceCountLink, &zero, sizeof(cl_uint), 0, sizeof(cl_uint), 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueFillBuffer, result);
+
+		cl_uint vertexCapacity = nets.vertexCapacity;
+		enqueueExtractNets(nets, clData.queue, 0, nullptr, nullptr);
+
+		result = clEnqueueReadBuffer(clData.queue, faceCountLink, CL_TRUE, 0, sizeof(cl_uint), &faceCount, 0, nullptr, nullptr);
+		CL_CHECK(clEnqueueReadBuffer, result);
+		result |= clFinish(clData.queue);
+		success = result == CL_SUCCESS;
+
+		// the vertex count has landed with the queue finished
+		fits = faceCount <= maxFaces && nets.pendingVertexCount <= vertexCapacity;
+	}
+
+	if (success && !fits)
+	{
+		printf("Surface net still didn't fit after growing, %u triangles\n", faceCount);
+		success = false;
+	}
+
+	if (success)
+		success = readVertices(clData, vertexLink, faceCount, compact, gridSize, mesh);
+
+	releaseBuffer(clData, vertexLink);
+	releaseBuffer(clData, particleLink);
+	releaseBuffer(clData, faceCountLink);
+	releaseNets(nets);
+
+	return success;
+}
+
+bool readVertices(CLData& clData, cl_mem vertexLink, cl_uint faceCount, bool compact, size_t gridSize, Mesh& mesh)
+{
+	size_t vertexSize = compact ? COMPACT_VERTEX_SIZE : VERTEX_SIZE;
+	size_t vertexCount = (size_t)faceCount * 3;
+	std::vector<unsigned char> vertices(glm::max(vertexCount, (size_t)1) * vertexSize);
+	cl_int result = clEnqueueReadBuffer(clData.queue, vertexLink, CL_TRUE, 0, vertexCount * vertexSize, vertices.data(), 0, nullptr, nullptr);
+	CL_CHECK(clEnqueueReadBuffer, result);
+
+	mesh.positions.resize(vertexCount);
+	mesh.normals.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		if (compact)
+		{
+			// 16-bit positions scaled by POSITION_SCALE and two 16-bit snorms of octahedral normal
+			const cl_uint* v = (const cl_uint*)vertices.data() + i * 3;
+			float positionScale = 65535.0f / gridSize;
+			mesh.positions[i] = glm::vec3(v[0] & 0xffff, v[0] >> 16, v[1] & 0xffff) / positionScale;
+			mesh.normals[i] = octahedralDecode((short)(v[2] & 0xffff) / 32767.0f, (short)(v[2] >> 16) / 32767.0f);
+		}
+		else
+		{
+			const glm::vec4* v = (const glm::vec4*)vertices.data() + i * 2;
+			mesh.positions[i] = glm::vec3(v[0]);
+			mesh.normals[i] = glm::vec3(v[1]);
+		}
+	}
+
+	return result == CL_SUCCESS;
+}
+
+void extractCPU(CPUMCData& cpuData, size_t gridSize, float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh)
+{
+	size_t grid[3] = { gridSize, gridSize, gridSize };
+
+	size_t faceCount = cpuMarchingCubes(cpuData, grid, threshold, particles.data(), (int)particles.size(), 0, nullptr);
+	std::vector<glm::vec4> vertices(faceCount * 6);
+	cpuMarchingCubes(cpuData, grid, threshold, particles.data(), (int)particles.size(), faceCount, vertices.data());
+
+	mesh.positions.resize(faceCount * 3);
+	mesh.normals.resize(faceCount * 3);
+	for (size_t i = 0; i < faceCount * 3; ++i)
+	{
+		mesh.positions[i] = glm::vec3(vertices[i * 2]);
+		mesh.normals[i] = glm::vec3(vertices[i * 2 + 1]);
+	}
+}
+
+// the metaball field straight from its definition
+float sampleMetaballs(const std::vector<glm::vec4>& particles, const glm::vec3& p)
+{
+	float d = 0;
+	for (const glm::vec4& particle : particles)
+	{
+		glm::vec3 vp = p - glm::vec3(particle);
+		d += 1.0f / glm::dot(vp, vp);
+	}
+	return d;
+}
+
+void extractBruteForce(size_t gridSize, float threshold, const std::vector<glm::vec4>& particles, Mesh& mesh)
+{
+	// in the order of the kernel's CUBE_CORNERS, which EDGE_INDICES index
+	const glm::vec3 corners[8] =
+	{
+		{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+		{ 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 }
+	};
+
+	mesh.positions.clear();
+	mesh.normals.clear();
+	for (size_t z = 0; z < gridSize; ++z)
+	for (size_t y = 0; y < gridSize; ++y)
+	for (size_t x = 0; x < gridSize; ++x)
+	{
+		glm::vec3 cube((float)x, (float)y, (float)z);
+		float values[8];
+		int flagIndex = 0;
+		for (int i = 0; i < 8; ++i)
+		{
+			values[i] = sampleMetaballs(particles, cube + corners[i]);
+			if (values[i] <= threshold)
+				flagIndex |= 1 << i;
+		}
+
+		glm::vec3 edgePositions[12];
+		for (int i = 0; i < 12; ++i)
+		{
+			if ((EDGE_FLAGS[flagIndex] & (1 << i)) == 0)
+				continue;
+
+			int a = EDGE_INDICES[i][0];
+			int b = EDGE_INDICES[i][1];
+			float delta = values[b] - values[a];
+			float offset = delta == 0 ? 0.5f : (threshold - values[a]) / delta;
+			edgePositions[i] = cube + corners[a] + (corners[b] - corners[a]) * offset;
+		}
+
+		for (int i = 0; i < 15 && TRIANGLE_TABLE[flagIndex][i] >= 0; ++i)
+		{
+			glm::vec3 p = edgePositions[TRIANGLE_TABLE[flagIndex][i]];
+
+			// central differences of the field, as fieldNormal in the kernel
+			glm::vec3 n;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				glm::vec3 step(0.0f);
+				step[axis] = 0.01f;
+				n[axis] = sampleMetaballs(particles, p - step) - sampleMetaballs(particles, p + step);
+			}
+			if (glm::dot(n, n) > 0)
+				n = glm::normalize(n);
+
+			mesh.positions.push_back(p);
+			mesh.normals.push_back(n);
+		}
+	}
+}
+
+glm::vec3 octahedralDecode(float x, float y)
+{
+	glm::vec3 n(x, y, 1.0f - fabs(x) - fabs(y));
+
+	// unfold the lower hemisphere
+	if (n.z < 0)
+	{
+		n.x = (1.0f - fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+		n.y = (1.0f - fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+	}
+
+	float length = glm::length(n);
+	return length > 0 ? n / length : n;
+}
+
+// quantised coordinates of a position, which order the triangles
+glm::ivec3 quantise(const glm::vec3& p, float quantum)
+{
+	return glm::ivec3((int)floor(p.x / quantum + 0.5f), (int)floor(p.y / quantum + 0.5f), (int)floor(p.z / quantum + 0.5f));
+}
+
+bool lessThan(const glm::ivec3& a, const glm::ivec3& b)
+{
+	return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+}
+
+struct TriangleKey
+{
+	std::array<int, 9>	key;
+	unsigned int		triangle;
+	int					first;		// vertex the canonical rotation starts at
+
+	bool operator < (const TriangleKey& other) const { return key < other.key; }
+};
+
+void canonicaliseMesh(Mesh& mesh, float quantum)
+{
+	size_t triangleCount = mesh.positions.size() / 3;
+	std::vector<TriangleKey> keys(triangleCount);
+
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		glm::ivec3 q[3];
+		for (int i = 0; i < 3; ++i)
+			q[i] = quantise(mesh.positions[t * 3 + i], quantum);
+
+		// rotating rather than sorting the vertices keeps the winding
+		int first = 0;
+		for (int i = 1; i < 3; ++i)
+			if (lessThan(q[i], q[first]))
+				first = i;
+
+		keys[t].triangle = (unsigned int)t;
+		keys[t].first = first;
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::ivec3& v = q[(first + i) % 3];
+			keys[t].key[i * 3] = v.x;
+			keys[t].key[i * 3 + 1] = v.y;
+			keys[t].key[i * 3 + 2] = v.z;
+		}
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	Mesh sorted;
+	sorted.positions.resize(mesh.positions.size());
+	sorted.normals.resize(mesh.normals.size());
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			size_t source = keys[t].triangle * 3 + (keys[t].first + i) % 3;
+			sorted.positions[t * 3 + i] = mesh.positions[source];
+			sorted.normals[t * 3 + i] = mesh.normals[source];
+		}
+	}
+
+	mesh.positions.swap(sorted.positions);
+	mesh.normals.swap(sorted.normals);
+}
+
+unsigned long long cellKey(const glm::ivec3& cell)
+{
+	// 21 bits per axis, offset so the cells just outside the grid stay positive
+	return (unsigned long long)((cell.x + 1) & 0x1fffff) |
+		((unsigned long long)((cell.y + 1) & 0x1fffff) << 21) |
+		((unsigned long long)((cell.z + 1) & 0x1fffff) << 42);
+}
+
+glm::ivec3 cellOf(const glm::vec3& p)
+{
+	return glm::ivec3((int)floor(p.x), (int)floor(p.y), (int)floor(p.z));
+}
+
+void buildVertexGrid(const Mesh& mesh, VertexGrid& grid)
+{
+	for (size_t i = 0; i < mesh.positions.size(); ++i)
+		grid[cellKey(cellOf(mesh.positions[i]))].push_back((unsigned int)i);
+}
+
+// nearest vertex within a cube of p, returns its distance or INFINITY if there is none
+float nearestVertex(const Mesh& mesh, const VertexGrid& grid, const glm::vec3& p, unsigned int* nearest)
+{
+	float nearestDistance = INFINITY;
+	glm::ivec3 cell = cellOf(p);
+
+	for (int z = -1; z <= 1; ++z)
+	for (int y = -1; y <= 1; ++y)
+	for (int x = -1; x <= 1; ++x)
+	{
+		VertexGrid::const_iterator found = grid.find(cellKey(cell + glm::ivec3(x, y, z)));
+		if (found == grid.end())
+			continue;
+
+		for (unsigned int i : found->second)
+		{
+			float d = glm::distance(p, mesh.positions[i]);
+			if (d < nearestDistance)
+			{
+				nearestDistance = d;
+				*nearest = i;
+			}
+		}
+	}
+
+	return nearestDistance;
+}
+
+// a triangle of other with the same winding whose vertices are all within bound of triangle t
+bool hasMatchingTriangle(const Mesh& mesh, size_t t, const Mesh& other, const VertexGrid& otherGrid, float bound)
+{
+	const glm::vec3* v = &mesh.positions[t * 3];
+	glm::ivec3 cell = cellOf(v[0]);
+
+	for (int z = -1; z <= 1; ++z)
+	for (int y = -1; y <= 1; ++y)
+	for (int x = -1; x <= 1; ++x)
+	{
+		VertexGrid::const_iterator found = otherGrid.find(cellKey(cell + glm::ivec3(x, y, z)));
+		if (found == otherGrid.end())
+			continue;
+
+		// any vertex near the first one may start a rotation of the same triangle
+		for (unsigned int i : found->second)
+		{
+			size_t base = i - i % 3;
+			if (glm::distance(v[0], other.positions[i]) <= bound &&
+				glm::distance(v[1], other.positions[base + (i % 3 + 1) % 3]) <= bound &&
+				glm::distance(v[2], other.positions[base + (i % 3 + 2) % 3]) <= bound)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// hausdorff distance, normal deviation and unmatched triangles from a to b
+void compareDirected(const Mesh& a, const Mesh& b, const VertexGrid& bGrid, float distanceBound, Comparison& comparison)
+{
+	for (size_t i = 0; i < a.positions.size(); ++i)
+	{
+		unsigned int nearest = 0;
+		float distance = nearestVertex(b, bGrid, a.positions[i], &nearest);
+		comparison.hausdorffDistance = glm::max(comparison.hausdorffDistance, distance);
+		if (distance == INFINITY)
+			continue;
+
+		// normals of zero length mark a degenerate gradient, which neither side can orient
+		const glm::vec3& na = a.normals[i];
+		const glm::vec3& nb = b.normals[nearest];
+		float lengths = glm::length(na) * glm::length(nb);
+		if (lengths > 0)
+		{
+			float angle = acos(glm::clamp(glm::dot(na, nb) / lengths, -1.0f, 1.0f)) * (180.0f / 3.14159265f);
+			comparison.normalDeviation = glm::max(comparison.normalDeviation, angle);
+		}
+	}
+
+	for (size_t t = 0; t < a.positions.size() / 3; ++t)
+		if (!hasMatchingTriangle(a, t, b, bGrid, distanceBound))
+			comparison.unmatchedTriangles++;
+}
+
+Comparison compareMeshes(const Mesh& reference, const Mesh& test, float distanceBound)
+{
+	Comparison comparison = { reference.positions.size() / 3, test.positions.size() / 3, 0, 0.0f, 0.0f };
+
+	VertexGrid referenceGrid, testGrid;
+	buildVertexGrid(reference, referenceGrid);
+	buildVertexGrid(test, testGrid);
+
+	compareDirected(reference, test, testGrid, distanceBound, comparison);
+	compareDirected(test, reference, referenceGrid, distanceBound, comparison);
+
+	return comparison;
+}
+
+bool report(const char* name, bool pass, const char* format, ...)
+{
+	printf("%s %s: ", pass ? "PASS" : "FAIL", name);
+
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+
+	printf("\n");
+	return pass;
+}
+
+bool compareAndReport(const VerifySettings& settings, const char* name, const Mesh& reference, const Mesh& test,
+					  const std::string& dumpName, const char* referenceSuffix, const char* testSuffix)
+{
+	Comparison comparison = compareMeshes(reference, test, settings.distanceBound);
+
+	size_t allowed = (size_t)(comparison.referenceTriangles * settings.countTolerance);
+	size_t countDifference = comparison.referenceTriangles > comparison.testTriangles ?
+		comparison.referenceTriangles - comparison.testTriangles : comparison.testTriangles - comparison.referenceTriangles;
+	bool pass = countDifference <= allowed &&
+		comparison.unmatchedTriangles <= allowed &&
+		comparison.hausdorffDistance <= settings.distanceBound &&
+		comparison.normalDeviation <= settings.normalBound;
+
+	if (!report(name, pass, "%u / %u triangles, %u unmatched, hausdorff %.5f, normals %.3f deg",
+				(unsigned int)comparison.testTriangles, (unsigned int)comparison.referenceTriangles,
+				(unsigned int)comparison.unmatchedTriangles, comparison.hausdorffDistance, comparison.normalDeviation))
+	{
+		dumpMesh(settings, dumpName + referenceSuffix, reference);
+		dumpMesh(settings, dumpName + testSuffix, test);
+	}
+
+	return pass;
+}
+
+void dumpMesh(const VerifySettings& settings, const std::string& dumpName, const Mesh& mesh)
+{
+	if (settings.dumpDir != nullptr)
+		writeOBJ((std::string(settings.dumpDir) + "/" + dumpName + ".obj").c_str(), mesh);
+}
+
+void makeSphere(int subdivisions, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices)
+{
+	positions = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+	indices = { 0, 2, 4,  2, 1, 4,  1, 3, 4,  3, 0, 4,  2, 0, 5,  1, 2, 5,  3, 1, 5,  0, 3, 5 };
+
+	for (int level = 0; level < subdivisions; ++level)
+	{
+		// each edge's midpoint is shared by the two triangles either side of it
+		std::unordered_map<unsigned long long, unsigned int> midpoints;
+		auto midpoint = [&](unsigned int a, unsigned int b)
+		{
+			unsigned long long key = ((unsigned long long)glm::min(a, b) << 32) | glm::max(a, b);
+			auto found = midpoints.find(key);
+			if (found != midpoints.end())
+				return found->second;
+			unsigned int index = (unsigned int)positions.size();
+			positions.push_back(glm::normalize(positions[a] + positions[b]));
+			midpoints[key] = index;
+			return index;
+		};
+
+		std::vector<unsigned int> split;
+		split.reserve(indices.size() * 4);
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			unsigned int a = indices[t], b = indices[t + 1], c = indices[t + 2];
+			unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+			unsigned int triangles[12] = { a, ab, ca,  ab, b, bc,  ca, bc, c,  ab, bc, ca };
+			split.insert(split.end(), triangles, triangles + 12);
+		}
+		indices.swap(split);
+	}
+}
+
+size_t countUnpairedEdges(const std::vector<unsigned int>& indices)
+{
+	std::unordered_map<unsigned long long, int> edges;
+	for (size_t t = 0; t < indices.size(); t += 3)
+		for (int i = 0; i < 3; ++i)
+			edges[((unsigned long long)indices[t + i] << 32) | indices[t + (i + 1) % 3]]++;
+
+	size_t unpaired = 0;
+	for (const auto& edge : edges)
+	{
+		auto reverse = edges.find((edge.first << 32) | (edge.first >> 32));
+		if (edge.second != 1 || reverse == edges.end() || reverse->second != 1)
+			unpaired++;
+	}
+	return unpaired;
+}
+
+bool verifySimplify(const VerifySettings& settings)
+{
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned int> indices;
+	makeSphere(SIMPLIFY_SUBDIVISIONS, positions, indices);
+	size_t originalTriangles = indices.size() / 3;
+
+	ThreadPool pool;
+	createThreadPool(pool, settings.cpuThreads);
+	SimplifySettings simplifySettings = { (size_t)(originalTriangles * SIMPLIFY_RATIO), 0.0f, 0, 0 };
+	size_t triangles = simplifyMesh(pool, positions, indices, simplifySettings);
+	releaseThreadPool(pool);
+
+	size_t unpairedEdges = countUnpairedEdges(indices);
+	bool pass = triangles > 0 && triangles < originalTriangles && triangles == indices.size() / 3 && unpairedEdges == 0;
+
+	return report("sphere simplify", pass, "%u / %u triangles, %u unpaired edges",
+				  (unsigned int)triangles, (unsigned int)originalTriangles, (unsigned int)unpairedEdges);
+}
+
+size_t countOpenEdges(const Mesh& mesh, float weldDistance, size_t gridSize)
+{
+	// neighbouring cubes compute a shared vertex separately, and may not agree
+	// on it to the last bit
+	Mesh welded;
+	VertexGrid weldedGrid;
+	std::vector<unsigned int> weldedIndex(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); ++i)
+	{
+		unsigned int nearest = 0;
+		if (nearestVertex(welded, weldedGrid, mesh.positions[i], &nearest) > weldDistance)
+		{
+			nearest = (unsigned int)welded.positions.size();
+			welded.positions.push_back(mesh.positions[i]);
+			weldedGrid[cellKey(cellOf(mesh.positions[i]))].push_back(nearest);
+		}
+		weldedIndex[i] = nearest;
+	}
+
+	// each edge adds one running from its lower vertex and takes one away
+	// running the other way, so the edges of a closed surface sum to zero
+	std::unordered_map<unsigned long long, int> edges;
+	for (size_t t = 0; t < mesh.positions.size() / 3; ++t)
+	{
+		unsigned int v[3] = { weldedIndex[t * 3], weldedIndex[t * 3 + 1], weldedIndex[t * 3 + 2] };
+
+		// a triangle that welds down to a line covers its edges both ways
+		if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+			continue;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			unsigned int a = v[i];
+			unsigned int b = v[(i + 1) % 3];
+			unsigned long long key = ((unsigned long long)glm::min(a, b) << 32) | glm::max(a, b);
+			edges[key] += a < b ? 1 : -1;
+		}
+	}
+
+	size_t openEdges = 0;
+	for (const auto& edge : edges)
+	{
+		if (edge.second == 0)
+			continue;
+
+		glm::vec3 low = glm::min(welded.positions[edge.first >> 32], welded.positions[edge.first & 0xffffffff]);
+		glm::vec3 high = glm::max(welded.positions[edge.first >> 32], welded.positions[edge.first & 0xffffffff]);
+		if (low.x >= 1 && low.y >= 1 && low.z >= 1 &&
+			high.x <= gridSize - 1 && high.y <= gridSize - 1 && high.z <= gridSize - 1)
+			openEdges++;
+	}
+
+	return openEdges;
+}
+
+bool writeOBJ(const char* path, const Mesh& mesh)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		printf("Unable to write %s\n", path);
+		return false;
+	}
+
+	// one line per vertex in canonical order, so two dumps diff triangle by triangle
+	for (size_t i = 0; i < mesh.positions.size(); ++i)
+		fprintf(file, "v %.4f %.4f %.4f\n", mesh.positions[i].x, mesh.positions[i].y, mesh.positions[i].z);
+	for (size_t i = 0; i < mesh.normals.size(); ++i)
+		fprintf(file, "vn %.3f %.3f %.3f\n", mesh.normals[i].x, mesh.normals[i].y, mesh.normals[i].z);
+	for (size_t t = 0; t < mesh.positions.size() / 3; ++t)
+		fprintf(file, "f %u//%u %u//%u %u//%u\n", (unsigned int)(t * 3 + 1), (unsigned int)(t * 3 + 1),
+			(unsigned int)(t * 3 + 2), (unsigned int)(t * 3 + 2), (unsigned int)(t * 3 + 3), (unsigned int)(t * 3 + 3));
+
+	fclose(file);
+	return true;
+}
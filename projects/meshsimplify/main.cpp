@@ -0,0 +1,187 @@
+// offline quadric error metric simplification of obj meshes
+//
+// reads the positions and faces of an obj (anything else, such as texture
+// coordinates, normals and groups, is dropped), simplifies it with the same
+// partitioned edge collapse clmarchingcubes uses on exported surfaces, and
+// writes the result back out as an obj. polygons are split into fans.
+//
+//	meshsimplify [options] input.obj output.obj
+
+#include "simplify.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+bool loadOBJ(const char* path, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices);
+bool saveOBJ(const char* path, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+int main(int argc, char* argv[])
+{
+	SimplifySettings settings = { 0 };
+	float ratio = 0.5f;
+	unsigned int threadCount = 0;
+	const char* inputPath = nullptr;
+	const char* outputPath = nullptr;
+
+	// command-line options
+	// -ratio r			fraction of the triangles to keep (default 0.5)
+	// -target n		number of triangles to keep, overriding -ratio
+	// -error e			largest distance a collapse may move the surface, in model units.
+	//					on its own, simplifies until every collapse left is over it
+	// -cells n			cells along each axis of the spatial partition (default from the thread count)
+	// -passes n		partitioned passes, the last of which covers the whole mesh (default 4)
+	// -threads n		threads, including the main thread (default one per hardware thread)
+	size_t target = 0;
+	bool ratioSet = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-ratio") == 0 && i + 1 < argc)
+		{
+			ratio = glm::clamp((float)atof(argv[++i]), 0.0f, 1.0f);
+			ratioSet = true;
+		}
+		else if (strcmp(argv[i], "-target") == 0 && i + 1 < argc)
+			target = (size_t)glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-error") == 0 && i + 1 < argc)
+			settings.maxError = glm::max((float)atof(argv[++i]), 0.0f);
+		else if (strcmp(argv[i], "-cells") == 0 && i + 1 < argc)
+			settings.cellsPerAxis = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-passes") == 0 && i + 1 < argc)
+			settings.maxPasses = glm::max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threadCount = glm::max(atoi(argv[++i]), 1);
+		else if (inputPath == nullptr)
+			inputPath = argv[i];
+		else if (outputPath == nullptr)
+			outputPath = argv[i];
+		else
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+	}
+
+	if (inputPath == nullptr || outputPath == nullptr)
+	{
+		fprintf(stderr, "usage: meshsimplify [-ratio r] [-target n] [-error e] [-cells n] [-passes n] [-threads n] input.obj output.obj\n");
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned int> indices;
+	if (!loadOBJ(inputPath, positions, indices))
+		exit(EXIT_FAILURE);
+
+	size_t inputTriangles = indices.size() / 3;
+
+	// an error bound on its own runs until the bound stops it
+	if (target > 0)
+		settings.targetTriangles = target;
+	else if (ratioSet || settings.maxError == 0.0f)
+		settings.targetTriangles = glm::max((size_t)(inputTriangles * ratio), (size_t)1);
+
+	ThreadPool pool;
+	createThreadPool(pool, threadCount);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t triangles = simplifyMesh(pool, positions, indices, settings);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	printf("%s: %zu -> %zu triangles, %zu vertices in %.1fms on %zu threads\n",
+		   inputPath, inputTriangles, triangles, positions.size(), ms, pool.threads.size() + 1);
+
+	releaseThreadPool(pool);
+
+	if (!saveOBJ(outputPath, positions, indices))
+		exit(EXIT_FAILURE);
+
+	return EXIT_SUCCESS;
+}
+
+// resolves a face's vertex reference, which may be v, v/vt, v//vn or v/vt/vn
+// and counts from the end when negative
+static bool parseFaceVertex(const char* token, size_t vertexCount, unsigned int& index)
+{
+	long value = strtol(token, nullptr, 10);
+	if (value < 0)
+		value += (long)vertexCount + 1;
+
+	if (value < 1 || (size_t)value > vertexCount)
+		return false;
+
+	index = (unsigned int)(value - 1);
+	return true;
+}
+
+bool loadOBJ(const char* path, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "couldn't open %s\n", path);
+		return false;
+	}
+
+	char line[1024];
+	size_t lineNumber = 0;
+	std::vector<unsigned int> face;
+	while (fgets(line, sizeof(line), file) != nullptr)
+	{
+		++lineNumber;
+
+		if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+		{
+			glm::vec3 p;
+			if (sscanf(line + 2, "%f %f %f", &p.x, &p.y, &p.z) != 3)
+			{
+				fprintf(stderr, "%s:%zu: bad vertex\n", path, lineNumber);
+				fclose(file);
+				return false;
+			}
+			positions.push_back(p);
+		}
+		else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+		{
+			face.clear();
+			for (char* token = strtok(line + 2, " \t\r\n"); token != nullptr; token = strtok(nullptr, " \t\r\n"))
+			{
+				unsigned int index;
+				if (!parseFaceVertex(token, positions.size(), index))
+				{
+					fprintf(stderr, "%s:%zu: bad face\n", path, lineNumber);
+					fclose(file);
+					return false;
+				}
+				face.push_back(index);
+			}
+
+			for (size_t k = 2; k < face.size(); ++k)
+			{
+				indices.push_back(face[0]);
+				indices.push_back(face[k - 1]);
+				indices.push_back(face[k]);
+			}
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool saveOBJ(const char* path, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "couldn't write %s\n", path);
+		return false;
+	}
+
+	for (const glm::vec3& p : positions)
+		fprintf(file, "v %g %g %g\n", p.x, p.y, p.z);
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+		fprintf(file, "f %u %u %u\n", indices[i] + 1, indices[i + 1] + 1, indices[i + 2] + 1);
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}